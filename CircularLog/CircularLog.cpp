@@ -14,7 +14,9 @@
 */
 /* Circular Log to hold recent debug printf() like spew. */
 #include <stdio.h>
+#include <string.h>
 #include "CircularLog.h"
+#include "Interlocked.h"
 
 // Only hook in the printfSpy mocks when building non-ARM unit tests.
 #ifndef __ARM_EABI__
@@ -22,47 +24,215 @@
 #endif
 
 
+static const uint32_t WRITERS_LOCKED_OUT = 0x80000000;
+// Positions never have bit 31 set so this can't be mistaken for one.
+static const uint32_t WRITER_SLOT_FREE = 0xFFFFFFFF;
+// Number of times that dump() and clear() poll while waiting for writers or another dump() before giving up on them.
+static const uint32_t MAX_WAIT_SPINS = 100000;
+
+
+void CircularLogBase::init(char* pBuffer, size_t size)
+{
+    m_pStart = pBuffer;
+    m_pEnd = pBuffer + size;
+    m_positionLimit = size * (WRITERS_LOCKED_OUT / size);
+    m_reserved = 0;
+    m_committed = 0;
+    m_clearPosition = 0;
+    m_droppedCount = 0;
+    for (size_t i = 0 ; i < CIRCULARLOG_MAX_WRITERS ; i++)
+    {
+        m_writerStart[i] = WRITER_SLOT_FREE;
+    }
+}
 
 void CircularLogBase::log(char* lineBuffer, size_t bufferSize, const char* pFormat, va_list args)
 {
-    vsnprintf(lineBuffer, bufferSize, pFormat, args);
+    int length = vsnprintf(lineBuffer, bufferSize, pFormat, args);
+    if (length <= 0 || bufferSize == 0)
+    {
+        return;
+    }
+    if ((size_t)length >= bufferSize)
+    {
+        // Line was truncated to fit in the line buffer.
+        length = bufferSize - 1;
+    }
+    write(lineBuffer, length);
+}
+
+void CircularLogBase::write(const char* pData, size_t length)
+{
+    uint32_t position;
+    uint32_t slot;
+    if (!reserve(length, &position, &slot))
+    {
+        interlockedIncrement(&m_droppedCount);
+        return;
+    }
+    copy(position, pData, length);
+    commit(length, slot);
+}
 
-    char* pCurr = lineBuffer;
-    while (*pCurr)
+void CircularLogBase::copy(uint32_t position, const char* pData, size_t length)
+{
+    // Overflowing overwrites the oldest part of the log. Copy in two pieces if the line wraps around the buffer end.
+    char*  pDest = m_pStart + bufferOffset(position);
+    size_t firstLength = m_pEnd - pDest;
+    if (length <= firstLength)
     {
-        enqueueChar(*pCurr++);
+        memcpy(pDest, pData, length);
+    }
+    else
+    {
+        memcpy(pDest, pData, firstLength);
+        memcpy(m_pStart, pData + firstLength, length - firstLength);
     }
 }
 
-void CircularLogBase::enqueueChar(char ch)
+bool CircularLogBase::reserve(size_t length, uint32_t* pPosition, uint32_t* pSlot)
 {
-    *m_pEnqueue = ch;
-    advancePointer(m_pEnqueue);
-    if (m_pDequeue == m_pEnqueue)
+    // The slot is claimed before reserving, and always holds a position at or before the one finally reserved, so
+    // that dump() can tell where the lines still being copied in might start.
+    uint32_t position = m_reserved & ~WRITERS_LOCKED_OUT;
+    uint32_t slot = 0;
+    while (interlockedCompareExchange(&m_writerStart[slot], position, WRITER_SLOT_FREE) != WRITER_SLOT_FREE)
     {
-        // Overflowing so advance dequeue pointer and lose one character from oldest part of string.
-        advancePointer(m_pDequeue);
+        if (++slot == CIRCULARLOG_MAX_WRITERS)
+        {
+            return false;
+        }
     }
+
+    do
+    {
+        position = m_reserved;
+        if (position & WRITERS_LOCKED_OUT)
+        {
+            m_writerStart[slot] = WRITER_SLOT_FREE;
+            return false;
+        }
+        m_writerStart[slot] = position;
+    } while (interlockedCompareExchange(&m_reserved, advancePosition(position, length), position) != position);
+
+    *pPosition = position;
+    *pSlot = slot;
+    return true;
+}
+
+void CircularLogBase::commit(size_t length, uint32_t slot)
+{
+    // Writers can finish out of order so this only tracks the total committed and not which lines it covers. The
+    // writer slots track that.
+    uint32_t position;
+    do
+    {
+        position = m_committed;
+    } while (interlockedCompareExchange(&m_committed, advancePosition(position, length), position) != position);
+    m_writerStart[slot] = WRITER_SLOT_FREE;
+}
+
+bool CircularLogBase::lockOutWriters(uint32_t* pPosition)
+{
+    uint32_t position;
+    uint32_t spins = 0;
+    do
+    {
+        // Another dump() or clear() already holds the log so wait for it to finish. It may have been preempted by
+        // this caller so give up rather than wait forever.
+        do
+        {
+            position = m_reserved;
+            if ((position & WRITERS_LOCKED_OUT) && ++spins == MAX_WAIT_SPINS)
+            {
+                return false;
+            }
+        } while (position & WRITERS_LOCKED_OUT);
+    } while (interlockedCompareExchange(&m_reserved, position | WRITERS_LOCKED_OUT, position) != position);
+
+    *pPosition = position;
+    return true;
+}
+
+uint32_t CircularLogBase::waitForWriters(uint32_t position)
+{
+    // Writers which reserved room before the lock out still need to finish copying their lines in.
+    for (uint32_t spins = 0 ; spins < MAX_WAIT_SPINS ; spins++)
+    {
+        if (m_committed == position)
+        {
+            return position;
+        }
+    }
+
+    // A writer has stalled part way through its line, most likely because this caller preempted it. Everything
+    // before the earliest line still being copied in is complete. Slots holding a position from before the last
+    // clear() can't be part way through anything which is still in the log.
+    uint32_t complete = position;
+    uint32_t completeLength = distance(position, m_clearPosition);
+    for (size_t i = 0 ; i < CIRCULARLOG_MAX_WRITERS ; i++)
+    {
+        uint32_t start = m_writerStart[i];
+        if (start != WRITER_SLOT_FREE && distance(start, m_clearPosition) < completeLength)
+        {
+            complete = start;
+            completeLength = distance(start, m_clearPosition);
+        }
+    }
+    return complete;
+}
+
+void CircularLogBase::allowWriters(uint32_t position)
+{
+    interlockedCompareExchange(&m_reserved, position, position | WRITERS_LOCKED_OUT);
 }
 
 void CircularLogBase::dump(FILE* pFile)
 {
-    if (isEmpty())
+    uint32_t end;
+    if (!lockOutWriters(&end))
     {
         return;
     }
-    if (doesStringWrapAround())
+    uint32_t complete = waitForWriters(end);
+
+    // A full log holds one less character than the size of the buffer. Writes up to end may have overwritten the
+    // oldest part of the log so the start is based on it, even if only the lines up to complete can be dumped.
+    size_t size = m_pEnd - m_pStart;
+    size_t length = distance(end, m_clearPosition);
+    if (length > size - 1)
     {
-        fprintf(pFile, "%.*s", m_pEnd - m_pDequeue, m_pDequeue);
-        fprintf(pFile, "%.*s", m_pEnqueue - m_pStart, m_pStart);
+        length = size - 1;
     }
-    else
+    size_t incompleteLength = distance(end, complete);
+    length = (length > incompleteLength) ? length - incompleteLength : 0;
+    if (length > 0)
     {
-        fprintf(pFile, "%.*s", m_pEnqueue - m_pDequeue, m_pDequeue);
+        size_t endOffset = bufferOffset(complete);
+        size_t startOffset = (endOffset + size - length) % size;
+        if (startOffset >= endOffset)
+        {
+            fprintf(pFile, "%.*s", (int)(size - startOffset), m_pStart + startOffset);
+            fprintf(pFile, "%.*s", (int)endOffset, m_pStart);
+        }
+        else
+        {
+            fprintf(pFile, "%.*s", (int)length, m_pStart + startOffset);
+        }
     }
+
+    allowWriters(end);
 }
 
 void CircularLogBase::clear()
 {
-    m_pEnqueue = m_pDequeue = m_pStart;
+    uint32_t end;
+    if (!lockOutWriters(&end))
+    {
+        return;
+    }
+    // Lines still being copied in are before end so they are cleared along with the rest, whether or not they finish.
+    waitForWriters(end);
+    m_clearPosition = end;
+    allowWriters(end);
 }
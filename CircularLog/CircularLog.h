@@ -12,14 +12,31 @@
    See the License for the specific language governing permissions and
    limitations under the License.
 */
-/* Circular Log to hold recent debug printf() like spew. */
+/* Circular Log to hold recent debug printf() like spew.
+
+   log() may be called concurrently from multiple threads and interrupt handlers. Each call claims one of
+   CIRCULARLOG_MAX_WRITERS writer slots, reserves room for its whole line with an interlocked compare and exchange and
+   then copies the line into the buffer, so writers never wait on one another. dump() and clear() lock out new writers
+   while they run and wait a bounded time for any writers which have already reserved room to finish copying their
+   line in. If one hasn't finished by then (ie. the thread calling dump() has preempted it), dump() only prints the
+   lines before the earliest unfinished one. Lines logged while the log is held, or while every writer slot is in use,
+   are dropped and counted in droppedCount(). If another dump() or clear() holds the log for longer than the bounded
+   wait then the call gives up without dumping or clearing. They spin while waiting so they must not be called from an
+   interrupt handler.
+*/
 #ifndef CIRCULAR_LOG_H_
 #define CIRCULAR_LOG_H_
 
 #include <assert.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 
+// Maximum number of threads and interrupt handlers which can be part way through logging a line at once.
+#ifndef CIRCULARLOG_MAX_WRITERS
+#define CIRCULARLOG_MAX_WRITERS 8
+#endif
+
 class CircularLogBase
 {
 public:
@@ -27,7 +44,11 @@ public:
     void clear();
     bool isEmpty()
     {
-        return m_pEnqueue == m_pDequeue;
+        return m_committed == m_clearPosition;
+    }
+    uint32_t droppedCount()
+    {
+        return m_droppedCount;
     }
 
 protected:
@@ -35,26 +56,50 @@ protected:
     {
     }
 
+    void init(char* pBuffer, size_t size);
     void log(char* lineBuffer, size_t bufferSize, const char* pFormat, va_list args);
 
-    void enqueueChar(char ch);
-    void advancePointer(char*& p)
+    void     write(const char* pData, size_t length);
+    bool     reserve(size_t length, uint32_t* pPosition, uint32_t* pSlot);
+    void     copy(uint32_t position, const char* pData, size_t length);
+    void     commit(size_t length, uint32_t slot);
+    bool     lockOutWriters(uint32_t* pPosition);
+    void     allowWriters(uint32_t position);
+    uint32_t waitForWriters(uint32_t position);
+    uint32_t advancePosition(uint32_t position, size_t length)
+    {
+        position += length;
+        if (position >= m_positionLimit)
+        {
+            position -= m_positionLimit;
+        }
+        return position;
+    }
+    uint32_t distance(uint32_t end, uint32_t start)
     {
-        p++;
-        if (p == m_pEnd)
+        if (end >= start)
         {
-            p = m_pStart;
+            return end - start;
         }
+        return end + m_positionLimit - start;
     }
-    bool doesStringWrapAround()
+    size_t bufferOffset(uint32_t position)
     {
-        return m_pDequeue > m_pEnqueue;
+        return position % (m_pEnd - m_pStart);
     }
 
-    char* m_pStart;
-    char* m_pEnd;
-    char* m_pEnqueue;
-    char* m_pDequeue;
+    char*             m_pStart;
+    char*             m_pEnd;
+    // Positions count bytes logged and wrap at m_positionLimit, a multiple of the buffer size below bit 31.
+    uint32_t          m_positionLimit;
+    // End of the last reservation, with WRITERS_LOCKED_OUT set while dump() or clear() hold the log.
+    volatile uint32_t m_reserved;
+    // Catches up with m_reserved once every writer has finished copying its line into the buffer.
+    volatile uint32_t m_committed;
+    // Position at or before the start of the line that each writer slot's owner is logging, WRITER_SLOT_FREE if unused.
+    volatile uint32_t m_writerStart[CIRCULARLOG_MAX_WRITERS];
+    volatile uint32_t m_clearPosition;
+    volatile uint32_t m_droppedCount;
 };
 
 
@@ -66,9 +111,7 @@ public:
     {
         assert ( SIZE > MAX_LINE );
 
-        m_pStart = m_buffer;
-        m_pEnd = m_pStart + sizeof(m_buffer);
-        clear();
+        init(m_buffer, sizeof(m_buffer));
     }
 
     void log(const char* pFormat, ...)
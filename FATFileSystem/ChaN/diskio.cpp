@@ -55,6 +55,27 @@ DRESULT disk_read (
         return RES_OK;
 }
 
+/*-----------------------------------------------------------------------*/
+/* Read Sector and Copy Head                                             */
+/*-----------------------------------------------------------------------*/
+
+#if _USE_READ_COPY
+DRESULT disk_read_copy (
+    BYTE pdrv,       /* Physical drive nmuber to identify the drive */
+    BYTE* buff,      /* Data buffer to store the sector */
+    DWORD sector,    /* Sector address in LBA */
+    BYTE* copy,      /* Buffer to also receive the head of the sector */
+    UINT ncopy       /* Number of bytes to copy to copy */
+)
+{
+    debug_if(FFS_DBG, "disk_read_copy(sector %d, ncopy %d) on pdrv [%d]\n", sector, ncopy, pdrv);
+    if (FATFileSystem::_ffs[pdrv]->disk_read_copy((uint8_t*)buff, sector, (uint8_t*)copy, ncopy))
+        return RES_PARERR;
+    else
+        return RES_OK;
+}
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Write Sector(s)                                                       */
 /*-----------------------------------------------------------------------*/
@@ -11,6 +11,7 @@ extern "C" {
 
 #define _USE_WRITE	1	/* 1: Enable disk_write function */
 #define _USE_IOCTL	1	/* 1: Enable disk_ioctl fucntion */
+#define _USE_READ_COPY	1	/* 1: Enable disk_read_copy function */
 
 #include "integer.h"
 
@@ -37,6 +38,7 @@ DSTATUS disk_status (BYTE pdrv);
 DRESULT disk_read (BYTE pdrv, BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
+DRESULT disk_read_copy (BYTE pdrv, BYTE* buff, DWORD sector, BYTE* copy, UINT ncopy);
 
 
 /* Disk Status Bits (DSTATUS) */
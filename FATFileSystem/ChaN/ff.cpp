@@ -696,35 +696,138 @@ void clear_lock (	/* Clear lock entries of the volume */
 /* Move/Flush disk access window in the file system object               */
 /*-----------------------------------------------------------------------*/
 #if !_FS_READONLY
+static
+FRESULT write_window (	/* FR_OK:succeeded, !=0:error */
+	FATFS* fs,		/* File system object */
+	const BYTE* buf,	/* Window buffer to be written */
+	DWORD wsect		/* Sector number held in the buffer */
+)
+{
+	UINT nf;
+
+
+	if (disk_write(fs->drv, buf, wsect, 1) != RES_OK)
+		return FR_DISK_ERR;
+	fs->n_winwrite++;
+	if (wsect - fs->fatbase < fs->fsize) {		/* Is it in the FAT area? */
+		for (nf = fs->n_fats; nf >= 2; nf--) {	/* Reflect the change to all FAT copies */
+			wsect += fs->fsize;
+			disk_write(fs->drv, buf, wsect, 1);
+		}
+	}
+	return FR_OK;
+}
+
+
 static
 FRESULT sync_window (	/* FR_OK:succeeded, !=0:error */
 	FATFS* fs		/* File system object */
 )
 {
-	DWORD wsect;
-	UINT nf;
 	FRESULT res = FR_OK;
 
 
 	if (fs->wflag) {	/* Write back the sector if it is dirty */
-		wsect = fs->winsect;	/* Current sector number */
-		if (disk_write(fs->drv, fs->win, wsect, 1) != RES_OK) {
-			res = FR_DISK_ERR;
-		} else {
-			fs->wflag = 0;
-			if (wsect - fs->fatbase < fs->fsize) {		/* Is it in the FAT area? */
-				for (nf = fs->n_fats; nf >= 2; nf--) {	/* Reflect the change to all FAT copies */
-					wsect += fs->fsize;
-					disk_write(fs->drv, fs->win, wsect, 1);
-				}
-			}
-		}
+		res = write_window(fs, fs->win, fs->winsect);
+		if (res == FR_OK) fs->wflag = 0;
 	}
 	return res;
 }
 #endif
 
 
+#if _FS_WINPOOL
+#if !_FS_READONLY
+static
+FRESULT sync_pool (	/* FR_OK:succeeded, !=0:error */
+	FATFS* fs		/* File system object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < _FS_WINPOOL; i++) {	/* Write back all dirty pool windows */
+		if (fs->pool_flag[i]) {
+			if (write_window(fs, fs->pool[i], fs->pool_sect[i]) != FR_OK) return FR_DISK_ERR;
+			fs->pool_flag[i] = 0;
+		}
+	}
+	return FR_OK;
+}
+#endif
+
+
+static
+void discard_pool (
+	FATFS* fs,		/* File system object */
+	DWORD sect,		/* First sector to be discarded */
+	DWORD n			/* Number of sectors to be discarded */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < _FS_WINPOOL; i++) {	/* Drop stale copies of sectors which are about to be written via win[] or directly */
+		if (fs->pool_sect[i] - sect < n) {
+			fs->pool_sect[i] = 0xFFFFFFFF;
+			fs->pool_flag[i] = 0;
+		}
+	}
+}
+
+
+static
+FRESULT swap_window (	/* FR_OK(0):succeeded, !=0:error */
+	FATFS* fs,		/* File system object */
+	DWORD sector	/* Sector number to make appearance in the fs->win[] */
+)
+{
+	UINT i, v;
+	DWORD sect;
+	BYTE flag, tmp, *buf;
+
+
+	for (v = 0; v < _FS_WINPOOL && fs->pool_sect[v] != sector; v++) ;
+	if (v == _FS_WINPOOL) {		/* Not in the pool: replace an empty or the least recently used pool window */
+		v = 0;
+		for (i = 0; i < _FS_WINPOOL; i++) {
+			if (fs->pool_sect[i] == 0xFFFFFFFF) { v = i; break; }
+			if (fs->pool_used[i] < fs->pool_used[v]) v = i;
+		}
+#if !_FS_READONLY
+		if (fs->pool_flag[v]) {	/* Write back the victim if it is dirty */
+			if (write_window(fs, fs->pool[v], fs->pool_sect[v]) != FR_OK) return FR_DISK_ERR;
+			fs->pool_flag[v] = 0;
+		}
+#endif
+		fs->pool_sect[v] = 0xFFFFFFFF;
+	}
+
+	buf = fs->pool[v];			/* Exchange the current window with the pool window */
+	for (i = 0; i < SS(fs); i++) {
+		tmp = buf[i]; buf[i] = fs->win[i]; fs->win[i] = tmp;
+	}
+	sect = fs->pool_sect[v]; flag = fs->pool_flag[v];
+	fs->pool_sect[v] = fs->winsect; fs->pool_flag[v] = fs->wflag;
+	fs->pool_used[v] = ++fs->pool_tick;
+
+	if (sect == sector) {		/* Pool hit */
+		fs->winsect = sector; fs->wflag = flag;
+		fs->n_winhit++;
+		return FR_OK;
+	}
+	fs->wflag = 0;
+	if (disk_read(fs->drv, fs->win, sector, 1) != RES_OK) {
+		fs->winsect = 0xFFFFFFFF;	/* Invalidate window if data is not reliable */
+		return FR_DISK_ERR;
+	}
+	fs->winsect = sector;
+	fs->n_winread++;
+	return FR_OK;
+}
+#endif	/* _FS_WINPOOL */
+
+
 static
 FRESULT move_window (	/* FR_OK(0):succeeded, !=0:error */
 	FATFS* fs,		/* File system object */
@@ -735,6 +838,9 @@ FRESULT move_window (	/* FR_OK(0):succeeded, !=0:error */
 
 
 	if (sector != fs->winsect) {	/* Window offset changed? */
+#if _FS_WINPOOL
+		res = swap_window(fs, sector);
+#else
 #if !_FS_READONLY
 		res = sync_window(fs);		/* Write-back changes */
 #endif
@@ -742,9 +848,14 @@ FRESULT move_window (	/* FR_OK(0):succeeded, !=0:error */
 			if (disk_read(fs->drv, fs->win, sector, 1) != RES_OK) {
 				sector = 0xFFFFFFFF;	/* Invalidate window if data is not reliable */
 				res = FR_DISK_ERR;
+			} else {
+				fs->n_winread++;
 			}
 			fs->winsect = sector;
 		}
+#endif
+	} else {
+		fs->n_winhit++;
 	}
 	return res;
 }
@@ -765,6 +876,9 @@ FRESULT sync_fs (	/* FR_OK:succeeded, !=0:error */
 
 
 	res = sync_window(fs);
+#if _FS_WINPOOL
+	if (res == FR_OK) res = sync_pool(fs);
+#endif
 	if (res == FR_OK) {
 		/* Update FSInfo sector if needed */
 		if (fs->fs_type == FS_FAT32 && fs->fsi_flag == 1) {
@@ -777,6 +891,9 @@ FRESULT sync_fs (	/* FR_OK:succeeded, !=0:error */
 			ST_DWORD(fs->win + FSI_Nxt_Free, fs->last_clust);
 			/* Write it into the FSInfo sector */
 			fs->winsect = fs->volbase + 1;
+#if _FS_WINPOOL
+			discard_pool(fs, fs->winsect, 1);
+#endif
 			disk_write(fs->drv, fs->win, fs->winsect, 1);
 			fs->fsi_flag = 0;
 		}
@@ -864,6 +981,58 @@ DWORD get_fat (	/* 0xFFFFFFFF:Disk error, 1:Internal error, 2..0x0FFFFFFF:Cluste
 
 
 
+/*-----------------------------------------------------------------------*/
+/* FAT access - Free cluster map                                         */
+/*-----------------------------------------------------------------------*/
+
+#if _USE_FREEMAP
+static
+void fmap_init (
+	FATFS* fs		/* File system object */
+)
+{
+	BYTE sh = 0;
+
+
+	while (((fs->n_fatent - 1) >> sh) >= (DWORD)_FREEMAP_SIZE * 8) sh++;	/* Make the groups large enough to cover the volume */
+	fs->fmap_shift = sh;
+	mem_set(fs->fmap, 0, _FREEMAP_SIZE);
+}
+
+
+static
+int fmap_is_full (	/* 1:The group of clst has no free cluster, 0:Unknown or has a free cluster */
+	FATFS* fs,		/* File system object */
+	DWORD clst		/* Cluster number in the group */
+)
+{
+	DWORD g = clst >> fs->fmap_shift;
+
+
+	return (fs->fmap[g / 8] >> (g % 8)) & 1;
+}
+
+
+static
+void fmap_set (
+	FATFS* fs,		/* File system object */
+	DWORD clst,		/* Cluster number in the group */
+	int full		/* 1:Group has no free cluster, 0:Group may have a free cluster */
+)
+{
+	DWORD g = clst >> fs->fmap_shift;
+
+
+	if (full)
+		fs->fmap[g / 8] |= (BYTE)(1 << (g % 8));
+	else
+		fs->fmap[g / 8] &= (BYTE)~(1 << (g % 8));
+}
+#endif	/* _USE_FREEMAP */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* FAT access - Change value of a FAT entry                              */
 /*-----------------------------------------------------------------------*/
@@ -885,6 +1054,9 @@ FRESULT put_fat (	/* FR_OK(0):succeeded, !=0:error */
 		res = FR_INT_ERR;
 
 	} else {
+#if _USE_FREEMAP
+		if (val == 0) fmap_set(fs, clst, 0);	/* The group now has a free cluster */
+#endif
 		switch (fs->fs_type) {
 		case FS_FAT12 :
 			bc = (UINT)clst; bc += bc / 2;
@@ -994,6 +1166,10 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 {
 	DWORD cs, ncl, scl;
 	FRESULT res;
+#if _USE_FREEMAP
+	DWORD gmask = ((DWORD)1 << fs->fmap_shift) - 1;	/* Cluster offset mask in a free map group */
+	int gtop = 0;			/* Scan of the current group started at its top */
+#endif
 
 
 	if (clst == 0) {		/* Create a new chain */
@@ -1015,10 +1191,26 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 			ncl = 2;
 			if (ncl > scl) return 0;	/* No free cluster */
 		}
+#if _USE_FREEMAP
+		if ((ncl & gmask) == 0 || ncl == 2) {	/* Top of a free map group? */
+			if (fmap_is_full(fs, ncl)) {	/* Skip the group without reading the FAT */
+				if (ncl <= scl && (ncl >> fs->fmap_shift) == (scl >> fs->fmap_shift)) return 0;	/* Wrapped around to the start group (no free cluster) */
+				ncl |= gmask;
+				continue;
+			}
+			gtop = 1;
+		}
+#endif
 		cs = get_fat(fs, ncl);			/* Get the cluster status */
 		if (cs == 0) break;				/* Found a free cluster */
 		if (cs == 0xFFFFFFFF || cs == 1)/* An error occurred */
 			return cs;
+#if _USE_FREEMAP
+		if (((ncl + 1) & gmask) == 0 || ncl + 1 == fs->n_fatent) {	/* End of a free map group? */
+			if (gtop) fmap_set(fs, ncl, 1);	/* The whole group was scanned and is in use */
+			gtop = 0;
+		}
+#endif
 		if (ncl == scl) return 0;		/* No free cluster */
 	}
 
@@ -1072,6 +1264,136 @@ DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 
 
 
+
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Cluster run cache                                      */
+/*-----------------------------------------------------------------------*/
+
+#if _USE_CLUSTER_CACHE
+static
+UINT clc_index (	/* Index of the first run which starts after fcl */
+	CLCACHE* cc,	/* Pointer to the cluster run cache */
+	DWORD fcl		/* Cluster index from the top of the file */
+)
+{
+	UINT lo = 0, hi = cc->used, mid;
+
+
+	while (lo < hi) {	/* Binary search of the runs sorted by fcl */
+		mid = (lo + hi) / 2;
+		if (cc->ext[mid].fcl <= fcl)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+
+static
+DWORD clc_nearest (	/* 0:No run at or before fcl, >=2:Cluster number of *kfcl */
+	CLCACHE* cc,	/* Pointer to the cluster run cache */
+	DWORD fcl,		/* Cluster index from the top of the file to be converted */
+	DWORD* kfcl		/* Returns the highest cached cluster index which is <= fcl */
+)
+{
+	UINT i;
+	CLEXT *ep;
+
+
+	i = clc_index(cc, fcl);
+	if (i == 0) return 0;
+	ep = &cc->ext[i - 1];
+	*kfcl = (fcl < ep->fcl + ep->ncl) ? fcl : ep->fcl + ep->ncl - 1;
+	return ep->clst + (*kfcl - ep->fcl);
+}
+
+
+static
+void clc_record (
+	CLCACHE* cc,	/* Pointer to the cluster run cache */
+	DWORD fcl,		/* Cluster index from the top of the file */
+	DWORD clst		/* Cluster number of fcl found on the FAT */
+)
+{
+	UINT i, j, k;
+	CLEXT *ep;
+
+
+	i = clc_index(cc, fcl);
+	if (i > 0) {
+		ep = &cc->ext[i - 1];
+		if (fcl < ep->fcl + ep->ncl) return;	/* Already cached */
+		if (fcl == ep->fcl + ep->ncl && clst == ep->clst + ep->ncl) {	/* Extends the previous run */
+			ep->ncl++;
+			if (i < cc->used && cc->ext[i].fcl == fcl + 1 && cc->ext[i].clst == clst + 1) {	/* Joins it to the next run */
+				ep->ncl += cc->ext[i].ncl;
+				for (k = i; k + 1 < cc->used; k++) cc->ext[k] = cc->ext[k + 1];
+				cc->used--;
+			}
+			return;
+		}
+	}
+	if (i < cc->used && cc->ext[i].fcl == fcl + 1 && cc->ext[i].clst == clst + 1) {	/* Prepends to the next run */
+		ep = &cc->ext[i];
+		ep->fcl--; ep->clst--; ep->ncl++;
+		return;
+	}
+	if (cc->used == _CLUSTER_CACHE_EXTENTS) {	/* Make room by dropping the shortest run */
+		for (j = 0, k = 1; k < cc->used; k++) {
+			if (cc->ext[k].ncl < cc->ext[j].ncl) j = k;
+		}
+		for (k = j; k + 1 < cc->used; k++) cc->ext[k] = cc->ext[k + 1];
+		cc->used--;
+		if (j < i) i--;
+	}
+	for (k = cc->used; k > i; k--) cc->ext[k] = cc->ext[k - 1];	/* Insert a new run */
+	cc->ext[i].fcl = fcl; cc->ext[i].clst = clst; cc->ext[i].ncl = 1;
+	cc->used++;
+}
+#endif	/* _USE_CLUSTER_CACHE */
+
+
+
+
+/*-----------------------------------------------------------------------*/
+/* FAT handling - Follow (or stretch) the cluster chain of a file        */
+/*-----------------------------------------------------------------------*/
+
+static
+DWORD follow_clust (	/* 0:Disk full (stretch only), 1:Error, 0xFFFFFFFF:Disk error, >=2:Cluster number */
+	FIL* fp,		/* Pointer to the file object */
+	DWORD clst,		/* Cluster number of cluster fcl-1 in the file */
+	DWORD fcl,		/* Cluster index from the top of the file to get */
+	BYTE stretch	/* Stretch the chain if it ends at clst (write mode only) */
+)
+{
+	DWORD ncl;
+#if _USE_CLUSTER_CACHE
+	DWORD kfcl;
+
+
+	if (fp->clcache) {
+		ncl = clc_nearest(fp->clcache, fcl, &kfcl);
+		if (ncl && kfcl == fcl) return ncl;	/* Cache hit */
+	}
+#endif
+#if !_FS_READONLY
+	if (stretch)
+		ncl = create_chain(fp->fs, clst);
+	else
+#endif
+		ncl = get_fat(fp->fs, clst);
+#if _USE_CLUSTER_CACHE
+	if (fp->clcache && ncl >= 2 && ncl < fp->fs->n_fatent)
+		clc_record(fp->clcache, fcl, ncl);
+#endif
+	return ncl;
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Directory handling - Set directory index                              */
 /*-----------------------------------------------------------------------*/
@@ -1164,6 +1486,9 @@ FRESULT dir_next (	/* FR_OK(0):succeeded, FR_NO_FILE:End of table, FR_DENIED:Cou
 					if (sync_window(dp->fs)) return FR_DISK_ERR;/* Flush disk access window */
 					mem_set(dp->fs->win, 0, SS(dp->fs));		/* Clear window buffer */
 					dp->fs->winsect = clust2sect(dp->fs, clst);	/* Cluster start sector */
+#if _FS_WINPOOL
+					discard_pool(dp->fs, dp->fs->winsect, dp->fs->csize);
+#endif
 					for (c = 0; c < dp->fs->csize; c++) {		/* Fill the new cluster with 0 */
 						dp->fs->wflag = 1;
 						if (sync_window(dp->fs)) return FR_DISK_ERR;
@@ -2178,6 +2503,9 @@ BYTE check_fs (	/* 0:Valid FAT-BS, 1:Valid BS but not FAT, 2:Not a BS, 3:Disk er
 )
 {
 	fs->wflag = 0; fs->winsect = 0xFFFFFFFF;	/* Invaidate window */
+#if _FS_WINPOOL
+	discard_pool(fs, 0, 0xFFFFFFFF);
+#endif
 	if (move_window(fs, sect) != FR_OK)			/* Load boot record */
 		return 3;
 
@@ -2240,6 +2568,15 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 	/* Following code attempts to mount the volume. (analyze BPB and initialize the fs object) */
 
 	fs->fs_type = 0;					/* Clear the file system object */
+	fs->n_winhit = fs->n_winread = fs->n_winwrite = 0;
+#if _FS_WINPOOL
+	fs->pool_tick = 0;
+	for (i = 0; i < _FS_WINPOOL; i++) {	/* Empty the window pool (the object may be uninitialized memory) */
+		fs->pool_sect[i] = 0xFFFFFFFF;
+		fs->pool_flag[i] = 0;
+		fs->pool_used[i] = 0;
+	}
+#endif
 	fs->drv = LD2PD(vol);				/* Bind the logical drive and a physical drive */
 	stat = disk_initialize(fs->drv);	/* Initialize the physical drive */
 	if (stat & STA_NOINIT)				/* Check if the initialization succeeded */
@@ -2326,6 +2663,9 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 #if !_FS_READONLY
 	/* Initialize cluster allocation information */
 	fs->last_clust = fs->free_clust = 0xFFFFFFFF;
+#if _USE_FREEMAP
+	fmap_init(fs);
+#endif
 
 	/* Get fsinfo if available */
 	fs->fsi_flag = 0x80;
@@ -2567,6 +2907,12 @@ FRESULT f_open (
 			fp->dsect = 0;
 #if _USE_FASTSEEK
 			fp->cltbl = 0;						/* Normal seek mode */
+#endif
+#if _USE_CLUSTER_CACHE
+			fp->clcache = 0;					/* No cluster run cache */
+#endif
+#if _USE_PREALLOC
+			fp->pcl = 0;						/* No preallocated clusters */
 #endif
 			fp->fs = dj.fs;	 					/* Validate file object */
 			fp->id = fp->fs->id;
@@ -2620,7 +2966,7 @@ FRESULT f_read (
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
 					else
 #endif
-						clst = get_fat(fp->fs, fp->clust);	/* Follow cluster chain on the FAT */
+						clst = follow_clust(fp, fp->clust, fp->fptr / SS(fp->fs) / fp->fs->csize, 0);	/* Follow cluster chain on the FAT */
 				}
 				if (clst < 2) ABORT(fp->fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
@@ -2656,8 +3002,18 @@ FRESULT f_read (
 					fp->flag &= ~FA__DIRTY;
 				}
 #endif
+#if _USE_READ_COPY
+				/* Less than a sector is left to read (cc == 0) so it all comes from the head of this sector. The
+				   driver copies it out while filling the sector cache rather than mem_cpy() reading it again. */
+				if (disk_read_copy(fp->fs->drv, fp->buf, sect, rbuff, btr) != RES_OK)
+					ABORT(fp->fs, FR_DISK_ERR);
+				fp->dsect = sect;
+				rcnt = btr;
+				continue;
+#else
 				if (disk_read(fp->fs->drv, fp->buf, sect, 1) != RES_OK)	/* Fill sector cache */
 					ABORT(fp->fs, FR_DISK_ERR);
+#endif
 			}
 #endif
 			fp->dsect = sect;
@@ -2723,7 +3079,7 @@ FRESULT f_write (
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
 					else
 #endif
-						clst = create_chain(fp->fs, fp->clust);	/* Follow or stretch cluster chain on the FAT */
+						clst = follow_clust(fp, fp->clust, fp->fptr / SS(fp->fs) / fp->fs->csize, 1);	/* Follow or stretch cluster chain on the FAT */
 				}
 				if (clst == 0) break;		/* Could not allocate a new cluster (disk full) */
 				if (clst == 1) ABORT(fp->fs, FR_INT_ERR);
@@ -2757,6 +3113,9 @@ FRESULT f_write (
 					cc = fp->fs->csize - csect;
 				if (disk_write(fp->fs->drv, wbuff, sect, cc) != RES_OK)
 					ABORT(fp->fs, FR_DISK_ERR);
+#if _FS_WINPOOL
+				discard_pool(fp->fs, sect, cc);
+#endif
 #if _FS_MINIMIZE <= 2
 #if _FS_TINY
 				if (fp->fs->winsect - sect < cc) {	/* Refill sector cache if it gets invalidated by the direct write */
@@ -2780,6 +3139,9 @@ FRESULT f_write (
 			if (fp->fptr >= fp->fsize) {	/* Avoid silly cache filling at growing edge */
 				if (sync_window(fp->fs)) ABORT(fp->fs, FR_DISK_ERR);
 				fp->fs->winsect = sect;
+#if _FS_WINPOOL
+				discard_pool(fp->fs, sect, 1);
+#endif
 			}
 #else
 			if (fp->dsect != sect) {		/* Fill sector cache with file data */
@@ -2864,6 +3226,47 @@ FRESULT f_sync (
 
 
 
+#if !_FS_READONLY && _USE_PREALLOC
+/*-----------------------------------------------------------------------*/
+/* Free the Unused Part of a Preallocated Area                           */
+/*-----------------------------------------------------------------------*/
+
+static
+FRESULT trim_prealloc (	/* FR_OK:succeeded, !=0:error */
+	FIL* fp			/* Pointer to the file object */
+)
+{
+	FRESULT res;
+	DWORD bcs, used, lcl;
+
+
+	res = validate(fp);
+	if (res == FR_OK && fp->pcl) {
+		bcs = (DWORD)fp->fs->csize * SS(fp->fs);
+		used = fp->fsize ? (fp->fsize - 1) / bcs + 1 : 0;	/* Number of clusters holding file data */
+		if (used < fp->pcl) {				/* Free the contiguous tail past the end of the file */
+			if (used == 0) {
+				res = remove_chain(fp->fs, fp->sclust);
+				fp->sclust = 0;
+			} else {
+				lcl = fp->sclust + used - 1;
+				res = put_fat(fp->fs, lcl, 0x0FFFFFFF);
+				if (res == FR_OK) res = remove_chain(fp->fs, lcl + 1);
+			}
+			fp->flag |= FA__WRITTEN;
+#if _USE_CLUSTER_CACHE
+			if (fp->clcache) fp->clcache->used = 0;
+#endif
+		}
+		fp->pcl = 0;
+	}
+	LEAVE_FF(fp->fs, res);
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Close File                                                            */
 /*-----------------------------------------------------------------------*/
@@ -2876,6 +3279,10 @@ FRESULT f_close (
 
 
 #if !_FS_READONLY
+#if _USE_PREALLOC
+	res = trim_prealloc(fp);			/* Free preallocated clusters which were not used */
+	if (res == FR_OK)
+#endif
 	res = f_sync(fp);					/* Flush cached data */
 	if (res == FR_OK)
 #endif
@@ -3047,6 +3454,9 @@ FRESULT f_lseek (
 {
 	FRESULT res;
 	DWORD clst, bcs, nsect, ifptr;
+#if _USE_CLUSTER_CACHE
+	DWORD fcl, kfcl, kcl;
+#endif
 #if _USE_FASTSEEK
 	DWORD cl, pcl, ncl, tcl, dsc, tlen, ulen, *tbl;
 #endif
@@ -3141,17 +3551,28 @@ FRESULT f_lseek (
 #endif
 				fp->clust = clst;
 			}
+#if _USE_CLUSTER_CACHE
+			if (clst != 0 && fp->clcache && ofs > bcs) {	/* Skip the part of the chain already in the cluster cache */
+				fcl = fp->fptr / bcs;
+				kcl = clc_nearest(fp->clcache, fcl + (ofs - 1) / bcs, &kfcl);
+				if (kcl && kfcl > fcl) {
+					fp->fptr += (kfcl - fcl) * bcs;
+					ofs -= (kfcl - fcl) * bcs;
+					clst = fp->clust = kcl;
+				}
+			}
+#endif
 			if (clst != 0) {
 				while (ofs > bcs) {						/* Cluster following loop */
 #if !_FS_READONLY
 					if (fp->flag & FA_WRITE) {			/* Check if in write mode or not */
-						clst = create_chain(fp->fs, clst);	/* Force stretch if in write mode */
+						clst = follow_clust(fp, clst, fp->fptr / bcs + 1, 1);	/* Force stretch if in write mode */
 						if (clst == 0) {				/* When disk gets full, clip file size */
 							ofs = bcs; break;
 						}
 					} else
 #endif
-						clst = get_fat(fp->fs, clst);	/* Follow cluster chain if not in write mode */
+						clst = follow_clust(fp, clst, fp->fptr / bcs + 1, 0);	/* Follow cluster chain if not in write mode */
 					if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
 					if (clst <= 1 || clst >= fp->fs->n_fatent) ABORT(fp->fs, FR_INT_ERR);
 					fp->clust = clst;
@@ -3426,6 +3847,10 @@ FRESULT f_getfree (
 	DWORD nfree, clst, sect, stat;
 	UINT i;
 	BYTE fat, *p;
+#if _USE_FREEMAP
+	DWORD e, gmask;
+	int gfree = 0;
+#endif
 
 
 	/* Get logical drive number */
@@ -3439,6 +3864,9 @@ FRESULT f_getfree (
 			/* Get number of free clusters */
 			fat = fs->fs_type;
 			nfree = 0;
+#if _USE_FREEMAP
+			gmask = ((DWORD)1 << fs->fmap_shift) - 1;
+#endif
 			if (fat == FS_FAT12) {	/* Sector unalighed entries: Search FAT via regular routine. */
 				clst = 2;
 				do {
@@ -3446,6 +3874,13 @@ FRESULT f_getfree (
 					if (stat == 0xFFFFFFFF) { res = FR_DISK_ERR; break; }
 					if (stat == 1) { res = FR_INT_ERR; break; }
 					if (stat == 0) nfree++;
+#if _USE_FREEMAP
+					if (stat == 0) gfree = 1;
+					if (((clst + 1) & gmask) == 0 || clst + 1 == fs->n_fatent) {	/* Record the state of each group */
+						fmap_set(fs, clst, !gfree);
+						gfree = 0;
+					}
+#endif
 				} while (++clst < fs->n_fatent);
 			} else {				/* Sector alighed entries: Accelerate the FAT search. */
 				clst = fs->n_fatent; sect = fs->fatbase;
@@ -3458,12 +3893,21 @@ FRESULT f_getfree (
 						i = SS(fs);
 					}
 					if (fat == FS_FAT16) {
-						if (LD_WORD(p) == 0) nfree++;
+						stat = LD_WORD(p);
 						p += 2; i -= 2;
 					} else {
-						if ((LD_DWORD(p) & 0x0FFFFFFF) == 0) nfree++;
+						stat = LD_DWORD(p) & 0x0FFFFFFF;
 						p += 4; i -= 4;
 					}
+					if (stat == 0) nfree++;
+#if _USE_FREEMAP
+					if (stat == 0) gfree = 1;
+					e = fs->n_fatent - clst;	/* FAT entry (cluster) number */
+					if (((e + 1) & gmask) == 0 || clst == 1) {	/* Record the state of each group */
+						fmap_set(fs, e, !gfree);
+						gfree = 0;
+					}
+#endif
 				} while (--clst);
 			}
 			fs->free_clust = nfree;	/* free_clust is valid */
@@ -3502,6 +3946,12 @@ FRESULT f_truncate (
 		if (fp->fsize > fp->fptr) {
 			fp->fsize = fp->fptr;	/* Set file size to current R/W point */
 			fp->flag |= FA__WRITTEN;
+#if _USE_CLUSTER_CACHE
+			if (fp->clcache) fp->clcache->used = 0;	/* Cached runs may include removed clusters */
+#endif
+#if _USE_PREALLOC
+			fp->pcl = 0;			/* Preallocated clusters past the new end are removed below */
+#endif
 			if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
 				res = remove_chain(fp->fs, fp->sclust);
 				fp->sclust = 0;
@@ -3533,6 +3983,107 @@ FRESULT f_truncate (
 
 
 
+#if _USE_PREALLOC
+/*-----------------------------------------------------------------------*/
+/* Allocate a Contiguous Area to a File                                  */
+/*-----------------------------------------------------------------------*/
+
+static
+DWORD find_free_run (	/* 0:Not found, 1:Internal error, 0xFFFFFFFF:Disk error, >=2:Top of the free run */
+	FATFS* fs,		/* File system object */
+	DWORD clst,		/* Cluster to start the search at */
+	DWORD end,		/* Cluster to stop the search before */
+	DWORD n			/* Number of contiguous free clusters needed */
+)
+{
+	DWORD cs, scl = 0, ncl = 0;
+#if _USE_FREEMAP
+	DWORD gmask = ((DWORD)1 << fs->fmap_shift) - 1;
+#endif
+
+
+	while (clst < end) {
+#if _USE_FREEMAP
+		if (((clst & gmask) == 0 || clst == 2) && fmap_is_full(fs, clst)) {	/* Skip groups with no free cluster */
+			clst = (clst | gmask) + 1;
+			ncl = 0;
+			continue;
+		}
+#endif
+		cs = get_fat(fs, clst);
+		if (cs == 0xFFFFFFFF || cs == 1) return cs;
+		if (cs == 0) {
+			if (ncl++ == 0) scl = clst;
+			if (ncl == n) return scl;
+		} else {
+			ncl = 0;
+		}
+		clst++;
+	}
+	return 0;
+}
+
+
+FRESULT f_prealloc (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD fsz		/* Number of bytes to allocate */
+)
+{
+	FRESULT res;
+	DWORD bcs, n, scl, clst, i;
+
+
+	res = validate(fp);						/* Check validity of the object */
+	if (res == FR_OK && fp->err) res = (FRESULT)fp->err;
+	if (res == FR_OK && (!(fp->flag & FA_WRITE) || fp->sclust || fp->fsize))
+		res = FR_DENIED;					/* Must be an empty file opened for writing */
+	if (res == FR_OK && fsz) {
+		bcs = (DWORD)fp->fs->csize * SS(fp->fs);	/* Cluster size (byte) */
+		n = (fsz - 1) / bcs + 1;			/* Number of clusters required */
+		clst = fp->fs->last_clust + 1;		/* Search from the last allocated cluster, wrapping once */
+		if (clst < 2 || clst >= fp->fs->n_fatent) clst = 2;
+		scl = find_free_run(fp->fs, clst, fp->fs->n_fatent, n);
+		if (scl == 0 && clst > 2)
+			scl = find_free_run(fp->fs, 2, clst + n - 1 < fp->fs->n_fatent ? clst + n - 1 : fp->fs->n_fatent, n);
+		if (scl == 0) res = FR_NOT_CONTIGUOUS;
+		if (scl == 1) res = FR_INT_ERR;
+		if (scl == 0xFFFFFFFF) res = FR_DISK_ERR;
+		for (i = 0; res == FR_OK && i < n; i++)	/* Create the chain */
+			res = put_fat(fp->fs, scl + i, i + 1 < n ? scl + i + 1 : 0x0FFFFFFF);
+		if (res != FR_OK && i > 1) {		/* Free the part of the chain already created (i - 1 links) */
+			if (fp->fs->free_clust != 0xFFFFFFFF)
+				fp->fs->free_clust -= i - 1;	/* remove_chain() counts them as freed */
+			remove_chain(fp->fs, scl);
+		}
+		if (res == FR_OK) {
+			fp->sclust = scl;
+			fp->pcl = n;
+			fp->flag |= FA__WRITTEN;		/* Directory entry is updated on sync */
+			fp->fs->last_clust = scl + n - 1;
+			if (fp->fs->free_clust != 0xFFFFFFFF) {
+				fp->fs->free_clust -= n;
+				fp->fs->fsi_flag |= 1;
+			}
+#if _USE_CLUSTER_CACHE
+			if (fp->clcache) {				/* The whole chain is already known */
+				fp->clcache->used = 1;
+				fp->clcache->ext[0].fcl = 0;
+				fp->clcache->ext[0].clst = scl;
+				fp->clcache->ext[0].ncl = n;
+			}
+#endif
+		} else if (res != FR_NOT_CONTIGUOUS) {
+			fp->err = (FRESULT)res;
+		}
+	}
+
+	LEAVE_FF(fp->fs, res);
+}
+#endif /* _USE_PREALLOC */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Delete a File or Directory                                            */
 /*-----------------------------------------------------------------------*/
@@ -3635,6 +4186,9 @@ FRESULT f_mkdir (
 				res = sync_window(dj.fs);
 			if (res == FR_OK) {					/* Initialize the new directory table */
 				dsc = clust2sect(dj.fs, dcl);
+#if _FS_WINPOOL
+				discard_pool(dj.fs, dsc, dj.fs->csize);
+#endif
 				dir = dj.fs->win;
 				mem_set(dir, 0, SS(dj.fs));
 				mem_set(dir + DIR_Name, ' ', 11);	/* Create "." entry */
@@ -3651,7 +4205,7 @@ FRESULT f_mkdir (
 					dj.fs->winsect = dsc++;
 					dj.fs->wflag = 1;
 					res = sync_window(dj.fs);
-					if (res != FR_OK) break;
+					if (res != FR_OK || n == 1) break;	/* Leave the last sector written in win[] (it may be pooled) */
 					mem_set(dir, 0, SS(dj.fs));
 				}
 			}
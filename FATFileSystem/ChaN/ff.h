@@ -104,11 +104,42 @@ typedef struct {
 	DWORD	dirbase;		/* Root directory start sector (FAT32:Cluster#) */
 	DWORD	database;		/* Data start sector */
 	DWORD	winsect;		/* Current sector appearing in the win[] */
+#if _USE_FREEMAP
+	BYTE	fmap_shift;		/* log2 of the number of clusters in each free map group */
+	BYTE	fmap[_FREEMAP_SIZE];	/* Free cluster map (1:group has no free cluster, 0:unknown or has free cluster) */
+#endif
+	DWORD	n_winhit;		/* Number of move_window() calls served without a disk read */
+	DWORD	n_winread;		/* Number of sectors read into win[] by move_window() */
+	DWORD	n_winwrite;		/* Number of dirty windows written back */
 	BYTE	win[_MAX_SS];	/* Disk access window for Directory, FAT (and file data at tiny cfg) */
+#if _FS_WINPOOL
+	DWORD	pool_tick;					/* LRU counter for the window pool */
+	DWORD	pool_sect[_FS_WINPOOL];		/* Sector held in each pool window (0xFFFFFFFF:empty) */
+	DWORD	pool_used[_FS_WINPOOL];		/* Value of pool_tick when each pool window was last used */
+	BYTE	pool_flag[_FS_WINPOOL];		/* Pool window flags (b0:dirty) */
+	BYTE	pool[_FS_WINPOOL][_MAX_SS];	/* Sectors recently moved out of win[] */
+#endif
 } FATFS;
 
 
 
+/* Cluster run cache (CLCACHE) */
+
+#if _USE_CLUSTER_CACHE
+typedef struct {
+	DWORD	fcl;			/* Index of the first cluster of the run from the top of the file */
+	DWORD	clst;			/* Cluster number of the first cluster of the run */
+	DWORD	ncl;			/* Number of contiguous clusters in the run */
+} CLEXT;
+
+typedef struct {
+	UINT	used;			/* Number of items used in ext[] */
+	CLEXT	ext[_CLUSTER_CACHE_EXTENTS];	/* Cluster runs sorted by fcl */
+} CLCACHE;
+#endif
+
+
+
 /* File object structure (FIL) */
 
 typedef struct {
@@ -128,6 +159,12 @@ typedef struct {
 #if _USE_FASTSEEK
 	DWORD*	cltbl;			/* Pointer to the cluster link map table (Nulled on file open) */
 #endif
+#if _USE_CLUSTER_CACHE
+	CLCACHE*	clcache;	/* Pointer to the cluster run cache (Nulled on file open) */
+#endif
+#if _USE_PREALLOC
+	DWORD	pcl;			/* Number of clusters allocated by f_prealloc() (Zeroed on file open) */
+#endif
 #if _FS_LOCK
 	UINT	lockid;			/* File lock ID origin from 1 (index of file semaphore table Files[]) */
 #endif
@@ -201,7 +238,8 @@ typedef enum {
 	FR_LOCKED,				/* (16) The operation is rejected according to the file sharing policy */
 	FR_NOT_ENOUGH_CORE,		/* (17) LFN working buffer could not be allocated */
 	FR_TOO_MANY_OPEN_FILES,	/* (18) Number of open files > _FS_LOCK */
-	FR_INVALID_PARAMETER	/* (19) Given parameter is invalid */
+	FR_INVALID_PARAMETER,	/* (19) Given parameter is invalid */
+	FR_NOT_CONTIGUOUS		/* (20) There is no contiguous free area large enough (f_prealloc) */
 } FRESULT;
 
 
@@ -216,6 +254,7 @@ FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data t
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
 FRESULT f_lseek (FIL* fp, DWORD ofs);								/* Move file pointer of a file object */
 FRESULT f_truncate (FIL* fp);										/* Truncate file */
+FRESULT f_prealloc (FIL* fp, DWORD fsz);							/* Allocate a contiguous area to an empty file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of a writing file */
 FRESULT f_opendir (FATFS_DIR* dp, const TCHAR* path);						/* Open a directory */
 FRESULT f_closedir (FATFS_DIR* dp);										/* Close an open directory */
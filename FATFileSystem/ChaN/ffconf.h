@@ -49,6 +49,34 @@
 /* This option switches fast seek feature. (0:Disable or 1:Enable) */
 
 
+#define	_USE_FREEMAP	1
+#define	_FREEMAP_SIZE	512
+/* This option switches the free cluster map. (0:Disable or 1:Enable)
+/  When enabled, the file system object holds a bitmap of _FREEMAP_SIZE bytes
+/  with one bit for each group of clusters, sized at mount to cover the volume.
+/  A set bit means the group is known to have no free clusters. The map starts
+/  clear on mount and is filled in as create_chain() and f_getfree() scan the
+/  FAT. put_fat() clears a group's bit when one of its clusters is freed.
+/  create_chain() skips full groups without reading their FAT sectors. */
+
+
+#define	_USE_PREALLOC	1
+/* This option switches f_prealloc() function. (0:Disable or 1:Enable)
+/  f_prealloc() allocates a contiguous run of clusters to an empty file up front so
+/  that writes within it don't need to allocate clusters. Any part of the run which
+/  is still beyond the end of the file is freed again by f_close(). */
+
+
+#define	_USE_CLUSTER_CACHE	1
+#define	_CLUSTER_CACHE_EXTENTS	16
+/* This option switches the automatic cluster run cache. (0:Disable or 1:Enable)
+/  When enabled, a file object can be given a CLCACHE which remembers up to
+/  _CLUSTER_CACHE_EXTENTS runs of contiguous clusters as the cluster chain is
+/  followed, so that f_lseek(), f_read() and f_write() don't need to read the FAT
+/  again for parts of the file which have already been visited. Unlike fast seek,
+/  no link map needs to be created up front and the file can still be expanded. */
+
+
 #define _USE_LABEL		0
 /* This option switches volume label functions, f_getlabel() and f_setlabel().
 /  (0:Disable or 1:Enable) */
@@ -92,7 +120,7 @@
 */
 
 
-#define	_USE_LFN	1
+#define	_USE_LFN	2
 #define	_MAX_LFN	255
 /* The _USE_LFN option switches the LFN feature.
 /
@@ -140,8 +168,9 @@
 / Drive/Volume Configurations
 /---------------------------------------------------------------------------*/
 
-#define _VOLUMES	1
-/* Number of volumes (logical drives) to be used. */
+#define _VOLUMES	3
+/* Number of volumes (logical drives) to be used. Two SD cards plus a volume striped
+/  across them (SDStripedFileSystem) need 3. */
 
 
 #define _STR_VOLUME_ID	0
@@ -202,6 +231,17 @@
 /  data transfer. */
 
 
+#define	_FS_WINPOOL	2
+/* This option sets the number of additional sector windows (0:Disable) kept in the
+/  file system object behind win[]. When move_window() leaves a sector, it is kept
+/  in the pool (with its dirty flag) instead of being written back, and a later
+/  move_window() to a pooled sector is served without a disk read. The least
+/  recently used pool window is written back and replaced when needed. This stops
+/  FAT, directory and FSINFO sectors from evicting each other during allocation
+/  heavy work, at a cost of _MAX_SS bytes per window. FATFS::n_winhit, n_winread
+/  and n_winwrite count window hits, disk reads and write-backs for sizing it. */
+
+
 #define _FS_NORTC	0
 #define _NORTC_MON	1
 #define _NORTC_MDAY	1
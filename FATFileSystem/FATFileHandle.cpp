@@ -36,6 +36,11 @@ FATFileHandle::FATFileHandle(FIL fh, FATFileHandle** ppHead) {
     *ppHead = this;
 
     _fh = fh;
+#if _USE_CLUSTER_CACHE
+    // Remember runs of contiguous clusters as the FAT chain is followed so that later seeks can skip over them.
+    _clcache.used = 0;
+    _fh.clcache = &_clcache;
+#endif
 }
 
 int FATFileHandle::close() {
@@ -105,3 +110,24 @@ int FATFileHandle::fsync() {
 off_t FATFileHandle::flen() {
     return _fh.fsize;
 }
+
+int FATFileHandle::preallocate(off_t length) {
+#if _USE_PREALLOC
+    if (length < 0 || (uint64_t)length > 0xFFFFFFFF) {
+        debug_if(FFS_DBG, "preallocate() length out of range\n");
+        return -1;
+    }
+    FRESULT res = f_prealloc(&_fh, length);
+    if (res == FR_NOT_CONTIGUOUS) {
+        debug_if(FFS_DBG, "f_prealloc() found no contiguous area for %d bytes\n", length);
+        return PREALLOCATE_NOT_CONTIGUOUS;
+    }
+    if (res) {
+        debug_if(FFS_DBG, "f_prealloc() failed: %d\n", res);
+        return -1;
+    }
+    return 0;
+#else
+    return -1;
+#endif
+}
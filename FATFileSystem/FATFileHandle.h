@@ -39,6 +39,14 @@ public:
     virtual int fsync();
     virtual off_t flen();
 
+    // Allocates a contiguous run of clusters large enough for length bytes to this empty file so that later writes
+    // within it don't have to touch the FAT. The file size isn't changed and any of the run which is still past the
+    // end of the file is freed again on close. Returns 0 on success, PREALLOCATE_NOT_CONTIGUOUS if there is no
+    // contiguous free area large enough (the file is left untouched) and -1 on other errors. Like the other calls
+    // here, any negative result is a failure.
+    enum { PREALLOCATE_NOT_CONTIGUOUS = -2 };
+    int preallocate(off_t length);
+
 protected:
     friend class FATFileSystem;
     
@@ -46,6 +54,9 @@ protected:
     FATFileHandle*  _pPrev;
     FATFileHandle** _ppHead;
     FIL             _fh;
+#if _USE_CLUSTER_CACHE
+    CLCACHE         _clcache;
+#endif
 
 };
 
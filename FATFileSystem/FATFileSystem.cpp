@@ -154,6 +154,13 @@ int FATFileSystem::unmount() {
     return res == 0 ? 0 : -1;
 }
 
+int FATFileSystem::disk_read_copy(uint8_t *buffer, uint32_t sector, uint8_t *copy, uint32_t copy_size) {
+    int res = disk_read(buffer, sector, 1);
+    if (res == 0)
+        memcpy(copy, buffer, copy_size);
+    return res;
+}
+
 int FATFileSystem::sync() {
     FATFileHandle* pCurr = _pHead;
     int result = 0;
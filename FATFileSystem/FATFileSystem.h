@@ -94,6 +94,12 @@ public:
     virtual int disk_sync() { return 0; }
     virtual uint32_t disk_sectors() = 0;
 
+    /**
+     * Reads one sector into buffer and copies its first copy_size bytes to copy. Drivers which can copy the data out
+     * while they are already passing over it (ie. to check its CRC) override this to save FatFs a second pass.
+     */
+    virtual int disk_read_copy(uint8_t *buffer, uint32_t sector, uint8_t *copy, uint32_t copy_size);
+
 protected:
     FATFileHandle*  _pHead;
 };
@@ -27,10 +27,13 @@
 // Function prototypes.
 static void printTestResult(bool testResult);
 static void printFinalTestResults();
+static void asyncTransferCallback(void* pContext, bool wasSuccessful);
 
 
 uint32_t g_totalTestCases = 0;
 uint32_t g_failingTestCases = 0;
+volatile uint32_t g_asyncCallbackCount = 0;
+volatile bool     g_asyncCallbackResult = false;
 
 
 int main(void)
@@ -345,6 +348,123 @@ int main(void)
     spi.exchange(0xFF);
     printTestResult(testResult);
 
+    // transferAsync() tests.
+    printf("Verify m_spi.transferAsync() with valid read & write buffers...");
+    testResult = true;
+    spi.resetByteCount();
+    g_asyncCallbackCount = 0;
+    memset(readBuffer, 0xAD, sizeof(readBuffer));
+    for (int i = 0 ; i < 256 ; i++)
+    {
+        writeBuffer[i] = i;
+    }
+    spi.transferAsync(writeBuffer, sizeof(writeBuffer), readBuffer, sizeof(readBuffer), asyncTransferCallback, NULL);
+    // At 10kHz, 256 bytes take ~200ms so the transfer should still be in progress.
+    uint32_t pendingPolls = 0;
+    while (spi.isTransferPending())
+    {
+        pendingPolls++;
+    }
+    if (pendingPolls == 0)
+    {
+        printf("\nExpected transfer to still be pending after transferAsync() returned.   ");
+        testResult = false;
+    }
+    if (!spi.waitForTransfer())
+    {
+        printf("\nDidn't expect transfer to fail.   ");
+        testResult = false;
+    }
+    if (g_asyncCallbackCount != 1 || !g_asyncCallbackResult)
+    {
+        printf("\nCallback count: %lu result: %d expected: 1 1   ", g_asyncCallbackCount, g_asyncCallbackResult);
+        testResult = false;
+    }
+    if (spi.getByteCount() != 256)
+    {
+        printf("\ngetByteCount() returned: %lu expected: 256   ", spi.getByteCount());
+        testResult = false;
+    }
+    for (int i = 0 ; i < 256 ; i++)
+    {
+        if (readBuffer[i] != i)
+        {
+            printf("\nactual: %d expected: %d   ", readBuffer[i], i);
+            testResult = false;
+        }
+    }
+    printTestResult(testResult);
+
+    printf("Verify m_spi.exchange() waits for pending m_spi.transferAsync() to complete...");
+    testResult = true;
+    memset(readBuffer, 0xAD, sizeof(readBuffer));
+    spi.transferAsync(writeBuffer, sizeof(writeBuffer), readBuffer, sizeof(readBuffer));
+    int byteReceived = spi.exchange(0x5A);
+    if (byteReceived != 0x5A)
+    {
+        printf("\nactual: %d expected: %d   ", byteReceived, 0x5A);
+        testResult = false;
+    }
+    if (spi.isTransferPending() || readBuffer[255] != 255)
+    {
+        printf("\nTransfer didn't complete before exchange().   ");
+        testResult = false;
+    }
+    printTestResult(testResult);
+
+    // readScatterAsync()/writeGatherAsync() tests.
+    printf("Verify m_spi.readScatterAsync() fills each segment and skips the gaps...");
+    testResult = true;
+    spi.resetByteCount();
+    memset(readBuffer, 0xAD, sizeof(readBuffer));
+    SPIDma::Segment scatterSegments[3] = { { readBuffer + 192, 64 }, { readBuffer, 32 }, { readBuffer + 64, 64 } };
+    spi.readScatterAsync(scatterSegments, 3);
+    if (!spi.waitForTransfer())
+    {
+        printf("\nDidn't expect transfer to fail.   ");
+        testResult = false;
+    }
+    if (spi.getByteCount() != 160)
+    {
+        printf("\ngetByteCount() returned: %lu expected: 160   ", spi.getByteCount());
+        testResult = false;
+    }
+    for (int i = 0 ; i < 256 ; i++)
+    {
+        // Loopback of the 0xFF fill bytes should only land in the 3 segments.
+        bool    isInSegment = (i < 32) || (i >= 64 && i < 128) || (i >= 192);
+        uint8_t expected = isInSegment ? 0xFF : 0xAD;
+        if (readBuffer[i] != expected)
+        {
+            printf("\nreadBuffer[%d] actual: %d expected: %d   ", i, readBuffer[i], expected);
+            testResult = false;
+        }
+    }
+    printTestResult(testResult);
+
+    printf("Verify m_spi.writeGatherAsync() sends all segments...");
+    testResult = true;
+    spi.resetByteCount();
+    SPIDma::Segment gatherSegments[2] = { { writeBuffer + 128, 128 }, { writeBuffer, 100 } };
+    spi.writeGatherAsync(gatherSegments, 2);
+    if (!spi.waitForTransfer())
+    {
+        printf("\nDidn't expect transfer to fail.   ");
+        testResult = false;
+    }
+    if (spi.getByteCount() != 228)
+    {
+        printf("\ngetByteCount() returned: %lu expected: 228   ", spi.getByteCount());
+        testResult = false;
+    }
+    byteReceived = spi.exchange(0x5A);
+    if (byteReceived != 0x5A)
+    {
+        printf("\nactual: %d expected: %d   ", byteReceived, 0x5A);
+        testResult = false;
+    }
+    printTestResult(testResult);
+
 
     printFinalTestResults();
     return 0;
@@ -366,4 +486,10 @@ static void printFinalTestResults()
     printf("Failing Tests: %lu %s\n", g_failingTestCases, (g_failingTestCases > 0) ? "**" : "");
     printf("Passing Tests: %lu\n", g_totalTestCases - g_failingTestCases);
     printf("  Total Tests: %lu\n", g_totalTestCases);
-}
\ No newline at end of file
+}
+
+static void asyncTransferCallback(void* pContext, bool wasSuccessful)
+{
+    g_asyncCallbackCount++;
+    g_asyncCallbackResult = wasSuccessful;
+}
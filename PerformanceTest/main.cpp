@@ -32,6 +32,7 @@ int main()
 {
     static const char         testFilename[] = "/sd/sdtst.bin";
     static const unsigned int testFileSize = 10 * 1024 * 1024;
+    static const unsigned int recordSize = 128;
     static Timer              timer;
     FILE*                     pFile = NULL;
     size_t                    bytesTransferred = 0;
@@ -157,6 +158,51 @@ int main()
     printf("Validated %u bytes.\n", totalBytes);
     fclose(pFile);
 
+
+    // Reading in records smaller than a sector with no stdio buffering results in a single sector disk_read() for
+    // each record. The sector cache and read-ahead turn these into multi-block reads once sequential access is seen.
+    printf("Performing %u byte record read test with read-ahead...\n", recordSize);
+    pFile = fopen(testFilename, "r");
+    checkSdLog(&g_sd);
+    if (!pFile)
+    {
+        fprintf(stderr, "error: Failed to open %s - %d\n", testFilename, errno);
+        testExit(&g_sd, -1);
+    }
+    setvbuf(pFile, NULL, _IONBF, 0);
+    g_sd.enableSectorCache(buffer, sizeof(buffer), 2);
+    g_sd.setReadAheadWindow(SDFILESYSTEM_READ_AHEAD_MAX_WINDOW);
+    checkSdLog(&g_sd);
+
+    timer.reset();
+    for (;;)
+    {
+        unsigned char record[recordSize];
+
+        bytesTransferred = fread(record, 1, sizeof(record), pFile);
+        checkSdLog(&g_sd);
+        if (bytesTransferred != sizeof(record))
+        {
+            if (ferror(pFile))
+            {
+                fprintf(stderr, "error: Failed to read from %s - %d\n", testFilename, errno);
+                testExit(&g_sd, -1);
+            }
+            else
+            {
+                break;
+            }
+        }
+    }
+    totalTicks = (unsigned int)timer.read_ms();
+    totalBytes = ftell(pFile);
+    fclose(pFile);
+    g_sd.disableSectorCache();
+    checkSdLog(&g_sd);
+
+    readRate = (totalBytes / (totalTicks / 1000.0f)) / (1000.0f * 1000.0f);
+    printf("    %.2f MB/second.\n", readRate);
+
     printf("Removing test file.\n");
     int removeResult = remove(testFilename);
     checkSdLog(&g_sd);
@@ -168,6 +214,7 @@ int main()
 
 
     dumpSdCounters(&g_sd);
+    dumpLatencyStats(&g_sd);
     printf("Test Completed!\n");
 
     return 0;
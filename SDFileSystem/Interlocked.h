@@ -26,6 +26,9 @@ uint32_t interlockedIncrement(volatile uint32_t* pValue);
 uint32_t interlockedDecrement(volatile uint32_t* pValue);
 uint32_t interlockedAdd(volatile uint32_t* pVal1, uint32_t val2);
 uint32_t interlockedSubtract(volatile uint32_t* pVal1, uint32_t val2);
+/* Stores exchange in *pValue only if it currently holds comparand. Returns the value that was in *pValue so that the
+   caller can tell if the exchange took place. */
+uint32_t interlockedCompareExchange(volatile uint32_t* pValue, uint32_t exchange, uint32_t comparand);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,82 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <string.h>
+#include "LatencyHistogram.h"
+
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(uint32_t latencyUs)
+{
+    m_counts[bucketForLatency(latencyUs)]++;
+    m_totalCount++;
+    if (latencyUs > m_maximum)
+    {
+        m_maximum = latencyUs;
+    }
+}
+
+void LatencyHistogram::reset()
+{
+    memset(m_counts, 0, sizeof(m_counts));
+    m_totalCount = 0;
+    m_maximum = 0;
+}
+
+uint32_t LatencyHistogram::bucketForLatency(uint32_t latencyUs)
+{
+    if (latencyUs == 0)
+    {
+        return 0;
+    }
+
+    // The bucket is the number of significant bits in the latency. CLZ makes this a single instruction on Cortex-M3.
+    uint32_t bucket = 32 - __builtin_clz(latencyUs);
+    if (bucket >= LATENCY_HISTOGRAM_BUCKETS)
+    {
+        bucket = LATENCY_HISTOGRAM_BUCKETS - 1;
+    }
+    return bucket;
+}
+
+uint32_t LatencyHistogram::bucketLowerBound(uint32_t bucket)
+{
+    if (bucket == 0)
+    {
+        return 0;
+    }
+    return 1 << (bucket - 1);
+}
+
+uint32_t LatencyHistogram::percentile(uint32_t percent) const
+{
+    // Walk the buckets until percent of the recorded latencies have been counted and return the largest latency
+    // which that bucket could hold, capped by the largest latency actually seen.
+    uint64_t threshold = ((uint64_t)m_totalCount * percent + 99) / 100;
+    uint64_t count = 0;
+    for (uint32_t bucket = 0 ; bucket < LATENCY_HISTOGRAM_BUCKETS - 1 ; bucket++)
+    {
+        count += m_counts[bucket];
+        if (count >= threshold && count > 0)
+        {
+            uint32_t upperBound = bucketLowerBound(bucket + 1) - 1;
+            return upperBound < m_maximum ? upperBound : m_maximum;
+        }
+    }
+    return m_maximum;
+}
@@ -0,0 +1,63 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/*
+    Histogram of latencies in microseconds with log2 sized buckets so that a fixed and small amount of RAM covers
+    everything from a few SPI exchanges up to the 500ms time outs. Bucket 0 counts latencies of 0us and bucket n
+    counts latencies from 2^(n-1) to 2^n - 1us. The last bucket also counts anything longer.
+*/
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+// 2^20us is just over a second.
+#define LATENCY_HISTOGRAM_BUCKETS 21
+
+
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void     record(uint32_t latencyUs);
+    void     reset();
+
+    uint32_t count(uint32_t bucket) const
+    {
+        return m_counts[bucket];
+    }
+    uint32_t totalCount() const
+    {
+        return m_totalCount;
+    }
+    uint32_t maximum() const
+    {
+        return m_maximum;
+    }
+
+    // Upper bound of the bucket holding the given percentile (ie. 99 for p99) of the recorded latencies.
+    uint32_t percentile(uint32_t percent) const;
+
+    static uint32_t bucketForLatency(uint32_t latencyUs);
+    // Smallest latency counted by bucket.
+    static uint32_t bucketLowerBound(uint32_t bucket);
+
+protected:
+    uint32_t m_counts[LATENCY_HISTOGRAM_BUCKETS];
+    uint32_t m_totalCount;
+    uint32_t m_maximum;
+};
+
+#endif // LATENCY_HISTOGRAM_H
@@ -16,6 +16,7 @@
  */
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include "SDCRC.h"
 
 // Set to non-zero to inject random CRC failures for fault testing.
@@ -23,11 +24,15 @@
 #define INJECT_CRC16_ERROR 0
 
 
-// On Thumb targets, we can take advantage of __REV16 for CRC16 code.
+// On Thumb targets, we can take advantage of __REV and __REV16 for CRC16 code.
 #ifdef __thumb__
 #include <cmsis.h>
 #endif
 
+#if SDCRC_CRC16_SLICES != 1 && SDCRC_CRC16_SLICES != 4 && SDCRC_CRC16_SLICES != 8
+#error "SDCRC_CRC16_SLICES must be 1, 4, or 8."
+#endif
+
 namespace SDCRC
 {
 
@@ -104,6 +109,31 @@ uint16_t g_Crc16Table[256] = {
     0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
 };
 
+#if SDCRC_CRC16_SLICES > 1
+// Table k-1 holds the CRC16 of each byte value followed by k zero bytes. This lets each byte of a word be looked up
+// independently of the others. They are built from g_Crc16Table on first use and live in RAM for the same reason.
+static uint16_t g_Crc16SliceTables[SDCRC_CRC16_SLICES - 1][256];
+static bool     g_isCrc16SliceTablesBuilt;
+#define CRC16_SLICE(K) g_Crc16SliceTables[(K) - 1]
+#endif
+
+typedef uint16_t (*Crc16Function)(const uint8_t* pData, size_t length, uint16_t crc);
+
+static uint16_t crc16FirstCall(const uint8_t* pData, size_t length, uint16_t crc);
+static uint16_t crc16CopyWords(uint8_t* pDest, const uint8_t* pSrc, size_t length, uint16_t crc);
+
+// The kernel which crc16CopyWords() has the copy fused into.
+#if SDCRC_CRC16_SLICES >= 4
+#define CRC16_COPY_KERNEL CRC16_KERNEL_SLICE_BY_4
+#else
+#define CRC16_COPY_KERNEL CRC16_KERNEL_TABLE
+#endif
+
+static Crc16Function g_pCrc16 = crc16FirstCall;
+static Crc16Kernel   g_crc16Kernel = CRC16_KERNEL_TABLE;
+static Crc16Backend* g_pCrc16Backend;
+
+
 uint8_t crc7(const uint8_t* pData, size_t length)
 {
     //Calculate the CRC7 checksum for the specified data block
@@ -121,15 +151,146 @@ uint8_t crc7(const uint8_t* pData, size_t length)
     return crc;
 }
 
-uint16_t crc16(const uint8_t* pData, size_t length)
+uint8_t crc7Command(uint8_t cmd, uint32_t argument)
 {
-    const uint32_t* p = (const uint32_t*)pData;
+    // The CRC starts at 0 so the command byte only needs the one lookup.
+    uint8_t crc = g_Crc7Table[cmd];
+    crc = g_Crc7Table[(crc << 1) ^ (uint8_t)(argument >> 24)];
+    crc = g_Crc7Table[(crc << 1) ^ (uint8_t)(argument >> 16)];
+    crc = g_Crc7Table[(crc << 1) ^ (uint8_t)(argument >> 8)];
+    crc = g_Crc7Table[(crc << 1) ^ (uint8_t)argument];
 
+    if (INJECT_CRC7_ERROR > 0 && (rand() % INJECT_CRC7_ERROR) == 0)
+    {
+        crc ^= 0x5A;
+    }
+
+    return crc;
+}
+
+uint16_t crc16(const uint8_t* pData, size_t length, uint16_t crc /* = 0 */)
+{
+    assert ( (length & 3) == 0 );
+
+    Crc16Backend* pBackend = g_pCrc16Backend;
+    if (!pBackend || !pBackend->crc16(pData, length, crc, &crc))
+    {
+        crc = g_pCrc16(pData, length, crc);
+    }
+
+    if (INJECT_CRC16_ERROR > 0 && (rand() % INJECT_CRC16_ERROR) == 0)
+    {
+        crc ^= 0xF00D;
+    }
+
+    // Return the calculated checksum
+    return crc;
+}
+
+uint16_t crc16Copy(uint8_t* pDest, const uint8_t* pSrc, size_t length, size_t copyLength, uint16_t crc /* = 0 */)
+{
     assert ( (length & 3) == 0 );
+    assert ( copyLength <= length );
+
+    // The copy is only fused into the kernel it was written for. If a backend or another kernel has been selected
+    // then the copy is made on its own and all of the data goes through crc16() so that the selection is honoured.
+    if (g_pCrc16Backend || crc16Kernel() != CRC16_COPY_KERNEL)
+    {
+        memcpy(pDest, pSrc, copyLength);
+        return crc16(pSrc, length, crc);
+    }
+
+    // The whole words to be copied are fused with the CRC calculation. A trailing partial word is copied on its own
+    // and then the rest of the data goes through crc16() as normal.
+    size_t fusedLength = copyLength & ~3;
+    if (fusedLength)
+    {
+        crc = crc16CopyWords(pDest, pSrc, fusedLength, crc);
+    }
+    if (copyLength > fusedLength)
+    {
+        memcpy(pDest + fusedLength, pSrc + fusedLength, copyLength - fusedLength);
+    }
+    if (length == fusedLength)
+    {
+        return crc;
+    }
+    return crc16(pSrc + fusedLength, length - fusedLength, crc);
+}
+
+static uint16_t crc16FirstCall(const uint8_t* pData, size_t length, uint16_t crc)
+{
+    if (!setCrc16Kernel(SDCRC_CRC16_KERNEL))
+    {
+        setCrc16Kernel(CRC16_KERNEL_TABLE);
+    }
+    return g_pCrc16(pData, length, crc);
+}
+
+void setCrc16Backend(Crc16Backend* pBackend)
+{
+    g_pCrc16Backend = pBackend;
+}
+
+Crc16Backend* crc16Backend()
+{
+    return g_pCrc16Backend;
+}
+
+bool setCrc16Kernel(Crc16Kernel kernel)
+{
+    switch (kernel)
+    {
+    case CRC16_KERNEL_TABLE:
+        g_pCrc16 = crc16Table;
+        break;
+#if SDCRC_CRC16_SLICES >= 4
+    case CRC16_KERNEL_SLICE_BY_4:
+        g_pCrc16 = crc16SliceBy4;
+        break;
+#endif
+#if SDCRC_CRC16_SLICES >= 8
+    case CRC16_KERNEL_SLICE_BY_8:
+        g_pCrc16 = crc16SliceBy8;
+        break;
+#endif
+    default:
+        return false;
+    }
+    g_crc16Kernel = kernel;
+    return true;
+}
+
+Crc16Kernel crc16Kernel()
+{
+    if (g_pCrc16 == crc16FirstCall && !setCrc16Kernel(SDCRC_CRC16_KERNEL))
+    {
+        setCrc16Kernel(CRC16_KERNEL_TABLE);
+    }
+    return g_crc16Kernel;
+}
+
+static inline uint32_t reverseBytes(uint32_t data)
+{
+#ifdef __thumb__
+    return __REV(data);
+#else
+    return (data >> 24) | ((data >> 8) & 0x0000FF00) | ((data << 8) & 0x00FF0000) | (data << 24);
+#endif
+}
+
+// Returns the next 4 bytes of the stream packed into a word with the first byte in the most significant bits.
+static inline uint32_t loadBigEndian(const uint32_t* p)
+{
+    return reverseBytes(*p);
+}
+
+uint16_t crc16Table(const uint8_t* pData, size_t length, uint16_t crc /* = 0 */)
+{
+    const uint32_t* p = (const uint32_t*)pData;
 
     // Calculate the CRC16 checksum for the specified data block.
     // Unrolled loop which processes 4-bytes per iteration.
-    uint16_t crc = 0;
     while (length)
     {
         uint32_t data = *p++;
@@ -150,13 +311,137 @@ uint16_t crc16(const uint8_t* pData, size_t length)
         length -= 4;
     }
 
-    if (INJECT_CRC16_ERROR > 0 && (rand() % INJECT_CRC16_ERROR) == 0)
+    return crc;
+}
+
+#if SDCRC_CRC16_SLICES > 1
+static void buildCrc16SliceTables()
+{
+    // Each table is the previous one with another zero byte fed through the CRC.
+    for (int slice = 1 ; slice < SDCRC_CRC16_SLICES ; slice++)
     {
-        crc ^= 0xF00D;
+        const uint16_t* pPrev = slice == 1 ? g_Crc16Table : CRC16_SLICE(slice - 1);
+        uint16_t*       pCurr = g_Crc16SliceTables[slice - 1];
+        for (int i = 0 ; i < 256 ; i++)
+        {
+            pCurr[i] = (pPrev[i] << 8) ^ g_Crc16Table[pPrev[i] >> 8];
+        }
+    }
+    g_isCrc16SliceTablesBuilt = true;
+}
+#endif
+
+#if SDCRC_CRC16_SLICES >= 4
+uint16_t crc16SliceBy4(const uint8_t* pData, size_t length, uint16_t crc /* = 0 */)
+{
+    const uint32_t* p = (const uint32_t*)pData;
+
+    if (!g_isCrc16SliceTablesBuilt)
+    {
+        buildCrc16SliceTables();
+    }
+
+    // The 16-bit CRC is completely shifted out by the 4 bytes of the word so it can be folded into the first 2 bytes
+    // and then the CRC of each byte, followed by however many bytes come after it, just needs to be XORed together.
+    while (length)
+    {
+        uint32_t data = loadBigEndian(p++) ^ ((uint32_t)crc << 16);
+        crc = CRC16_SLICE(3)[data >> 24] ^
+              CRC16_SLICE(2)[(data >> 16) & 0xFF] ^
+              CRC16_SLICE(1)[(data >> 8) & 0xFF] ^
+              g_Crc16Table[data & 0xFF];
+        length -= 4;
     }
 
-    // Return the calculated checksum
     return crc;
 }
+#else
+uint16_t crc16SliceBy4(const uint8_t* pData, size_t length, uint16_t crc /* = 0 */)
+{
+    return crc16Table(pData, length, crc);
+}
+#endif
+
+#if SDCRC_CRC16_SLICES >= 4
+// Slice-by-4 kernel which also stores each word to pDest once it has been loaded for the CRC. The store goes through
+// memcpy() since pDest can be unaligned, which the Cortex-M3 handles with a single STR.
+static uint16_t crc16CopyWords(uint8_t* pDest, const uint8_t* pSrc, size_t length, uint16_t crc)
+{
+    const uint32_t* p = (const uint32_t*)pSrc;
+
+    if (!g_isCrc16SliceTablesBuilt)
+    {
+        buildCrc16SliceTables();
+    }
+
+    while (length)
+    {
+        uint32_t word = *p++;
+        memcpy(pDest, &word, sizeof(word));
+        pDest += sizeof(word);
+
+        uint32_t data = reverseBytes(word) ^ ((uint32_t)crc << 16);
+        crc = CRC16_SLICE(3)[data >> 24] ^
+              CRC16_SLICE(2)[(data >> 16) & 0xFF] ^
+              CRC16_SLICE(1)[(data >> 8) & 0xFF] ^
+              g_Crc16Table[data & 0xFF];
+        length -= 4;
+    }
+
+    return crc;
+}
+#else
+static uint16_t crc16CopyWords(uint8_t* pDest, const uint8_t* pSrc, size_t length, uint16_t crc)
+{
+    while (length--)
+    {
+        uint8_t byte = *pSrc++;
+        *pDest++ = byte;
+        crc = (crc << 8) ^ g_Crc16Table[(crc >> 8) ^ byte];
+    }
+
+    return crc;
+}
+#endif
+
+#if SDCRC_CRC16_SLICES >= 8
+uint16_t crc16SliceBy8(const uint8_t* pData, size_t length, uint16_t crc /* = 0 */)
+{
+    const uint32_t* p = (const uint32_t*)pData;
+
+    if (!g_isCrc16SliceTablesBuilt)
+    {
+        buildCrc16SliceTables();
+    }
+
+    while (length >= 8)
+    {
+        uint32_t data1 = loadBigEndian(p++) ^ ((uint32_t)crc << 16);
+        uint32_t data2 = loadBigEndian(p++);
+        crc = CRC16_SLICE(7)[data1 >> 24] ^
+              CRC16_SLICE(6)[(data1 >> 16) & 0xFF] ^
+              CRC16_SLICE(5)[(data1 >> 8) & 0xFF] ^
+              CRC16_SLICE(4)[data1 & 0xFF] ^
+              CRC16_SLICE(3)[data2 >> 24] ^
+              CRC16_SLICE(2)[(data2 >> 16) & 0xFF] ^
+              CRC16_SLICE(1)[(data2 >> 8) & 0xFF] ^
+              g_Crc16Table[data2 & 0xFF];
+        length -= 8;
+    }
+
+    // Finish off a trailing word.
+    if (length)
+    {
+        crc = crc16SliceBy4((const uint8_t*)p, length, crc);
+    }
+
+    return crc;
+}
+#else
+uint16_t crc16SliceBy8(const uint8_t* pData, size_t length, uint16_t crc /* = 0 */)
+{
+    return crc16SliceBy4(pData, length, crc);
+}
+#endif
 
 } // namespace
@@ -20,11 +20,72 @@
 #include <stdio.h>
 #include <stdint.h>
 
+// Number of 256 entry CRC16 lookup tables to reserve RAM for. Each table after the first takes 512 bytes.
+//  1 - Only CRC16_KERNEL_TABLE is available.
+//  4 - CRC16_KERNEL_SLICE_BY_4 is also available.
+//  8 - All kernels are available.
+#ifndef SDCRC_CRC16_SLICES
+#define SDCRC_CRC16_SLICES 4
+#endif
+
+// Kernel used by crc16() until setCrc16Kernel() is called. Falls back to CRC16_KERNEL_TABLE if the selected kernel
+// needs more tables than SDCRC_CRC16_SLICES provides.
+#ifndef SDCRC_CRC16_KERNEL
+#define SDCRC_CRC16_KERNEL SDCRC::CRC16_KERNEL_SLICE_BY_4
+#endif
+
 namespace SDCRC
 {
 
+enum Crc16Kernel
+{
+    // Single 256 entry table with one lookup per byte.
+    CRC16_KERNEL_TABLE,
+    // Reads a 32-bit word at a time and looks up each of its bytes in its own table so that the lookups don't depend
+    // on each other.
+    CRC16_KERNEL_SLICE_BY_4,
+    // Same as CRC16_KERNEL_SLICE_BY_4 but 64-bits at a time.
+    CRC16_KERNEL_SLICE_BY_8
+};
+
 uint8_t  crc7(const uint8_t* data, size_t length);
-uint16_t crc16(const uint8_t* data, size_t length);
+// Same result as crc7() over the 5-byte command token made up of cmd followed by the big-endian argument, but with the
+// CRC carried straight from the command byte through each argument byte rather than from a buffer (ie. for commands
+// such as CMD17/CMD18/CMD24/CMD25 which carry a block address).
+uint8_t  crc7Command(uint8_t cmd, uint32_t argument);
+// The crc parameter allows the CRC to be continued across multiple buffers (ie. scatter/gather lists). The data must
+// be 32-bit aligned and length must be a multiple of 4 bytes.
+uint16_t crc16(const uint8_t* data, size_t length, uint16_t crc = 0);
+// Same as crc16() but also copies the first copyLength bytes of pSrc to pDest in the same pass over the data, for
+// callers which would otherwise read a freshly received block twice (once for the CRC and again to copy part of it
+// out). pDest doesn't need to be aligned and copyLength can be any number of bytes up to length. The copy is only
+// fused with the CRC16_KERNEL_SLICE_BY_4 kernel; with any other kernel, or a backend set, it is a memcpy() followed
+// by crc16().
+uint16_t crc16Copy(uint8_t* pDest, const uint8_t* pSrc, size_t length, size_t copyLength, uint16_t crc = 0);
+
+// Interface to an engine, such as a CRC peripheral, which crc16() can offload work to.
+class Crc16Backend
+{
+public:
+    virtual ~Crc16Backend() {}
+
+    // Returns false without touching pCrc if the backend can't take this request (ie. the engine is busy or the buffer
+    // is too small to be worth it). crc16() then falls back to the software kernel.
+    virtual bool crc16(const uint8_t* pData, size_t length, uint16_t crc, uint16_t* pCrc) = 0;
+};
+
+// Offloads crc16() calls to pBackend when it is able to take them. NULL to always use the software kernels.
+void          setCrc16Backend(Crc16Backend* pBackend);
+Crc16Backend* crc16Backend();
+
+// Selects the kernel used by crc16(). Returns false if the kernel wasn't compiled in (see SDCRC_CRC16_SLICES).
+bool        setCrc16Kernel(Crc16Kernel kernel);
+Crc16Kernel crc16Kernel();
+
+// The individual kernels which crc16() dispatches to. They all return the same results.
+uint16_t crc16Table(const uint8_t* data, size_t length, uint16_t crc = 0);
+uint16_t crc16SliceBy4(const uint8_t* data, size_t length, uint16_t crc = 0);
+uint16_t crc16SliceBy8(const uint8_t* data, size_t length, uint16_t crc = 0);
 
 }
 
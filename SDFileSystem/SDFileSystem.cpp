@@ -28,7 +28,6 @@
 #include <diskio.h>
 #include "SDFileSystem.h"
 #include "SDCRC.h"
-#include "SingleThreadedCheck.h"
 
 
 // The circular error log can be disabled via SDFILESYSTEM_ENABLE_ERROR_LOG
@@ -38,6 +37,18 @@
     #define LOG_ERROR(...)
 #endif
 
+// The latency histograms can be disabled via SDFILESYSTEM_ENABLE_LATENCY_STATS
+#if SDFILESYSTEM_ENABLE_LATENCY_STATS
+    #define LATENCY_START(START) uint32_t START = m_latencyTimer.read_us()
+    #define LATENCY_RECORD(HISTOGRAM, US) m_latencyStats.HISTOGRAM.record(US)
+    #define LATENCY_RECORD_SINCE(HISTOGRAM, START) \
+        m_latencyStats.HISTOGRAM.record((uint32_t)m_latencyTimer.read_us() - START)
+#else
+    #define LATENCY_START(START)
+    #define LATENCY_RECORD(HISTOGRAM, US)
+    #define LATENCY_RECORD_SINCE(HISTOGRAM, START)
+#endif
+
 
 
 // Possible states for SD Chip Select signal.
@@ -46,6 +57,8 @@
 
 // SD Commands used by this code.
 #define CMD0    0   // GO_IDLE_STATE - Resets the SD Memory Card.
+#define CMD6    6   // SWITCH_FUNC - Checks switchable function (mode 0) and switches card function (mode 1).
+                    //               Responds with a 512-bit status data block.
 #define CMD8    8   // SEND_IF_COND - Sends SD Memory Card interface condition that includes host supply voltage
                     //                information and asks the accessed card whether card can operate in supplied
                     //                voltage range.
@@ -93,6 +106,11 @@
 #define CMD8_VHS_OFFSET         8
 #define CMD8_VHS_2_7__3_6V      (1 << CMD8_VHS_OFFSET)  // 2.7 - 3.6V
 
+// Arguments for CMD6 - SWITCH_FUNC. Function group 1 (access mode) is set to High-Speed (function 1) and the other
+// groups are left unchanged (0xF).
+#define CMD6_CHECK_HIGH_SPEED   0x00FFFFF1
+#define CMD6_SWITCH_HIGH_SPEED  0x80FFFFF1
+
 // Bits for CMD59 - CRC_ON_OFF
 #define CMD59_CRC_OPTION_BIT    (1 << 0)
 
@@ -124,6 +142,39 @@
 #define OCR_3_2__3_3V   (1 << 20)
 #define OCR_CCS         (1 << 30)
 
+// 7.3.1.1 Command Format - Complete 48-bit command tokens, CRC7 included, for the commands which are always sent with
+// an argument of 0. These are sent for every ACMD (CMD55) and around most reads/writes (CMD12/CMD13) so they skip the
+// CRC7 calculation altogether. Spelled out by hand since C++98 has no constexpr. validateCmdPacket() in the unit
+// tests checks the packets sent against SDCRC::crc7().
+static const uint8_t g_cmd0Packet[]  = { 0x40, 0x00, 0x00, 0x00, 0x00, 0x95 };
+static const uint8_t g_cmd12Packet[] = { 0x4C, 0x00, 0x00, 0x00, 0x00, 0x61 };
+static const uint8_t g_cmd13Packet[] = { 0x4D, 0x00, 0x00, 0x00, 0x00, 0x0D };
+static const uint8_t g_cmd55Packet[] = { 0x77, 0x00, 0x00, 0x00, 0x00, 0x65 };
+static const uint8_t g_cmd58Packet[] = { 0x7A, 0x00, 0x00, 0x00, 0x00, 0xFD };
+
+static const uint8_t* findConstantCommandPacket(uint8_t cmd, uint32_t argument)
+{
+    if (argument != 0)
+    {
+        return NULL;
+    }
+    switch (cmd)
+    {
+    case CMD0:
+        return g_cmd0Packet;
+    case CMD12:
+        return g_cmd12Packet;
+    case CMD13:
+        return g_cmd13Packet;
+    case CMD55:
+        return g_cmd55Packet;
+    case CMD58:
+        return g_cmd58Packet;
+    default:
+        return NULL;
+    }
+}
+
 
 SDFileSystem::SDFileSystem(PinName mosi, PinName miso, PinName sclk, PinName cs, const char* name)
     : FATFileSystem(name), m_spi(mosi, miso, sclk, cs, HIGH)
@@ -133,6 +184,25 @@ SDFileSystem::SDFileSystem(PinName mosi, PinName miso, PinName sclk, PinName cs,
     m_status = STA_NOINIT;
     m_blockToAddressShift = 0;
     m_spiBytesPerSecond = 0;
+    m_readAheadWindow = 0;
+    m_lastReadBlock = ~0U;
+    m_readStreamIdleTimeout = 0;
+    m_writeStatusCheckInterval = 1;
+    m_maximumFrequency = SDFILESYSTEM_DEFAULT_SPEED_FREQUENCY;
+    m_currentFrequency = 0;
+    m_crcErrorBurstCount = 0;
+    m_pWaitStrategy = NULL;
+    m_waitSpinTimeUs = 0;
+    m_uncheckedWriteCount = 0;
+    m_writeStatusResult = RES_OK;
+    m_readStreamBlock = 0;
+    m_isReadStreamOpen = false;
+    m_streamBlock = 0;
+    m_streamBlocksLeft = 0;
+    m_streamTransactionBlocks = 0;
+    m_streamResult = RES_OK;
+    m_isStreamStarted = false;
+    m_isStreamTransactionOpen = false;
 
     // Initialize Diagnostic Counters.
     m_selectFirstExchangeRequiredCount = 0;
@@ -152,14 +222,42 @@ SDFileSystem::SDFileSystem(PinName mosi, PinName miso, PinName sclk, PinName cs,
     m_transmitTimeoutCount = 0;
     m_transmitTransferFailCount = 0;
     m_transmitResponseErrorCount = 0;
+    m_readAheadCount = 0;
+    m_readAheadSectorCount = 0;
+    m_readStreamContinueCount = 0;
+    m_fusedReadCopyCount = 0;
+    m_writeStreamTransactionCount = 0;
+    m_frequencyFallbackCount = 0;
+    m_waitBackOffCount = 0;
+    m_threadCount = 0;
+    m_pLock = NULL;
+    m_pRequests = NULL;
+    m_isServicingRequests = false;
+    m_mergedRequestCount = 0;
+
+#if SDFILESYSTEM_ENABLE_LATENCY_STATS
+    m_latencyTimer.start();
+#endif // SDFILESYSTEM_ENABLE_LATENCY_STATS
 
     m_spi.format(8, polarity0phase0);
 }
 
 int SDFileSystem::disk_initialize()
 {
-    // Makes sure that only 1 thread is attempting to use the SDFileSystem.
-    SingleThreadedCheck check;
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
+
+    // A different card may have been inserted so anything in the sector cache is no longer valid.
+    m_sectorCache.invalidate();
+    m_lastReadBlock = ~0U;
+    // The card is about to be reset so any open read stream or write stream transaction is abandoned along with the
+    // status of unchecked writes.
+    m_uncheckedWriteCount = 0;
+    m_isReadStreamOpen = false;
+    m_isStreamStarted = false;
+    m_isStreamTransactionOpen = false;
+    // CRC errors seen at the previous clock rate don't count against the newly negotiated one.
+    m_crcErrorBurstCount = 0;
 
     // Follow the flow-chart from section "7.2.1 Mode Selection and Initialization"
     // of the "SD Specifications Part 1 Physical Layer Simplified Specification Version 4.10"
@@ -310,8 +408,9 @@ int SDFileSystem::disk_initialize()
         }
     }
 
-    // 2. System Features - Default speed mode (slowest) is 25MHz.
-    setCurrentFrequency(25000000);
+    // 2. System Features - Default speed mode (slowest) is 25MHz. High-Speed mode (up to 50MHz) is only used if
+    //                      requested with setMaximumFrequency() and the card supports it.
+    setCurrentFrequency(negotiateFrequency());
 
     // Mark that the driver is now initialized.
     m_status &= ~STA_NOINIT;
@@ -326,294 +425,1201 @@ int SDFileSystem::disk_status()
 
 int SDFileSystem::disk_read(uint8_t* pBuffer, uint32_t blockNumber, uint32_t count)
 {
-    // Makes sure that only 1 thread is attempting to use the SDFileSystem.
-    SingleThreadedCheck check;
+    if (m_pLock)
+    {
+        return queueRequest(false, pBuffer, blockNumber, count);
+    }
 
-    // Save for the purpose of error logging original parameter values.
-    uint8_t* pOrigBuffer = pBuffer;
-    uint32_t origBlockNumber = blockNumber;
-    uint32_t origCount = count;
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
 
-    // These variables will throw unused warning when logging is disabled.
-    (void)pOrigBuffer;
-    (void)origBlockNumber;
-    (void)origCount;
+    LATENCY_START(startUs);
+    int result = readThroughSectorCache(pBuffer, blockNumber, count);
+    LATENCY_RECORD_SINCE(diskRead, startUs);
+    return result;
+}
 
-    if (m_status & STA_NOINIT)
-    {
-        LOG_ERROR("disk_read(%X,%d,%d) - Attempt to read uninitialized drive\n", pOrigBuffer, origBlockNumber, origCount);
-        return RES_NOTRDY;
-    }
-    if (!count)
+int SDFileSystem::disk_read_copy(uint8_t* pBuffer, uint32_t blockNumber, uint8_t* pCopy, uint32_t copySize)
+{
+    if (copySize > 512)
     {
-        LOG_ERROR("disk_read(%X,%d,%d) - Attempt to read 0 blocks\n", pOrigBuffer, origBlockNumber, origCount);
+        LOG_ERROR("disk_read_copy(%X,%d,%X,%d) - Copy larger than block\n", pBuffer, blockNumber, pCopy, copySize);
         return RES_PARERR;
     }
-
-    // 7.2.3 Data Read - Gives an overview of the single/multi block read process for SPI mode.
-    if (count == 1)
+    if (m_pLock || isSectorCacheActive(1))
     {
-        // 7.3.1.3 Detailed Command Description - Refer to note 10 for read/write commands.
-        // SDSC will require converting block number to byte address and high capacity disks use block number as address.
-        uint32_t blockAddress = blockNumber << m_blockToAddressShift;
-
-        // Issue CMD17 to start block read and then process transmitted data block.
-        int response = sendCommandAndReceiveDataBlock(CMD17, blockAddress, pBuffer, 512);
-        if (response != RES_OK)
+        // Queued requests and sector cache hits don't pass through verifyDataBlockCrc() so there is no pass over the
+        // data for the copy to be fused with.
+        int result = disk_read(pBuffer, blockNumber, 1);
+        if (result == RES_OK)
         {
-            LOG_ERROR("disk_read(%X,%d,%d) - Read failed\n", pOrigBuffer, origBlockNumber, origCount);
+            memcpy(pCopy, pBuffer, copySize);
         }
-        return response;
+        return result;
     }
 
-    for (uint32_t retry = 1 ; retry <= 3 ; retry++)
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
+
+    LATENCY_START(startUs);
+    int result = readBlocks(pBuffer, blockNumber, 1, pCopy, copySize);
+    LATENCY_RECORD_SINCE(diskRead, startUs);
+    if (result == RES_OK)
     {
-        // 7.3.1.3 Detailed Command Description - Refer to note 10 for read/write commands.
-        // SDSC will require converting block number to byte address and high capacity disks use block number as address.
-        uint32_t blockAddress = blockNumber << m_blockToAddressShift;
+        m_fusedReadCopyCount++;
+    }
+    return result;
+}
 
-        if (!select())
-        {
-            // Log error error and return immediately.  No need to deselect() again when select() failed.
-            LOG_ERROR("disk_read(%X,%d,%d) - Select timed out\n", pOrigBuffer, origBlockNumber, origCount);
-            return RES_ERROR;
-        }
+int SDFileSystem::readThroughSectorCache(uint8_t* pBuffer, uint32_t blockNumber, uint32_t count)
+{
+    if (!isSectorCacheActive(count))
+    {
+        return readBlocks(pBuffer, blockNumber, count);
+    }
 
-        // CMD18 is used to start the multi-block read.
-        uint8_t r1Response = sendCommandAndGetResponse(CMD18, blockAddress);
-        if (r1Response != 0)
-        {
-            LOG_ERROR("disk_read(%X,%d,%d) - CMD18 returned 0x%02X\n",
-                      pOrigBuffer, origBlockNumber, origCount, r1Response);
-            deselect();
-            return RES_ERROR;
-        }
+    // Track the last block read so that sequential single sector reads can be detected for read-ahead.
+    bool isSequential = (blockNumber == m_lastReadBlock + 1);
+    m_lastReadBlock = blockNumber + count - 1;
 
-        while (count)
+    if (count > 1)
+    {
+        // Multi-block reads are normally file data so they bypass the cache but they still need to return any data
+        // which is sitting dirty in the cache.
+        int result = readBlocks(pBuffer, blockNumber, count);
+        if (result == RES_OK)
         {
-            if (!receiveDataBlock(pBuffer, 512))
-            {
-                LOG_ERROR("disk_read(%X,%d,%d) - receiveDataBlock failed. block=%d\n",
-                          pOrigBuffer, origBlockNumber, origCount, blockNumber);
-                // Record maximum number of read retries.
-                if (retry > m_maximumReadRetryCount)
-                {
-                    m_maximumReadRetryCount = retry;
-                }
-                // Break out of this inner loop and allow outer loop to retry.
-                break;
-            }
-
-            // Reset retry counter when any read goes through successfully since we only want to fail
-            // when the retry counter is exceeded for a single block.
-            retry = 1;
-            // Advance to next block.
-            pBuffer += 512;
-            blockNumber++;
-            count--;
+            IoVector vector = { pBuffer, count * 512 };
+            copyDirtyCachedBlocks(&vector, 1, blockNumber, count);
         }
+        return result;
+    }
 
-        // CMD12 is sent to stop the multi-block read and then deselect() at end of multi-block read, error or not.
-        r1Response = sendCommandAndGetResponse(CMD12);
-        deselect();
-        if (r1Response != 0)
+    SectorCache::Line* pLine = m_sectorCache.lookup(blockNumber);
+    if (!pLine && isSequential && m_readAheadWindow > 1 && readAhead(blockNumber, &pLine) == RES_OK)
+    {
+        memcpy(pBuffer, pLine->pData, 512);
+        return RES_OK;
+    }
+    if (!pLine)
+    {
+        int result = allocateCacheLine(blockNumber, &pLine);
+        if (result != RES_OK)
         {
-            LOG_ERROR("disk_read(%X,%d,%d) - CMD12 returned 0x%02X\n",
-                      pOrigBuffer, origBlockNumber, origCount, r1Response);
-            return RES_ERROR;
+            return result;
         }
-
-        if (count == 0)
+        result = readBlocks(pLine->pData, blockNumber, 1);
+        if (result != RES_OK)
         {
-            // Have successfully completed the read.
-            return RES_OK;
+            // Line was left invalid by allocateCacheLine() so nothing more to clean up.
+            return result;
         }
+        m_sectorCache.fill(pLine, blockNumber, false);
     }
-
-    // Get here if we have run out of retries so return an error back to the caller.
-    return RES_ERROR;
+    memcpy(pBuffer, pLine->pData, 512);
+    return RES_OK;
 }
 
 int SDFileSystem::disk_write(const uint8_t* pBuffer, uint32_t blockNumber, uint32_t count)
 {
-    // Makes sure that only 1 thread is attempting to use the SDFileSystem.
-    SingleThreadedCheck check;
+    if (m_pLock)
+    {
+        return queueRequest(true, (uint8_t*)pBuffer, blockNumber, count);
+    }
 
-    // Save for the purpose of error logging original parameter values.
-    uint32_t origCount = count;
-    uint32_t origBlockNumber = blockNumber;
-    const uint8_t* pOrigBuffer = pBuffer;
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
 
-    // These variables will throw unused warning when logging is disabled.
-    (void)origBlockNumber;
-    (void)pOrigBuffer;
+    LATENCY_START(startUs);
+    int result = writeThroughSectorCache(pBuffer, blockNumber, count);
+    LATENCY_RECORD_SINCE(diskWrite, startUs);
+    return result;
+}
 
-    if (m_status & STA_NOINIT)
+int SDFileSystem::writeThroughSectorCache(const uint8_t* pBuffer, uint32_t blockNumber, uint32_t count)
+{
+    if (!isSectorCacheActive(count))
     {
-        LOG_ERROR("disk_write(%X,%d,%d) - Attempt to write uninitialized drive\n", pOrigBuffer, origBlockNumber, origCount);
-        return RES_NOTRDY;
+        return writeBlocks(pBuffer, blockNumber, count);
     }
-    if (!count)
+
+    IoVector vector = { (void*)pBuffer, count * 512 };
+    if (count > 1)
     {
-        LOG_ERROR("disk_write(%X,%d,%d) - Attempt to write 0 blocks\n", pOrigBuffer, origBlockNumber, origCount);
-        return RES_PARERR;
+        // Multi-block writes are normally file data so they are written through to the card. Any cached copies of
+        // these blocks are updated to match. They are left dirty if the write failed so that it is retried on the
+        // next flush.
+        int result = writeBlocks(pBuffer, blockNumber, count);
+        updateCachedBlocks(&vector, 1, blockNumber, count, result != RES_OK);
+        return result;
     }
 
-    // 7.2.4 Data Write - Gives an overview of the single/multi block write process for SPI mode.
-    for (uint32_t retry = 1 ; retry <= 3 ; retry++)
+    // Single block writes (FAT and directory updates) are held in the cache until evicted or flushed.
+    SectorCache::Line* pLine = m_sectorCache.lookup(blockNumber);
+    if (!pLine)
     {
-        // 7.3.1.3 Detailed Command Description - Refer to note 10 for read/write commands.
-        // SDSC will require converting block number to byte address and high capacity disks use block number as address.
-        uint32_t blockAddress = blockNumber << m_blockToAddressShift;
-        uint8_t  r1Response = 0xFF;
-        if (origCount == 1)
+        int result = allocateCacheLine(blockNumber, &pLine);
+        if (result != RES_OK)
         {
-            if (!select())
-            {
-                LOG_ERROR("disk_write(%X,%d,%d) - Select timed out\n", pOrigBuffer, origBlockNumber, origCount);
-                return RES_ERROR;
-            }
+            return result;
+        }
+    }
+    memcpy(pLine->pData, pBuffer, 512);
+    m_sectorCache.fill(pLine, blockNumber, true);
+    return RES_OK;
+}
 
-            // CMD24 is used to start single block write.
-            uint8_t r1Response = sendCommandAndGetResponse(CMD24, blockAddress);
-            if (r1Response != 0)
-            {
-                LOG_ERROR("disk_write(%X,%d,%d) - CMD24 returned 0x%02X\n", pOrigBuffer, origBlockNumber, origCount, r1Response);
-                deselect();
-                return RES_ERROR;
-            }
+int SDFileSystem::disk_readv(const IoVector* pVectors, size_t vectorCount, uint32_t blockNumber)
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
 
-            uint8_t dataResponse = transmitDataBlock(BLOCK_START, pBuffer, 512);
-            if (dataResponse != DATA_RESPONSE_DATA_ACCEPTED)
-            {
-                LOG_ERROR("disk_write(%X,%d,%d) - transmitDataBlock failed\n", pOrigBuffer, origBlockNumber, origCount);
-                // Record if this was the maximum number of write attempts we have made for a single block.
-                if (retry > m_maximumWriteRetryCount)
-                {
-                    m_maximumWriteRetryCount = retry;
-                }
-                // Encountered error while transmitting data block so try again.
-                deselect();
-                continue;
-            }
-        }
-        else
-        {
-            // 4.3.4 Data Write - ACMD23 can be used before CMD25 to indicate how many blocks should be pre-erased to
-            //                    improve multi-block write performance.
-            cmd(ACMD23, count & 0x07FFFF);
+    return readVectorsThroughSectorCache(pVectors, vectorCount, blockNumber);
+}
 
-            if (!select())
-            {
-                LOG_ERROR("disk_write(%X,%d,%d) - Select timed out\n", pOrigBuffer, origBlockNumber, origCount);
-                return RES_ERROR;
-            }
+int SDFileSystem::readVectorsThroughSectorCache(const IoVector* pVectors, size_t vectorCount, uint32_t blockNumber)
+{
+    int result = readVectors(pVectors, vectorCount, blockNumber);
+    if (result == RES_OK && m_sectorCache.isEnabled())
+    {
+        uint32_t count = 0;
+        validateVectors(pVectors, vectorCount, &count);
+        copyDirtyCachedBlocks(pVectors, vectorCount, blockNumber, count);
+    }
+    return result;
+}
 
-            // CMD25 is used to start multi block write.
-            r1Response = sendCommandAndGetResponse(CMD25, blockAddress);
-            if (r1Response != 0)
-            {
-                LOG_ERROR("disk_write(%X,%d,%d) - CMD25 returned 0x%02X\n", pOrigBuffer, origBlockNumber, origCount, r1Response);
-                deselect();
-                return RES_ERROR;
-            }
+int SDFileSystem::disk_writev(const IoVector* pVectors, size_t vectorCount, uint32_t blockNumber)
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
 
-            // Loop through and send each block to the card.
-            const uint8_t* pStartBuffer = pBuffer;
-            uint32_t startBlockNumber = blockNumber;
-            uint32_t startCount = count;
-            while (count)
-            {
-                uint8_t dataResponse = transmitDataBlock(MULTIPLE_BLOCK_START, pBuffer, 512);
-                if (dataResponse != DATA_RESPONSE_DATA_ACCEPTED)
-                {
-                    LOG_ERROR("disk_write(%X,%d,%d) - transmitDataBlock failed. block=%d\n",
-                               pOrigBuffer, origBlockNumber, origCount, blockNumber);
+    return writeVectorsThroughSectorCache(pVectors, vectorCount, blockNumber);
+}
 
-                    // Record if this was the maximum number of write attempts we have made for a single block.
-                    if (retry > m_maximumWriteRetryCount)
-                    {
-                        m_maximumWriteRetryCount = retry;
-                    }
+int SDFileSystem::writeVectorsThroughSectorCache(const IoVector* pVectors, size_t vectorCount, uint32_t blockNumber)
+{
+    int result = writeVectors(pVectors, vectorCount, blockNumber);
+    if ((result == RES_OK || result == RES_ERROR) && m_sectorCache.isEnabled())
+    {
+        uint32_t count = 0;
+        validateVectors(pVectors, vectorCount, &count);
+        updateCachedBlocks(pVectors, vectorCount, blockNumber, count, result != RES_OK);
+    }
+    return result;
+}
 
-                    // 7.3.3.1 Data Response Token - Send CMD12 to stop write when an error data response token is
-                    //                               returned.
-                    deselect();
-                    cmd(12);
+int SDFileSystem::enableSectorCache(void* pBuffer, size_t bufferSize, uint32_t ways)
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
 
-                    // 7.3.3.1 Data Response Token - Send ACMD22 on write error to determine number of
-                    //                               successful writes.
-                    if (dataResponse == DATA_RESPONSE_WRITE_ERROR)
-                    {
-                        // Determine number of blocks that were successfully written.
-                        uint8_t data[4];
-                        int result = sendCommandAndReceiveDataBlock(ACMD22, 0, data, sizeof(data));
-                        if (result != RES_OK)
-                        {
-                            LOG_ERROR("disk_write(%X,%d,%d) - Failed to retrieve written block count.\n",
-                                       pOrigBuffer, origBlockNumber, origCount);
-                            return result;
-                        }
+    // Don't lose any dirty sectors from a previously enabled cache.
+    int result = flushSectorCache();
+    if (result != RES_OK)
+    {
+        LOG_ERROR("enableSectorCache(%X,%d,%d) - Failed to flush existing cache\n", pBuffer, bufferSize, ways);
+        return result;
+    }
+    if (!m_sectorCache.init(pBuffer, bufferSize, ways))
+    {
+        LOG_ERROR("enableSectorCache(%X,%d,%d) - Buffer too small\n", pBuffer, bufferSize, ways);
+        return RES_PARERR;
+    }
+    return RES_OK;
+}
 
-                        // Copy big-endian 32-bit value into machine appropriate 32-bit format.
-                        uint32_t blocksWritten = ((uint32_t)data[0] << 24) |
-                                                 ((uint32_t)data[1] << 16) |
-                                                 ((uint32_t)data[2] << 8) |
-                                                  (uint32_t)data[3];
+int SDFileSystem::disableSectorCache()
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
 
-                        // If the returned count is too large then default to no blocks being written successfully.
-                        if (blocksWritten > startCount)
-                        {
-                            blocksWritten = 0;
-                        }
+    int result = flushSectorCache();
+    if (result != RES_OK)
+    {
+        LOG_ERROR("disableSectorCache() - Failed to flush cache\n");
+        return result;
+    }
+    m_sectorCache.uninit();
+    // Read-ahead prefetches into the sector cache so it can't be used without it.
+    m_readAheadWindow = 0;
+    return RES_OK;
+}
 
-                        // Rewind to first block that needs to be retried.
-                        pBuffer = pStartBuffer + 512 * blocksWritten;
-                        blockNumber = startBlockNumber + blocksWritten;
-                        count = startCount - blocksWritten;
-                    }
+int SDFileSystem::setReadAheadWindow(uint32_t windowSectors)
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
 
-                    // Break out of this inner loop so that we can retry from the outer loop.
-                    break;
-                }
+    if (windowSectors > SDFILESYSTEM_READ_AHEAD_MAX_WINDOW)
+    {
+        LOG_ERROR("setReadAheadWindow(%d) - Window too large\n", windowSectors);
+        return RES_PARERR;
+    }
+    if (windowSectors > 0 && !m_sectorCache.isEnabled())
+    {
+        LOG_ERROR("setReadAheadWindow(%d) - Sector cache not enabled\n", windowSectors);
+        return RES_PARERR;
+    }
+    m_readAheadWindow = windowSectors;
+    return RES_OK;
+}
 
-                // Reset retry counter when any write goes through successfully since we only want to fail
-                // when the retry counter is exceeded for a single block.
-                retry = 1;
+int SDFileSystem::setReadStreamIdleTimeout(uint32_t idleTimeoutMs)
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
 
-                // Advance to next block.
-                pBuffer += 512;
+    int result = closeReadStream();
+    m_readStreamIdleTimeout = idleTimeoutMs;
+    m_readStreamTimer.start();
+    return result;
+}
+
+int SDFileSystem::setWriteStatusCheckInterval(uint32_t writeCount)
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
+
+    if (writeCount == 0)
+    {
+        LOG_ERROR("setWriteStatusCheckInterval(%d) - Interval must be at least 1\n", writeCount);
+        return RES_PARERR;
+    }
+    // Check any writes left unchecked by the previous interval under the new one.
+    int result = checkDeferredWriteStatus();
+    m_writeStatusCheckInterval = writeCount;
+    return result;
+}
+
+int SDFileSystem::setMaximumFrequency(uint32_t maximumFrequency)
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
+
+    if (maximumFrequency < SDFILESYSTEM_MINIMUM_FREQUENCY)
+    {
+        LOG_ERROR("setMaximumFrequency(%d) - Frequency must be at least %dHz\n",
+                  maximumFrequency, SDFILESYSTEM_MINIMUM_FREQUENCY);
+        return RES_PARERR;
+    }
+    m_maximumFrequency = maximumFrequency;
+    return RES_OK;
+}
+
+int SDFileSystem::setWaitStrategy(SDWaitStrategy* pStrategy, uint32_t spinTimeUs)
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
+
+    m_pWaitStrategy = pStrategy;
+    m_waitSpinTimeUs = spinTimeUs;
+    return RES_OK;
+}
+
+int SDFileSystem::setLock(SDLock* pLock)
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
+
+    if (m_pRequests || m_isServicingRequests)
+    {
+        LOG_ERROR("setLock(%X) - Can't change lock while requests are queued\n", pLock);
+        return RES_ERROR;
+    }
+    m_pLock = pLock;
+    return RES_OK;
+}
+
+SDFileSystem::ScopedLock::ScopedLock(SDFileSystem* pSd)
+{
+    // Remember the lock taken here since setLock() can change it before this object is destroyed.
+    m_pLock = pSd->m_pLock;
+    if (!m_pLock)
+    {
+        return;
+    }
+
+    // The thread servicing queued requests drops the lock while it talks to the card so wait for it to finish.
+    m_pLock->lock();
+    while (pSd->m_isServicingRequests)
+    {
+        m_pLock->wait();
+    }
+}
+
+SDFileSystem::ScopedLock::~ScopedLock()
+{
+    if (m_pLock)
+    {
+        m_pLock->unlock();
+    }
+}
+
+int SDFileSystem::queueRequest(bool isWrite, uint8_t* pBuffer, uint32_t blockNumber, uint32_t count)
+{
+    Request request;
+    request.pNext = NULL;
+    request.pBuffer = pBuffer;
+    request.blockNumber = blockNumber;
+    request.count = count;
+    request.result = RES_ERROR;
+    request.isWrite = isWrite;
+    request.isDone = false;
+
+    m_pLock->lock();
+    LATENCY_START(startUs);
+
+    // Keep the queue sorted by block number (after any requests for the same block so that they stay in order) so
+    // that it can be serviced in a single sweep across the card.
+    Request** ppCurr = &m_pRequests;
+    while (*ppCurr && (*ppCurr)->blockNumber <= blockNumber)
+    {
+        ppCurr = &(*ppCurr)->pNext;
+    }
+    request.pNext = *ppCurr;
+    *ppCurr = &request;
+
+    // The first thread to find the queue idle services everything queued so far, including requests from other threads.
+    while (!request.isDone)
+    {
+        if (!m_isServicingRequests)
+        {
+            serviceRequests();
+        }
+        else
+        {
+            m_pLock->wait();
+        }
+    }
+
+    if (isWrite)
+    {
+        LATENCY_RECORD_SINCE(diskWrite, startUs);
+    }
+    else
+    {
+        LATENCY_RECORD_SINCE(diskRead, startUs);
+    }
+    m_pLock->unlock();
+
+    return request.result;
+}
+
+void SDFileSystem::serviceRequests()
+{
+    // Called with the lock held. Take ownership of the current queue and then drop the lock while talking to the card
+    // so that other threads can queue up the next batch of requests.
+    Request* pBatch = m_pRequests;
+    m_pRequests = NULL;
+    m_isServicingRequests = true;
+    m_pLock->unlock();
+
+    {
+        // Makes sure that only 1 thread is using the SDFileSystem at a time.
+        SingleThreadedCheck check(m_threadCount);
+
+        Request* pCurr = pBatch;
+        while (pCurr)
+        {
+            // Gather up the run of contiguous requests in the same direction which can be issued as one transfer.
+            Request* pLast = pCurr;
+            uint32_t requestCount = 1;
+            while (requestCount < SDFILESYSTEM_MAX_MERGED_REQUESTS &&
+                   pLast->pNext &&
+                   pLast->pNext->isWrite == pCurr->isWrite &&
+                   pLast->pNext->blockNumber == pLast->blockNumber + pLast->count &&
+                   isMergeable(pLast) && isMergeable(pLast->pNext))
+            {
+                pLast = pLast->pNext;
+                requestCount++;
+            }
+
+            int result = transferRequests(pCurr, requestCount);
+            for (uint32_t i = 0 ; i < requestCount ; i++)
+            {
+                pCurr->result = result;
+                pCurr = pCurr->pNext;
+            }
+        }
+    }
+
+    // Reacquire the lock before completing the requests since the waiting threads own them and will return as soon as
+    // they see them marked as done.
+    m_pLock->lock();
+    while (pBatch)
+    {
+        Request* pNext = pBatch->pNext;
+        pBatch->isDone = true;
+        pBatch = pNext;
+    }
+    m_isServicingRequests = false;
+    m_pLock->notifyAll();
+}
+
+bool SDFileSystem::isMergeable(const Request* pRequest)
+{
+    // Single block requests are handled by the sector cache when it is enabled.
+    return pRequest->count > 0 && !(m_sectorCache.isEnabled() && pRequest->count == 1);
+}
+
+int SDFileSystem::transferRequests(Request* pFirst, uint32_t requestCount)
+{
+    if (requestCount == 1)
+    {
+        if (pFirst->isWrite)
+        {
+            return writeThroughSectorCache(pFirst->pBuffer, pFirst->blockNumber, pFirst->count);
+        }
+        return readThroughSectorCache(pFirst->pBuffer, pFirst->blockNumber, pFirst->count);
+    }
+
+    IoVector vectors[SDFILESYSTEM_MAX_MERGED_REQUESTS];
+    Request* pCurr = pFirst;
+    for (uint32_t i = 0 ; i < requestCount ; i++)
+    {
+        vectors[i].pBuffer = pCurr->pBuffer;
+        vectors[i].count = pCurr->count * 512;
+        pCurr = pCurr->pNext;
+    }
+    m_mergedRequestCount += requestCount - 1;
+
+    if (pFirst->isWrite)
+    {
+        return writeVectorsThroughSectorCache(vectors, requestCount, pFirst->blockNumber);
+    }
+    return readVectorsThroughSectorCache(vectors, requestCount, pFirst->blockNumber);
+}
+
+int SDFileSystem::startWriteStream(uint32_t blockNumber, uint32_t blockCount)
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
+
+    if (m_status & STA_NOINIT)
+    {
+        LOG_ERROR("startWriteStream(%d,%d) - Attempt to write uninitialized drive\n", blockNumber, blockCount);
+        return RES_NOTRDY;
+    }
+    if (blockCount == 0)
+    {
+        LOG_ERROR("startWriteStream(%d,%d) - Attempt to stream 0 blocks\n", blockNumber, blockCount);
+        return RES_PARERR;
+    }
+
+    // Finish off the transaction of any previous stream before switching to the new one.
+    int result = closeWriteStreamTransaction();
+    if (result != RES_OK)
+    {
+        LOG_ERROR("startWriteStream(%d,%d) - Failed to flush previous stream\n", blockNumber, blockCount);
+        return result;
+    }
+    m_streamBlock = blockNumber;
+    m_streamBlocksLeft = blockCount;
+    m_streamResult = RES_OK;
+    m_isStreamStarted = true;
+    return RES_OK;
+}
+
+int SDFileSystem::writeStream(const uint8_t* pBuffer, uint32_t count)
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
+
+    if (!m_isStreamStarted)
+    {
+        LOG_ERROR("writeStream(%X,%d) - Stream not started\n", pBuffer, count);
+        return RES_PARERR;
+    }
+    if (count == 0 || count > m_streamBlocksLeft)
+    {
+        LOG_ERROR("writeStream(%X,%d) - Attempt to write %d blocks left in stream\n", pBuffer, count, m_streamBlocksLeft);
+        return RES_PARERR;
+    }
+    if (m_streamResult != RES_OK)
+    {
+        LOG_ERROR("writeStream(%X,%d) - Stream failed earlier\n", pBuffer, count);
+        return m_streamResult;
+    }
+
+    // Stream writes are file data so, like multi-block disk_write() calls, they bypass the sector cache but any cached
+    // copies of these blocks are updated to match.
+    uint32_t blockNumber = m_streamBlock;
+    int      result = transmitWriteStreamBlocks(pBuffer, count);
+    if (m_sectorCache.isEnabled())
+    {
+        IoVector vector = { (void*)pBuffer, count * 512 };
+        updateCachedBlocks(&vector, 1, blockNumber, count, result != RES_OK);
+    }
+    return result;
+}
+
+int SDFileSystem::flushWriteStream()
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
+
+    return finishWriteStreamTransaction();
+}
+
+int SDFileSystem::endWriteStream()
+{
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
+
+    // The stream is flushed and reset while still holding the lock so that another thread can't start a new stream
+    // in between and then have it ended here.
+    int result = finishWriteStreamTransaction();
+    m_isStreamStarted = false;
+    m_streamResult = RES_OK;
+    return result;
+}
+
+int SDFileSystem::readBlocks(uint8_t* pBuffer, uint32_t blockNumber, uint32_t count,
+                             uint8_t* pCopy /* = NULL */, size_t copySize /* = 0 */)
+{
+    // Save for the purpose of error logging original parameter values.
+    uint8_t* pOrigBuffer = pBuffer;
+    uint32_t origBlockNumber = blockNumber;
+    uint32_t origCount = count;
+
+    // These variables will throw unused warning when logging is disabled.
+    (void)pOrigBuffer;
+    (void)origBlockNumber;
+    (void)origCount;
+
+    if (m_status & STA_NOINIT)
+    {
+        LOG_ERROR("disk_read(%X,%d,%d) - Attempt to read uninitialized drive\n", pOrigBuffer, origBlockNumber, origCount);
+        return RES_NOTRDY;
+    }
+    if (!count)
+    {
+        LOG_ERROR("disk_read(%X,%d,%d) - Attempt to read 0 blocks\n", pOrigBuffer, origBlockNumber, origCount);
+        return RES_PARERR;
+    }
+
+    // 7.2.3 Data Read - Gives an overview of the single/multi block read process for SPI mode.
+    bool isContinuation = isReadStreamContinuation(blockNumber);
+    if (count == 1 && !isContinuation)
+    {
+        // 7.3.1.3 Detailed Command Description - Refer to note 10 for read/write commands.
+        // SDSC will require converting block number to byte address and high capacity disks use block number as address.
+        uint32_t blockAddress = blockNumber << m_blockToAddressShift;
+
+        // Issue CMD17 to start block read and then process transmitted data block.
+        int response = sendCommandAndReceiveDataBlock(CMD17, blockAddress, pBuffer, 512, pCopy, copySize);
+        if (response != RES_OK)
+        {
+            LOG_ERROR("disk_read(%X,%d,%d) - Read failed\n", pOrigBuffer, origBlockNumber, origCount);
+        }
+        return response;
+    }
+
+    for (uint32_t retry = 1 ; retry <= 3 ; retry++)
+    {
+        // 7.3.1.3 Detailed Command Description - Refer to note 10 for read/write commands.
+        // SDSC will require converting block number to byte address and high capacity disks use block number as address.
+        uint32_t blockAddress = blockNumber << m_blockToAddressShift;
+        uint8_t  r1Response = 0xFF;
+
+        if (isContinuation)
+        {
+            // The card is still selected and waiting to send this block for the CMD18 left open by the last read.
+            isContinuation = false;
+            m_isReadStreamOpen = false;
+            m_readStreamContinueCount++;
+        }
+        else
+        {
+            // select() will stop any open read stream which this read doesn't continue.
+            if (!select())
+            {
+                // Log error error and return immediately.  No need to deselect() again when select() failed.
+                LOG_ERROR("disk_read(%X,%d,%d) - Select timed out\n", pOrigBuffer, origBlockNumber, origCount);
+                return RES_ERROR;
+            }
+
+            // CMD18 is used to start the multi-block read.
+            r1Response = sendCommandAndGetResponse(CMD18, blockAddress);
+            if (r1Response != 0)
+            {
+                LOG_ERROR("disk_read(%X,%d,%d) - CMD18 returned 0x%02X\n",
+                          pOrigBuffer, origBlockNumber, origCount, r1Response);
+                deselect();
+                return RES_ERROR;
+            }
+        }
+
+        // The CRC of each block is verified while the next block is being received via DMA so that the SPI bus
+        // isn't left idle during the CRC calculation. pBuffer, blockNumber, and count are only advanced once a
+        // block's CRC has been verified so that a retry restarts from the first block not successfully read.
+        uint8_t* pReceiveBuffer = pBuffer;
+        uint32_t receiveCount = count;
+        uint16_t pendingCrc = 0;
+        bool     isCrcPending = false;
+        while (count)
+        {
+            SPIDma::Segment receiveSegment = { pReceiveBuffer, 512 };
+            SPIDma::Segment verifySegment = { pBuffer, 512 };
+            bool            isReceiveStarted = false;
+            if (receiveCount > 0)
+            {
+                isReceiveStarted = startReceiveDataBlock(&receiveSegment, 1);
+                if (!isReceiveStarted)
+                {
+                    LOG_ERROR("disk_read(%X,%d,%d) - startReceiveDataBlock failed. block=%d\n",
+                              pOrigBuffer, origBlockNumber, origCount, blockNumber + (isCrcPending ? 1 : 0));
+                }
+            }
+
+            if (isCrcPending)
+            {
+                isCrcPending = false;
+                // Only the first block can be copied out (see disk_read_copy()).
+                bool isFirstBlock = (pBuffer == pOrigBuffer);
+                if (!verifyDataBlockCrc(&verifySegment, 1, pendingCrc,
+                                        isFirstBlock ? pCopy : NULL, isFirstBlock ? copySize : 0))
+                {
+                    LOG_ERROR("disk_read(%X,%d,%d) - verifyDataBlockCrc failed. block=%d\n",
+                              pOrigBuffer, origBlockNumber, origCount, blockNumber);
+                    // Let the block already in flight complete before stopping the read.
+                    if (isReceiveStarted)
+                    {
+                        finishReceiveDataBlock(&receiveSegment, 1, &pendingCrc);
+                    }
+                    // Record maximum number of read retries.
+                    if (retry > m_maximumReadRetryCount)
+                    {
+                        m_maximumReadRetryCount = retry;
+                    }
+                    // Break out of this inner loop and allow outer loop to retry.
+                    break;
+                }
+
+                // Reset retry counter when any read goes through successfully since we only want to fail
+                // when the retry counter is exceeded for a single block.
+                retry = 1;
+                // Advance to next block.
+                pBuffer += 512;
+                blockNumber++;
+                count--;
+            }
+
+            if (receiveCount == 0)
+            {
+                // The last block has now been verified.
+                continue;
+            }
+            if (isReceiveStarted && !finishReceiveDataBlock(&receiveSegment, 1, &pendingCrc))
+            {
+                LOG_ERROR("disk_read(%X,%d,%d) - finishReceiveDataBlock failed. block=%d\n",
+                          pOrigBuffer, origBlockNumber, origCount, blockNumber);
+                isReceiveStarted = false;
+            }
+            if (!isReceiveStarted)
+            {
+                // Record maximum number of read retries.
+                if (retry > m_maximumReadRetryCount)
+                {
+                    m_maximumReadRetryCount = retry;
+                }
+                // Break out of this inner loop and allow outer loop to retry.
+                break;
+            }
+
+            // The CRC for this block will be checked while the next block is being received.
+            isCrcPending = true;
+            pReceiveBuffer += 512;
+            receiveCount--;
+        }
+
+        if (count == 0 && m_readStreamIdleTimeout > 0)
+        {
+            // Leave the CMD18 open so that the next read can continue it if it is sequential.
+            m_isReadStreamOpen = true;
+            m_readStreamBlock = blockNumber;
+            m_readStreamTimer.reset();
+            return RES_OK;
+        }
+
+        // CMD12 is sent to stop the multi-block read and then deselect() at end of multi-block read, error or not.
+        r1Response = sendCommandAndGetResponse(CMD12);
+        deselect();
+        if (r1Response != 0)
+        {
+            LOG_ERROR("disk_read(%X,%d,%d) - CMD12 returned 0x%02X\n",
+                      pOrigBuffer, origBlockNumber, origCount, r1Response);
+            return RES_ERROR;
+        }
+
+        if (count == 0)
+        {
+            // Have successfully completed the read.
+            return RES_OK;
+        }
+    }
+
+    // Get here if we have run out of retries so return an error back to the caller.
+    return RES_ERROR;
+}
+
+bool SDFileSystem::isReadStreamContinuation(uint32_t blockNumber)
+{
+    if (!m_isReadStreamOpen || blockNumber != m_readStreamBlock)
+    {
+        return false;
+    }
+    return (uint32_t)m_readStreamTimer.read_ms() <= m_readStreamIdleTimeout;
+}
+
+int SDFileSystem::closeReadStream()
+{
+    if (!m_isReadStreamOpen)
+    {
+        return RES_OK;
+    }
+    m_isReadStreamOpen = false;
+
+    // CMD12 is sent to stop the multi-block read and then deselect() since the card was left selected.
+    uint8_t r1Response = sendCommandAndGetResponse(CMD12);
+    deselect();
+    if (r1Response != 0)
+    {
+        LOG_ERROR("closeReadStream() - CMD12 returned 0x%02X. block=%d\n", r1Response, m_readStreamBlock);
+        return RES_ERROR;
+    }
+    return RES_OK;
+}
+
+int SDFileSystem::writeBlocks(const uint8_t* pBuffer, uint32_t blockNumber, uint32_t count)
+{
+    // Save for the purpose of error logging original parameter values.
+    uint32_t origCount = count;
+    uint32_t origBlockNumber = blockNumber;
+    const uint8_t* pOrigBuffer = pBuffer;
+
+    // These variables will throw unused warning when logging is disabled.
+    (void)origBlockNumber;
+    (void)pOrigBuffer;
+
+    if (m_status & STA_NOINIT)
+    {
+        LOG_ERROR("disk_write(%X,%d,%d) - Attempt to write uninitialized drive\n", pOrigBuffer, origBlockNumber, origCount);
+        return RES_NOTRDY;
+    }
+    if (!count)
+    {
+        LOG_ERROR("disk_write(%X,%d,%d) - Attempt to write 0 blocks\n", pOrigBuffer, origBlockNumber, origCount);
+        return RES_PARERR;
+    }
+
+    // 7.2.4 Data Write - Gives an overview of the single/multi block write process for SPI mode.
+    for (uint32_t retry = 1 ; retry <= 3 ; retry++)
+    {
+        // 7.3.1.3 Detailed Command Description - Refer to note 10 for read/write commands.
+        // SDSC will require converting block number to byte address and high capacity disks use block number as address.
+        uint32_t blockAddress = blockNumber << m_blockToAddressShift;
+        uint8_t  r1Response = 0xFF;
+        if (origCount == 1)
+        {
+            if (!select())
+            {
+                LOG_ERROR("disk_write(%X,%d,%d) - Select timed out\n", pOrigBuffer, origBlockNumber, origCount);
+                return RES_ERROR;
+            }
+
+            // CMD24 is used to start single block write.
+            uint8_t r1Response = sendCommandAndGetResponse(CMD24, blockAddress);
+            if (r1Response != 0)
+            {
+                LOG_ERROR("disk_write(%X,%d,%d) - CMD24 returned 0x%02X\n", pOrigBuffer, origBlockNumber, origCount, r1Response);
+                deselect();
+                return RES_ERROR;
+            }
+
+            SPIDma::Segment segment = { (void*)pBuffer, 512 };
+            uint8_t         dataResponse = transmitDataBlock(BLOCK_START, &segment, 1);
+            if (dataResponse != DATA_RESPONSE_DATA_ACCEPTED)
+            {
+                LOG_ERROR("disk_write(%X,%d,%d) - transmitDataBlock failed\n", pOrigBuffer, origBlockNumber, origCount);
+                // Record if this was the maximum number of write attempts we have made for a single block.
+                if (retry > m_maximumWriteRetryCount)
+                {
+                    m_maximumWriteRetryCount = retry;
+                }
+                // Encountered error while transmitting data block so try again.
+                deselect();
+                continue;
+            }
+        }
+        else
+        {
+            // 4.3.4 Data Write - ACMD23 can be used before CMD25 to indicate how many blocks should be pre-erased to
+            //                    improve multi-block write performance.
+            cmd(ACMD23, count & 0x07FFFF);
+
+            if (!select())
+            {
+                LOG_ERROR("disk_write(%X,%d,%d) - Select timed out\n", pOrigBuffer, origBlockNumber, origCount);
+                return RES_ERROR;
+            }
+
+            // CMD25 is used to start multi block write.
+            r1Response = sendCommandAndGetResponse(CMD25, blockAddress);
+            if (r1Response != 0)
+            {
+                LOG_ERROR("disk_write(%X,%d,%d) - CMD25 returned 0x%02X\n", pOrigBuffer, origBlockNumber, origCount, r1Response);
+                deselect();
+                return RES_ERROR;
+            }
+
+            // Loop through and send each block to the card.
+            // The writes are pipelined so that the CRC for the next block is calculated while the current block is
+            // being sent via DMA. Only the CRC for the first block needs to be calculated up front.
+            const uint8_t* pStartBuffer = pBuffer;
+            uint32_t startBlockNumber = blockNumber;
+            uint32_t startCount = count;
+            uint16_t crc = SDCRC::crc16(pBuffer, 512);
+            while (count)
+            {
+                SPIDma::Segment segment = { (void*)pBuffer, 512 };
+                const uint8_t*  pNextBuffer = (count > 1) ? pBuffer + 512 : NULL;
+                uint16_t        nextCrc = 0;
+                uint8_t dataResponse = transmitDataBlock(MULTIPLE_BLOCK_START, &segment, 1, &crc, pNextBuffer, &nextCrc);
+                if (dataResponse != DATA_RESPONSE_DATA_ACCEPTED)
+                {
+                    LOG_ERROR("disk_write(%X,%d,%d) - transmitDataBlock failed. block=%d\n",
+                               pOrigBuffer, origBlockNumber, origCount, blockNumber);
+
+                    // Record if this was the maximum number of write attempts we have made for a single block.
+                    if (retry > m_maximumWriteRetryCount)
+                    {
+                        m_maximumWriteRetryCount = retry;
+                    }
+
+                    // 7.3.3.1 Data Response Token - Send CMD12 to stop write when an error data response token is
+                    //                               returned.
+                    deselect();
+                    cmd(12);
+
+                    // 7.3.3.1 Data Response Token - Send ACMD22 on write error to determine number of
+                    //                               successful writes.
+                    if (dataResponse == DATA_RESPONSE_WRITE_ERROR)
+                    {
+                        // Determine number of blocks that were successfully written.
+                        uint32_t blocksWritten = 0;
+                        int result = getWrittenBlockCount(&blocksWritten);
+                        if (result != RES_OK)
+                        {
+                            LOG_ERROR("disk_write(%X,%d,%d) - Failed to retrieve written block count.\n",
+                                       pOrigBuffer, origBlockNumber, origCount);
+                            return result;
+                        }
+
+                        // If the returned count is too large then default to no blocks being written successfully.
+                        if (blocksWritten > startCount)
+                        {
+                            blocksWritten = 0;
+                        }
+
+                        // Rewind to first block that needs to be retried.
+                        pBuffer = pStartBuffer + 512 * blocksWritten;
+                        blockNumber = startBlockNumber + blocksWritten;
+                        count = startCount - blocksWritten;
+                    }
+
+                    // Break out of this inner loop so that we can retry from the outer loop.
+                    break;
+                }
+
+                // Reset retry counter when any write goes through successfully since we only want to fail
+                // when the retry counter is exceeded for a single block.
+                retry = 1;
+
+                // Advance to next block.
+                pBuffer += 512;
                 blockNumber++;
                 count--;
+                crc = nextCrc;
+            }
+
+            if (count == 0)
+            {
+                // Send stop transmission token.
+                transmitDataBlock(MULTIPLE_BLOCK_STOP, NULL, 0);
+            }
+            else
+            {
+                // Still have blocks that need to be sent so retry.
+                continue;
+            }
+        }
+
+        // 7.2.4 Data Write - Validate write by issuing CMD13 to get current card status.
+        uint32_t cardStatus = 0;
+        deselect();
+        if (isWriteStatusCheckDeferred())
+        {
+            // Write was accepted and its status will be checked by a later write or disk_sync().
+            return RES_OK;
+        }
+        r1Response = getCardStatus(&cardStatus);
+        if (r1Response != 0)
+        {
+            LOG_ERROR("disk_write(%X,%d,%d) - CMD13 failed. r1Response=0x%02X\n",
+                      pOrigBuffer, origBlockNumber, origCount, r1Response);
+            return writeStatusError();
+        }
+        if (cardStatus != 0)
+        {
+            LOG_ERROR("disk_write(%X,%d,%d) - CMD13 failed. Status=0x%02X\n",
+                      pOrigBuffer, origBlockNumber, origCount, cardStatus);
+            return writeStatusError();
+        }
+
+        // Write was successful.
+        return RES_OK;
+    }
+
+    return RES_ERROR;
+}
+
+int SDFileSystem::readVectors(const IoVector* pVectors, size_t vectorCount, uint32_t blockNumber)
+{
+    // Save for the purpose of error logging original parameter values.
+    uint32_t origBlockNumber = blockNumber;
+
+    // This variable will throw unused warning when logging is disabled.
+    (void)origBlockNumber;
+
+    if (m_status & STA_NOINIT)
+    {
+        LOG_ERROR("disk_readv(%X,%d,%d) - Attempt to read uninitialized drive\n", pVectors, vectorCount, origBlockNumber);
+        return RES_NOTRDY;
+    }
+    uint32_t count = 0;
+    if (!validateVectors(pVectors, vectorCount, &count))
+    {
+        LOG_ERROR("disk_readv(%X,%d,%d) - Invalid vectors\n", pVectors, vectorCount, origBlockNumber);
+        return RES_PARERR;
+    }
+
+    // 7.2.3 Data Read - Gives an overview of the single/multi block read process for SPI mode.
+    // blockIndex is only advanced once a block has been successfully received so that a retry restarts from the first
+    // block not successfully read.
+    uint32_t blockIndex = 0;
+    for (uint32_t retry = 1 ; retry <= 3 ; retry++)
+    {
+        // 7.3.1.3 Detailed Command Description - Refer to note 10 for read/write commands.
+        // SDSC will require converting block number to byte address and high capacity disks use block number as address.
+        uint32_t blockAddress = (blockNumber + blockIndex) << m_blockToAddressShift;
+        uint8_t  readCmd = (count - blockIndex > 1) ? CMD18 : CMD17;
+
+        if (!select())
+        {
+            // Log error error and return immediately.  No need to deselect() again when select() failed.
+            LOG_ERROR("disk_readv(%X,%d,%d) - Select timed out\n", pVectors, vectorCount, origBlockNumber);
+            return RES_ERROR;
+        }
+
+        // CMD17 is used to read a single block and CMD18 to start a multi-block read.
+        uint8_t r1Response = sendCommandAndGetResponse(readCmd, blockAddress);
+        if (r1Response != 0)
+        {
+            LOG_ERROR("disk_readv(%X,%d,%d) - %s returned 0x%02X\n",
+                      pVectors, vectorCount, origBlockNumber, cmdToString(readCmd), r1Response);
+            deselect();
+            return RES_ERROR;
+        }
+
+        while (blockIndex < count)
+        {
+            // Each block is received straight into the vector buffers which it overlaps.
+            SPIDma::Segment segments[SPIDMA_MAX_SEGMENTS];
+            size_t          segmentCount = getBlockSegments(pVectors, vectorCount, blockIndex, segments);
+            if (!receiveDataBlock(segments, segmentCount))
+            {
+                LOG_ERROR("disk_readv(%X,%d,%d) - receiveDataBlock failed. block=%d\n",
+                          pVectors, vectorCount, origBlockNumber, blockNumber + blockIndex);
+                // Record maximum number of read retries.
+                if (retry > m_maximumReadRetryCount)
+                {
+                    m_maximumReadRetryCount = retry;
+                }
+                // Break out of this inner loop and allow outer loop to retry.
+                break;
             }
 
-            if (count == 0)
+            // Reset retry counter when any read goes through successfully since we only want to fail
+            // when the retry counter is exceeded for a single block.
+            retry = 1;
+            blockIndex++;
+            if (readCmd == CMD17)
             {
-                // Send stop transmission token.
-                transmitDataBlock(MULTIPLE_BLOCK_STOP, NULL, 0);
+                break;
             }
-            else
+        }
+
+        if (readCmd == CMD18)
+        {
+            // CMD12 is sent to stop the multi-block read, error or not.
+            r1Response = sendCommandAndGetResponse(CMD12);
+            if (r1Response != 0)
             {
-                // Still have blocks that need to be sent so retry.
-                continue;
+                LOG_ERROR("disk_readv(%X,%d,%d) - CMD12 returned 0x%02X\n",
+                          pVectors, vectorCount, origBlockNumber, r1Response);
+                deselect();
+                return RES_ERROR;
+            }
+        }
+        deselect();
+
+        if (blockIndex == count)
+        {
+            // Have successfully completed the read.
+            return RES_OK;
+        }
+    }
+
+    // Get here if we have run out of retries so return an error back to the caller.
+    return RES_ERROR;
+}
+
+int SDFileSystem::writeVectors(const IoVector* pVectors, size_t vectorCount, uint32_t blockNumber)
+{
+    // Save for the purpose of error logging original parameter values.
+    uint32_t origBlockNumber = blockNumber;
+
+    // This variable will throw unused warning when logging is disabled.
+    (void)origBlockNumber;
+
+    if (m_status & STA_NOINIT)
+    {
+        LOG_ERROR("disk_writev(%X,%d,%d) - Attempt to write uninitialized drive\n", pVectors, vectorCount, origBlockNumber);
+        return RES_NOTRDY;
+    }
+    uint32_t count = 0;
+    if (!validateVectors(pVectors, vectorCount, &count))
+    {
+        LOG_ERROR("disk_writev(%X,%d,%d) - Invalid vectors\n", pVectors, vectorCount, origBlockNumber);
+        return RES_PARERR;
+    }
+
+    // 7.2.4 Data Write - Gives an overview of the multi block write process for SPI mode.
+    // CMD25 is used even for a single block so that there is only one write path to maintain for vectored writes.
+    uint32_t blockIndex = 0;
+    for (uint32_t retry = 1 ; retry <= 3 ; retry++)
+    {
+        // 7.3.1.3 Detailed Command Description - Refer to note 10 for read/write commands.
+        // SDSC will require converting block number to byte address and high capacity disks use block number as address.
+        uint32_t blockAddress = (blockNumber + blockIndex) << m_blockToAddressShift;
+        uint32_t startIndex = blockIndex;
+        uint32_t startCount = count - blockIndex;
+
+        // 4.3.4 Data Write - ACMD23 can be used before CMD25 to indicate how many blocks should be pre-erased to
+        //                    improve multi-block write performance.
+        cmd(ACMD23, startCount & 0x07FFFF);
+
+        if (!select())
+        {
+            LOG_ERROR("disk_writev(%X,%d,%d) - Select timed out\n", pVectors, vectorCount, origBlockNumber);
+            return RES_ERROR;
+        }
+
+        // CMD25 is used to start multi block write.
+        uint8_t r1Response = sendCommandAndGetResponse(CMD25, blockAddress);
+        if (r1Response != 0)
+        {
+            LOG_ERROR("disk_writev(%X,%d,%d) - CMD25 returned 0x%02X\n", pVectors, vectorCount, origBlockNumber, r1Response);
+            deselect();
+            return RES_ERROR;
+        }
+
+        // Loop through and send each block to the card straight from the vector buffers which it overlaps.
+        while (blockIndex < count)
+        {
+            SPIDma::Segment segments[SPIDMA_MAX_SEGMENTS];
+            size_t          segmentCount = getBlockSegments(pVectors, vectorCount, blockIndex, segments);
+            uint8_t         dataResponse = transmitDataBlock(MULTIPLE_BLOCK_START, segments, segmentCount);
+            if (dataResponse != DATA_RESPONSE_DATA_ACCEPTED)
+            {
+                LOG_ERROR("disk_writev(%X,%d,%d) - transmitDataBlock failed. block=%d\n",
+                           pVectors, vectorCount, origBlockNumber, blockNumber + blockIndex);
+
+                // Record if this was the maximum number of write attempts we have made for a single block.
+                if (retry > m_maximumWriteRetryCount)
+                {
+                    m_maximumWriteRetryCount = retry;
+                }
+
+                // 7.3.3.1 Data Response Token - Send CMD12 to stop write when an error data response token is
+                //                               returned.
+                deselect();
+                cmd(12);
+
+                // 7.3.3.1 Data Response Token - Send ACMD22 on write error to determine number of
+                //                               successful writes.
+                if (dataResponse == DATA_RESPONSE_WRITE_ERROR)
+                {
+                    uint32_t blocksWritten = 0;
+                    int result = getWrittenBlockCount(&blocksWritten);
+                    if (result != RES_OK)
+                    {
+                        LOG_ERROR("disk_writev(%X,%d,%d) - Failed to retrieve written block count.\n",
+                                   pVectors, vectorCount, origBlockNumber);
+                        return result;
+                    }
+
+                    // If the returned count is too large then default to no blocks being written successfully.
+                    if (blocksWritten > startCount)
+                    {
+                        blocksWritten = 0;
+                    }
+
+                    // Rewind to first block that needs to be retried.
+                    blockIndex = startIndex + blocksWritten;
+                }
+
+                // Break out of this inner loop so that we can retry from the outer loop.
+                break;
             }
+
+            // Reset retry counter when any write goes through successfully since we only want to fail
+            // when the retry counter is exceeded for a single block.
+            retry = 1;
+            blockIndex++;
+        }
+
+        if (blockIndex < count)
+        {
+            // Still have blocks that need to be sent so retry.
+            continue;
         }
 
+        // Send stop transmission token.
+        transmitDataBlock(MULTIPLE_BLOCK_STOP, NULL, 0);
+
         // 7.2.4 Data Write - Validate write by issuing CMD13 to get current card status.
         uint32_t cardStatus = 0;
         deselect();
-        r1Response = cmd(CMD13, 0, &cardStatus);
+        if (isWriteStatusCheckDeferred())
+        {
+            // Write was accepted and its status will be checked by a later write or disk_sync().
+            return RES_OK;
+        }
+        r1Response = getCardStatus(&cardStatus);
         if (r1Response != 0)
         {
-            LOG_ERROR("disk_write(%X,%d,%d) - CMD13 failed. r1Response=0x%02X\n",
-                      pOrigBuffer, origBlockNumber, origCount, r1Response);
-            return RES_ERROR;
+            LOG_ERROR("disk_writev(%X,%d,%d) - CMD13 failed. r1Response=0x%02X\n",
+                      pVectors, vectorCount, origBlockNumber, r1Response);
+            return writeStatusError();
         }
         if (cardStatus != 0)
         {
-            LOG_ERROR("disk_write(%X,%d,%d) - CMD13 failed. Status=0x%02X\n",
-                      pOrigBuffer, origBlockNumber, origCount, cardStatus);
-            return RES_ERROR;
+            LOG_ERROR("disk_writev(%X,%d,%d) - CMD13 failed. Status=0x%02X\n",
+                      pVectors, vectorCount, origBlockNumber, cardStatus);
+            return writeStatusError();
         }
 
         // Write was successful.
@@ -623,10 +1629,198 @@ int SDFileSystem::disk_write(const uint8_t* pBuffer, uint32_t blockNumber, uint3
     return RES_ERROR;
 }
 
+int SDFileSystem::openWriteStreamTransaction()
+{
+    // 4.3.4 Data Write - All of the blocks left in the stream are going to be written so have the card pre-erase them.
+    cmd(ACMD23, m_streamBlocksLeft & 0x07FFFF);
+
+    if (!select())
+    {
+        LOG_ERROR("writeStream() - Select timed out\n");
+        return RES_ERROR;
+    }
+
+    // CMD25 is used to start multi block write.
+    uint8_t r1Response = sendCommandAndGetResponse(CMD25, m_streamBlock << m_blockToAddressShift);
+    if (r1Response != 0)
+    {
+        LOG_ERROR("writeStream() - CMD25 returned 0x%02X. block=%d\n", r1Response, m_streamBlock);
+        deselect();
+        return RES_ERROR;
+    }
+
+    m_isStreamTransactionOpen = true;
+    m_streamTransactionBlocks = 0;
+    m_writeStreamTransactionCount++;
+    return RES_OK;
+}
+
+int SDFileSystem::closeWriteStreamTransaction()
+{
+    if (!m_isStreamTransactionOpen)
+    {
+        return RES_OK;
+    }
+    m_isStreamTransactionOpen = false;
+
+    // Send stop transmission token.
+    transmitDataBlock(MULTIPLE_BLOCK_STOP, NULL, 0);
+
+    // 7.2.4 Data Write - Validate write by issuing CMD13 to get current card status. This also covers any writes
+    //                   which skipped their own CMD13.
+    uint32_t cardStatus = 0;
+    deselect();
+    m_uncheckedWriteCount = 0;
+    uint8_t r1Response = getCardStatus(&cardStatus);
+    if (r1Response != 0)
+    {
+        LOG_ERROR("flushWriteStream() - CMD13 failed. r1Response=0x%02X\n", r1Response);
+        return writeStatusError();
+    }
+    if (cardStatus != 0)
+    {
+        LOG_ERROR("flushWriteStream() - CMD13 failed. Status=0x%02X\n", cardStatus);
+        return writeStatusError();
+    }
+    return RES_OK;
+}
+
+int SDFileSystem::finishWriteStreamTransaction()
+{
+    int result = closeWriteStreamTransaction();
+    if (result != RES_OK)
+    {
+        LOG_ERROR("flushWriteStream() - Failed to stop write transaction\n");
+        return result;
+    }
+    return m_streamResult;
+}
+
+int SDFileSystem::transmitWriteStreamBlocks(const uint8_t* pBuffer, uint32_t count)
+{
+    // Save for the purpose of error logging original parameter values.
+    uint32_t origCount = count;
+    const uint8_t* pOrigBuffer = pBuffer;
+
+    // These variables will throw unused warning when logging is disabled.
+    (void)origCount;
+    (void)pOrigBuffer;
+
+    for (uint32_t retry = 1 ; retry <= 3 ; retry++)
+    {
+        if (!m_isStreamTransactionOpen)
+        {
+            int result = openWriteStreamTransaction();
+            if (result != RES_OK)
+            {
+                return result;
+            }
+        }
+
+        // Loop through and send each block to the card, pipelined the same way as in writeBlocks().
+        uint32_t sentCount = 0;
+        uint16_t crc = SDCRC::crc16(pBuffer, 512);
+        while (count)
+        {
+            SPIDma::Segment segment = { (void*)pBuffer, 512 };
+            const uint8_t*  pNextBuffer = (count > 1) ? pBuffer + 512 : NULL;
+            uint16_t        nextCrc = 0;
+            uint8_t dataResponse = transmitDataBlock(MULTIPLE_BLOCK_START, &segment, 1, &crc, pNextBuffer, &nextCrc);
+            if (dataResponse != DATA_RESPONSE_DATA_ACCEPTED)
+            {
+                LOG_ERROR("writeStream(%X,%d) - transmitDataBlock failed. block=%d\n",
+                           pOrigBuffer, origCount, m_streamBlock);
+
+                // Record if this was the maximum number of write attempts we have made for a single block.
+                if (retry > m_maximumWriteRetryCount)
+                {
+                    m_maximumWriteRetryCount = retry;
+                }
+
+                // 7.3.3.1 Data Response Token - Send CMD12 to stop write when an error data response token is
+                //                               returned.
+                m_isStreamTransactionOpen = false;
+                deselect();
+                cmd(CMD12);
+
+                // 7.3.3.1 Data Response Token - Send ACMD22 on write error to determine number of
+                //                               successful writes.
+                if (dataResponse == DATA_RESPONSE_WRITE_ERROR)
+                {
+                    // Determine number of blocks that were successfully written.
+                    uint32_t blocksWritten = 0;
+                    int result = getWrittenBlockCount(&blocksWritten);
+                    if (result != RES_OK)
+                    {
+                        LOG_ERROR("writeStream(%X,%d) - Failed to retrieve written block count.\n",
+                                   pOrigBuffer, origCount);
+                        return result;
+                    }
+
+                    // If the returned count is too large then default to no blocks being written successfully.
+                    if (blocksWritten > m_streamTransactionBlocks)
+                    {
+                        blocksWritten = 0;
+                    }
+
+                    // Blocks sent by earlier writeStream() calls in this transaction can't be resent since the caller
+                    // has already reused those buffers.
+                    uint32_t earlierCount = m_streamTransactionBlocks - sentCount;
+                    if (blocksWritten < earlierCount)
+                    {
+                        LOG_ERROR("writeStream(%X,%d) - Lost %d blocks from earlier writes\n",
+                                   pOrigBuffer, origCount, earlierCount - blocksWritten);
+                        return RES_ERROR;
+                    }
+
+                    // Rewind to first block that needs to be retried.
+                    uint32_t rewindCount = m_streamTransactionBlocks - blocksWritten;
+                    pBuffer -= 512 * rewindCount;
+                    count += rewindCount;
+                    m_streamBlock -= rewindCount;
+                    m_streamBlocksLeft += rewindCount;
+                }
+
+                // Break out of this inner loop so that we can retry from the outer loop.
+                break;
+            }
+
+            // Reset retry counter when any write goes through successfully since we only want to fail
+            // when the retry counter is exceeded for a single block.
+            retry = 1;
+
+            // Advance to next block.
+            pBuffer += 512;
+            count--;
+            sentCount++;
+            m_streamBlock++;
+            m_streamBlocksLeft--;
+            m_streamTransactionBlocks++;
+            crc = nextCrc;
+        }
+
+        if (count == 0)
+        {
+            // The transaction is left open for the next writeStream() call.
+            return RES_OK;
+        }
+    }
+
+    return RES_ERROR;
+}
+
 int SDFileSystem::disk_sync()
 {
-    // Makes sure that only 1 thread is attempting to use the SDFileSystem.
-    SingleThreadedCheck check;
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
+
+    // Write back any dirty sectors held in the sector cache.
+    int result = flushSectorCache();
+    if (result != RES_OK)
+    {
+        LOG_ERROR("disk_sync() - Failed to flush sector cache\n");
+        return result;
+    }
 
     // Calling select() will assert chip select low and wait for any outstanding writes to leave busy state before
     // returning or timing out.
@@ -636,12 +1830,67 @@ int SDFileSystem::disk_sync()
         return RES_ERROR;
     }
     deselect();
+
+    // Check the status of any writes which skipped CMD13 and report any failure found since the last disk_sync().
+    checkDeferredWriteStatus();
+    result = m_writeStatusResult;
+    m_writeStatusResult = RES_OK;
+    if (result != RES_OK)
+    {
+        LOG_ERROR("disk_sync() - Deferred write status check failed\n");
+    }
+    return result;
+}
+
+bool SDFileSystem::isWriteStatusCheckDeferred()
+{
+    if (++m_uncheckedWriteCount < m_writeStatusCheckInterval)
+    {
+        return true;
+    }
+    // The CMD13 about to be issued covers all of the writes since the last check.
+    m_uncheckedWriteCount = 0;
+    return false;
+}
+
+int SDFileSystem::checkDeferredWriteStatus()
+{
+    if (m_uncheckedWriteCount == 0)
+    {
+        return RES_OK;
+    }
+    m_uncheckedWriteCount = 0;
+
+    // The error bits in the card status are only cleared when read so this covers all of the unchecked writes.
+    uint32_t cardStatus = 0;
+    uint8_t  r1Response = getCardStatus(&cardStatus);
+    if (r1Response != 0)
+    {
+        LOG_ERROR("checkDeferredWriteStatus() - CMD13 failed. r1Response=0x%02X\n", r1Response);
+        return writeStatusError();
+    }
+    if (cardStatus != 0)
+    {
+        LOG_ERROR("checkDeferredWriteStatus() - CMD13 failed. Status=0x%02X\n", cardStatus);
+        return writeStatusError();
+    }
     return RES_OK;
 }
 
+int SDFileSystem::writeStatusError()
+{
+    // When writes skip CMD13, a failed status check may belong to an earlier write which has already returned
+    // success so the failure is also held for the next disk_sync() to report.
+    if (m_writeStatusCheckInterval > 1)
+    {
+        m_writeStatusResult = RES_ERROR;
+    }
+    return RES_ERROR;
+}
+
 uint32_t SDFileSystem::disk_sectors()
 {
-    // Don't need to use SingleThreadedCheck here as the call to getCSD() will perform the necessary check.
+    // Don't need to use ExclusiveAccess here as the call to getCSD() will perform the necessary check.
 
     if (m_status & STA_NOINIT)
     {
@@ -678,8 +1927,8 @@ uint32_t SDFileSystem::disk_sectors()
 
 int SDFileSystem::getCID(uint8_t* pCID, size_t cidSize)
 {
-    // Makes sure that only 1 thread is attempting to use the SDFileSystem.
-    SingleThreadedCheck check;
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
 
     // CID register is 16 bytes in length.
     assert ( cidSize == 16 );
@@ -695,8 +1944,8 @@ int SDFileSystem::getCID(uint8_t* pCID, size_t cidSize)
 
 int SDFileSystem::getCSD(uint8_t* pCSD, size_t csdSize)
 {
-    // Makes sure that only 1 thread is attempting to use the SDFileSystem.
-    SingleThreadedCheck check;
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
 
     // CSD register is 16 bytes in length.
     assert ( csdSize == 16 );
@@ -712,8 +1961,8 @@ int SDFileSystem::getCSD(uint8_t* pCSD, size_t csdSize)
 
 int SDFileSystem::getOCR(uint32_t* pOCR)
 {
-    // Makes sure that only 1 thread is attempting to use the SDFileSystem.
-    SingleThreadedCheck check;
+    // Makes sure that only 1 thread is using the SDFileSystem at a time.
+    ExclusiveAccess access(this);
 
     uint8_t r1Response = cmd(CMD58, 0, pOCR);
     if (r1Response & R1_ERRORS_MASK)
@@ -747,22 +1996,111 @@ uint32_t SDFileSystem::extractBits(const uint8_t* p, size_t size, uint32_t lowBi
         }
         uint32_t byteMask = (1 << bitsLeft) - 1;
 
-        val |= ((p[i] >> bitSrcOffset) & byteMask) << bitDestOffset;
+        val |= ((p[i] >> bitSrcOffset) & byteMask) << bitDestOffset;
+
+        bitSrcOffset = 0;
+        bitDestOffset += bitsFromByte;
+        bitsLeft -= bitsFromByte;
+    }
+    assert ( bitsLeft == 0 );
+
+    return val;
+}
+
+
+
+
+uint32_t SDFileSystem::negotiateFrequency()
+{
+    if (m_maximumFrequency <= SDFILESYSTEM_DEFAULT_SPEED_FREQUENCY)
+    {
+        return m_maximumFrequency;
+    }
+    if (!switchToHighSpeed())
+    {
+        return SDFILESYSTEM_DEFAULT_SPEED_FREQUENCY;
+    }
+    if (m_maximumFrequency > SDFILESYSTEM_HIGH_SPEED_FREQUENCY)
+    {
+        return SDFILESYSTEM_HIGH_SPEED_FREQUENCY;
+    }
+    return m_maximumFrequency;
+}
+
+bool SDFileSystem::switchToHighSpeed()
+{
+    // 5.3.2 CSD Register - Cards which support CMD6 set bit 10 of the CCC (card command classes) field.
+    uint8_t csd[16];
+    int result = sendCommandAndReceiveDataBlock(CMD9, 0, csd, sizeof(csd));
+    if (result != RES_OK)
+    {
+        LOG_ERROR("switchToHighSpeed() - CSD read failed\n");
+        return false;
+    }
+    if (extractBits(csd, sizeof(csd), 84 + 10, 84 + 10) == 0)
+    {
+        return false;
+    }
 
-        bitSrcOffset = 0;
-        bitDestOffset += bitsFromByte;
-        bitsLeft -= bitsFromByte;
+    // 4.3.10 Switch Function Command - Check (mode 0) if High-Speed is supported before switching to it (mode 1).
+    // 4.3.10.4 Switch Function Status - Bits 415:400 are the functions supported by group 1 and bits 379:376 are
+    //                                   the function which was (or would be) selected for group 1.
+    uint8_t status[64];
+    result = sendCommandAndReceiveDataBlock(CMD6, CMD6_CHECK_HIGH_SPEED, status, sizeof(status));
+    if (result != RES_OK)
+    {
+        LOG_ERROR("switchToHighSpeed() - CMD6 check failed\n");
+        return false;
+    }
+    if (extractBits(status, sizeof(status), 401, 401) == 0 || extractBits(status, sizeof(status), 376, 379) != 1)
+    {
+        return false;
+    }
+    result = sendCommandAndReceiveDataBlock(CMD6, CMD6_SWITCH_HIGH_SPEED, status, sizeof(status));
+    if (result != RES_OK)
+    {
+        LOG_ERROR("switchToHighSpeed() - CMD6 switch failed\n");
+        return false;
+    }
+    uint32_t function = extractBits(status, sizeof(status), 376, 379);
+    if (function != 1)
+    {
+        LOG_ERROR("switchToHighSpeed() - CMD6 switch selected function 0x%X\n", function);
+        return false;
     }
-    assert ( bitsLeft == 0 );
 
-    return val;
+    return true;
 }
 
+void SDFileSystem::recordCrcError()
+{
+    // Occasional CRC errors are handled by retries but a burst of them probably means that the SPI clock is too fast
+    // for this card or its wiring so drop to half the clock rate.
+    if (m_crcErrorBurstCount == 0 || (uint32_t)m_crcErrorTimer.read_ms() > SDFILESYSTEM_CRC_FALLBACK_WINDOW_MS)
+    {
+        m_crcErrorBurstCount = 0;
+        m_crcErrorTimer.reset();
+        m_crcErrorTimer.start();
+    }
+    if (++m_crcErrorBurstCount < SDFILESYSTEM_CRC_FALLBACK_ERRORS)
+    {
+        return;
+    }
+    m_crcErrorBurstCount = 0;
 
-
+    uint32_t fallbackFrequency = m_currentFrequency / 2;
+    if (fallbackFrequency < SDFILESYSTEM_MINIMUM_FREQUENCY)
+    {
+        return;
+    }
+    LOG_ERROR("recordCrcError() - Falling back from %dHz to %dHz\n", m_currentFrequency, fallbackFrequency);
+    m_frequencyFallbackCount++;
+    setCurrentFrequency(fallbackFrequency);
+}
 
 void SDFileSystem::setCurrentFrequency(uint32_t spiFrequency)
 {
+    m_currentFrequency = spiFrequency;
     // It takes 8 spi clock cycles per byte exchanged.
     m_spiBytesPerSecond = spiFrequency / 8;
 
@@ -786,24 +2124,45 @@ uint8_t SDFileSystem::cmd(uint8_t cmd, uint32_t argument /* = 0 */, uint32_t* pR
     return response;
 }
 
-const char* SDFileSystem::cmdToString(uint8_t cmd)
+uint8_t SDFileSystem::getCardStatus(uint32_t* pCardStatus)
 {
-    static char cmdString[7];
+    LATENCY_START(startUs);
+    uint8_t response = cmd(CMD13, 0, pCardStatus);
+    LATENCY_RECORD_SINCE(statusCheck, startUs);
+
+    return response;
+}
 
+const char* SDFileSystem::cmdToString(uint8_t cmd)
+{
+    // Format into a per instance buffer so that cards on different buses can log errors at the same time.
     if (cmd & ACMD_BIT)
     {
-        snprintf(cmdString, sizeof(cmdString), "ACMD%d", cmd & ~ACMD_BIT);
+        snprintf(m_cmdString, sizeof(m_cmdString), "ACMD%d", cmd & ~ACMD_BIT);
     }
     else
     {
-        snprintf(cmdString, sizeof(cmdString), "CMD%d", cmd);
+        snprintf(m_cmdString, sizeof(m_cmdString), "CMD%d", cmd);
     }
 
-    return cmdString;
+    return m_cmdString;
 }
 
 bool SDFileSystem::select()
 {
+    // Any other command ends the CMD18 left open by a read stream. The blocks read through it were already verified
+    // so a failure of the CMD12 only needs to be logged.
+    closeReadStream();
+    // Any other command ends the CMD25 left open by a write stream. Errors are returned by the next stream call.
+    if (m_isStreamTransactionOpen)
+    {
+        int result = closeWriteStreamTransaction();
+        if (result != RES_OK)
+        {
+            m_streamResult = result;
+        }
+    }
+
     // 7.2 SPI Bus Protocol - Prepare to start sending next command to SD card.
     // Assert chip select low before starting to send any command.
     m_spi.setChipSelect(LOW);
@@ -819,7 +2178,10 @@ bool SDFileSystem::select()
     }
 
     // Wait for card to exit busy state.
-    if (!waitWhileBusy(m_spiBytesPerSecond / 2))
+    uint32_t elapsedUs;
+    bool     isReady = waitWhileBusy(m_spiBytesPerSecond / 2, &elapsedUs);
+    LATENCY_RECORD(selectWait, elapsedUs);
+    if (!isReady)
     {
         // Card never left busy state after 500 msecs.
         LOG_ERROR("select() - 500 msec time out\n");
@@ -830,20 +2192,14 @@ bool SDFileSystem::select()
     return true;
 }
 
-bool SDFileSystem::waitWhileBusy(uint32_t maxSpiExchanges)
+bool SDFileSystem::waitWhileBusy(uint32_t maxSpiExchanges, uint32_t* pElapsedUs)
 {
     // 7.2.4 Data Write - Card will keep MISO asserted low while it is busy. Will receive 0xFF once it is no longer
     //                    in busy state.
-    uint32_t iteration = 0;
-    uint8_t  response;
-    do
-    {
-        response = m_spi.exchange(0xFF);
-        iteration++;
-    } while (response != 0xFF && iteration < maxSpiExchanges);
+    uint8_t  response = waitForCard(true, maxSpiExchanges, pElapsedUs);
 
     // Record the maximum wait time.
-    uint32_t elapsedTime = (iteration * 1000) / m_spiBytesPerSecond;
+    uint32_t elapsedTime = *pElapsedUs / 1000;
     if (elapsedTime >  m_maximumWaitWhileBusyTime)
     {
         m_maximumWaitWhileBusyTime = elapsedTime;
@@ -859,6 +2215,62 @@ bool SDFileSystem::waitWhileBusy(uint32_t maxSpiExchanges)
     return true;
 }
 
+bool SDFileSystem::isCardWaiting(uint8_t response, uint8_t waitingResponse)
+{
+    // While busy, the card returns 0x00 but anything other than 0xFF means it is still busy.
+    if (waitingResponse == 0x00)
+    {
+        return response != 0xFF;
+    }
+    return response == 0xFF;
+}
+
+uint8_t SDFileSystem::waitForCard(bool isBusyWait, uint32_t maxSpiExchanges, uint32_t* pElapsedUs)
+{
+    // The card holds MISO low while it is busy (isBusyWait) and high until it starts sending a data block.
+    uint8_t waitingResponse = isBusyWait ? 0x00 : 0xFF;
+
+    // Spin first since most waits are short. Without a wait strategy, spin for the whole wait.
+    uint32_t spinExchanges = maxSpiExchanges;
+    if (m_pWaitStrategy)
+    {
+        uint32_t strategySpinExchanges = ((uint64_t)m_waitSpinTimeUs * m_spiBytesPerSecond) / 1000000;
+        if (strategySpinExchanges < spinExchanges)
+        {
+            spinExchanges = strategySpinExchanges ? strategySpinExchanges : 1;
+        }
+    }
+    uint32_t iteration = 0;
+    uint8_t  response;
+    do
+    {
+        response = m_spi.exchange(0xFF);
+        iteration++;
+    } while (isCardWaiting(response, waitingResponse) && iteration < spinExchanges);
+    uint32_t elapsedUs = ((uint64_t)iteration * 1000000) / m_spiBytesPerSecond;
+
+    // Let the wait strategy have the CPU between polls for the rest of the wait.
+    if (isCardWaiting(response, waitingResponse) && iteration < maxSpiExchanges)
+    {
+        uint32_t timeoutUs = ((uint64_t)maxSpiExchanges * 1000000) / m_spiBytesPerSecond;
+        uint32_t spinUs = elapsedUs;
+        uint32_t waitCount = 0;
+        m_waitTimer.reset();
+        m_waitTimer.start();
+        do
+        {
+            m_pWaitStrategy->backOff(waitCount++);
+            response = m_spi.exchange(0xFF);
+            elapsedUs = spinUs + m_waitTimer.read_us();
+        } while (isCardWaiting(response, waitingResponse) && elapsedUs < timeoutUs);
+        m_waitTimer.stop();
+        m_waitBackOffCount += waitCount;
+    }
+
+    *pElapsedUs = elapsedUs;
+    return response;
+}
+
 void SDFileSystem::deselect()
 {
     // 7.2 SPI Bus Protocol - De-assert chip select at end of command.
@@ -906,20 +2318,22 @@ uint8_t SDFileSystem::sendCommandAndGetResponse(uint8_t cmd, uint32_t argument /
 
         // 7.3.1.1 Command Format - Build up the 48-bit command token based on function arguments.
         // NOTE: Always using CRC.
-        uint8_t packet[6];
-        packet[0] = CMD_TRANSMISSION_BIT | (cmd & 0x3F);
-        packet[1] = argument >> 24;
-        packet[2] = argument >> 16;
-        packet[3] = argument >> 8;
-        packet[4] = argument;
-        packet[5] = (SDCRC::crc7(packet, 5) << 1) | CMD_STOP_BIT;
-
-        // Write this 6-byte packet to the SPI bus.
-        for (size_t i = 0 ; i < sizeof(packet) ; i++)
+        uint8_t        packet[6];
+        const uint8_t* pPacket = findConstantCommandPacket(cmd, argument);
+        if (!pPacket)
         {
-            m_spi.send(packet[i]);
+            packet[0] = CMD_TRANSMISSION_BIT | (cmd & 0x3F);
+            packet[1] = argument >> 24;
+            packet[2] = argument >> 16;
+            packet[3] = argument >> 8;
+            packet[4] = argument;
+            packet[5] = (SDCRC::crc7Command(packet[0], argument) << 1) | CMD_STOP_BIT;
+            pPacket = packet;
         }
 
+        // Write this 6-byte packet to the SPI bus.
+        m_spi.send(pPacket, sizeof(packet));
+
         // Discard extra byte after CMD12.
         // Is this really required?  Would probably be required if this padding byte had start bit cleared.
         if (cmd == 12)
@@ -964,6 +2378,7 @@ uint8_t SDFileSystem::sendCommandAndGetResponse(uint8_t cmd, uint32_t argument /
             }
             // Update total CRC failure counter.
             m_cmdCrcErrorCount++;
+            recordCrcError();
 
             // Retry the command again after toggling the chip select line.
             deselect();
@@ -1007,7 +2422,8 @@ uint8_t SDFileSystem::sendCommandAndGetResponse(uint8_t cmd, uint32_t argument /
     return r1Response;
 }
 
-int SDFileSystem::sendCommandAndReceiveDataBlock(uint8_t cmd, uint32_t cmdArgument, uint8_t* pBuffer, size_t bufferSize)
+int SDFileSystem::sendCommandAndReceiveDataBlock(uint8_t cmd, uint32_t cmdArgument, uint8_t* pBuffer, size_t bufferSize,
+                                                 uint8_t* pCopy /* = NULL */, size_t copySize /* = 0 */)
 {
     // 7.2.3 Data Read - Gives an overview of the single block read process for SPI mode.
     // Assume the read operation has failed until we get all the way through the process successfully.
@@ -1031,7 +2447,7 @@ int SDFileSystem::sendCommandAndReceiveDataBlock(uint8_t cmd, uint32_t cmdArgume
                        cmdToString(cmd), cmdArgument, pBuffer, bufferSize, cmdToString(cmd), r1Response);
             break;
         }
-        if (!receiveDataBlock(pBuffer, bufferSize))
+        if (!receiveDataBlock(pBuffer, bufferSize, pCopy, copySize))
         {
             LOG_ERROR("sendCommandAndReceiveDataBlock(%s,%X,%X,%d) - receiveDataBlock failed\n",
                       cmdToString(cmd), cmdArgument, pBuffer, bufferSize);
@@ -1054,21 +2470,46 @@ int SDFileSystem::sendCommandAndReceiveDataBlock(uint8_t cmd, uint32_t cmdArgume
     return retVal;
 }
 
-bool SDFileSystem::receiveDataBlock(uint8_t* pBuffer, size_t bufferSize)
+bool SDFileSystem::receiveDataBlock(uint8_t* pBuffer, size_t bufferSize,
+                                    uint8_t* pCopy /* = NULL */, size_t copySize /* = 0 */)
+{
+    SPIDma::Segment segment = { pBuffer, bufferSize };
+    return receiveDataBlock(&segment, 1, pCopy, copySize);
+}
+
+bool SDFileSystem::receiveDataBlock(const SPIDma::Segment* pSegments, size_t segmentCount,
+                                    uint8_t* pCopy /* = NULL */, size_t copySize /* = 0 */)
+{
+    uint16_t crcExpected = 0;
+
+    if (!startReceiveDataBlock(pSegments, segmentCount))
+    {
+        return false;
+    }
+    if (!finishReceiveDataBlock(pSegments, segmentCount, &crcExpected))
+    {
+        return false;
+    }
+    return verifyDataBlockCrc(pSegments, segmentCount, crcExpected, pCopy, copySize);
+}
+
+bool SDFileSystem::startReceiveDataBlock(const SPIDma::Segment* pSegments, size_t segmentCount)
 {
+    // These variables will throw unused warning when logging is disabled.
+    void*  pBuffer = pSegments[0].pBuffer;
+    size_t bufferSize = getSegmentsSize(pSegments, segmentCount);
+    (void)pBuffer;
+    (void)bufferSize;
+
     // 4.3.3 Data Read - Keeps the DAT bus lines pulled high when not transmitting data.
     // 4.6.2.1 Read - 100ms as the minimum read timeout.
     // Wait up to 500msec until something other than 0xFF is encountered.
-    uint32_t iteration = 0;
-    uint8_t  byte;
-    do
-    {
-        byte = m_spi.exchange(0xFF);
-        iteration++;
-    } while (byte == 0xFF && iteration < m_spiBytesPerSecond / 2);
+    uint32_t elapsedUs;
+    uint8_t  byte = waitForCard(false, m_spiBytesPerSecond / 2, &elapsedUs);
 
     // Record maximum amount of wait time.
-    uint32_t elapsedTime = (iteration * 1000) / m_spiBytesPerSecond;
+    uint32_t elapsedTime = elapsedUs / 1000;
+    LATENCY_RECORD(receiveWait, elapsedUs);
     if (elapsedTime > m_maximumReceiveDataBlockWaitTime)
     {
         m_maximumReceiveDataBlockWaitTime = elapsedTime;
@@ -1077,7 +2518,7 @@ bool SDFileSystem::receiveDataBlock(uint8_t* pBuffer, size_t bufferSize)
     // Check for timeout waiting for non-0xFF byte read.
     if (byte == 0xFF)
     {
-        LOG_ERROR("receiveDataBlock(%X,%d) - Time out after 500ms\n", pBuffer, bufferSize);
+        LOG_ERROR("startReceiveDataBlock(%X,%d) - Time out after 500ms\n", pBuffer, bufferSize);
         m_receiveTimeoutCount++;
         return false;
     }
@@ -1086,42 +2527,83 @@ bool SDFileSystem::receiveDataBlock(uint8_t* pBuffer, size_t bufferSize)
     // 0xFE is the start block for single/multiple reads.
     if (byte != BLOCK_START)
     {
-        LOG_ERROR("receiveDataBlock(%X,%d) - Expected 0xFE start block token. Response=0x%02X\n",
+        LOG_ERROR("startReceiveDataBlock(%X,%d) - Expected 0xFE start block token. Response=0x%02X\n",
                   pBuffer, bufferSize, byte);
         m_receiveBadTokenCount++;
         return false;
     }
 
-    // Read block bytes into provided buffer.
-    uint32_t byteToWrite = 0xFF;
-    bool transferResult = m_spi.transfer(&byteToWrite, 1, pBuffer, bufferSize);
+    // Start reading block bytes into provided buffers. finishReceiveDataBlock() waits for it to complete.
+    m_spi.readScatterAsync(pSegments, segmentCount);
+    return true;
+}
+
+bool SDFileSystem::finishReceiveDataBlock(const SPIDma::Segment* pSegments, size_t segmentCount, uint16_t* pCrcExpected)
+{
+    bool transferResult = m_spi.waitForTransfer();
     if (!transferResult)
     {
-        LOG_ERROR("receiveDataBlock(%X,%d) - SPI transfer failed\n", pBuffer, bufferSize);
+        LOG_ERROR("finishReceiveDataBlock(%X,%d) - SPI transfer failed\n",
+                  pSegments[0].pBuffer, getSegmentsSize(pSegments, segmentCount));
         m_receiveTransferFailCount++;
         return false;
     }
 
-    // Read and check 16-bit CRC
+    // Read 16-bit CRC which follows the data block.
     uint16_t crcExpected = m_spi.exchange(0xFF) << 8;
     crcExpected |= m_spi.exchange(0xFF);
-    uint16_t crcActual = SDCRC::crc16(pBuffer, bufferSize);
+    *pCrcExpected = crcExpected;
+
+    return true;
+}
+
+bool SDFileSystem::verifyDataBlockCrc(const SPIDma::Segment* pSegments, size_t segmentCount, uint16_t crcExpected,
+                                      uint8_t* pCopy /* = NULL */, size_t copySize /* = 0 */)
+{
+    uint16_t crcActual = 0;
+    for (size_t i = 0 ; i < segmentCount ; i++)
+    {
+        const uint8_t* pData = (const uint8_t*)pSegments[i].pBuffer;
+        size_t         size = pSegments[i].count;
+        if (copySize == 0)
+        {
+            crcActual = SDCRC::crc16(pData, size, crcActual);
+            continue;
+        }
+
+        // The caller's copy is made as the data is read for the CRC. It is left partially written if the CRC fails.
+        size_t copyLength = copySize < size ? copySize : size;
+        crcActual = SDCRC::crc16Copy(pCopy, pData, size, copyLength, crcActual);
+        pCopy += copyLength;
+        copySize -= copyLength;
+    }
     if (crcActual != crcExpected)
     {
-        LOG_ERROR("receiveDataBlock(%X,%d) - Invalid CRC. Expected=0x%04X Actual=0x%04X\n",
-                  pBuffer, bufferSize, crcExpected, crcActual);
+        LOG_ERROR("verifyDataBlockCrc(%X,%d) - Invalid CRC. Expected=0x%04X Actual=0x%04X\n",
+                  pSegments[0].pBuffer, getSegmentsSize(pSegments, segmentCount), crcExpected, crcActual);
         m_receiveCrcErrorCount++;
+        recordCrcError();
         return false;
     }
 
     return true;
 }
 
-uint8_t SDFileSystem::transmitDataBlock(uint8_t blockToken, const uint8_t* pBuffer, size_t bufferSize)
+uint8_t SDFileSystem::transmitDataBlock(uint8_t blockToken, const SPIDma::Segment* pSegments, size_t segmentCount,
+                                        const uint16_t* pCrc /* = NULL */,
+                                        const uint8_t* pNextBuffer /* = NULL */, uint16_t* pNextCrc /* = NULL */)
 {
+    // These variables will throw unused warning when logging is disabled.
+    const void* pBuffer = segmentCount ? pSegments[0].pBuffer : NULL;
+    size_t      bufferSize = getSegmentsSize(pSegments, segmentCount);
+    (void)pBuffer;
+
     // 7.2.4 Data Write - Overview of write process. If there was a previous data block write then we must wait for
     //                    the chip to no longer be busy.
-    if (!waitWhileBusy(m_spiBytesPerSecond / 2))
+    uint32_t elapsedUs;
+    bool     isReady = waitWhileBusy(m_spiBytesPerSecond / 2, &elapsedUs);
+    LATENCY_RECORD(programWait, elapsedUs);
+    if (!isReady)
     {
         LOG_ERROR("transmitDataBlock(%X,%X,%d) - Time out after 500ms\n", blockToken, pBuffer, bufferSize);
         m_transmitTimeoutCount++;
@@ -1135,12 +2617,31 @@ uint8_t SDFileSystem::transmitDataBlock(uint8_t blockToken, const uint8_t* pBuff
     {
         // 7.2.4 Data Write - When sending stop transmission token, just need to wait while busy.
         // There is no buffer to send.
-        assert ( !pBuffer );
+        assert ( !pSegments );
         return DATA_RESPONSE_DATA_ACCEPTED;
     }
 
-    // Write block bytes from provided buffer.
-    bool transferResult = m_spi.transfer(pBuffer, bufferSize, NULL, 0);
+    // Start writing block bytes from provided buffers and use the time while the DMA is running to calculate the CRC
+    // for this block (if the caller didn't already provide it) and the next block (if the caller provided one).
+    m_spi.writeGatherAsync(pSegments, segmentCount);
+    uint16_t crc = 0;
+    if (pCrc)
+    {
+        crc = *pCrc;
+    }
+    else
+    {
+        for (size_t i = 0 ; i < segmentCount ; i++)
+        {
+            crc = SDCRC::crc16((const uint8_t*)pSegments[i].pBuffer, pSegments[i].count, crc);
+        }
+    }
+    if (pNextBuffer)
+    {
+        assert ( pNextCrc );
+        *pNextCrc = SDCRC::crc16(pNextBuffer, bufferSize);
+    }
+    bool transferResult = m_spi.waitForTransfer();
     if (!transferResult)
     {
         LOG_ERROR("transmitDataBlock(%X,%X,%d) - SPI transfer failed\n", blockToken, pBuffer, bufferSize);
@@ -1149,7 +2650,6 @@ uint8_t SDFileSystem::transmitDataBlock(uint8_t blockToken, const uint8_t* pBuff
     }
 
     // Send 16-bit CRC.
-    uint16_t crc = SDCRC::crc16(pBuffer, bufferSize);
     m_spi.send(crc >> 8);
     m_spi.send(crc);
 
@@ -1160,6 +2660,282 @@ uint8_t SDFileSystem::transmitDataBlock(uint8_t blockToken, const uint8_t* pBuff
     {
         LOG_ERROR("transmitDataBlock(%X,%X,%d) - Data Response=0x%02X\n", blockToken, pBuffer, bufferSize, dataResponse);
         m_transmitResponseErrorCount++;
+        if ((dataResponse & DATA_RESPONSE_MASK) == DATA_RESPONSE_CRC_ERROR)
+        {
+            recordCrcError();
+        }
     }
     return dataResponse & DATA_RESPONSE_MASK;
 }
+
+int SDFileSystem::getWrittenBlockCount(uint32_t* pBlocksWritten)
+{
+    // 4.3.4 Data Write - ACMD22 returns the number of blocks successfully written by the last write command.
+    uint8_t data[4];
+    int result = sendCommandAndReceiveDataBlock(ACMD22, 0, data, sizeof(data));
+    if (result != RES_OK)
+    {
+        return result;
+    }
+
+    // Copy big-endian 32-bit value into machine appropriate 32-bit format.
+    *pBlocksWritten = ((uint32_t)data[0] << 24) |
+                      ((uint32_t)data[1] << 16) |
+                      ((uint32_t)data[2] << 8) |
+                       (uint32_t)data[3];
+    return RES_OK;
+}
+
+size_t SDFileSystem::getSegmentsSize(const SPIDma::Segment* pSegments, size_t segmentCount)
+{
+    size_t size = 0;
+    for (size_t i = 0 ; i < segmentCount ; i++)
+    {
+        size += pSegments[i].count;
+    }
+    return size;
+}
+
+bool SDFileSystem::validateVectors(const IoVector* pVectors, size_t vectorCount, uint32_t* pBlockCount)
+{
+    if (!pVectors || vectorCount == 0)
+    {
+        return false;
+    }
+
+    // SDCRC::crc16() processes 4 bytes at a time so each buffer must be a multiple of 4 bytes.
+    size_t totalSize = 0;
+    for (size_t i = 0 ; i < vectorCount ; i++)
+    {
+        if (!pVectors[i].pBuffer || pVectors[i].count == 0 || (pVectors[i].count & 3) != 0)
+        {
+            return false;
+        }
+        totalSize += pVectors[i].count;
+    }
+    if ((totalSize & 511) != 0)
+    {
+        return false;
+    }
+
+    // Make sure that no block needs more GPDMA linked list items than SPIDma supports.
+    uint32_t blockCount = totalSize / 512;
+    for (uint32_t block = 0 ; block < blockCount ; block++)
+    {
+        SPIDma::Segment segments[SPIDMA_MAX_SEGMENTS];
+        if (getBlockSegments(pVectors, vectorCount, block, segments) == 0)
+        {
+            return false;
+        }
+    }
+
+    *pBlockCount = blockCount;
+    return true;
+}
+
+size_t SDFileSystem::getBlockSegments(const IoVector* pVectors, size_t vectorCount, uint32_t blockIndex,
+                                      SPIDma::Segment* pSegments)
+{
+    // Find the pieces of the vectors which overlap the 512-byte block at blockIndex. Returns 0 if the block would
+    // need more than SPIDMA_MAX_SEGMENTS pieces.
+    size_t offset = blockIndex * 512;
+    size_t remaining = 512;
+    size_t segmentCount = 0;
+    for (size_t i = 0 ; i < vectorCount && remaining > 0 ; i++)
+    {
+        if (offset >= pVectors[i].count)
+        {
+            offset -= pVectors[i].count;
+            continue;
+        }
+        if (segmentCount == SPIDMA_MAX_SEGMENTS)
+        {
+            return 0;
+        }
+
+        size_t count = pVectors[i].count - offset;
+        if (count > remaining)
+        {
+            count = remaining;
+        }
+        pSegments[segmentCount].pBuffer = (uint8_t*)pVectors[i].pBuffer + offset;
+        pSegments[segmentCount].count = count;
+        segmentCount++;
+        remaining -= count;
+        offset = 0;
+    }
+
+    return segmentCount;
+}
+
+bool SDFileSystem::isSectorCacheActive(uint32_t count)
+{
+    // Let the uncached code paths handle and log invalid requests.
+    return m_sectorCache.isEnabled() && !(m_status & STA_NOINIT) && count > 0;
+}
+
+int SDFileSystem::allocateCacheLine(uint32_t sector, SectorCache::Line** ppLine)
+{
+    SectorCache::Line* pLine = m_sectorCache.findVictim(sector);
+    if (pLine->isValid && pLine->isDirty)
+    {
+        int result = writeBlocks(pLine->pData, pLine->sector, 1);
+        if (result != RES_OK)
+        {
+            LOG_ERROR("allocateCacheLine(%d,%X) - Failed to write back sector %d\n", sector, ppLine, pLine->sector);
+            return result;
+        }
+    }
+    m_sectorCache.evict(pLine);
+    *ppLine = pLine;
+    return RES_OK;
+}
+
+int SDFileSystem::flushSectorCache()
+{
+    if (!m_sectorCache.isEnabled())
+    {
+        return RES_OK;
+    }
+
+    // Dirty lines are written back in ascending sector order so that runs of consecutive dirty sectors can be
+    // coalesced into a single multi-block write straight out of the cache lines.
+    SectorCache::Line* pLine;
+    while ((pLine = m_sectorCache.findLowestDirtyLine()) != NULL)
+    {
+        SectorCache::Line* runLines[SDFILESYSTEM_SECTOR_CACHE_MAX_RUN];
+        IoVector           vectors[SDFILESYSTEM_SECTOR_CACHE_MAX_RUN];
+        uint32_t           sector = pLine->sector;
+        uint32_t           runLength = 0;
+        while (pLine && pLine->isDirty && runLength < SDFILESYSTEM_SECTOR_CACHE_MAX_RUN)
+        {
+            runLines[runLength] = pLine;
+            vectors[runLength].pBuffer = pLine->pData;
+            vectors[runLength].count = 512;
+            runLength++;
+            pLine = m_sectorCache.peek(sector + runLength);
+        }
+
+        int result;
+        if (runLength == 1)
+        {
+            result = writeBlocks(runLines[0]->pData, sector, 1);
+        }
+        else
+        {
+            result = writeVectors(vectors, runLength, sector);
+        }
+        if (result != RES_OK)
+        {
+            LOG_ERROR("flushSectorCache() - Failed to write %d sectors starting at %d\n", runLength, sector);
+            return result;
+        }
+        for (uint32_t i = 0 ; i < runLength ; i++)
+        {
+            runLines[i]->isDirty = false;
+        }
+    }
+
+    return RES_OK;
+}
+
+int SDFileSystem::readAhead(uint32_t blockNumber, SectorCache::Line** ppLine)
+{
+    // Allocate cache lines for the window of sectors starting at blockNumber. The window is cut short at the first
+    // sector which is already cached (so that dirty data isn't overwritten) or when a line allocated earlier in this
+    // window would have to be recycled. Lines are filled as they are allocated so that findVictim() doesn't hand
+    // them out again but they are discarded below if the read fails.
+    SectorCache::Line* lines[SDFILESYSTEM_READ_AHEAD_MAX_WINDOW];
+    IoVector           vectors[SDFILESYSTEM_READ_AHEAD_MAX_WINDOW];
+    uint32_t           sectorCount = 0;
+    int                result = RES_OK;
+    while (sectorCount < m_readAheadWindow)
+    {
+        uint32_t           sector = blockNumber + sectorCount;
+        SectorCache::Line* pLine = m_sectorCache.findVictim(sector);
+        if (sectorCount > 0 && m_sectorCache.peek(sector))
+        {
+            break;
+        }
+        if (pLine->isValid && pLine->sector >= blockNumber && pLine->sector < sector)
+        {
+            break;
+        }
+        result = allocateCacheLine(sector, &pLine);
+        if (result != RES_OK)
+        {
+            break;
+        }
+        m_sectorCache.fill(pLine, sector, false);
+        lines[sectorCount] = pLine;
+        vectors[sectorCount].pBuffer = pLine->pData;
+        vectors[sectorCount].count = 512;
+        sectorCount++;
+    }
+
+    if (sectorCount > 0)
+    {
+        result = readVectors(vectors, sectorCount, blockNumber);
+    }
+    if (result != RES_OK)
+    {
+        LOG_ERROR("readAhead(%d,%X) - Failed to prefetch %d sectors\n", blockNumber, ppLine, sectorCount);
+        for (uint32_t i = 0 ; i < sectorCount ; i++)
+        {
+            lines[i]->isValid = false;
+        }
+        return result;
+    }
+
+    m_readAheadCount++;
+    m_readAheadSectorCount += sectorCount;
+    *ppLine = lines[0];
+    return RES_OK;
+}
+
+void SDFileSystem::copyDirtyCachedBlocks(const IoVector* pVectors, size_t vectorCount,
+                                         uint32_t blockNumber, uint32_t count)
+{
+    for (uint32_t i = 0 ; i < count ; i++)
+    {
+        SectorCache::Line* pLine = m_sectorCache.peek(blockNumber + i);
+        if (!pLine || !pLine->isDirty)
+        {
+            continue;
+        }
+
+        SPIDma::Segment segments[SPIDMA_MAX_SEGMENTS];
+        size_t          segmentCount = getBlockSegments(pVectors, vectorCount, i, segments);
+        const uint8_t*  pSrc = pLine->pData;
+        for (size_t j = 0 ; j < segmentCount ; j++)
+        {
+            memcpy(segments[j].pBuffer, pSrc, segments[j].count);
+            pSrc += segments[j].count;
+        }
+    }
+}
+
+void SDFileSystem::updateCachedBlocks(const IoVector* pVectors, size_t vectorCount,
+                                      uint32_t blockNumber, uint32_t count, bool isDirty)
+{
+    for (uint32_t i = 0 ; i < count ; i++)
+    {
+        SectorCache::Line* pLine = m_sectorCache.peek(blockNumber + i);
+        if (!pLine)
+        {
+            continue;
+        }
+
+        SPIDma::Segment segments[SPIDMA_MAX_SEGMENTS];
+        size_t          segmentCount = getBlockSegments(pVectors, vectorCount, i, segments);
+        uint8_t*        pDest = pLine->pData;
+        for (size_t j = 0 ; j < segmentCount ; j++)
+        {
+            memcpy(pDest, segments[j].pBuffer, segments[j].count);
+            pDest += segments[j].count;
+        }
+        // Every cached copy of a block that failed to write is marked dirty, even if it was clean before, so that
+        // the next flush retries the write. Otherwise it now matches the card and is clean.
+        pLine->isDirty = isDirty;
+    }
+}
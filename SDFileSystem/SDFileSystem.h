@@ -30,11 +30,40 @@
 #include <FATFileSystem.h>
 #include <SPIDma.h>
 #include <CircularLog.h>
+#include <Timer.h>
+#include "SectorCache.h"
+#include "LatencyHistogram.h"
+#include "SDWaitStrategy.h"
+#include "SDLock.h"
+#include "SingleThreadedCheck.h"
 #include <stdint.h>
 
 // The circular error log can be disabled by setting SDFILESYSTEM_ENABLE_ERROR_LOG to 0.
 #define SDFILESYSTEM_ENABLE_ERROR_LOG 1
 
+// The latency histograms can be disabled by setting SDFILESYSTEM_ENABLE_LATENCY_STATS to 0.
+#define SDFILESYSTEM_ENABLE_LATENCY_STATS 1
+
+// Maximum number of consecutive dirty sectors which will be coalesced into a single CMD25 when flushing the sector
+// cache.
+#define SDFILESYSTEM_SECTOR_CACHE_MAX_RUN 16
+
+// Maximum number of sectors which can be prefetched into the sector cache with a single CMD18 read-ahead.
+#define SDFILESYSTEM_READ_AHEAD_MAX_WINDOW 16
+
+// Maximum number of queued disk_read()/disk_write() requests which can be merged into a single CMD18/CMD25.
+#define SDFILESYSTEM_MAX_MERGED_REQUESTS 8
+
+// SPI clock rates. The card starts out in default speed mode and can be switched to High-Speed mode with CMD6.
+#define SDFILESYSTEM_MINIMUM_FREQUENCY          400000
+#define SDFILESYSTEM_DEFAULT_SPEED_FREQUENCY    25000000
+#define SDFILESYSTEM_HIGH_SPEED_FREQUENCY       50000000
+
+// The SPI clock rate is halved when SDFILESYSTEM_CRC_FALLBACK_ERRORS CRC errors are detected within
+// SDFILESYSTEM_CRC_FALLBACK_WINDOW_MS milliseconds of each other.
+#define SDFILESYSTEM_CRC_FALLBACK_ERRORS        4
+#define SDFILESYSTEM_CRC_FALLBACK_WINDOW_MS     1000
+
 
 class SDFileSystem : public FATFileSystem
 {
@@ -48,6 +77,83 @@ public:
     virtual int disk_write(const uint8_t* buffer, uint32_t block_number, uint32_t count);
     virtual int disk_sync();
     virtual uint32_t disk_sectors();
+    // Reads a single block into buffer, like disk_read(), and also copies its first copy_size bytes to copy (ie.
+    // FatFs filling a file's sector buffer to satisfy a small f_read()). The copy is made during the same pass over
+    // the received data as the CRC check rather than by reading the block again afterwards. Falls back to a separate
+    // copy when the read is satisfied from the sector cache or queued behind a lock.
+    virtual int disk_read_copy(uint8_t* buffer, uint32_t block_number, uint8_t* copy, uint32_t copy_size);
+
+    // Scatter/gather versions of disk_read()/disk_write(). The blocks starting at block_number are transferred to/from
+    // the list of buffers in pVectors, in order, using a single CMD18/CMD25. The buffers don't need to be block sized
+    // or contiguous since GPDMA linked lists are used to split each 512-byte block across multiple buffers without any
+    // intermediate copies. Each buffer must be a multiple of 4 bytes in size, the total size must be a multiple of 512
+    // bytes, and no block can be split across more than SPIDMA_MAX_SEGMENTS buffers.
+    typedef SPIDma::Segment IoVector;
+    int disk_readv(const IoVector* pVectors, size_t vectorCount, uint32_t block_number);
+    int disk_writev(const IoVector* pVectors, size_t vectorCount, uint32_t block_number);
+
+    // Optional write-back cache for single sector reads/writes (ie. FAT and directory sectors). The cache is carved
+    // out of the caller supplied buffer so that its RAM budget and location (ie. AHBSRAM) are under the caller's
+    // control. Dirty sectors are written back when evicted or when disk_sync() is called, with consecutive dirty
+    // sectors coalesced into a single CMD25. Multi-sector reads/writes bypass the cache but are kept coherent with it.
+    int enableSectorCache(void* pBuffer, size_t bufferSize, uint32_t ways);
+    int disableSectorCache();
+
+    // Optional read-ahead for single sector reads (ie. FatFs reading a file in chunks smaller than a sector). When a
+    // single sector read misses the sector cache and immediately follows the previously read sector, windowSectors
+    // sectors are prefetched into the sector cache with a single CMD18 so that the following sequential reads hit.
+    // Requires the sector cache to be enabled. A windowSectors of 0 disables read-ahead.
+    int setReadAheadWindow(uint32_t windowSectors);
+
+    // Optional read streaming for long sequential reads (ie. FatFs reading a file a cluster at a time). When enabled,
+    // the CMD18 used for a multi-block read is left open after the last requested block and the next read continues
+    // it if it starts with the following block, avoiding the CMD18/CMD12 overhead and NAC latency of a new command.
+    // The CMD18 is stopped with CMD12 when a read isn't sequential, before any other command is sent to the card (ie.
+    // writes and disk_sync()), or when the next read comes more than idleTimeoutMs after the previous one. The idle
+    // check is only made by the next read so call disk_sync() to release the card early. An idleTimeoutMs of 0
+    // disables read streaming.
+    int setReadStreamIdleTimeout(uint32_t idleTimeoutMs);
+
+    // Every disk_write() normally ends with a CMD13 to verify the card status, which also means waiting for the card
+    // to finish programming the data before returning. With a writeCount greater than 1, only every writeCount'th
+    // write issues CMD13 and the rest return as soon as the card has accepted their data. The card's status error
+    // bits accumulate until read so each CMD13 covers all of the writes since the last one. disk_sync() also checks
+    // the status of any unchecked writes, and returns an error if any status check since the previous disk_sync()
+    // failed, even if the write which failed had already returned success. The default writeCount of 1 keeps strict
+    // per-write verification.
+    int setWriteStatusCheckInterval(uint32_t writeCount);
+
+    // Highest SPI clock rate to be used by the next disk_initialize(). The default is the 25MHz limit of default
+    // speed mode. A higher maximumFrequency makes disk_initialize() use CMD6 to switch cards which support it into
+    // High-Speed mode so that they can be clocked at up to 50MHz. Cards without High-Speed support stay at 25MHz.
+    // Where the SPI peripheral can't generate the requested rate exactly, the next slower rate is used. Whatever the
+    // rate, it is halved each time a burst of CRC errors indicates that it is too fast for the card or its wiring.
+    int setMaximumFrequency(uint32_t maximumFrequency);
+
+    // Waits for the card to finish programming and for read data to start arriving normally spin, clocking 0xFF
+    // bytes out to poll the card for up to 500ms. With a wait strategy set, the driver only spins for spinTimeUs and
+    // then calls pStrategy->backOff() before each further poll so that the CPU can be given to other threads during
+    // long busy periods. The 500ms time outs are then measured with a Timer. A NULL pStrategy restores spinning.
+    int setWaitStrategy(SDWaitStrategy* pStrategy, uint32_t spinTimeUs);
+
+    // Without a lock, the application must make sure that only one thread uses the object at a time (a second thread
+    // trips the SingleThreadedCheck). Setting pLock allows any thread to call in at any time. disk_read()/disk_write()
+    // requests are then queued and serviced, in block order, by whichever waiting thread finds the queue idle.
+    // Requests for consecutive blocks in the same direction are merged into a single CMD18/CMD25. Other calls wait for
+    // the requests being serviced to complete. Must be called before other threads start using the object.
+    int setLock(SDLock* pLock);
+
+    // Streaming multi-block writes for large contiguous files (see SDStreamWriter). startWriteStream() sets the first
+    // block and the number of blocks that the stream may write. writeStream() then sends the next count blocks to the
+    // card within a CMD25 which is left open between calls so that the ACMD23/CMD25/stop token/CMD13 overhead is only
+    // paid once rather than on every call. flushWriteStream() sends the stop token and checks the card status but
+    // leaves the stream positioned so that the next writeStream() continues where it left off. Any other command sent
+    // to the card (ie. a FAT update) flushes the stream first, with any error from that flush being returned by the
+    // next stream call. endWriteStream() flushes and then ends the stream.
+    int startWriteStream(uint32_t blockNumber, uint32_t blockCount);
+    int writeStream(const uint8_t* pBuffer, uint32_t count);
+    int flushWriteStream();
+    int endWriteStream();
 
     // Accessors for SD registers.
     int getCID(uint8_t* pCID, size_t cidSize);
@@ -74,6 +180,73 @@ public:
     }
 #endif // SDFILESYSTEM_ENABLE_ERROR_LOG
 
+#if SDFILESYSTEM_ENABLE_LATENCY_STATS
+    // Histograms of how long (in microseconds) each type of operation has taken since construction or the last
+    // resetLatencyStats(). They show the tail latencies which the maximum* counters below can't.
+    struct LatencyStats
+    {
+        // Calls to disk_read() and disk_write().
+        LatencyHistogram diskRead;
+        LatencyHistogram diskWrite;
+        // Waits for the card to stop being busy before select() can issue a command.
+        LatencyHistogram selectWait;
+        // Waits for the card to finish programming a block within a multiple block write.
+        LatencyHistogram programWait;
+        // Waits for the start token of a data block being read.
+        LatencyHistogram receiveWait;
+        // CMD13 status checks after writes.
+        LatencyHistogram statusCheck;
+    };
+    void getLatencyStats(LatencyStats* pStats)
+    {
+        *pStats = m_latencyStats;
+    }
+    void resetLatencyStats()
+    {
+        m_latencyStats = LatencyStats();
+    }
+#endif // SDFILESYSTEM_ENABLE_LATENCY_STATS
+
+    // Number of single sector reads/writes which were found in the sector cache.
+    uint32_t sectorCacheHitCount()
+    {
+        return m_sectorCache.hitCount();
+    }
+    // Number of single sector reads/writes which weren't found in the sector cache.
+    uint32_t sectorCacheMissCount()
+    {
+        return m_sectorCache.missCount();
+    }
+    // Number of valid sectors which had to be evicted from the sector cache to make room for another.
+    uint32_t sectorCacheEvictCount()
+    {
+        return m_sectorCache.evictCount();
+    }
+    // Number of read-ahead operations which have been issued because sequential access was detected.
+    uint32_t readAheadCount()
+    {
+        return m_readAheadCount;
+    }
+    // Total number of sectors brought into the sector cache by read-ahead operations.
+    uint32_t readAheadSectorCount()
+    {
+        return m_readAheadSectorCount;
+    }
+    // Number of reads which continued the CMD18 left open by the previous read rather than starting a new one.
+    uint32_t readStreamContinueCount()
+    {
+        return m_readStreamContinueCount;
+    }
+    // Number of disk_read_copy() calls which copied the data out while checking its CRC.
+    uint32_t fusedReadCopyCount()
+    {
+        return m_fusedReadCopyCount;
+    }
+    // Number of CMD25 transactions which have been opened for write streams.
+    uint32_t writeStreamTransactionCount()
+    {
+        return m_writeStreamTransactionCount;
+    }
     // Count how many times the first SPI exchange in select() was actually required.
     uint32_t selectFirstExchangeRequiredCount()
     {
@@ -84,6 +257,16 @@ public:
     {
         return m_maximumWaitWhileBusyTime;
     }
+    // The total number of times that the wait strategy was asked to back off.
+    uint32_t waitBackOffCount()
+    {
+        return m_waitBackOffCount;
+    }
+    // Number of queued disk_read()/disk_write() requests which were merged into the transfer of an earlier request.
+    uint32_t mergedRequestCount()
+    {
+        return m_mergedRequestCount;
+    }
     // The maximum number of times getCommandAndReturnResponse() loops waiting for valid R1 response.
     uint32_t maximumWaitForR1ResponseLoopCount()
     {
@@ -166,30 +349,165 @@ public:
     {
         return m_transmitResponseErrorCount;
     }
+    // The SPI clock rate currently in use.
+    uint32_t currentFrequency()
+    {
+        return m_currentFrequency;
+    }
+    // The total number of times that the SPI clock rate was halved because of a burst of CRC errors.
+    uint32_t frequencyFallbackCount()
+    {
+        return m_frequencyFallbackCount;
+    }
 
 protected:
+    // disk_read()/disk_write() request queued by a thread when a lock is set.
+    struct Request
+    {
+        Request* pNext;
+        uint8_t* pBuffer;
+        uint32_t blockNumber;
+        uint32_t count;
+        int      result;
+        bool     isWrite;
+        bool     isDone;
+    };
+
+    // Takes the lock (if one is set) and waits for any queued requests being serviced by another thread to complete.
+    class ScopedLock
+    {
+    public:
+        ScopedLock(SDFileSystem* pSd);
+        ~ScopedLock();
+
+    protected:
+        SDLock* m_pLock;
+    };
+    friend class ScopedLock;
+
+    // Used on entry to each public method so that only one thread is ever using the object. With a lock set this
+    // serializes the callers and otherwise it checks that the application did so. The members are destroyed in
+    // reverse order so the thread count is decremented before the lock is released.
+    class ExclusiveAccess
+    {
+    public:
+        ExclusiveAccess(SDFileSystem* pSd)
+            : m_lock(pSd), m_check(pSd->m_threadCount)
+        {
+        }
+
+    protected:
+        ScopedLock          m_lock;
+        SingleThreadedCheck m_check;
+    };
+    friend class ExclusiveAccess;
+
+    int          queueRequest(bool isWrite, uint8_t* pBuffer, uint32_t blockNumber, uint32_t count);
+    void         serviceRequests();
+    int          transferRequests(Request* pFirst, uint32_t requestCount);
+    bool         isMergeable(const Request* pRequest);
     virtual void setCurrentFrequency(uint32_t spiFrequency);
+    uint32_t     negotiateFrequency();
+    bool         switchToHighSpeed();
+    void         recordCrcError();
     uint8_t      cmd(uint8_t cmd, uint32_t argument = 0, uint32_t* pResponse = NULL);
     bool         select();
     void         deselect();
-    bool         waitWhileBusy(uint32_t maxSpiExchanges);
+    bool         waitWhileBusy(uint32_t maxSpiExchanges, uint32_t* pElapsedUs);
+    uint8_t      waitForCard(bool isBusyWait, uint32_t maxSpiExchanges, uint32_t* pElapsedUs);
+    static bool  isCardWaiting(uint8_t response, uint8_t waitingResponse);
+    uint8_t      getCardStatus(uint32_t* pCardStatus);
     uint8_t      sendCommandAndGetResponse(uint8_t cmd, uint32_t argument = 0, uint32_t* pResponse = NULL);
-    int          sendCommandAndReceiveDataBlock(uint8_t cmd, uint32_t cmdArgument, uint8_t* pBuffer, size_t bufferSize);
-    bool         receiveDataBlock(uint8_t* pBuffer, size_t bufferSize);
-    uint8_t      transmitDataBlock(uint8_t blockToken, const uint8_t* pBuffer, size_t bufferSize);
+    int          sendCommandAndReceiveDataBlock(uint8_t cmd, uint32_t cmdArgument, uint8_t* pBuffer, size_t bufferSize,
+                                                uint8_t* pCopy = NULL, size_t copySize = 0);
+    bool         receiveDataBlock(uint8_t* pBuffer, size_t bufferSize, uint8_t* pCopy = NULL, size_t copySize = 0);
+    bool         receiveDataBlock(const SPIDma::Segment* pSegments, size_t segmentCount,
+                                  uint8_t* pCopy = NULL, size_t copySize = 0);
+    bool         startReceiveDataBlock(const SPIDma::Segment* pSegments, size_t segmentCount);
+    bool         finishReceiveDataBlock(const SPIDma::Segment* pSegments, size_t segmentCount, uint16_t* pCrcExpected);
+    bool         verifyDataBlockCrc(const SPIDma::Segment* pSegments, size_t segmentCount, uint16_t crcExpected,
+                                    uint8_t* pCopy = NULL, size_t copySize = 0);
+    uint8_t      transmitDataBlock(uint8_t blockToken, const SPIDma::Segment* pSegments, size_t segmentCount,
+                                   const uint16_t* pCrc = NULL,
+                                   const uint8_t* pNextBuffer = NULL, uint16_t* pNextCrc = NULL);
+    int          getWrittenBlockCount(uint32_t* pBlocksWritten);
+    int          readBlocks(uint8_t* pBuffer, uint32_t blockNumber, uint32_t count,
+                            uint8_t* pCopy = NULL, size_t copySize = 0);
+    bool         isReadStreamContinuation(uint32_t blockNumber);
+    bool         isWriteStatusCheckDeferred();
+    int          checkDeferredWriteStatus();
+    int          writeStatusError();
+    int          closeReadStream();
+    int          writeBlocks(const uint8_t* pBuffer, uint32_t blockNumber, uint32_t count);
+    int          readVectors(const IoVector* pVectors, size_t vectorCount, uint32_t blockNumber);
+    int          writeVectors(const IoVector* pVectors, size_t vectorCount, uint32_t blockNumber);
+    int          readThroughSectorCache(uint8_t* pBuffer, uint32_t blockNumber, uint32_t count);
+    int          writeThroughSectorCache(const uint8_t* pBuffer, uint32_t blockNumber, uint32_t count);
+    int          readVectorsThroughSectorCache(const IoVector* pVectors, size_t vectorCount, uint32_t blockNumber);
+    int          writeVectorsThroughSectorCache(const IoVector* pVectors, size_t vectorCount, uint32_t blockNumber);
+    bool         isSectorCacheActive(uint32_t count);
+    int          allocateCacheLine(uint32_t sector, SectorCache::Line** ppLine);
+    int          flushSectorCache();
+    int          readAhead(uint32_t blockNumber, SectorCache::Line** ppLine);
+    void         copyDirtyCachedBlocks(const IoVector* pVectors, size_t vectorCount, uint32_t blockNumber, uint32_t count);
+    int          openWriteStreamTransaction();
+    int          closeWriteStreamTransaction();
+    int          finishWriteStreamTransaction();
+    int          transmitWriteStreamBlocks(const uint8_t* pBuffer, uint32_t count);
+    void         updateCachedBlocks(const IoVector* pVectors, size_t vectorCount, uint32_t blockNumber, uint32_t count,
+                                    bool isDirty);
+
+    static size_t getSegmentsSize(const SPIDma::Segment* pSegments, size_t segmentCount);
+    static bool   validateVectors(const IoVector* pVectors, size_t vectorCount, uint32_t* pBlockCount);
+    static size_t getBlockSegments(const IoVector* pVectors, size_t vectorCount, uint32_t blockIndex,
+                                   SPIDma::Segment* pSegments);
 
-    static const char* cmdToString(uint8_t cmd);
+    const char* cmdToString(uint8_t cmd);
 
     SPIDma                 m_spi;
+    volatile uint32_t      m_threadCount;
+    SDLock*                m_pLock;
+    Request*               m_pRequests;
+    bool                   m_isServicingRequests;
+    char                   m_cmdString[7];
     int                    m_status;
     uint32_t               m_blockToAddressShift;
     uint32_t               m_spiBytesPerSecond;
+    SectorCache            m_sectorCache;
+    uint32_t               m_readAheadWindow;
+    uint32_t               m_lastReadBlock;
+    Timer                  m_readStreamTimer;
+    uint32_t               m_readStreamIdleTimeout;
+    uint32_t               m_readStreamBlock;
+    bool                   m_isReadStreamOpen;
+    uint32_t               m_writeStatusCheckInterval;
+    uint32_t               m_uncheckedWriteCount;
+    int                    m_writeStatusResult;
+    uint32_t               m_maximumFrequency;
+    uint32_t               m_currentFrequency;
+    Timer                  m_crcErrorTimer;
+    uint32_t               m_crcErrorBurstCount;
+    SDWaitStrategy*        m_pWaitStrategy;
+    uint32_t               m_waitSpinTimeUs;
+    Timer                  m_waitTimer;
+    uint32_t               m_streamBlock;
+    uint32_t               m_streamBlocksLeft;
+    uint32_t               m_streamTransactionBlocks;
+    int                    m_streamResult;
+    bool                   m_isStreamStarted;
+    bool                   m_isStreamTransactionOpen;
 
 #if SDFILESYSTEM_ENABLE_ERROR_LOG
     // Error Log.
     CircularLog<1024, 256> m_log;
 #endif // SDFILESYSTEM_ENABLE_ERROR_LOG
 
+#if SDFILESYSTEM_ENABLE_LATENCY_STATS
+    // Latency Histograms. The timer is left running to timestamp operations.
+    LatencyStats           m_latencyStats;
+    Timer                  m_latencyTimer;
+#endif // SDFILESYSTEM_ENABLE_LATENCY_STATS
+
     // Diagnostic Counters.
     uint32_t               m_selectFirstExchangeRequiredCount;
     uint32_t               m_maximumWaitWhileBusyTime;
@@ -208,6 +526,14 @@ protected:
     uint32_t               m_transmitTimeoutCount;
     uint32_t               m_transmitTransferFailCount;
     uint32_t               m_transmitResponseErrorCount;
+    uint32_t               m_readAheadCount;
+    uint32_t               m_readAheadSectorCount;
+    uint32_t               m_readStreamContinueCount;
+    uint32_t               m_fusedReadCopyCount;
+    uint32_t               m_writeStreamTransactionCount;
+    uint32_t               m_frequencyFallbackCount;
+    uint32_t               m_waitBackOffCount;
+    uint32_t               m_mergedRequestCount;
 };
 
 #endif // SD_FILE_SYSTEM_H
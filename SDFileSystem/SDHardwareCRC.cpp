@@ -0,0 +1,33 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "SDHardwareCRC.h"
+
+
+SDHardwareCRC::SDHardwareCRC()
+{
+    m_offloadCount = 0;
+}
+
+bool SDHardwareCRC::crc16(const uint8_t* pData, size_t length, uint16_t crc, uint16_t* pCrc)
+{
+    if (length < SDHARDWARECRC_MIN_LENGTH || !m_engine.start(pData, length, crc))
+    {
+        return false;
+    }
+    *pCrc = m_engine.wait();
+    m_offloadCount++;
+
+    return true;
+}
@@ -0,0 +1,51 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* SDCRC::Crc16Backend which offloads the CRC16 of SD data blocks to the CRC engine peripheral. To use it:
+    static SDHardwareCRC hardwareCrc;
+    SDCRC::setCrc16Backend(&hardwareCrc);
+
+   Requests smaller than SDHARDWARECRC_MIN_LENGTH, requests made while the engine is busy with another SD card, and
+   all requests on parts without a CRC engine (ie. the LPC1768) fall back to the software kernels.
+*/
+#ifndef SD_HARDWARE_CRC_H_
+#define SD_HARDWARE_CRC_H_
+
+#include "CRCEngine.h"
+#include "SDCRC.h"
+
+
+// Buffers smaller than this are cheaper to handle in software than to set up a DMA transfer for.
+#define SDHARDWARECRC_MIN_LENGTH 64
+
+
+class SDHardwareCRC : public SDCRC::Crc16Backend
+{
+public:
+    SDHardwareCRC();
+
+    virtual bool crc16(const uint8_t* pData, size_t length, uint16_t crc, uint16_t* pCrc);
+
+    // Number of crc16() calls which were offloaded to the engine.
+    uint32_t offloadCount()
+    {
+        return m_offloadCount;
+    }
+
+protected:
+    CRCEngine m_engine;
+    uint32_t  m_offloadCount;
+};
+
+#endif /* SD_HARDWARE_CRC_H_ */
@@ -0,0 +1,39 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/*
+    Interface to the RTOS primitives which SDFileSystem uses to accept calls from multiple threads. It combines a mutex
+    with a condition variable associated with it. This driver doesn't depend on any particular RTOS so the application
+    implements it with whatever its RTOS provides (ie. a Mutex and ConditionVariable) and passes it to
+    SDFileSystem::setLock().
+*/
+#ifndef SD_LOCK_H
+#define SD_LOCK_H
+
+
+class SDLock
+{
+public:
+    virtual ~SDLock() {}
+
+    virtual void lock() = 0;
+    virtual void unlock() = 0;
+    // Called with the lock held. Atomically unlocks, blocks until another thread calls notifyAll() and then relocks.
+    // Spurious wakeups are allowed since callers always recheck their condition.
+    virtual void wait() = 0;
+    // Called with the lock held. Wakes up every thread blocked in wait().
+    virtual void notifyAll() = 0;
+};
+
+#endif // SD_LOCK_H
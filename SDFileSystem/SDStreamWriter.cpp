@@ -0,0 +1,189 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <stdio.h>
+#include <string.h>
+#include "SDStreamWriter.h"
+
+
+SDStreamWriter::SDStreamWriter(SDFileSystem* pSd)
+{
+    m_pSd = pSd;
+    m_size = 0;
+    m_maxSize = 0;
+    m_isOpen = false;
+}
+
+SDStreamWriter::~SDStreamWriter()
+{
+    close();
+}
+
+int SDStreamWriter::open(const char* pFilename, uint32_t maxSize)
+{
+#if _USE_PREALLOC
+    if (m_isOpen || maxSize == 0)
+    {
+        return -1;
+    }
+
+    char path[64];
+    int  pathLength = snprintf(path, sizeof(path), "%s:/%s", m_pSd->_fsid, pFilename);
+    if (pathLength < 0 || pathLength >= (int)sizeof(path))
+    {
+        // Don't create a file with a truncated name.
+        return -1;
+    }
+    FRESULT res = f_open(&m_file, path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (res)
+    {
+        return -1;
+    }
+#if _USE_CLUSTER_CACHE
+    // f_prealloc() records the reserved run here so that flush() can seek to the end of the data without FAT reads.
+    m_clusterCache.used = 0;
+    m_file.clcache = &m_clusterCache;
+#endif
+    res = f_prealloc(&m_file, maxSize);
+    if (res)
+    {
+        f_close(&m_file);
+        return res == FR_NOT_CONTIGUOUS ? NOT_CONTIGUOUS : -1;
+    }
+
+    FATFS*   pFs = m_file.fs;
+    uint32_t firstBlock = pFs->database + (m_file.sclust - 2) * pFs->csize;
+    if (m_pSd->startWriteStream(firstBlock, (maxSize + 511) / 512))
+    {
+        f_close(&m_file);
+        return -1;
+    }
+    m_size = 0;
+    m_maxSize = maxSize;
+    m_isOpen = true;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+int SDStreamWriter::write(const void* pBuffer, size_t length)
+{
+    if (!m_isOpen)
+    {
+        return -1;
+    }
+    if (length > m_maxSize - m_size)
+    {
+        length = m_maxSize - m_size;
+    }
+
+    const uint8_t* pSrc = (const uint8_t*)pBuffer;
+    uint8_t*       pSector = (uint8_t*)m_sector;
+    size_t         bytesLeft = length;
+    while (bytesLeft > 0)
+    {
+        uint32_t offset = m_size % 512;
+        if (offset == 0 && bytesLeft >= 512 && ((uintptr_t)pSrc & 3) == 0)
+        {
+            // Whole sectors in a word aligned buffer can be sent straight from the caller's buffer.
+            uint32_t count = bytesLeft / 512;
+            if (streamBlocks(pSrc, count))
+            {
+                return -1;
+            }
+            pSrc += count * 512;
+            bytesLeft -= count * 512;
+            m_size += count * 512;
+            continue;
+        }
+
+        // Partial or unaligned sectors are gathered in m_sector first.
+        size_t bytesToCopy = 512 - offset;
+        if (bytesToCopy > bytesLeft)
+        {
+            bytesToCopy = bytesLeft;
+        }
+        memcpy(pSector + offset, pSrc, bytesToCopy);
+        if (offset + bytesToCopy == 512 && streamBlocks(pSector, 1))
+        {
+            return -1;
+        }
+        pSrc += bytesToCopy;
+        bytesLeft -= bytesToCopy;
+        m_size += bytesToCopy;
+    }
+    return length;
+}
+
+int SDStreamWriter::streamBlocks(const uint8_t* pBuffer, uint32_t count)
+{
+    if (m_pSd->writeStream(pBuffer, count))
+    {
+        // Leave the file as it was at the last successful flush().
+        m_pSd->endWriteStream();
+        f_close(&m_file);
+        m_isOpen = false;
+        return -1;
+    }
+    return 0;
+}
+
+int SDStreamWriter::flush()
+{
+    if (!m_isOpen)
+    {
+        return -1;
+    }
+    if (m_pSd->flushWriteStream())
+    {
+        return -1;
+    }
+
+    // Let FatFs know how much data is now in the file. Seeking past the end of a file opened for writing extends it
+    // and the seek stays within the reserved clusters so the FAT isn't touched. The trailing partial sector is then
+    // written through FatFs. It is written again by the stream once it has been filled.
+    uint32_t partialSize = m_size % 512;
+    UINT     bytesWritten;
+    FRESULT  res = f_lseek(&m_file, m_size - partialSize);
+    if (res == FR_OK && partialSize > 0)
+    {
+        res = f_write(&m_file, m_sector, partialSize, &bytesWritten);
+    }
+    if (res == FR_OK)
+    {
+        res = f_sync(&m_file);
+    }
+    return res ? -1 : 0;
+}
+
+int SDStreamWriter::close()
+{
+    if (!m_isOpen)
+    {
+        return 0;
+    }
+
+    int result = flush();
+    if (m_pSd->endWriteStream())
+    {
+        result = -1;
+    }
+    if (f_close(&m_file))
+    {
+        result = -1;
+    }
+    m_isOpen = false;
+    return result;
+}
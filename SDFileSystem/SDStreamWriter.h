@@ -0,0 +1,77 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/*
+    Writer for large sequential files (ie. data logs) which sends the file data straight to the card with
+    SDFileSystem's write stream rather than going through f_write(). open() reserves a contiguous run of clusters with
+    f_prealloc() so that the whole file can be written with a single CMD25 which is only stopped when flush() or
+    close() is called. f_write() instead splits writes at every cluster boundary and issues a separate
+    ACMD23/CMD25/stop/CMD13 sequence for each piece.
+
+    FatFs only learns about the data when flush() or close() is called. At that point the file size is updated and a
+    trailing partial sector is written through FatFs. The data written since the last flush() is lost if power fails
+    before the next one.
+*/
+#ifndef SD_STREAM_WRITER_H
+#define SD_STREAM_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ff.h>
+#include "SDFileSystem.h"
+
+
+class SDStreamWriter
+{
+public:
+    SDStreamWriter(SDFileSystem* pSd);
+    ~SDStreamWriter();
+
+    // Creates (or truncates) pFilename on pSd and reserves a contiguous run of clusters large enough for maxSize bytes.
+    // Returns 0 on success, NOT_CONTIGUOUS if there is no contiguous free area large enough and -1 on other errors.
+    enum { NOT_CONTIGUOUS = 1 };
+    int     open(const char* pFilename, uint32_t maxSize);
+    // Appends length bytes to the file. Returns the number of bytes written, which is less than length once the
+    // reserved space has been filled, or -1 on error.
+    int     write(const void* pBuffer, size_t length);
+    // Stops the open CMD25 and updates the file size and directory entry to cover all of the data written so far.
+    int     flush();
+    // Flushes and then closes the file. The unused part of the reserved space is freed.
+    int     close();
+
+    bool isOpen()
+    {
+        return m_isOpen;
+    }
+    uint32_t size()
+    {
+        return m_size;
+    }
+
+protected:
+    int streamBlocks(const uint8_t* pBuffer, uint32_t count);
+
+    SDFileSystem* m_pSd;
+    FIL           m_file;
+#if _USE_CLUSTER_CACHE
+    CLCACHE       m_clusterCache;
+#endif
+    uint32_t      m_size;
+    uint32_t      m_maxSize;
+    bool          m_isOpen;
+    // Holds the partial sector at the end of the file. Word aligned for the DMA and SDCRC::crc16().
+    uint32_t      m_sector[512 / sizeof(uint32_t)];
+};
+
+#endif // SD_STREAM_WRITER_H
@@ -0,0 +1,272 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <diskio.h>
+#include "SDStripedFileSystem.h"
+
+
+SDStripedFileSystem::SDStripedFileSystem(const char* pName, SDFileSystem** ppCards, uint32_t cardCount,
+                                         uint32_t stripeSectors)
+    : FATFileSystem(pName)
+{
+    // An invalid configuration is left with no cards so that disk_initialize() fails.
+    m_cardCount = 0;
+    m_stripeSectors = stripeSectors;
+    m_sectorCount = 0;
+    m_status = STA_NOINIT;
+    if (cardCount < 2 || cardCount > SDSTRIPEDFILESYSTEM_MAX_CARDS || stripeSectors == 0)
+    {
+        return;
+    }
+
+    for (uint32_t i = 0 ; i < cardCount ; i++)
+    {
+        m_pCards[i] = ppCards[i];
+    }
+    m_cardCount = cardCount;
+}
+
+int SDStripedFileSystem::disk_initialize()
+{
+    m_status = STA_NOINIT;
+    m_sectorCount = 0;
+    if (m_cardCount == 0)
+    {
+        return m_status;
+    }
+
+    uint32_t minimumSectors = ~0U;
+    for (uint32_t i = 0 ; i < m_cardCount ; i++)
+    {
+        if (m_pCards[i]->disk_initialize() != 0)
+        {
+            return m_status;
+        }
+        uint32_t sectors = m_pCards[i]->disk_sectors();
+        if (sectors < minimumSectors)
+        {
+            minimumSectors = sectors;
+        }
+    }
+
+    // Only use whole stripes of the smallest card.
+    m_sectorCount = (minimumSectors / m_stripeSectors) * m_stripeSectors * m_cardCount;
+    m_status = 0;
+    return m_status;
+}
+
+int SDStripedFileSystem::disk_status()
+{
+    return m_status;
+}
+
+int SDStripedFileSystem::disk_read(uint8_t* pBuffer, uint32_t blockNumber, uint32_t count)
+{
+    return transfer(false, pBuffer, blockNumber, count);
+}
+
+int SDStripedFileSystem::disk_write(const uint8_t* pBuffer, uint32_t blockNumber, uint32_t count)
+{
+    return transfer(true, (uint8_t*)pBuffer, blockNumber, count);
+}
+
+int SDStripedFileSystem::disk_sync()
+{
+    if (m_status & STA_NOINIT)
+    {
+        return RES_NOTRDY;
+    }
+
+    // Sync every card, even after a failure, so that as much data as possible makes it to the cards.
+    int result = RES_OK;
+    for (uint32_t i = 0 ; i < m_cardCount ; i++)
+    {
+        int cardResult = m_pCards[i]->disk_sync();
+        if (result == RES_OK)
+        {
+            result = cardResult;
+        }
+    }
+    return result;
+}
+
+uint32_t SDStripedFileSystem::disk_sectors()
+{
+    return m_sectorCount;
+}
+
+int SDStripedFileSystem::transfer(bool isWrite, uint8_t* pBuffer, uint32_t blockNumber, uint32_t count)
+{
+    if (m_status & STA_NOINIT)
+    {
+        return RES_NOTRDY;
+    }
+    if (count == 0 || blockNumber >= m_sectorCount || count > m_sectorCount - blockNumber)
+    {
+        return RES_PARERR;
+    }
+
+    // Limit each pass to SDSTRIPEDFILESYSTEM_MAX_VECTORS rows (one stripe on each card) so that the vectors fit on
+    // the stack.
+    uint32_t rowSectors = m_stripeSectors * m_cardCount;
+    uint32_t endBlock = blockNumber + count;
+    while (blockNumber < endBlock)
+    {
+        uint32_t passEndBlock = (blockNumber / rowSectors + SDSTRIPEDFILESYSTEM_MAX_VECTORS) * rowSectors;
+        if (passEndBlock > endBlock)
+        {
+            passEndBlock = endBlock;
+        }
+
+        int result = transferRows(isWrite, pBuffer, blockNumber, passEndBlock);
+        if (result != RES_OK)
+        {
+            return result;
+        }
+        pBuffer += (passEndBlock - blockNumber) * 512;
+        blockNumber = passEndBlock;
+    }
+
+    return RES_OK;
+}
+
+int SDStripedFileSystem::transferRows(bool isWrite, uint8_t* pBuffer, uint32_t blockNumber, uint32_t endBlock)
+{
+    SDFileSystem::IoVector vectors[SDSTRIPEDFILESYSTEM_MAX_CARDS][SDSTRIPEDFILESYSTEM_MAX_VECTORS];
+    size_t                 vectorCounts[SDSTRIPEDFILESYSTEM_MAX_CARDS];
+    uint32_t               cardBlocks[SDSTRIPEDFILESYSTEM_MAX_CARDS];
+    uint32_t               blockCounts[SDSTRIPEDFILESYSTEM_MAX_CARDS];
+    uint32_t               rowSectors = m_stripeSectors * m_cardCount;
+    uint32_t               firstRow = blockNumber / rowSectors;
+    uint32_t               lastRow = (endBlock - 1) / rowSectors;
+
+    // Gather the pieces of each row which belong to each card. Only the first and last rows can be partial so each
+    // card's pieces are contiguous on the card.
+    for (uint32_t card = 0 ; card < m_cardCount ; card++)
+    {
+        vectorCounts[card] = 0;
+        cardBlocks[card] = 0;
+        blockCounts[card] = 0;
+        for (uint32_t row = firstRow ; row <= lastRow ; row++)
+        {
+            uint32_t stripeStart = row * rowSectors + card * m_stripeSectors;
+            uint32_t start = stripeStart > blockNumber ? stripeStart : blockNumber;
+            uint32_t end = stripeStart + m_stripeSectors < endBlock ? stripeStart + m_stripeSectors : endBlock;
+            if (start >= end)
+            {
+                continue;
+            }
+            if (vectorCounts[card] == 0)
+            {
+                cardBlocks[card] = row * m_stripeSectors + (start - stripeStart);
+            }
+            SDFileSystem::IoVector* pVector = &vectors[card][vectorCounts[card]++];
+            pVector->pBuffer = pBuffer + (start - blockNumber) * 512;
+            pVector->count = (end - start) * 512;
+            blockCounts[card] += end - start;
+        }
+    }
+
+    if (isWrite)
+    {
+        return writeInterleaved(vectors, cardBlocks, blockCounts);
+    }
+
+    for (uint32_t card = 0 ; card < m_cardCount ; card++)
+    {
+        if (vectorCounts[card] == 0)
+        {
+            continue;
+        }
+        int result = m_pCards[card]->disk_readv(vectors[card], vectorCounts[card], cardBlocks[card]);
+        if (result != RES_OK)
+        {
+            return result;
+        }
+    }
+    return RES_OK;
+}
+
+int SDStripedFileSystem::writeInterleaved(SDFileSystem::IoVector vectors[][SDSTRIPEDFILESYSTEM_MAX_VECTORS],
+                                          const uint32_t* pCardBlocks, const uint32_t* pBlockCounts)
+{
+    // Each card gets a write stream (one open CMD25) and the blocks are sent to the cards in turn so that each card's
+    // programming time overlaps with the transfers to the other cards.
+    size_t   vectorIndices[SDSTRIPEDFILESYSTEM_MAX_CARDS];
+    size_t   vectorOffsets[SDSTRIPEDFILESYSTEM_MAX_CARDS];
+    uint32_t blocksLeft[SDSTRIPEDFILESYSTEM_MAX_CARDS];
+    bool     isStarted[SDSTRIPEDFILESYSTEM_MAX_CARDS];
+    int      result = RES_OK;
+    for (uint32_t card = 0 ; card < m_cardCount ; card++)
+    {
+        vectorIndices[card] = 0;
+        vectorOffsets[card] = 0;
+        blocksLeft[card] = 0;
+        isStarted[card] = false;
+    }
+    for (uint32_t card = 0 ; card < m_cardCount ; card++)
+    {
+        if (pBlockCounts[card] == 0)
+        {
+            continue;
+        }
+        result = m_pCards[card]->startWriteStream(pCardBlocks[card], pBlockCounts[card]);
+        if (result != RES_OK)
+        {
+            break;
+        }
+        isStarted[card] = true;
+        blocksLeft[card] = pBlockCounts[card];
+    }
+
+    bool isBlockLeft = (result == RES_OK);
+    while (isBlockLeft)
+    {
+        isBlockLeft = false;
+        for (uint32_t card = 0 ; card < m_cardCount && result == RES_OK ; card++)
+        {
+            if (blocksLeft[card] == 0)
+            {
+                continue;
+            }
+            SDFileSystem::IoVector* pVector = &vectors[card][vectorIndices[card]];
+            result = m_pCards[card]->writeStream((uint8_t*)pVector->pBuffer + vectorOffsets[card], 1);
+            vectorOffsets[card] += 512;
+            if (vectorOffsets[card] == pVector->count)
+            {
+                vectorIndices[card]++;
+                vectorOffsets[card] = 0;
+            }
+            blocksLeft[card]--;
+            isBlockLeft = isBlockLeft || blocksLeft[card] != 0;
+        }
+        isBlockLeft = isBlockLeft && result == RES_OK;
+    }
+
+    // End every stream which was started, even after a failure, so that the cards are left out of their CMD25. A card
+    // whose stream wasn't started may still have a stream of its own in progress so it is left alone.
+    for (uint32_t card = 0 ; card < m_cardCount ; card++)
+    {
+        if (!isStarted[card])
+        {
+            continue;
+        }
+        int endResult = m_pCards[card]->endWriteStream();
+        if (result == RES_OK)
+        {
+            result = endResult;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,77 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/*
+    Presents N SD cards, each on its own SPI bus, as one RAID-0 style volume. The volume is split into stripes of
+    stripeSectors sectors which are assigned to the cards in turn so that large sequential transfers are spread evenly
+    across all of the cards.
+
+    A disk_read()/disk_write() is split into the pieces which belong to each card. Reads are sent to each card in turn
+    as a single disk_readv() which scatters its stripes straight into the caller's buffer. Writes open a write stream
+    (one CMD25) on each card and then send the blocks to the cards in turn. SDFileSystem returns as soon as a card has
+    accepted a block so each card programs that block while the others are being sent theirs and, with N cards, most
+    of the busy time which limits a single card's write bandwidth is hidden.
+
+    The cards are FATFileSystem objects too so ffconf.h's _VOLUMES must leave room for each card plus this volume.
+*/
+#ifndef SD_STRIPED_FILE_SYSTEM_H
+#define SD_STRIPED_FILE_SYSTEM_H
+
+#include <stdint.h>
+#include "SDFileSystem.h"
+
+// Maximum number of cards which can be striped together.
+#define SDSTRIPEDFILESYSTEM_MAX_CARDS 4
+
+// Maximum number of stripes sent to a card in each pass over the cards. Larger requests are split.
+#define SDSTRIPEDFILESYSTEM_MAX_VECTORS 16
+
+
+class SDStripedFileSystem : public FATFileSystem
+{
+public:
+    // ppCards points to cardCount (2 - SDSTRIPEDFILESYSTEM_MAX_CARDS) cards. The array is copied.
+    SDStripedFileSystem(const char* pName, SDFileSystem** ppCards, uint32_t cardCount, uint32_t stripeSectors);
+
+    // FATFileSystem interface. disk_initialize() initializes every card and the volume is sized to the smallest.
+    virtual int disk_initialize();
+    virtual int disk_status();
+    virtual int disk_read(uint8_t* buffer, uint32_t block_number, uint32_t count);
+    virtual int disk_write(const uint8_t* buffer, uint32_t block_number, uint32_t count);
+    virtual int disk_sync();
+    virtual uint32_t disk_sectors();
+
+    uint32_t cardCount()
+    {
+        return m_cardCount;
+    }
+    uint32_t stripeSectors()
+    {
+        return m_stripeSectors;
+    }
+
+protected:
+    int transfer(bool isWrite, uint8_t* pBuffer, uint32_t blockNumber, uint32_t count);
+    int transferRows(bool isWrite, uint8_t* pBuffer, uint32_t blockNumber, uint32_t endBlock);
+    int writeInterleaved(SDFileSystem::IoVector vectors[][SDSTRIPEDFILESYSTEM_MAX_VECTORS],
+                         const uint32_t* pCardBlocks, const uint32_t* pBlockCounts);
+
+    SDFileSystem* m_pCards[SDSTRIPEDFILESYSTEM_MAX_CARDS];
+    uint32_t      m_cardCount;
+    uint32_t      m_stripeSectors;
+    uint32_t      m_sectorCount;
+    int           m_status;
+};
+
+#endif // SD_STRIPED_FILE_SYSTEM_H
@@ -0,0 +1,48 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <assert.h>
+#include "SDWaitStrategy.h"
+
+
+SDSleepWaitStrategy::SDSleepWaitStrategy(void (*pSleepUs)(int us), uint32_t minimumUs, uint32_t maximumUs)
+{
+    assert ( pSleepUs );
+    assert ( minimumUs <= maximumUs );
+
+    m_pSleepUs = pSleepUs;
+    m_minimumUs = minimumUs;
+    m_maximumUs = maximumUs;
+}
+
+void SDSleepWaitStrategy::backOff(uint32_t waitCount)
+{
+    uint32_t delayUs = m_minimumUs;
+    uint32_t doublings = waitCount;
+    if (delayUs == 0 && waitCount > 0)
+    {
+        delayUs = 1;
+        doublings--;
+    }
+    while (doublings-- > 0 && delayUs < m_maximumUs)
+    {
+        delayUs <<= 1;
+    }
+    if (delayUs > m_maximumUs)
+    {
+        delayUs = m_maximumUs;
+    }
+
+    m_pSleepUs(delayUs);
+}
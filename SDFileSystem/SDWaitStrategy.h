@@ -0,0 +1,55 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/*
+    Strategies for how SDFileSystem gives the CPU away while it waits for the card. SDFileSystem always spins (polls
+    the card with back to back SPI exchanges) for the spin period given to SDFileSystem::setWaitStrategy() since most
+    waits (NAC and single block program times) are short. If the card is still busy after that, backOff() is called
+    before each further poll of the card so that the strategy can yield to other threads, sleep, or block until
+    something like a MISO edge interrupt indicates that the card is probably ready.
+*/
+#ifndef SD_WAIT_STRATEGY_H
+#define SD_WAIT_STRATEGY_H
+
+#include <stdint.h>
+
+
+class SDWaitStrategy
+{
+public:
+    virtual ~SDWaitStrategy() {}
+
+    // waitCount starts at 0 for each wait and counts the calls made for it so far so that implementations can back
+    // off further the longer that the card stays busy.
+    virtual void backOff(uint32_t waitCount) = 0;
+};
+
+
+// Calls pSleepUs (ie. mbed's wait_us() or a wrapper around the RTOS's thread sleep) with a delay which starts at
+// minimumUs and doubles on each call for the same wait, up to maximumUs. With a minimumUs of 0, the first call is
+// pSleepUs(0) which an RTOS wrapper can use to just yield, and the delay then doubles from 1us.
+class SDSleepWaitStrategy : public SDWaitStrategy
+{
+public:
+    SDSleepWaitStrategy(void (*pSleepUs)(int us), uint32_t minimumUs, uint32_t maximumUs);
+
+    virtual void backOff(uint32_t waitCount);
+
+protected:
+    void     (*m_pSleepUs)(int us);
+    uint32_t m_minimumUs;
+    uint32_t m_maximumUs;
+};
+
+#endif // SD_WAIT_STRATEGY_H
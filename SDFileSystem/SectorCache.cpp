@@ -0,0 +1,163 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <assert.h>
+#include "SectorCache.h"
+
+
+SectorCache::SectorCache()
+{
+    uninit();
+}
+
+bool SectorCache::init(void* pBuffer, size_t bufferSize, uint32_t ways)
+{
+    uninit();
+    if (!pBuffer || ways == 0)
+    {
+        return false;
+    }
+
+    // The sector data is placed first so that it stays word aligned for SDCRC::crc16() and the GPDMA. The Line
+    // tracking structures are placed after all of the sector data.
+    uintptr_t start = ((uintptr_t)pBuffer + 3) & ~(uintptr_t)3;
+    uintptr_t end = (uintptr_t)pBuffer + bufferSize;
+    if (end <= start)
+    {
+        return false;
+    }
+    size_t   usableSize = end - start;
+    uint32_t lineCount = usableSize / (512 + sizeof(Line));
+    uint32_t setCount = lineCount / ways;
+    if (setCount == 0)
+    {
+        return false;
+    }
+    lineCount = setCount * ways;
+
+    uint8_t* pData = (uint8_t*)start;
+    m_pLines = (Line*)(pData + lineCount * 512);
+    assert ( ((uintptr_t)m_pLines & 3) == 0 );
+    for (uint32_t i = 0 ; i < lineCount ; i++)
+    {
+        m_pLines[i].pData = pData + i * 512;
+    }
+    m_setCount = setCount;
+    m_ways = ways;
+    invalidate();
+
+    return true;
+}
+
+void SectorCache::uninit()
+{
+    m_pLines = NULL;
+    m_setCount = 0;
+    m_ways = 0;
+    m_useCount = 0;
+    m_hitCount = 0;
+    m_missCount = 0;
+    m_evictCount = 0;
+}
+
+void SectorCache::invalidate()
+{
+    for (uint32_t i = 0 ; i < lineCount() ; i++)
+    {
+        m_pLines[i].sector = 0;
+        m_pLines[i].lastUsed = 0;
+        m_pLines[i].isValid = false;
+        m_pLines[i].isDirty = false;
+    }
+}
+
+SectorCache::Line* SectorCache::lookup(uint32_t sector)
+{
+    Line* pLine = peek(sector);
+    if (!pLine)
+    {
+        m_missCount++;
+        return NULL;
+    }
+
+    m_hitCount++;
+    pLine->lastUsed = ++m_useCount;
+    return pLine;
+}
+
+SectorCache::Line* SectorCache::peek(uint32_t sector)
+{
+    Line* pSet = setForSector(sector);
+    for (uint32_t i = 0 ; i < m_ways ; i++)
+    {
+        if (pSet[i].isValid && pSet[i].sector == sector)
+        {
+            return &pSet[i];
+        }
+    }
+    return NULL;
+}
+
+SectorCache::Line* SectorCache::findVictim(uint32_t sector)
+{
+    // The use counter only wraps after 4 billion accesses and the worst case when it does is a poor LRU choice
+    // for a single replacement in each set.
+    Line* pSet = setForSector(sector);
+    Line* pVictim = &pSet[0];
+    for (uint32_t i = 0 ; i < m_ways ; i++)
+    {
+        if (!pSet[i].isValid)
+        {
+            return &pSet[i];
+        }
+        if (pSet[i].lastUsed < pVictim->lastUsed)
+        {
+            pVictim = &pSet[i];
+        }
+    }
+    return pVictim;
+}
+
+void SectorCache::evict(Line* pLine)
+{
+    if (pLine->isValid)
+    {
+        m_evictCount++;
+    }
+    pLine->isValid = false;
+    pLine->isDirty = false;
+}
+
+void SectorCache::fill(Line* pLine, uint32_t sector, bool isDirty)
+{
+    assert ( pLine >= setForSector(sector) && pLine < setForSector(sector) + m_ways );
+    pLine->sector = sector;
+    pLine->isValid = true;
+    pLine->isDirty = isDirty;
+    pLine->lastUsed = ++m_useCount;
+}
+
+SectorCache::Line* SectorCache::findLowestDirtyLine()
+{
+    Line* pLowest = NULL;
+    for (uint32_t i = 0 ; i < lineCount() ; i++)
+    {
+        Line* pLine = &m_pLines[i];
+        if (pLine->isDirty && (!pLowest || pLine->sector < pLowest->sector))
+        {
+            pLowest = pLine;
+        }
+    }
+    return pLowest;
+}
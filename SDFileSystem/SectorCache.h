@@ -0,0 +1,101 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/*
+    N-way set associative cache of 512-byte sectors with LRU replacement within each set.
+    The cache doesn't perform any I/O itself. It just tracks which sectors are cached and which are dirty so that
+    the owner (ie. SDFileSystem) can decide when to read, write back, and flush them.
+*/
+#ifndef SECTOR_CACHE_H
+#define SECTOR_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+class SectorCache
+{
+public:
+    struct Line
+    {
+        uint8_t* pData;
+        uint32_t sector;
+        uint32_t lastUsed;
+        bool     isValid;
+        bool     isDirty;
+    };
+
+    SectorCache();
+
+    // Carve the caller supplied buffer into as many 512-byte lines as will fit (along with their tracking data) and
+    // group them into sets of ways lines each. The buffer can be placed in any RAM which the GPDMA can access (ie.
+    // AHBSRAM). Returns false if the buffer isn't large enough for at least one set.
+    bool     init(void* pBuffer, size_t bufferSize, uint32_t ways);
+    void     uninit();
+    bool     isEnabled()
+    {
+        return m_setCount != 0;
+    }
+    // Mark every line as invalid, discarding any dirty data.
+    void     invalidate();
+
+    // Returns the line holding sector (and marks it as most recently used) or NULL if it isn't cached. Updates the
+    // hit/miss counters.
+    Line*    lookup(uint32_t sector);
+    // Same as lookup() but doesn't update LRU state or counters.
+    Line*    peek(uint32_t sector);
+    // Returns the line in sector's set which should be replaced next: an invalid line if there is one, otherwise
+    // the least recently used. The caller is responsible for writing it back first if it is dirty.
+    Line*    findVictim(uint32_t sector);
+    // Invalidate a line so that it can be refilled. Counts as an eviction if it held a valid sector.
+    void     evict(Line* pLine);
+    // Mark a line as holding sector, with pData already filled in, and make it the most recently used.
+    void     fill(Line* pLine, uint32_t sector, bool isDirty);
+    // Returns the dirty line with the lowest sector number or NULL if there are no dirty lines. Used to flush dirty
+    // lines in ascending sector order so that runs of consecutive sectors can be coalesced into a single write.
+    Line*    findLowestDirtyLine();
+
+    uint32_t lineCount()
+    {
+        return m_setCount * m_ways;
+    }
+    uint32_t hitCount()
+    {
+        return m_hitCount;
+    }
+    uint32_t missCount()
+    {
+        return m_missCount;
+    }
+    uint32_t evictCount()
+    {
+        return m_evictCount;
+    }
+
+protected:
+    Line*    setForSector(uint32_t sector)
+    {
+        return &m_pLines[(sector % m_setCount) * m_ways];
+    }
+
+    Line*    m_pLines;
+    uint32_t m_setCount;
+    uint32_t m_ways;
+    uint32_t m_useCount;
+    uint32_t m_hitCount;
+    uint32_t m_missCount;
+    uint32_t m_evictCount;
+};
+
+#endif // SECTOR_CACHE_H
@@ -18,11 +18,8 @@
 #include "Interlocked.h"
 
 
-// Static Members.
-volatile uint32_t SingleThreadedCheck::m_threadCount = 0;
-
-
-SingleThreadedCheck::SingleThreadedCheck()
+SingleThreadedCheck::SingleThreadedCheck(volatile uint32_t& threadCount)
+    : m_threadCount(threadCount)
 {
     // Increment counter when this thread enters scope.
     uint32_t newThreadCount = interlockedIncrement(&m_threadCount);
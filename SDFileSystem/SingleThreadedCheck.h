@@ -18,13 +18,16 @@
 #include <stdint.h>
 
 
+// Each object being protected owns its own thread count so that separate objects (ie. SD cards on different SPI
+// buses) can be used from different threads at the same time.
 class SingleThreadedCheck
 {
 public:
-    SingleThreadedCheck();
+    SingleThreadedCheck(volatile uint32_t& threadCount);
     ~SingleThreadedCheck();
 
-    static volatile uint32_t m_threadCount;
+protected:
+    volatile uint32_t& m_threadCount;
 };
 
 #endif // SINGLE_THREADED_CHECK_H
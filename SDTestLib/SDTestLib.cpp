@@ -20,6 +20,7 @@
 // Function Prototypes.
 static void dumpCSDv1(SDFileSystem* pSD, uint8_t* pCSD);
 static void dumpCSDv2(SDFileSystem* pSD, uint8_t* pCSD);
+static void dumpLatencyHistogram(const char* pName, const LatencyHistogram& histogram);
 
 
 void checkSdLog(SDFileSystem* pSD)
@@ -279,5 +280,51 @@ void dumpSdCounters(SDFileSystem* pSD)
     DUMP_COUNTER(transmitTimeoutCount, 0);
     DUMP_COUNTER(transmitTransferFailCount, 0);
     DUMP_COUNTER(transmitResponseErrorCount, 0);
+    DUMP_COUNTER(sectorCacheHitCount, 0);
+    DUMP_COUNTER(sectorCacheMissCount, 0);
+    DUMP_COUNTER(sectorCacheEvictCount, 0);
+    DUMP_COUNTER(readAheadCount, 0);
+    DUMP_COUNTER(readAheadSectorCount, 0);
+
+    printf("FAT Window Counters\n");
+    printf("    n_winhit = %lu\n", (unsigned long)pSD->_fs.n_winhit);
+    printf("    n_winread = %lu\n", (unsigned long)pSD->_fs.n_winread);
+    printf("    n_winwrite = %lu\n", (unsigned long)pSD->_fs.n_winwrite);
+}
+
+void dumpLatencyStats(SDFileSystem* pSD)
+{
+#if SDFILESYSTEM_ENABLE_LATENCY_STATS
+    SDFileSystem::LatencyStats stats;
+
+    pSD->getLatencyStats(&stats);
+    printf("SD Card Driver Latencies (usec)\n");
+    dumpLatencyHistogram("diskRead", stats.diskRead);
+    dumpLatencyHistogram("diskWrite", stats.diskWrite);
+    dumpLatencyHistogram("selectWait", stats.selectWait);
+    dumpLatencyHistogram("programWait", stats.programWait);
+    dumpLatencyHistogram("receiveWait", stats.receiveWait);
+    dumpLatencyHistogram("statusCheck", stats.statusCheck);
+#else
+    (void)pSD;
+#endif // SDFILESYSTEM_ENABLE_LATENCY_STATS
+}
+
+static void dumpLatencyHistogram(const char* pName, const LatencyHistogram& histogram)
+{
+    if (histogram.totalCount() == 0)
+    {
+        return;
+    }
 
+    printf("    %s: count = %lu, p50 <= %lu, p99 <= %lu, max = %lu\n",
+           pName, histogram.totalCount(), histogram.percentile(50), histogram.percentile(99), histogram.maximum());
+    for (uint32_t bucket = 0 ; bucket < LATENCY_HISTOGRAM_BUCKETS ; bucket++)
+    {
+        uint32_t count = histogram.count(bucket);
+        if (count != 0)
+        {
+            printf("        >= %7lu: %lu\n", LatencyHistogram::bucketLowerBound(bucket), count);
+        }
+    }
 }
@@ -24,5 +24,6 @@ void dumpCID(SDFileSystem* pSD);
 void dumpCSD(SDFileSystem* pSD);
 void testExit(SDFileSystem* pSD, int retVal);
 void dumpSdCounters(SDFileSystem* pSD);
+void dumpLatencyStats(SDFileSystem* pSD);
 
 #endif // SD_TEST_LIB_H_
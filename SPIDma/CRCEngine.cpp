@@ -0,0 +1,157 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CRCEngine.h"
+#include "GPDMA.h"
+
+
+#if defined(TARGET_LPC408X) || defined(TARGET_LPC4088) || defined(TARGET_LPC4088_DM)
+#define CRC_ENGINE_PRESENT 1
+#else
+#define CRC_ENGINE_PRESENT 0
+#endif
+
+// MODE register value for the CRC-CCITT polynomial with no bit reversal or complementing of the data or sum.
+#define CRC_MODE_CCITT 0
+
+// Number of times per byte that wait() polls for the DMA transfer to complete before giving up on it and feeding the
+// engine from the CPU instead. A byte wide memory to memory transfer takes a few bus cycles per byte so this only
+// trips if the channel has stalled.
+#define CRC_DMA_POLLS_PER_BYTE  64
+#define CRC_DMA_POLLS_MINIMUM   1024
+
+
+CRCEngine::CRCEngine()
+{
+    m_pChannel = NULL;
+    m_pData = NULL;
+    m_length = 0;
+    m_channel = -1;
+    m_seed = 0;
+    m_isBusy = false;
+    m_isDmaActive = false;
+
+#if CRC_ENGINE_PRESENT
+    enableGpdmaPower();
+    enableGpdmaInLittleEndianMode();
+    m_channel = allocateDmaChannel(GPDMA_CHANNEL_MEM2MEM);
+    m_pChannel = dmaChannelFromIndex(m_channel);
+#endif
+}
+
+CRCEngine::~CRCEngine()
+{
+    if (m_channel != -1)
+    {
+        freeDmaChannel(m_channel);
+    }
+}
+
+bool CRCEngine::isAvailable()
+{
+    return CRC_ENGINE_PRESENT != 0;
+}
+
+bool CRCEngine::start(const void* pData, size_t length, uint16_t seed)
+{
+#if CRC_ENGINE_PRESENT
+    // Both SSP buses can have SD cards being used from different threads so claim the engine atomically.
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+        bool wasBusy = m_isBusy;
+        m_isBusy = true;
+    __set_PRIMASK(primask);
+    if (wasBusy)
+    {
+        return false;
+    }
+
+    LPC_CRC->MODE = CRC_MODE_CCITT;
+    LPC_CRC->SEED = seed;
+
+    if (!m_pChannel || length > DMACCxCONTROL_TRANSFER_SIZE_MASK)
+    {
+        feedEngine(pData, length);
+        m_isDmaActive = false;
+        return true;
+    }
+
+    // Byte wide transfers (source and destination width fields left at 0) so that the engine sees the bytes in the
+    // same order that they go out on the SPI bus. The terminal count interrupt is enabled in the control word so that
+    // the raw status bit polled by wait() gets set but it stays masked in the config register so no ISR runs.
+    m_pData = pData;
+    m_length = length;
+    m_seed = seed;
+    uint32_t channelMask = 1 << m_channel;
+    LPC_GPDMA->DMACIntTCClear = channelMask;
+    LPC_GPDMA->DMACIntErrClr  = channelMask;
+    m_pChannel->DMACCSrcAddr  = (uint32_t)pData;
+    m_pChannel->DMACCDestAddr = (uint32_t)&LPC_CRC->WR_DATA;
+    m_pChannel->DMACCLLI      = 0;
+    m_pChannel->DMACCControl  = DMACCxCONTROL_I | DMACCxCONTROL_SI |
+                                (DMACCxCONTROL_BURSTSIZE_4 << DMACCxCONTROL_SBSIZE_SHIFT) |
+                                (DMACCxCONTROL_BURSTSIZE_4 << DMACCxCONTROL_DBSIZE_SHIFT) |
+                                (length & DMACCxCONTROL_TRANSFER_SIZE_MASK);
+    m_pChannel->DMACCConfig   = DMACCxCONFIG_ENABLE | DMACCxCONFIG_TRANSFER_TYPE_M2M;
+    m_isDmaActive = true;
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+void CRCEngine::feedEngine(const void* pData, size_t length)
+{
+#if CRC_ENGINE_PRESENT
+    const uint8_t*    p = (const uint8_t*)pData;
+    volatile uint8_t* pWriteData = (volatile uint8_t*)&LPC_CRC->WR_DATA;
+    while (length--)
+    {
+        *pWriteData = *p++;
+    }
+#endif
+}
+
+uint16_t CRCEngine::wait()
+{
+#if CRC_ENGINE_PRESENT
+    if (m_isDmaActive)
+    {
+        // The raw status register is polled since the channel interrupt is left disabled.
+        uint32_t channelMask = 1 << m_channel;
+        uint32_t pollsLeft = m_length * CRC_DMA_POLLS_PER_BYTE + CRC_DMA_POLLS_MINIMUM;
+        while ((LPC_GPDMA->DMACRawIntTCStat & channelMask) == 0 && --pollsLeft > 0)
+        {
+        }
+        m_isDmaActive = false;
+
+        if (pollsLeft == 0)
+        {
+            // The transfer never completed so stop the channel and calculate the whole CRC again from the CPU.
+            m_pChannel->DMACCConfig = 0;
+            LPC_GPDMA->DMACIntTCClear = channelMask;
+            LPC_GPDMA->DMACIntErrClr  = channelMask;
+            LPC_CRC->SEED = m_seed;
+            feedEngine(m_pData, m_length);
+        }
+    }
+    uint16_t crc = LPC_CRC->SUM;
+    m_isBusy = false;
+
+    return crc;
+#else
+    return 0;
+#endif
+}
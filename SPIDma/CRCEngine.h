@@ -0,0 +1,53 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+// Driver for the CRC engine found on the LPC177x/8x (LPC1788, LPC4088) and similar parts. It computes the CRC-CCITT
+// used by SD data blocks. The data is fed to the engine by a memory to memory GPDMA transfer on
+// GPDMA_CHANNEL_MEM2MEM so that the CPU is free between start() and wait(). If that channel is already taken then
+// the CPU feeds the engine itself, as it also does if wait() gives up on a transfer which never completes. The
+// LPC1768 has no CRC engine so isAvailable() returns false there and callers should fall back to SDCRC's software
+// kernels.
+#ifndef CRC_ENGINE_H_
+#define CRC_ENGINE_H_
+
+#include <mbed.h>
+
+
+class CRCEngine
+{
+public:
+    CRCEngine();
+    ~CRCEngine();
+
+    bool     isAvailable();
+
+    // Starts calculating the CRC-CCITT (x^16 + x^12 + x^5 + 1, no reflection) of length bytes at pData, continuing
+    // on from seed. Returns false if there is no engine or it is already being used by another caller. Otherwise the
+    // result must be collected with wait() and the buffer left untouched until then.
+    bool     start(const void* pData, size_t length, uint16_t seed);
+    uint16_t wait();
+
+protected:
+    void     feedEngine(const void* pData, size_t length);
+
+    LPC_GPDMACH_TypeDef* m_pChannel;
+    const void*          m_pData;
+    size_t               m_length;
+    int                  m_channel;
+    uint16_t             m_seed;
+    volatile bool        m_isBusy;
+    bool                 m_isDmaActive;
+};
+
+#endif /* CRC_ENGINE_H_ */
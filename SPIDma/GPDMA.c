@@ -18,48 +18,70 @@
 
 uint32_t g_dmaChannelsInUse;
 
+static DmaChannelHandler g_channelHandlers[GPDMA_CHANNEL_LOWEST + 1];
+static void*             g_channelContexts[GPDMA_CHANNEL_LOWEST + 1];
+static int               g_isIrqHandlerInstalled;
+
+
+static void dmaIrqHandler(void);
+
+
 int allocateDmaChannel(DmaDesiredChannel desiredChannel)
 {
+    // Multiple SPIDma objects (one per SSP bus) can be allocating and freeing channels so make the update of
+    // g_dmaChannelsInUse atomic.
+    uint32_t primask = __get_PRIMASK();
+    int      channel = -1;
+    __disable_irq();
     switch (desiredChannel)
     {
     case GPDMA_CHANNEL_HIGH:
         for (int i = GPDMA_CHANNEL_HIGHEST ; i <= GPDMA_CHANNEL_LOWEST ; i++)
         {
-            uint32_t mask = (1 << i);
-            if ((mask & g_dmaChannelsInUse) == 0)
+            if (((1 << i) & g_dmaChannelsInUse) == 0)
             {
-                g_dmaChannelsInUse |= mask;
-                return i;
+                channel = i;
+                break;
             }
         }
-        return -1;
+        break;
     case GPDMA_CHANNEL_LOW:
         // Reserve GPDMA_CHANNEL_LOWEST for memory to memory operations.
         for (int i = GPDMA_CHANNEL_LOWEST - 1; i >= GPDMA_CHANNEL_HIGHEST ; i--)
         {
-            uint32_t mask = (1 << i);
-            if ((mask & g_dmaChannelsInUse) == 0)
+            if (((1 << i) & g_dmaChannelsInUse) == 0)
             {
-                g_dmaChannelsInUse |= mask;
-                return i;
+                channel = i;
+                break;
             }
         }
-        return -1;
+        break;
     default:
         if (((1 << desiredChannel) & g_dmaChannelsInUse) == 0)
         {
-            return desiredChannel;
+            channel = desiredChannel;
         }
-        return -1;
+        break;
     }
-    return -1;
+    if (channel != -1)
+    {
+        g_dmaChannelsInUse |= (1 << channel);
+    }
+    __set_PRIMASK(primask);
+
+    return channel;
 }
 
 void freeDmaChannel(int channel)
 {
     if (channel >= GPDMA_CHANNEL_HIGHEST && channel <= GPDMA_CHANNEL_LOWEST)
     {
+        setDmaChannelHandler(channel, NULL, NULL);
+
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
         g_dmaChannelsInUse &= ~(1 << channel);
+        __set_PRIMASK(primask);
     }
 }
 
@@ -87,3 +109,45 @@ LPC_GPDMACH_TypeDef* dmaChannelFromIndex(int index)
         return NULL;
     }
 }
+
+void setDmaChannelHandler(int channel, DmaChannelHandler pHandler, void* pContext)
+{
+    if (channel < GPDMA_CHANNEL_HIGHEST || channel > GPDMA_CHANNEL_LOWEST)
+    {
+        return;
+    }
+
+    // Disable the shared interrupt while updating the handler table so that the ISR never sees a half updated entry.
+    NVIC_DisableIRQ(DMA_IRQn);
+        g_channelHandlers[channel] = pHandler;
+        g_channelContexts[channel] = pContext;
+        if (!g_isIrqHandlerInstalled)
+        {
+            NVIC_SetVector(DMA_IRQn, (uint32_t)dmaIrqHandler);
+            g_isIrqHandlerInstalled = 1;
+        }
+    NVIC_EnableIRQ(DMA_IRQn);
+}
+
+static void dmaIrqHandler(void)
+{
+    // All 8 channels share this one interrupt so dispatch to the handler registered for each channel which has an
+    // unmasked interrupt pending.
+    uint32_t pending = LPC_GPDMA->DMACIntStat;
+    for (int i = GPDMA_CHANNEL_HIGHEST ; pending != 0 && i <= GPDMA_CHANNEL_LOWEST ; i++)
+    {
+        uint32_t mask = (1 << i);
+        if ((pending & mask) == 0)
+        {
+            continue;
+        }
+        int isError = LPC_GPDMA->DMACIntErrStat & mask;
+        LPC_GPDMA->DMACIntTCClear = mask;
+        LPC_GPDMA->DMACIntErrClr = mask;
+        if (g_channelHandlers[i])
+        {
+            g_channelHandlers[i](g_channelContexts[i], isError);
+        }
+        pending &= ~mask;
+    }
+}
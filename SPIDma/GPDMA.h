@@ -75,6 +75,16 @@ typedef enum
     GPDMA_CHANNEL_LOW = 0x7FFFFFFF                  // Search from 6 down until find unused channel.
 } DmaDesiredChannel;
 
+// GPDMA linked list item.  Loaded into a channel's DMACCxSrcAddr, DMACCxDestAddr, DMACCxLLI, and DMACCxControl
+// registers when the previous item completes.  Must be word aligned and located in RAM accessible to the GPDMA.
+typedef struct
+{
+    uint32_t srcAddr;
+    uint32_t destAddr;
+    uint32_t nextLli;
+    uint32_t control;
+} DmaLinkedListItem;
+
 static __INLINE void enableGpdmaPower(void)
 {
     LPC_SC->PCONP |= (1 << 29);
@@ -93,11 +103,18 @@ extern "C"
 #endif
 
 
+// Handler called from the shared GPDMA interrupt for a channel with a pending terminal count or error interrupt.
+// The interrupt status bits for the channel are cleared before the handler is called so that it is free to start
+// another transfer on the same channel. isError is non-zero if the channel stopped because of a DMA error.
+typedef void (*DmaChannelHandler)(void* pContext, int isError);
+
+
 extern uint32_t g_dmaChannelsInUse;
 
 int                  allocateDmaChannel(DmaDesiredChannel desiredChannel);
 void                 freeDmaChannel(int channel);
 LPC_GPDMACH_TypeDef* dmaChannelFromIndex(int index);
+void                 setDmaChannelHandler(int channel, DmaChannelHandler pHandler, void* pContext);
 
 
 #ifdef __cplusplus
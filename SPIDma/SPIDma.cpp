@@ -14,6 +14,8 @@
 */
 // Class to expose greater SPI functionality than the stock SPI class from the mbed SDK:
 // * A transfer() method which utilizes DMA to reduce CPU overhead.
+// * A transferAsync() method which starts a DMA transfer and returns immediately, signalling completion from the
+//   GPDMA interrupt so that the CPU can do other work (ie. CRC calculations) while the data is on the wire.
 // * Separate send() and exchange() methods so that a user only needs to block on SPI reads as needed. The mbed SDK
 //   version always blocks and waits for each byte to go over the wire, not taking advantage of the FIFO.
 #include <assert.h>
@@ -24,12 +26,24 @@
 // The LPC17xx has an 8 element FIFO.
 #define SPI_FIFO_SIZE 8
 
+// SSP interrupt bit used in RIS, MIS, IMSC, and ICR registers to flag receive FIFO overflow.
+#define SSP_INTERRUPT_RX_OVERRUN (1 << 0)
+
+
+SPIDma* SPIDma::s_pSspOwners[2];
+
 
 SPIDma::SPIDma(PinName mosi, PinName miso, PinName sclk, PinName ssel /* = NC */, int sselInitVal /* = 1 */)
     : SPI(mosi, miso, sclk, NC), m_cs(ssel, sselInitVal)
 {
     m_readsToDiscard = 0;
     m_byteCount = 0;
+    m_dummyRead = 0;
+    m_fillByte = 0xFF;
+    m_pCallback = NULL;
+    m_pCallbackContext = NULL;
+    m_isTransferPending = false;
+    m_transferResult = true;
 
     // Setup GPDMA module.
     enableGpdmaPower();
@@ -41,6 +55,21 @@ SPIDma::SPIDma(PinName mosi, PinName miso, PinName sclk, PinName ssel /* = NC */
     m_pChannelTx = dmaChannelFromIndex(m_channelTx);
     m_sspRx = (_spi.spi == (LPC_SSP_TypeDef*)SPI_1) ? DMA_PERIPHERAL_SSP1_RX : DMA_PERIPHERAL_SSP0_RX;
     m_sspTx = (_spi.spi == (LPC_SSP_TypeDef*)SPI_1) ? DMA_PERIPHERAL_SSP1_TX : DMA_PERIPHERAL_SSP0_TX;
+    m_sspIndex = (_spi.spi == (LPC_SSP_TypeDef*)SPI_1) ? 1 : 0;
+
+    // Interrupts used for signalling completion (or Rx FIFO overflow) of transfers started with transferAsync().
+    setDmaChannelHandler(m_channelRx, rxChannelHandler, this);
+    s_pSspOwners[m_sspIndex] = this;
+    if (m_sspIndex == 1)
+    {
+        NVIC_SetVector(SSP1_IRQn, (uint32_t)ssp1IrqHandler);
+        NVIC_EnableIRQ(SSP1_IRQn);
+    }
+    else
+    {
+        NVIC_SetVector(SSP0_IRQn, (uint32_t)ssp0IrqHandler);
+        NVIC_EnableIRQ(SSP0_IRQn);
+    }
 
 #if SPIDMA_LOOP_BACK_TEST
     m_enqueue = m_dequeue = 0;
@@ -50,6 +79,9 @@ SPIDma::SPIDma(PinName mosi, PinName miso, PinName sclk, PinName ssel /* = NC */
 
 SPIDma::~SPIDma()
 {
+    waitForTransfer();
+    NVIC_DisableIRQ(m_sspIndex == 1 ? SSP1_IRQn : SSP0_IRQn);
+    s_pSspOwners[m_sspIndex] = NULL;
     freeDmaChannel(m_channelTx);
     freeDmaChannel(m_channelRx);
 }
@@ -85,6 +117,7 @@ void SPIDma::setChipSelect(int state)
 
 void SPIDma::send(int data)
 {
+    waitForTransfer();
     readDiscardedNonBlocking();
     if (m_readsToDiscard >= SPI_FIFO_SIZE)
     {
@@ -96,6 +129,33 @@ void SPIDma::send(int data)
     sspWrite(data);
 }
 
+void SPIDma::send(const void* pvData, size_t count)
+{
+    const uint8_t* p = (const uint8_t*)pvData;
+
+    waitForTransfer();
+    m_byteCount += count;
+    while (count > 0)
+    {
+        // Only block on discarded reads when every FIFO slot is in use.
+        readDiscardedNonBlocking();
+        if (m_readsToDiscard >= SPI_FIFO_SIZE)
+        {
+            assert ( m_readsToDiscard == SPI_FIFO_SIZE );
+            readDiscardedBlocking();
+        }
+
+        size_t room = SPI_FIFO_SIZE - m_readsToDiscard;
+        size_t burst = count < room ? count : room;
+        m_readsToDiscard += burst;
+        count -= burst;
+        while (burst--)
+        {
+            sspWrite(*p++);
+        }
+    }
+}
+
 void SPIDma::readDiscardedNonBlocking()
 {
     // Keep reading discarded values until there are no more or the read would block.
@@ -151,6 +211,7 @@ int SPIDma::isWriteable()
 
 int  SPIDma::exchange(int data)
 {
+    waitForTransfer();
     completeDiscardedReads();
     m_byteCount++;
     sspWrite(data);
@@ -166,13 +227,69 @@ void SPIDma::completeDiscardedReads()
 }
 
 bool SPIDma::transfer(const void* pvWrite, size_t writeCount, void* pvRead, size_t readCount)
+{
+    bool retVal = true;
+
+    waitForTransfer();
+    startTransfer(pvWrite, writeCount, pvRead, readCount, false);
+
+    // Wait for the DMA transmit to complete.
+    // The raw status registers are polled since the channel interrupts are left disabled for blocking transfers.
+    while ((LPC_GPDMA->DMACRawIntTCStat & (1 << m_channelTx)) == 0)
+    {
+    }
+
+    // Wait for the DMA receive to complete. End early if Rx FIFO overflowed.
+    uint32_t iteration = 0;
+    while ((LPC_GPDMA->DMACRawIntTCStat & (1 << m_channelRx)) == 0)
+    {
+        // Check for Rx FIFO overflow every so often. Don't do it all the time since reading SPI peripheral registers
+        // too often will slow down the DMA operations on the same peripheral.
+        if ((++iteration & (16 - 1)) == 0 && _spi.spi->RIS & SSP_INTERRUPT_RX_OVERRUN)
+        {
+            abortTransferOnRxOverflow();
+            retVal = false;
+            break;
+        }
+    }
+
+    // Turn off DMA requests in SSP.
+    _spi.spi->DMACR = 0x0;
+
+    return retVal;
+}
+
+void SPIDma::transferAsync(const void* pvWrite, size_t writeCount, void* pvRead, size_t readCount,
+                           TransferCallback pCallback /* = NULL */, void* pContext /* = NULL */)
+{
+    waitForTransfer();
+
+    m_pCallback = pCallback;
+    m_pCallbackContext = pContext;
+    m_transferResult = true;
+    m_isTransferPending = true;
+    startTransfer(pvWrite, writeCount, pvRead, readCount, true);
+}
+
+bool SPIDma::isTransferPending()
+{
+    return m_isTransferPending;
+}
+
+bool SPIDma::waitForTransfer()
+{
+    while (m_isTransferPending)
+    {
+    }
+    return m_transferResult;
+}
+
+void SPIDma::startTransfer(const void* pvWrite, size_t writeCount, void* pvRead, size_t readCount, bool isAsync)
 {
     size_t                transferCount = (writeCount > readCount) ? writeCount : readCount;
     size_t                actualReadCount = transferCount;
     int                   readIncrement = (readCount > 1 && pvRead) ? 1 : 0;
     int                   writeIncrement = (writeCount > 1) ? 1 : 0;
-    uint32_t              dummyRead = 0;
-    bool                  retVal = true;
 
     // If complete read buffer then we should first pre-fetch any discarded reads so that they don't end up in pvRead.
     if (readCount == transferCount)
@@ -191,11 +308,11 @@ bool SPIDma::transfer(const void* pvWrite, size_t writeCount, void* pvRead, size
     // Must specify a buffer containing what should be written to SPI.
     // If writeCount is 1 then the single element will be repeatedly sent for each element read.
     assert ( pvWrite && writeCount > 0 );
-    // If pvRead is NULL then we will use dummyRead for discarded reads.  The readCount has to be <= 1 though.
+    // If pvRead is NULL then we will use m_dummyRead for discarded reads.  The readCount has to be <= 1 though.
     assert ( pvRead || readCount <= 1 );
 
     // Make sure that the Rx FIFO hasn't already overflown.
-    assert ( (_spi.spi->RIS & (1 << 0)) == 0 );
+    assert ( (_spi.spi->RIS & SSP_INTERRUPT_RX_OVERRUN) == 0 );
 
     // Clear error and terminal complete interrupts for both channels.
     uint32_t channelsMask = (1 << m_channelRx) | (1 << m_channelTx);
@@ -204,7 +321,7 @@ bool SPIDma::transfer(const void* pvWrite, size_t writeCount, void* pvRead, size
 
     // Prep channel to receive the incoming bytes from the SPI device.
     m_pChannelRx->DMACCSrcAddr  = (uint32_t)&_spi.spi->DR;
-    m_pChannelRx->DMACCDestAddr = (uint32_t)(pvRead ? pvRead : &dummyRead);
+    m_pChannelRx->DMACCDestAddr = (uint32_t)(pvRead ? pvRead : &m_dummyRead);
     m_pChannelRx->DMACCLLI      = 0;
     m_pChannelRx->DMACCControl  = DMACCxCONTROL_I |
                                 (readIncrement ? DMACCxCONTROL_DI : 0) |
@@ -222,65 +339,191 @@ bool SPIDma::transfer(const void* pvWrite, size_t writeCount, void* pvRead, size
                      (DMACCxCONTROL_BURSTSIZE_4 << DMACCxCONTROL_DBSIZE_SHIFT) |
                      (transferCount & DMACCxCONTROL_TRANSFER_SIZE_MASK);
 
+    enableTransferChannels(isAsync);
+}
+
+void SPIDma::readScatterAsync(const Segment* pSegments, size_t segmentCount,
+                              TransferCallback pCallback /* = NULL */, void* pContext /* = NULL */)
+{
+    startScatterGatherTransfer(pSegments, segmentCount, true, pCallback, pContext);
+}
+
+void SPIDma::writeGatherAsync(const Segment* pSegments, size_t segmentCount,
+                              TransferCallback pCallback /* = NULL */, void* pContext /* = NULL */)
+{
+    startScatterGatherTransfer(pSegments, segmentCount, false, pCallback, pContext);
+}
+
+void SPIDma::startScatterGatherTransfer(const Segment* pSegments, size_t segmentCount, bool isRead,
+                                        TransferCallback pCallback, void* pContext)
+{
+    assert ( pSegments && segmentCount > 0 && segmentCount <= SPIDMA_MAX_SEGMENTS );
+
+    // Any previous transfer must be complete before its linked list items can be overwritten.
+    waitForTransfer();
+
+    // The scattered side of the transfer receives every byte so pre-fetch any discarded reads first.
+    completeDiscardedReads();
+
+    // Build up the linked list items for all but the first segment, which is loaded directly into the channel
+    // registers. Only the last item in the list should raise the terminal count interrupt.
+    uint32_t peripheralAddress = (uint32_t)&_spi.spi->DR;
+    uint32_t baseControl = (isRead ? DMACCxCONTROL_DI : DMACCxCONTROL_SI) |
+                           (DMACCxCONTROL_BURSTSIZE_4 << DMACCxCONTROL_SBSIZE_SHIFT) |
+                           (DMACCxCONTROL_BURSTSIZE_4 << DMACCxCONTROL_DBSIZE_SHIFT);
+    size_t   transferCount = pSegments[0].count;
+    for (size_t i = 1 ; i < segmentCount ; i++)
+    {
+        DmaLinkedListItem* pItem = &m_linkedListItems[i - 1];
+        bool               isLast = (i == segmentCount - 1);
+        uint32_t           bufferAddress = (uint32_t)pSegments[i].pBuffer;
+
+        assert ( pSegments[i].pBuffer && pSegments[i].count > 0 );
+        pItem->srcAddr = isRead ? peripheralAddress : bufferAddress;
+        pItem->destAddr = isRead ? bufferAddress : peripheralAddress;
+        pItem->nextLli = isLast ? 0 : (uint32_t)(pItem + 1);
+        pItem->control = baseControl |
+                         (isLast ? DMACCxCONTROL_I : 0) |
+                         (pSegments[i].count & DMACCxCONTROL_TRANSFER_SIZE_MASK);
+        transferCount += pSegments[i].count;
+    }
+    assert ( transferCount <= DMACCxCONTROL_TRANSFER_SIZE_MASK );
+    m_byteCount += transferCount;
+
+    // Make sure that the Rx FIFO hasn't already overflown.
+    assert ( (_spi.spi->RIS & SSP_INTERRUPT_RX_OVERRUN) == 0 );
+
+    m_pCallback = pCallback;
+    m_pCallbackContext = pContext;
+    m_transferResult = true;
+    m_isTransferPending = true;
+
+    // Clear error and terminal complete interrupts for both channels.
+    uint32_t channelsMask = (1 << m_channelRx) | (1 << m_channelTx);
+    LPC_GPDMA->DMACIntTCClear = channelsMask;
+    LPC_GPDMA->DMACIntErrClr  = channelsMask;
+
+    // The channel on the scattered/gathered side of the transfer walks the linked list while the other channel just
+    // transfers transferCount bytes to/from a single location.
+    LPC_GPDMACH_TypeDef* pListChannel = isRead ? m_pChannelRx : m_pChannelTx;
+    LPC_GPDMACH_TypeDef* pFixedChannel = isRead ? m_pChannelTx : m_pChannelRx;
+    uint32_t             firstAddress = (uint32_t)pSegments[0].pBuffer;
+    assert ( pSegments[0].pBuffer && pSegments[0].count > 0 );
+    pListChannel->DMACCSrcAddr  = isRead ? peripheralAddress : firstAddress;
+    pListChannel->DMACCDestAddr = isRead ? firstAddress : peripheralAddress;
+    pListChannel->DMACCLLI      = (segmentCount > 1) ? (uint32_t)&m_linkedListItems[0] : 0;
+    pListChannel->DMACCControl  = baseControl |
+                                  ((segmentCount == 1) ? DMACCxCONTROL_I : 0) |
+                                  (pSegments[0].count & DMACCxCONTROL_TRANSFER_SIZE_MASK);
+
+    pFixedChannel->DMACCSrcAddr  = isRead ? (uint32_t)&m_fillByte : peripheralAddress;
+    pFixedChannel->DMACCDestAddr = isRead ? peripheralAddress : (uint32_t)&m_dummyRead;
+    pFixedChannel->DMACCLLI      = 0;
+    pFixedChannel->DMACCControl  = DMACCxCONTROL_I |
+                                   (DMACCxCONTROL_BURSTSIZE_4 << DMACCxCONTROL_SBSIZE_SHIFT) |
+                                   (DMACCxCONTROL_BURSTSIZE_4 << DMACCxCONTROL_DBSIZE_SHIFT) |
+                                   (transferCount & DMACCxCONTROL_TRANSFER_SIZE_MASK);
+
+    enableTransferChannels(true);
+}
+
+void SPIDma::enableTransferChannels(bool isAsync)
+{
     // Enable receive and transmit channels.
+    // Only the receive channel needs to interrupt for async transfers since it always completes after the transmit
+    // channel. The Rx FIFO overflow interrupt is also enabled in the SSP so that a stalled transfer isn't left hanging.
+    uint32_t interruptFlags = isAsync ? (DMACCxCONFIG_IE | DMACCxCONFIG_ITC) : 0;
     m_pChannelRx->DMACCConfig = DMACCxCONFIG_ENABLE |
                    (m_sspRx << DMACCxCONFIG_SRC_PERIPHERAL_SHIFT) |
                    DMACCxCONFIG_TRANSFER_TYPE_P2M |
-                   DMACCxCONFIG_IE |
-                   DMACCxCONFIG_ITC;
+                   interruptFlags;
     m_pChannelTx->DMACCConfig = DMACCxCONFIG_ENABLE |
                    (m_sspTx << DMACCxCONFIG_DEST_PERIPHERAL_SHIFT) |
-                   DMACCxCONFIG_TRANSFER_TYPE_M2P |
-                   DMACCxCONFIG_IE |
-                   DMACCxCONFIG_ITC;
+                   DMACCxCONFIG_TRANSFER_TYPE_M2P;
+    _spi.spi->IMSC = isAsync ? SSP_INTERRUPT_RX_OVERRUN : 0;
 
     // Turn on DMA requests in SSP.
     _spi.spi->DMACR = 0x3;
+}
 
-    // Wait for the DMA transmit to complete.
-    while ((LPC_GPDMA->DMACIntStat & (1 << m_channelTx)) == 0)
+void SPIDma::abortTransferOnRxOverflow()
+{
+    // Turn off DMA requests in SSP.
+    _spi.spi->DMACR = 0x0;
+
+    // Halt the Rx DMA channel and stop the Tx DMA channel if it hasn't already completed.
+    m_pChannelRx->DMACCConfig = DMACCxCONFIG_HALT;
+    while (m_pChannelRx->DMACCConfig & DMACCxCONFIG_ACTIVE)
     {
     }
+    m_pChannelTx->DMACCConfig = 0;
 
-    // Wait for the DMA receive to complete. End early if Rx FIFO overflowed.
-    uint32_t iteration = 0;
-    while ((LPC_GPDMA->DMACIntStat & (1 << m_channelRx)) == 0)
+    // Flush any remaining Rx FIFO data.
+    while (isBusy())
     {
-        // Check for Rx FIFO overflow every so often. Don't do it all the time since reading SPI peripheral registers
-        // too often will slow down the DMA operations on the same peripheral.
-        if ((++iteration & (16 - 1)) == 0 && _spi.spi->RIS & (1 << 0))
-        {
-            // Turn off DMA requests in SSP.
-            _spi.spi->DMACR = 0x0;
-
-            // Halt the Rx DMA channel.
-            m_pChannelRx->DMACCConfig = DMACCxCONFIG_HALT;
-            while (m_pChannelRx->DMACCConfig & DMACCxCONFIG_ACTIVE)
-            {
-            }
-
-            // Flush any remaining Rx FIFO data.
-            waitForCompletion();
-            while (isReadable())
-            {
-                sspRead();
-            }
-
-            // Clear the Rx overflow error.
-            _spi.spi->ICR = 1 << 0;
-            retVal = false;
-            break;
-        }
+    }
+    completeDiscardedReads();
+    while (isReadable())
+    {
+        sspRead();
     }
 
-    // Turn off DMA requests in SSP.
+    // Clear the Rx overflow error.
+    _spi.spi->ICR = SSP_INTERRUPT_RX_OVERRUN;
+}
+
+void SPIDma::completeAsyncTransfer(bool wasSuccessful)
+{
+    // The DMA and SSP overflow interrupts can race each other so only the first to arrive completes the transfer.
+    if (!m_isTransferPending)
+    {
+        return;
+    }
+
+    _spi.spi->IMSC = 0;
     _spi.spi->DMACR = 0x0;
 
-    return retVal;
+    // Clear the pending flag before issuing the callback so that it can start another transfer.
+    m_transferResult = wasSuccessful;
+    m_isTransferPending = false;
+    if (m_pCallback)
+    {
+        m_pCallback(m_pCallbackContext, wasSuccessful);
+    }
+}
+
+void SPIDma::rxChannelHandler(void* pContext, int isError)
+{
+    SPIDma* pThis = (SPIDma*)pContext;
+    pThis->completeAsyncTransfer(!isError);
+}
+
+void SPIDma::ssp0IrqHandler()
+{
+    handleSspInterrupt(s_pSspOwners[0]);
+}
+
+void SPIDma::ssp1IrqHandler()
+{
+    handleSspInterrupt(s_pSspOwners[1]);
+}
+
+void SPIDma::handleSspInterrupt(SPIDma* pThis)
+{
+    if (!pThis)
+    {
+        return;
+    }
+    if (pThis->_spi.spi->MIS & SSP_INTERRUPT_RX_OVERRUN)
+    {
+        pThis->abortTransferOnRxOverflow();
+        pThis->completeAsyncTransfer(false);
+    }
 }
 
 void SPIDma::waitForCompletion()
 {
+    waitForTransfer();
     while (isBusy())
     {
     }
@@ -14,6 +14,10 @@
 */
 // Class to expose greater SPI functionality than the stock SPI class from the mbed SDK:
 // * A transfer() method which utilizes DMA to reduce CPU overhead.
+// * A transferAsync() method which starts a DMA transfer and returns immediately, signalling completion from the
+//   GPDMA interrupt so that the CPU can do other work (ie. CRC calculations) while the data is on the wire.
+// * readScatterAsync() and writeGatherAsync() methods which use GPDMA linked lists to transfer to/from multiple
+//   non-contiguous buffers as a single DMA operation.
 // * Separate send() and exchange() methods so that a user only needs to block on SPI reads as needed. The mbed SDK
 //   version always blocks and waits for each byte to go over the wire, not taking advantage of the FIFO.
 #ifndef SPI_DMA_H_
@@ -22,6 +26,9 @@
 // Only need to set this 1 when running LoopbackTest. It allows the test to peek in and see what reads were discarded.
 #define SPIDMA_LOOP_BACK_TEST 0
 
+// Maximum number of buffers which can be passed into a single readScatterAsync() or writeGatherAsync() call.
+#define SPIDMA_MAX_SEGMENTS 8
+
 
 #include <mbed.h>
 #include "GPDMA.h"
@@ -30,6 +37,17 @@
 class SPIDma : public SPI
 {
 public:
+    // Called from interrupt context when a transfer started with transferAsync() completes. wasSuccessful is false if
+    // the receive FIFO overflowed or the DMA controller flagged an error.
+    typedef void (*TransferCallback)(void* pContext, bool wasSuccessful);
+
+    // Describes one of the buffers in a readScatterAsync() or writeGatherAsync() list.
+    struct Segment
+    {
+        void*  pBuffer;
+        size_t count;
+    };
+
     SPIDma(PinName mosi, PinName miso, PinName sclk, PinName ssel = NC, int sselInitVal = 1);
     ~SPIDma();
 
@@ -47,8 +65,35 @@ public:
     //  if the receive FIFO overflows.
     //  NOTE: Only supports 8-bit element transfers currently.
     bool transfer(const void* pvWrite, size_t writeCount, void* pvRead, size_t readCount);
+    //  Start the same multi-byte DMA read/write as transfer() but return as soon as the DMA channels are running.
+    //  Completion can be detected by polling isTransferPending(), blocking in waitForTransfer(), or by providing a
+    //  pCallback which will be invoked from interrupt context. The pvWrite and pvRead buffers must remain valid until
+    //  the transfer completes. Any other SPIDma method called while the transfer is pending will first wait for it
+    //  to complete.
+    void transferAsync(const void* pvWrite, size_t writeCount, void* pvRead, size_t readCount,
+                       TransferCallback pCallback = NULL, void* pContext = NULL);
+    //  Start an asynchronous read which sends 0xFF for each byte and scatters the received bytes across the buffers
+    //  in pSegments, in order. The segments are chained together with GPDMA linked list items so that the whole list
+    //  is read with a single DMA operation. Completion is signalled the same way as transferAsync(). The segment list
+    //  is copied so only the buffers it points to need to remain valid until the transfer completes. There can be no
+    //  more than SPIDMA_MAX_SEGMENTS segments and they can't total more than 4095 bytes.
+    void readScatterAsync(const Segment* pSegments, size_t segmentCount,
+                          TransferCallback pCallback = NULL, void* pContext = NULL);
+    //  Start an asynchronous write which gathers the bytes to be sent from the buffers in pSegments, in order. The
+    //  corresponding MISO data is discarded. Has the same restrictions as readScatterAsync().
+    void writeGatherAsync(const Segment* pSegments, size_t segmentCount,
+                          TransferCallback pCallback = NULL, void* pContext = NULL);
+    //  Returns true while a transfer started with transferAsync() is still in progress.
+    bool isTransferPending();
+    //  Blocks until any transfer started with transferAsync() has completed. Returns the same result that transfer()
+    //  would have returned for that transfer (true if no transfer was pending). Must not be called with interrupts
+    //  disabled.
+    bool waitForTransfer();
     //  This is a non-blocking write. The corresponding MOSI data is ignored.
     void send(int data);
+    //  Non-blocking write of a short run of bytes (ie. a 6-byte command packet). Bytes are pushed into the transmit
+    //  FIFO as a burst, blocking only when it fills, rather than checking FIFO state before every byte as send() does.
+    void send(const void* pvData, size_t count);
     // Waits for all data in the transmit FIFO to be completely sent before returning.
     void waitForCompletion();
     // Number of bytes that have been transferred.
@@ -102,7 +147,21 @@ protected:
     int  isWriteable();
     void completeDiscardedReads();
     bool isBusy();
+    void startTransfer(const void* pvWrite, size_t writeCount, void* pvRead, size_t readCount, bool isAsync);
+    void startScatterGatherTransfer(const Segment* pSegments, size_t segmentCount, bool isRead,
+                                    TransferCallback pCallback, void* pContext);
+    void enableTransferChannels(bool isAsync);
+    void abortTransferOnRxOverflow();
+    void completeAsyncTransfer(bool wasSuccessful);
+
+    static void rxChannelHandler(void* pContext, int isError);
+    static void ssp0IrqHandler();
+    static void ssp1IrqHandler();
+    static void handleSspInterrupt(SPIDma* pThis);
+
+    static SPIDma*          s_pSspOwners[2];
 
+    DmaLinkedListItem       m_linkedListItems[SPIDMA_MAX_SEGMENTS - 1];
     LPC_GPDMACH_TypeDef*    m_pChannelRx;
     LPC_GPDMACH_TypeDef*    m_pChannelTx;
     DigitalOut              m_cs;
@@ -112,6 +171,13 @@ protected:
     uint32_t                m_sspRx;
     uint32_t                m_sspTx;
     uint32_t                m_byteCount;
+    uint32_t                m_sspIndex;
+    uint32_t                m_dummyRead;
+    uint32_t                m_fillByte;
+    TransferCallback        m_pCallback;
+    void*                   m_pCallbackContext;
+    volatile bool           m_isTransferPending;
+    volatile bool           m_transferResult;
 };
 
 #endif /* SPI_DMA_H_ */
@@ -299,6 +299,7 @@ int main()
     }
 
     dumpSdCounters(&g_sd);
+    dumpLatencyStats(&g_sd);
     printf("Test Completed!\n");
 
     return 0;
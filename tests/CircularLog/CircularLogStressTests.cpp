@@ -0,0 +1,287 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <CircularLog.h>
+#include <printfSpy.h>
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+
+// Each thread logs RECORD_COUNT records of the form "A000123\n" where the letter identifies the thread and the digits
+// are the record's sequence number within that thread.
+static const uint32_t THREAD_COUNT = 4;
+static const uint32_t RECORD_COUNT = 2000;
+static const size_t   RECORD_LENGTH = 8;
+
+// Big enough to hold every record logged by all of the threads.
+typedef CircularLog<65536, 16> BigLog;
+// Small enough that the threads overflow it many times over.
+typedef CircularLog<4096, 16>  SmallLog;
+
+
+// Log which can leave a record part way through being copied in, as if its writer had been preempted by the thread
+// calling dump(). The record uses the letter after the writer threads'.
+class StalledWriterLog : public BigLog
+{
+public:
+    void startStalledRecord(uint32_t sequence)
+    {
+        snprintf(m_record, sizeof(m_record), "%c%06u\n", 'A' + THREAD_COUNT, sequence);
+        CHECK_TRUE(reserve(RECORD_LENGTH, &m_position, &m_slot));
+        copy(m_position, m_record, RECORD_LENGTH / 2);
+    }
+
+    void finishStalledRecord()
+    {
+        copy(m_position + RECORD_LENGTH / 2, m_record + RECORD_LENGTH / 2, RECORD_LENGTH / 2);
+        commit(RECORD_LENGTH, m_slot);
+    }
+
+protected:
+    char     m_record[RECORD_LENGTH + 1];
+    uint32_t m_position;
+    uint32_t m_slot;
+};
+
+
+template <class LOG>
+struct WriterThread
+{
+    LOG*      pLog;
+    char      id;
+    pthread_t thread;
+};
+
+template <class LOG>
+static void* writerThread(void* pv)
+{
+    WriterThread<LOG>* pThread = (WriterThread<LOG>*)pv;
+    for (uint32_t i = 0 ; i < RECORD_COUNT ; i++)
+    {
+        pThread->pLog->log("%c%06u\n", pThread->id, i);
+        if ((i & 63) == 0)
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+
+TEST_GROUP(CircularLogStress)
+{
+    WriterThread<BigLog>   m_bigThreads[THREAD_COUNT];
+    WriterThread<SmallLog> m_smallThreads[THREAD_COUNT];
+    char                   m_output[65536];
+
+    void setup()
+    {
+        printfSpy_Hook(sizeof(m_output));
+    }
+
+    void teardown()
+    {
+        printfSpy_Unhook();
+    }
+
+    template <class LOG>
+    void startWriters(WriterThread<LOG>* pThreads, LOG* pLog)
+    {
+        for (uint32_t i = 0 ; i < THREAD_COUNT ; i++)
+        {
+            pThreads[i].pLog = pLog;
+            pThreads[i].id = 'A' + i;
+            LONGS_EQUAL(0, pthread_create(&pThreads[i].thread, NULL, writerThread<LOG>, &pThreads[i]));
+        }
+    }
+
+    template <class LOG>
+    void joinWriters(WriterThread<LOG>* pThreads)
+    {
+        for (uint32_t i = 0 ; i < THREAD_COUNT ; i++)
+        {
+            LONGS_EQUAL(0, pthread_join(pThreads[i].thread, NULL));
+        }
+    }
+
+    // dump() makes two fprintf() calls when the log wraps around the end of its buffer so join them back together.
+    void dumpLog(CircularLogBase* pLog)
+    {
+        size_t callCount = printfSpy_GetCallCount();
+        pLog->dump(stderr);
+        size_t calls = printfSpy_GetCallCount() - callCount;
+
+        m_output[0] = '\0';
+        if (calls == 2)
+        {
+            strcat(m_output, printfSpy_GetPreviousOutput());
+        }
+        if (calls > 0)
+        {
+            strcat(m_output, printfSpy_GetLastOutput());
+        }
+    }
+
+    // Every record must be whole and each thread's records must be in the order it logged them. The oldest record is
+    // skipped when the log has overflowed since it will have lost its beginning. Returns the number of records found.
+    uint32_t validateRecords(bool hasOverflowed)
+    {
+        const char* pCurr = m_output;
+        int         lastSequence[THREAD_COUNT + 1];
+
+        if (hasOverflowed)
+        {
+            pCurr = strchr(m_output, '\n');
+            CHECK_TRUE(pCurr != NULL);
+            pCurr++;
+        }
+        LONGS_EQUAL(0, strlen(pCurr) % RECORD_LENGTH);
+        for (uint32_t i = 0 ; i < THREAD_COUNT + 1 ; i++)
+        {
+            lastSequence[i] = -1;
+        }
+
+        uint32_t recordCount = 0;
+        for ( ; *pCurr ; pCurr += RECORD_LENGTH, recordCount++)
+        {
+            uint32_t thread = pCurr[0] - 'A';
+            CHECK_TRUE(thread < THREAD_COUNT + 1);
+            int sequence = 0;
+            for (size_t i = 1 ; i < RECORD_LENGTH - 1 ; i++)
+            {
+                CHECK_TRUE(pCurr[i] >= '0' && pCurr[i] <= '9');
+                sequence = sequence * 10 + pCurr[i] - '0';
+            }
+            LONGS_EQUAL('\n', pCurr[RECORD_LENGTH - 1]);
+            CHECK_TRUE(sequence > lastSequence[thread]);
+            lastSequence[thread] = sequence;
+        }
+        return recordCount;
+    }
+};
+
+
+TEST(CircularLogStress, FourWritersWhichFitInLog_ShouldLogEveryRecordWhole)
+{
+    BigLog* pLog = new BigLog;
+
+    startWriters(m_bigThreads, pLog);
+    joinWriters(m_bigThreads);
+    dumpLog(pLog);
+
+    LONGS_EQUAL(THREAD_COUNT * RECORD_COUNT, validateRecords(false));
+    LONGS_EQUAL(0, pLog->droppedCount());
+    delete pLog;
+}
+
+TEST(CircularLogStress, FourWritersWhichOverflowLog_ShouldKeepMostRecentRecordsWhole)
+{
+    SmallLog* pLog = new SmallLog;
+
+    startWriters(m_smallThreads, pLog);
+    joinWriters(m_smallThreads);
+    dumpLog(pLog);
+
+    LONGS_EQUAL(4095, strlen(m_output));
+    LONGS_EQUAL(4095 / RECORD_LENGTH, validateRecords(true));
+    LONGS_EQUAL(0, pLog->droppedCount());
+    delete pLog;
+}
+
+TEST(CircularLogStress, DumpWhileFourWritersAreLogging_ShouldOnlyDumpWholeRecordsAndCountDroppedOnes)
+{
+    BigLog* pLog = new BigLog;
+
+    startWriters(m_bigThreads, pLog);
+    for (int i = 0 ; i < 200 ; i++)
+    {
+        dumpLog(pLog);
+        validateRecords(false);
+    }
+    joinWriters(m_bigThreads);
+    dumpLog(pLog);
+
+    LONGS_EQUAL(THREAD_COUNT * RECORD_COUNT - pLog->droppedCount(), validateRecords(false));
+    delete pLog;
+}
+
+TEST(CircularLogStress, ClearWhileFourWritersAreLogging_ShouldLeaveLogStartingOnRecordBoundary)
+{
+    BigLog* pLog = new BigLog;
+
+    startWriters(m_bigThreads, pLog);
+    for (int i = 0 ; i < 200 ; i++)
+    {
+        pLog->clear();
+        sched_yield();
+        dumpLog(pLog);
+        validateRecords(false);
+    }
+    joinWriters(m_bigThreads);
+    pLog->clear();
+
+    CHECK_TRUE(pLog->isEmpty());
+    delete pLog;
+}
+
+TEST(CircularLogStress, DumpWhileWriterIsStalledMidRecord_ShouldNotWaitForItAndOnlyDumpRecordsBeforeIt)
+{
+    StalledWriterLog* pLog = new StalledWriterLog;
+    pLog->log("%c%06u\n", 'A' + THREAD_COUNT, 0);
+    pLog->log("%c%06u\n", 'A' + THREAD_COUNT, 1);
+    pLog->startStalledRecord(2);
+
+    startWriters(m_bigThreads, (BigLog*)pLog);
+    for (int i = 0 ; i < 50 ; i++)
+    {
+        dumpLog(pLog);
+        LONGS_EQUAL(2, validateRecords(false));
+    }
+    joinWriters(m_bigThreads);
+    dumpLog(pLog);
+    LONGS_EQUAL(2, validateRecords(false));
+
+    pLog->finishStalledRecord();
+    dumpLog(pLog);
+    LONGS_EQUAL(3 + THREAD_COUNT * RECORD_COUNT - pLog->droppedCount(), validateRecords(false));
+    delete pLog;
+}
+
+TEST(CircularLogStress, ClearWhileWriterIsStalledMidRecord_ShouldNotWaitForItOrDumpItOnceFinished)
+{
+    StalledWriterLog* pLog = new StalledWriterLog;
+    pLog->log("%c%06u\n", 'A' + THREAD_COUNT, 0);
+    pLog->startStalledRecord(1);
+
+    startWriters(m_bigThreads, (BigLog*)pLog);
+    for (int i = 0 ; i < 50 ; i++)
+    {
+        pLog->clear();
+        sched_yield();
+        dumpLog(pLog);
+        validateRecords(false);
+    }
+    joinWriters(m_bigThreads);
+    pLog->clear();
+    pLog->finishStalledRecord();
+
+    CHECK_TRUE(pLog->isEmpty());
+    dumpLog(pLog);
+    LONGS_EQUAL(0, validateRecords(false));
+    delete pLog;
+}
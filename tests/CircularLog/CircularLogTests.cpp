@@ -20,6 +20,24 @@
 // Include C++ headers for test harness.
 #include "CppUTest/TestHarness.h"
 
+// Log which can be held as if by a dump() or clear() running on another thread.
+class HeldLog : public CircularLog<9,8>
+{
+public:
+    void hold()
+    {
+        CHECK_TRUE(lockOutWriters(&m_heldPosition));
+    }
+
+    void release()
+    {
+        allowWriters(m_heldPosition);
+    }
+
+protected:
+    uint32_t m_heldPosition;
+};
+
 TEST_GROUP(CircularLog)
 {
     void setup()
@@ -166,4 +184,22 @@ TEST(CircularLog, IsEmptyAfterClear_ShouldReturnTrue)
     log.log("\n");
     log.clear();
     CHECK_TRUE(log.isEmpty());
-}
\ No newline at end of file
+}
+
+TEST(CircularLog, DumpAndClearWhileAnotherDumpHoldsLog_ShouldGiveUpRatherThanWait)
+{
+    HeldLog log;
+    log.log("Test %d\n", 1);
+    log.hold();
+
+    log.dump(stderr);
+    log.clear();
+    log.log("Test %d\n", 2);
+
+    LONGS_EQUAL(0, printfSpy_GetCallCount());
+    LONGS_EQUAL(1, log.droppedCount());
+    log.release();
+    log.dump(stderr);
+    LONGS_EQUAL(1, printfSpy_GetCallCount());
+    STRCMP_EQUAL("Test 1\n", printfSpy_GetLastOutput());
+}
@@ -0,0 +1,122 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Host microbenchmark which measures the throughput of each SDCRC::crc16() kernel over 512-byte blocks.
+
+   Results are for the host CPU and are only intended for comparing kernels. The relative cost of table lookups is
+   different on the Cortex-M3 so any change to the default kernel should be confirmed with PerformanceTest on hardware.
+
+   It also compares crc16Copy() against a crc16() followed by a memcpy() for the sizes of copy which FatFs makes out of a
+   freshly read sector for small f_read() calls, along with the bytes of memory that the CPU reads and writes for each.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <SDCRC.h>
+
+
+typedef uint16_t (*Crc16Function)(const uint8_t* pData, size_t length, uint16_t crc);
+
+static const uint32_t g_iterations = 200000;
+
+static uint32_t g_block[512 / sizeof(uint32_t)];
+static uint8_t  g_copy[512];
+static uint32_t g_copySizes[] = { 16, 128, 256, 500 };
+
+
+static void     benchmarkKernel(const char* pDescription, Crc16Function pCrc16);
+static void     benchmarkCopy(uint32_t copySize);
+static uint64_t microseconds();
+
+
+int main(int argc, char** argv)
+{
+    uint8_t* pBlock = (uint8_t*)g_block;
+    for (size_t i = 0 ; i < sizeof(g_block) ; i++)
+    {
+        pBlock[i] = (uint8_t)(i * 31 + (i >> 3));
+    }
+
+    benchmarkKernel("CRC16_KERNEL_TABLE", SDCRC::crc16Table);
+    benchmarkKernel("CRC16_KERNEL_SLICE_BY_4", SDCRC::crc16SliceBy4);
+    benchmarkKernel("CRC16_KERNEL_SLICE_BY_8", SDCRC::crc16SliceBy8);
+
+    // crc16Copy() only fuses the copy into the slice-by-4 kernel so compare it against the same kernel.
+    printf("\nCRC16 of a 512-byte block plus copy of its head (CRC16_KERNEL_SLICE_BY_4)\n");
+    SDCRC::setCrc16Kernel(SDCRC::CRC16_KERNEL_SLICE_BY_4);
+    for (size_t i = 0 ; i < sizeof(g_copySizes)/sizeof(g_copySizes[0]) ; i++)
+    {
+        benchmarkCopy(g_copySizes[i]);
+    }
+
+    return 0;
+}
+
+static void benchmarkKernel(const char* pDescription, Crc16Function pCrc16)
+{
+    // Chain the CRC from one block to the next so that the compiler can't hoist the calculation out of the loop.
+    uint16_t crc = pCrc16((const uint8_t*)g_block, sizeof(g_block), 0);
+    uint64_t start = microseconds();
+    for (uint32_t i = 0 ; i < g_iterations ; i++)
+    {
+        crc = pCrc16((const uint8_t*)g_block, sizeof(g_block), crc);
+    }
+    uint64_t elapsed = microseconds() - start;
+
+    double bytesPerSecond = (double)g_iterations * sizeof(g_block) * 1000000.0 / (double)elapsed;
+    printf("%-24s %8.1f MB/s %6.1f ns/block (crc=0x%04X)\n",
+           pDescription,
+           bytesPerSecond / (1024.0 * 1024.0),
+           (double)elapsed * 1000.0 / (double)g_iterations,
+           crc);
+}
+
+static void benchmarkCopy(uint32_t copySize)
+{
+    const uint8_t* pBlock = (const uint8_t*)g_block;
+
+    uint16_t crc = 0;
+    uint64_t start = microseconds();
+    for (uint32_t i = 0 ; i < g_iterations ; i++)
+    {
+        crc = SDCRC::crc16(pBlock, sizeof(g_block), crc);
+        memcpy(g_copy, pBlock, copySize);
+    }
+    uint64_t separateElapsed = microseconds() - start;
+    uint16_t separateCrc = crc;
+
+    crc = 0;
+    start = microseconds();
+    for (uint32_t i = 0 ; i < g_iterations ; i++)
+    {
+        crc = SDCRC::crc16Copy(g_copy, pBlock, sizeof(g_block), copySize, crc);
+    }
+    uint64_t fusedElapsed = microseconds() - start;
+
+    // The separate copy reads the head of the block a second time.
+    printf("%3u byte copy: crc16()+memcpy() %6.1f ns/block %4u bytes, crc16Copy() %6.1f ns/block %4u bytes%s\n",
+           copySize,
+           (double)separateElapsed * 1000.0 / (double)g_iterations,
+           (uint32_t)sizeof(g_block) + 2 * copySize,
+           (double)fusedElapsed * 1000.0 / (double)g_iterations,
+           (uint32_t)sizeof(g_block) + copySize,
+           crc == separateCrc ? "" : " (CRC MISMATCH)");
+}
+
+static uint64_t microseconds()
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
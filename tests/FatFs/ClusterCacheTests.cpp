@@ -0,0 +1,259 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "FatFsBase.h"
+
+
+static const uint32_t RANDOM_SEEKS = 200;
+static const uint32_t RECORD_SIZE = 100;
+
+
+TEST_GROUP_BASE(ClusterCache, FatFsBase)
+{
+    uint32_t m_random;
+    uint32_t m_chain[4096];
+
+    void setup()
+    {
+        FatFsBase::setup();
+        m_random = 1;
+    }
+
+    uint32_t nextRandom()
+    {
+        m_random = m_random * 1103515245 + 12345;
+        return m_random >> 8;
+    }
+
+    // Writes files A and B a chunk at a time, in turn, so that each ends up with chunkCount runs of chunkClusters.
+    void writeInterleavedFiles(const char* pFilenameA, const char* pFilenameB, uint32_t chunkClusters,
+                               uint32_t chunkCount)
+    {
+        FIL fileA;
+        FIL fileB;
+        LONGS_EQUAL(FR_OK, f_open(&fileA, pFilenameA, FA_CREATE_ALWAYS | FA_WRITE));
+        LONGS_EQUAL(FR_OK, f_open(&fileB, pFilenameB, FA_CREATE_ALWAYS | FA_WRITE));
+        for (uint32_t i = 0 ; i < chunkCount ; i++)
+        {
+            appendPattern(&fileA, chunkClusters * clusterSize(), 1);
+            appendPattern(&fileB, chunkClusters * clusterSize(), 2);
+        }
+        LONGS_EQUAL(FR_OK, f_close(&fileA));
+        LONGS_EQUAL(FR_OK, f_close(&fileB));
+    }
+
+    uint32_t countRuns(uint32_t sclust)
+    {
+        uint32_t length = readChain(sclust, m_chain, sizeof(m_chain) / sizeof(m_chain[0]));
+        uint32_t runs = 0;
+        for (uint32_t i = 0 ; i < length ; i++)
+        {
+            if (i == 0 || m_chain[i] != m_chain[i - 1] + 1)
+            {
+                runs++;
+            }
+        }
+        return runs;
+    }
+
+    // Every cached run must be sorted, not overlap the next one, and agree with the chain in the FAT on the card.
+    void validateClusterCache(const CLCACHE* pCache, uint32_t sclust)
+    {
+        uint32_t length = readChain(sclust, m_chain, sizeof(m_chain) / sizeof(m_chain[0]));
+        CHECK_TRUE(pCache->used <= _CLUSTER_CACHE_EXTENTS);
+        for (uint32_t i = 0 ; i < pCache->used ; i++)
+        {
+            const CLEXT* pExtent = &pCache->ext[i];
+            CHECK_TRUE(pExtent->ncl > 0);
+            CHECK_TRUE(pExtent->fcl + pExtent->ncl <= length);
+            if (i > 0)
+            {
+                CHECK_TRUE(pCache->ext[i - 1].fcl + pCache->ext[i - 1].ncl <= pExtent->fcl);
+            }
+            for (uint32_t j = 0 ; j < pExtent->ncl ; j++)
+            {
+                LONGS_EQUAL(m_chain[pExtent->fcl + j], pExtent->clst + j);
+            }
+        }
+    }
+
+    void readWholeFile(FIL* pFile, uint32_t seed)
+    {
+        checkRead(pFile, 0, pFile->fsize, seed);
+    }
+
+    // Reads RECORD_SIZE bytes from RANDOM_SEEKS random offsets and returns the number of FAT sectors read to do it.
+    uint32_t readRandomRecords(FIL* pFile, uint32_t seed)
+    {
+        m_random = 1;
+        resetCounts();
+        for (uint32_t i = 0 ; i < RANDOM_SEEKS ; i++)
+        {
+            uint32_t offset = nextRandom() % (pFile->fsize - RECORD_SIZE);
+            checkRead(pFile, offset, RECORD_SIZE, seed);
+        }
+        return g_simDisk.fatSectorsRead;
+    }
+
+    uint32_t readRandomRecordsWithoutCache(const char* pFilename, uint32_t seed)
+    {
+        FIL file;
+        LONGS_EQUAL(FR_OK, f_open(&file, pFilename, FA_OPEN_EXISTING | FA_READ));
+        uint32_t fatSectorsRead = readRandomRecords(&file, seed);
+        LONGS_EQUAL(FR_OK, f_close(&file));
+        return fatSectorsRead;
+    }
+};
+
+
+TEST(ClusterCache, ContiguousFile_RandomSeeksAfterWarmup_ShouldReadNoFatSectors)
+{
+    // 2000 clusters span 16 FAT sectors, more than the FatFs window and its pool can hold.
+    const uint32_t clusterCount = 2000;
+    FIL            file;
+    CLCACHE        cache;
+    writeFile("0:/contig.bin", clusterCount * clusterSize(), 1);
+    remount();
+    LONGS_EQUAL(FR_OK, f_open(&file, "0:/contig.bin", FA_OPEN_EXISTING | FA_READ));
+    cache.used = 0;
+    file.clcache = &cache;
+
+    readWholeFile(&file, 1);
+    LONGS_EQUAL(1, cache.used);
+    // The first cluster comes from the directory entry so it isn't cached.
+    LONGS_EQUAL(clusterCount - 1, cache.ext[0].ncl);
+    validateClusterCache(&cache, file.sclust);
+        LONGS_EQUAL(0, readRandomRecords(&file, 1));
+    LONGS_EQUAL(FR_OK, f_close(&file));
+
+        CHECK_TRUE(readRandomRecordsWithoutCache("0:/contig.bin", 1) > 0);
+}
+
+TEST(ClusterCache, FragmentedFile_RandomSeeksAfterWarmup_ShouldReadNoFatSectors)
+{
+    FIL     file;
+    CLCACHE cache;
+    writeInterleavedFiles("0:/a.bin", "0:/b.bin", 64, 8);
+    remount();
+    LONGS_EQUAL(FR_OK, f_open(&file, "0:/a.bin", FA_OPEN_EXISTING | FA_READ));
+    LONGS_EQUAL(8, countRuns(file.sclust));
+    cache.used = 0;
+    file.clcache = &cache;
+
+    readWholeFile(&file, 1);
+    LONGS_EQUAL(8, cache.used);
+    validateClusterCache(&cache, file.sclust);
+        LONGS_EQUAL(0, readRandomRecords(&file, 1));
+    LONGS_EQUAL(FR_OK, f_close(&file));
+
+        CHECK_TRUE(readRandomRecordsWithoutCache("0:/a.bin", 1) > 0);
+    checkFile("0:/b.bin", 8 * 64 * clusterSize(), 2);
+}
+
+TEST(ClusterCache, MoreRunsThanExtents_ShouldEvictRunsAndStillReadCorrectData)
+{
+    const uint32_t chunkCount = _CLUSTER_CACHE_EXTENTS + 4;
+    FIL            file;
+    CLCACHE        cache;
+    writeInterleavedFiles("0:/a.bin", "0:/b.bin", 8, chunkCount);
+    remount();
+    LONGS_EQUAL(FR_OK, f_open(&file, "0:/a.bin", FA_OPEN_EXISTING | FA_READ));
+    LONGS_EQUAL(chunkCount, countRuns(file.sclust));
+    cache.used = 0;
+    file.clcache = &cache;
+
+    readWholeFile(&file, 1);
+    LONGS_EQUAL(_CLUSTER_CACHE_EXTENTS, cache.used);
+    validateClusterCache(&cache, file.sclust);
+    readRandomRecords(&file, 1);
+    LONGS_EQUAL(_CLUSTER_CACHE_EXTENTS, cache.used);
+    validateClusterCache(&cache, file.sclust);
+    LONGS_EQUAL(FR_OK, f_close(&file));
+}
+
+TEST(ClusterCache, AppendAfterSeekWhileOtherFileAllocates_ShouldCacheNewRunsAndKeepData)
+{
+    const uint32_t chunkSize = 100 * clusterSize();
+    FIL            file;
+    CLCACHE        cache;
+    LONGS_EQUAL(FR_OK, f_open(&file, "0:/a.bin", FA_CREATE_ALWAYS | FA_READ | FA_WRITE));
+    cache.used = 0;
+    file.clcache = &cache;
+
+    appendPattern(&file, chunkSize, 1);
+    writeFile("0:/b.bin", chunkSize, 2);
+    checkRead(&file, chunkSize / 2 + 7, RECORD_SIZE, 1);
+    LONGS_EQUAL(FR_OK, f_lseek(&file, file.fsize));
+    appendPattern(&file, chunkSize, 1);
+    writeFile("0:/c.bin", chunkSize, 3);
+    checkRead(&file, 10, RECORD_SIZE, 1);
+    LONGS_EQUAL(FR_OK, f_lseek(&file, file.fsize));
+    appendPattern(&file, chunkSize, 1);
+    LONGS_EQUAL(FR_OK, f_sync(&file));
+    LONGS_EQUAL(3, countRuns(file.sclust));
+    LONGS_EQUAL(3, cache.used);
+    validateClusterCache(&cache, file.sclust);
+        LONGS_EQUAL(0, readRandomRecords(&file, 1));
+    LONGS_EQUAL(FR_OK, f_close(&file));
+
+    remount();
+    checkFile("0:/a.bin", 3 * chunkSize, 1);
+    checkFile("0:/b.bin", chunkSize, 2);
+    checkFile("0:/c.bin", chunkSize, 3);
+}
+
+TEST(ClusterCache, TruncateThenReuseFreedClustersThenRegrow_ShouldDropStaleRuns)
+{
+    const uint32_t chunkSize = 100 * clusterSize();
+    FIL            file;
+    CLCACHE        cache;
+    LONGS_EQUAL(FR_OK, f_open(&file, "0:/a.bin", FA_CREATE_ALWAYS | FA_READ | FA_WRITE));
+    cache.used = 0;
+    file.clcache = &cache;
+    appendPattern(&file, 3 * chunkSize, 1);
+    readWholeFile(&file, 1);
+    LONGS_EQUAL(1, cache.used);
+    LONGS_EQUAL(299, cache.ext[0].ncl);
+
+    LONGS_EQUAL(FR_OK, f_lseek(&file, chunkSize));
+    LONGS_EQUAL(FR_OK, f_truncate(&file));
+    LONGS_EQUAL(FR_OK, f_sync(&file));
+    LONGS_EQUAL(0, cache.used);
+    LONGS_EQUAL(100, readChain(file.sclust, NULL, 4096));
+    // Make the next allocation reuse the clusters freed from the end of the file.
+    uint32_t freedCluster = file.sclust + 100;
+    m_fs.last_clust = freedCluster - 1;
+    writeFile("0:/b.bin", 2 * chunkSize, 2);
+    FIL fileB;
+    LONGS_EQUAL(FR_OK, f_open(&fileB, "0:/b.bin", FA_OPEN_EXISTING | FA_READ));
+    LONGS_EQUAL(freedCluster, fileB.sclust);
+    LONGS_EQUAL(FR_OK, f_close(&fileB));
+
+    readWholeFile(&file, 1);
+    LONGS_EQUAL(FR_OK, f_lseek(&file, file.fsize));
+    appendPattern(&file, 2 * chunkSize, 1);
+    LONGS_EQUAL(FR_OK, f_sync(&file));
+    LONGS_EQUAL(2, countRuns(file.sclust));
+    CHECK_FALSE(m_chain[100] >= freedCluster && m_chain[100] < freedCluster + 200);
+    validateClusterCache(&cache, file.sclust);
+    readWholeFile(&file, 1);
+    LONGS_EQUAL(2, cache.used);
+    validateClusterCache(&cache, file.sclust);
+    LONGS_EQUAL(FR_OK, f_close(&file));
+
+    remount();
+    checkFile("0:/a.bin", 3 * chunkSize, 1);
+    checkFile("0:/b.bin", 2 * chunkSize, 2);
+    checkFreeCount();
+}
@@ -0,0 +1,256 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Test fixture which runs FatFs on top of the SDFileSystem driver and a SDCardSim card so that the FatFs extensions
+   can be tested against a real volume. The card is formatted as FAT32 with 1 sector clusters so that files cover
+   many FAT sectors without needing much data. The FAT on the card can be read and written directly to check what
+   FatFs has done or to set up volumes which would take a long time to create through FatFs.
+*/
+#ifndef _FAT_FS_BASE_H_
+#define _FAT_FS_BASE_H_
+
+#include <string.h>
+#include <ff.h>
+#include <diskio.h>
+#include <SDFileSystem.h>
+#include <SDCardSim.h>
+#include <SimSDFileSystem.h>
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+
+// State shared with the FatFs disk_*() functions in SimDisk.cpp.
+struct SimDisk
+{
+    SimSDFileSystem* pSd;
+    // Sectors read by disk_read() and disk_read_copy() and how many of those were FAT sectors.
+    uint32_t         sectorsRead;
+    uint32_t         fatSectorsRead;
+    uint32_t         sectorsWritten;
+    // FAT sectors are those from fatStart up to, but not including, fatEnd.
+    uint32_t         fatStart;
+    uint32_t         fatEnd;
+    // Reading failReadSector fails after it has been read failReadSkip more times. Set to 0xFFFFFFFF to not fail.
+    uint32_t         failReadSector;
+    uint32_t         failReadSkip;
+};
+
+extern SimDisk g_simDisk;
+
+
+// Value of a FAT32 entry which marks the end of a cluster chain.
+#define FAT_EOC 0x0FFFFFFF
+
+// Offset of the free count in the FSINFO sector, followed by the next free hint.
+#define FSI_FREE_COUNT  488
+
+
+class FatFsBase : public Utest
+{
+protected:
+    // 64MB card which gives ~130k clusters.
+    enum { CARD_SECTORS = 64 * 1024 * 2 };
+
+    void setup()
+    {
+        m_pCard = new SDCardSim(CARD_SECTORS);
+        m_pSd = new SimSDFileSystem(m_pCard);
+        memset(&g_simDisk, 0, sizeof(g_simDisk));
+        g_simDisk.pSd = m_pSd;
+        g_simDisk.failReadSector = 0xFFFFFFFF;
+
+        LONGS_EQUAL(FR_OK, f_mount(&m_fs, "0:", 0));
+        LONGS_EQUAL(FR_OK, f_mkfs("0:", 0, 512));
+        remount();
+        LONGS_EQUAL(FS_FAT32, m_fs.fs_type);
+        LONGS_EQUAL(1, m_fs.csize);
+    }
+
+    void teardown()
+    {
+        f_mount(NULL, "0:", 0);
+        delete m_pSd;
+        delete m_pCard;
+        memset(&g_simDisk, 0, sizeof(g_simDisk));
+    }
+
+    void remount()
+    {
+        LONGS_EQUAL(FR_OK, f_mount(NULL, "0:", 0));
+        LONGS_EQUAL(FR_OK, f_mount(&m_fs, "0:", 1));
+        g_simDisk.fatStart = m_fs.fatbase;
+        g_simDisk.fatEnd = m_fs.fatbase + m_fs.n_fats * m_fs.fsize;
+    }
+
+    void resetCounts()
+    {
+        g_simDisk.sectorsRead = 0;
+        g_simDisk.fatSectorsRead = 0;
+        g_simDisk.sectorsWritten = 0;
+    }
+
+    // Contents of a test file with the given seed at a given offset. Each sector of a file is different.
+    static uint8_t patternByte(uint32_t seed, uint32_t offset)
+    {
+        return (uint8_t)(seed * 131 + offset * 7 + (offset >> 9) * 13);
+    }
+
+    static void fillPattern(uint8_t* pBuffer, size_t size, uint32_t seed, uint32_t offset)
+    {
+        for (size_t i = 0 ; i < size ; i++)
+        {
+            pBuffer[i] = patternByte(seed, offset + i);
+        }
+    }
+
+    void appendPattern(FIL* pFile, uint32_t size, uint32_t seed)
+    {
+        uint8_t buffer[1024];
+        while (size > 0)
+        {
+            UINT chunk = size < sizeof(buffer) ? size : sizeof(buffer);
+            UINT bytesWritten = 0;
+            fillPattern(buffer, chunk, seed, pFile->fptr);
+            LONGS_EQUAL(FR_OK, f_write(pFile, buffer, chunk, &bytesWritten));
+            LONGS_EQUAL(chunk, bytesWritten);
+            size -= chunk;
+        }
+    }
+
+    void writeFile(const char* pFilename, uint32_t size, uint32_t seed)
+    {
+        FIL file;
+        LONGS_EQUAL(FR_OK, f_open(&file, pFilename, FA_CREATE_ALWAYS | FA_WRITE));
+        appendPattern(&file, size, seed);
+        LONGS_EQUAL(FR_OK, f_close(&file));
+    }
+
+    // Reads size bytes at offset and checks that they match the pattern written with seed.
+    void checkRead(FIL* pFile, uint32_t offset, uint32_t size, uint32_t seed)
+    {
+        uint8_t actual[1024];
+        uint8_t expected[1024];
+        while (size > 0)
+        {
+            UINT chunk = size < sizeof(actual) ? size : sizeof(actual);
+            UINT bytesRead = 0;
+            LONGS_EQUAL(FR_OK, f_lseek(pFile, offset));
+            LONGS_EQUAL(FR_OK, f_read(pFile, actual, chunk, &bytesRead));
+            LONGS_EQUAL(chunk, bytesRead);
+            fillPattern(expected, chunk, seed, offset);
+            CHECK_TRUE(0 == memcmp(expected, actual, chunk));
+            offset += chunk;
+            size -= chunk;
+        }
+    }
+
+    void checkFile(const char* pFilename, uint32_t size, uint32_t seed)
+    {
+        FIL file;
+        LONGS_EQUAL(FR_OK, f_open(&file, pFilename, FA_OPEN_EXISTING | FA_READ));
+        LONGS_EQUAL(size, file.fsize);
+        checkRead(&file, 0, size, seed);
+        LONGS_EQUAL(FR_OK, f_close(&file));
+    }
+
+    uint32_t clusterSize()
+    {
+        return m_fs.csize * 512;
+    }
+
+    uint32_t fatEntry(uint32_t cluster)
+    {
+        uint32_t offset = cluster * 4;
+        uint8_t* pEntry = m_pCard->sector(m_fs.fatbase + offset / 512) + offset % 512;
+        return (pEntry[0] | (pEntry[1] << 8) | (pEntry[2] << 16) | ((uint32_t)pEntry[3] << 24)) & 0x0FFFFFFF;
+    }
+
+    // Writes straight to every FAT on the card so FatFs must be remounted to see the change.
+    void setFatEntry(uint32_t cluster, uint32_t value)
+    {
+        for (uint32_t fat = 0 ; fat < m_fs.n_fats ; fat++)
+        {
+            uint32_t offset = cluster * 4;
+            uint8_t* pEntry = m_pCard->sector(m_fs.fatbase + fat * m_fs.fsize + offset / 512) + offset % 512;
+            pEntry[0] = value;
+            pEntry[1] = value >> 8;
+            pEntry[2] = value >> 16;
+            pEntry[3] = (pEntry[3] & 0xF0) | ((value >> 24) & 0x0F);
+        }
+    }
+
+    // Marks the free count and next free hints in the FSINFO sector on the card as unknown, as needed after the FAT
+    // has been changed with setFatEntry().
+    void invalidateFsInfo()
+    {
+        uint8_t* pFsInfo = m_pCard->sector(m_fs.volbase + 1);
+        memset(pFsInfo + FSI_FREE_COUNT, 0xFF, 8);
+    }
+
+    // Counts the free clusters by scanning the FAT on the card, without FatFs or its free cluster map.
+    uint32_t scanFreeClusters()
+    {
+        uint32_t freeCount = 0;
+        for (uint32_t cluster = 2 ; cluster < m_fs.n_fatent ; cluster++)
+        {
+            if (fatEntry(cluster) == 0)
+            {
+                freeCount++;
+            }
+        }
+        return freeCount;
+    }
+
+    // Follows a cluster chain in the FAT on the card. Fills in pChain (if not NULL) and returns its length.
+    uint32_t readChain(uint32_t cluster, uint32_t* pChain, uint32_t maxLength)
+    {
+        uint32_t length = 0;
+        while (cluster >= 2 && cluster < m_fs.n_fatent)
+        {
+            CHECK_TRUE(length < maxLength);
+            if (pChain)
+            {
+                pChain[length] = cluster;
+            }
+            length++;
+            cluster = fatEntry(cluster);
+        }
+        LONGS_EQUAL(FAT_EOC, cluster);
+        return length;
+    }
+
+    uint32_t freeClusters()
+    {
+        DWORD   freeCount = 0;
+        FATFS*  pFs = NULL;
+        LONGS_EQUAL(FR_OK, f_getfree("0:", &freeCount, &pFs));
+        return freeCount;
+    }
+
+    // Checks that FatFs, a full FAT scan by FatFs and a scan of the FAT on the card all agree on the free count.
+    void checkFreeCount()
+    {
+        uint32_t scanned = scanFreeClusters();
+        LONGS_EQUAL(scanned, freeClusters());
+        m_fs.free_clust = 0xFFFFFFFF;
+        LONGS_EQUAL(scanned, freeClusters());
+    }
+
+    SDCardSim*       m_pCard;
+    SimSDFileSystem* m_pSd;
+    FATFS            m_fs;
+};
+
+#endif /* _FAT_FS_BASE_H_ */
@@ -0,0 +1,195 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "FatFsBase.h"
+
+
+TEST_GROUP_BASE(FreeMap, FatFsBase)
+{
+    uint32_t m_sclustA;
+    uint32_t m_sclustB;
+    uint32_t m_sclustD;
+
+    uint32_t groupSize()
+    {
+        return 1 << m_fs.fmap_shift;
+    }
+
+    bool isGroupFull(uint32_t cluster)
+    {
+        uint32_t group = cluster >> m_fs.fmap_shift;
+        return ((m_fs.fmap[group / 8] >> (group % 8)) & 1) != 0;
+    }
+
+    // Checks the groups which lie wholly inside a run of clusters in use.
+    void checkGroupsFull(uint32_t firstCluster, uint32_t clusterCount, bool isFull)
+    {
+        uint32_t cluster = (firstCluster + groupSize() - 1) & ~(groupSize() - 1);
+        uint32_t groups = 0;
+        for ( ; cluster + groupSize() <= firstCluster + clusterCount ; cluster += groupSize(), groups++)
+        {
+            CHECK_TRUE(isFull == isGroupFull(cluster));
+        }
+        CHECK_TRUE(groups > 0);
+    }
+
+    uint32_t firstCluster(const char* pFilename)
+    {
+        FIL file;
+        LONGS_EQUAL(FR_OK, f_open(&file, pFilename, FA_OPEN_EXISTING | FA_READ));
+        uint32_t cluster = file.sclust;
+        LONGS_EQUAL(FR_OK, f_close(&file));
+        return cluster;
+    }
+
+    // Files A, B and D sit next to each other at the start of the volume, each covering several free map groups.
+    void createFiles()
+    {
+        writeFile("0:/A.BIN", 4 * groupSize() * clusterSize(), 1);
+        writeFile("0:/B.BIN", 4 * groupSize() * clusterSize(), 2);
+        writeFile("0:/D.BIN", 4 * groupSize() * clusterSize(), 3);
+        m_sclustA = firstCluster("0:/A.BIN");
+        m_sclustB = firstCluster("0:/B.BIN");
+        m_sclustD = firstCluster("0:/D.BIN");
+        LONGS_EQUAL(m_sclustA + 4 * groupSize(), m_sclustB);
+        LONGS_EQUAL(m_sclustB + 4 * groupSize(), m_sclustD);
+    }
+
+    // A full scan by f_getfree() marks every group without a free cluster as full.
+    void markFullGroupsWithGetFree()
+    {
+        m_fs.free_clust = 0xFFFFFFFF;
+        freeClusters();
+        checkGroupsFull(2, m_sclustD + 4 * groupSize() - 2, true);
+    }
+
+    uint32_t createFileFromStartOfVolume(const char* pFilename, uint32_t size, uint32_t seed)
+    {
+        m_fs.last_clust = 1;
+        writeFile(pFilename, size, seed);
+        return firstCluster(pFilename);
+    }
+
+    void checkFiles()
+    {
+        remount();
+        checkFile("0:/A.BIN", 4 * groupSize() * clusterSize(), 1);
+        checkFile("0:/D.BIN", 4 * groupSize() * clusterSize(), 3);
+        checkFreeCount();
+        // Clearing the map makes FatFs scan the FAT rather than trust it.
+        memset(m_fs.fmap, 0, sizeof(m_fs.fmap));
+        m_fs.free_clust = 0xFFFFFFFF;
+        LONGS_EQUAL(scanFreeClusters(), freeClusters());
+    }
+};
+
+
+TEST(FreeMap, UnlinkFileInGroupsMarkedFullByGetFree_ShouldClearGroupsAndReuseClusters)
+{
+    createFiles();
+    markFullGroupsWithGetFree();
+
+        LONGS_EQUAL(FR_OK, f_unlink("0:/B.BIN"));
+    checkGroupsFull(m_sclustB, 4 * groupSize(), false);
+    checkGroupsFull(2, m_sclustB - 2, true);
+    LONGS_EQUAL(m_sclustB, createFileFromStartOfVolume("0:/C.BIN", 2 * groupSize() * clusterSize(), 4));
+    checkFiles();
+    checkFile("0:/C.BIN", 2 * groupSize() * clusterSize(), 4);
+}
+
+TEST(FreeMap, TruncateFileInGroupsMarkedFullByGetFree_ShouldClearGroupsAndReuseClusters)
+{
+    FIL file;
+    createFiles();
+    markFullGroupsWithGetFree();
+
+    LONGS_EQUAL(FR_OK, f_open(&file, "0:/B.BIN", FA_OPEN_EXISTING | FA_WRITE));
+    LONGS_EQUAL(FR_OK, f_lseek(&file, groupSize() * clusterSize()));
+        LONGS_EQUAL(FR_OK, f_truncate(&file));
+    LONGS_EQUAL(FR_OK, f_close(&file));
+    checkGroupsFull(m_sclustB + groupSize(), 3 * groupSize(), false);
+    LONGS_EQUAL(m_sclustB + groupSize(), createFileFromStartOfVolume("0:/C.BIN", clusterSize(), 4));
+    checkFiles();
+    checkFile("0:/C.BIN", clusterSize(), 4);
+}
+
+TEST(FreeMap, UnlinkFileInGroupsMarkedFullByCreateChain_ShouldClearGroupsAndReuseClusters)
+{
+    createFiles();
+    // Scanning from the start of the volume for a free cluster marks the groups which are in use as full.
+    uint32_t sclustC = createFileFromStartOfVolume("0:/C.BIN", clusterSize(), 4);
+    LONGS_EQUAL(m_sclustD + 4 * groupSize(), sclustC);
+    checkGroupsFull(m_sclustA, sclustC - m_sclustA, true);
+
+        LONGS_EQUAL(FR_OK, f_unlink("0:/B.BIN"));
+    LONGS_EQUAL(m_sclustB, createFileFromStartOfVolume("0:/E.BIN", clusterSize(), 5));
+    checkFiles();
+    checkFile("0:/C.BIN", clusterSize(), 4);
+    checkFile("0:/E.BIN", clusterSize(), 5);
+}
+
+TEST(FreeMap, PreallocAfterUnlinkInGroupsMarkedFull_ShouldFindFreedRun)
+{
+    FIL file;
+    createFiles();
+    markFullGroupsWithGetFree();
+    LONGS_EQUAL(FR_OK, f_unlink("0:/B.BIN"));
+
+    LONGS_EQUAL(FR_OK, f_open(&file, "0:/C.BIN", FA_CREATE_ALWAYS | FA_WRITE));
+    m_fs.last_clust = 1;
+        LONGS_EQUAL(FR_OK, f_prealloc(&file, 4 * groupSize() * clusterSize()));
+    LONGS_EQUAL(m_sclustB, file.sclust);
+    appendPattern(&file, 4 * groupSize() * clusterSize(), 4);
+    LONGS_EQUAL(FR_OK, f_close(&file));
+    checkFiles();
+    checkFile("0:/C.BIN", 4 * groupSize() * clusterSize(), 4);
+}
+
+TEST(FreeMap, ExtendChainWhenOnlyFreeClusterIsBelowItInSecondGroup_ShouldFindIt)
+{
+    // Group 0 covers clusters 0 to groupSize() - 1 so the free cluster is the first one in group 1. The chain is
+    // moved so that it ends just after it, which makes the scan wrap around the volume before reaching it.
+    const uint32_t freeCluster = groupSize();
+    const uint32_t lastCluster = groupSize() + 1;
+    writeFile("0:/A.BIN", 2 * clusterSize(), 1);
+    uint32_t sclust = firstCluster("0:/A.BIN");
+    memcpy(m_pCard->sector(m_fs.database + (lastCluster - 2) * m_fs.csize),
+           m_pCard->sector(m_fs.database + (sclust + 1 - 2) * m_fs.csize), clusterSize());
+    for (uint32_t cluster = 2 ; cluster < m_fs.n_fatent ; cluster++)
+    {
+        if (cluster != sclust && cluster != freeCluster && fatEntry(cluster) == 0)
+        {
+            setFatEntry(cluster, FAT_EOC);
+        }
+    }
+    setFatEntry(sclust, lastCluster);
+    setFatEntry(lastCluster, FAT_EOC);
+    invalidateFsInfo();
+    remount();
+    LONGS_EQUAL(1, freeClusters());
+    CHECK_TRUE(isGroupFull(2));
+    CHECK_FALSE(isGroupFull(freeCluster));
+
+    FIL file;
+    LONGS_EQUAL(FR_OK, f_open(&file, "0:/A.BIN", FA_OPEN_EXISTING | FA_WRITE));
+    LONGS_EQUAL(FR_OK, f_lseek(&file, file.fsize));
+        appendPattern(&file, clusterSize(), 1);
+    LONGS_EQUAL(FR_OK, f_close(&file));
+
+    LONGS_EQUAL(freeCluster, fatEntry(lastCluster));
+    remount();
+    checkFile("0:/A.BIN", 3 * clusterSize(), 1);
+    checkFreeCount();
+    LONGS_EQUAL(0, freeClusters());
+}
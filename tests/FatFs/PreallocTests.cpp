@@ -0,0 +1,158 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <FATFileHandle.h>
+#include "FatFsBase.h"
+
+
+TEST_GROUP_BASE(Prealloc, FatFsBase)
+{
+    FIL m_file;
+
+    void openFile(const char* pFilename)
+    {
+        LONGS_EQUAL(FR_OK, f_open(&m_file, pFilename, FA_CREATE_ALWAYS | FA_WRITE));
+    }
+
+    void checkClustersFree(uint32_t firstCluster, uint32_t clusterCount)
+    {
+        for (uint32_t i = 0 ; i < clusterCount ; i++)
+        {
+            LONGS_EQUAL(0, fatEntry(firstCluster + i));
+        }
+    }
+
+    uint32_t fileFirstCluster(const char* pFilename)
+    {
+        FIL file;
+        LONGS_EQUAL(FR_OK, f_open(&file, pFilename, FA_OPEN_EXISTING | FA_READ));
+        uint32_t cluster = file.sclust;
+        LONGS_EQUAL(FR_OK, f_close(&file));
+        return cluster;
+    }
+};
+
+
+TEST(Prealloc, PartlyUsedThenClosed_ShouldFreeUnusedTail)
+{
+    const uint32_t size = 30 * clusterSize() + clusterSize() / 2;
+    uint32_t       freeBefore = freeClusters();
+    openFile("0:/LOG.BIN");
+        LONGS_EQUAL(FR_OK, f_prealloc(&m_file, 100 * clusterSize()));
+    uint32_t sclust = m_file.sclust;
+    LONGS_EQUAL(100, m_file.pcl);
+    LONGS_EQUAL(freeBefore - 100, freeClusters());
+    appendPattern(&m_file, size, 1);
+    LONGS_EQUAL(FR_OK, f_close(&m_file));
+
+    LONGS_EQUAL(31, readChain(sclust, NULL, 100));
+    checkClustersFree(sclust + 31, 69);
+    LONGS_EQUAL(freeBefore - 31, freeClusters());
+    remount();
+    checkFile("0:/LOG.BIN", size, 1);
+    checkFreeCount();
+    LONGS_EQUAL(freeBefore - 31, freeClusters());
+}
+
+TEST(Prealloc, UnusedThenClosed_ShouldFreeWholeRunAndLeaveFileWithoutClusters)
+{
+    uint32_t freeBefore = freeClusters();
+    openFile("0:/LOG.BIN");
+        LONGS_EQUAL(FR_OK, f_prealloc(&m_file, 50 * clusterSize()));
+    uint32_t sclust = m_file.sclust;
+    LONGS_EQUAL(FR_OK, f_close(&m_file));
+
+    checkClustersFree(sclust, 50);
+    LONGS_EQUAL(freeBefore, freeClusters());
+    remount();
+    LONGS_EQUAL(0, fileFirstCluster("0:/LOG.BIN"));
+    checkFile("0:/LOG.BIN", 0, 1);
+    checkFreeCount();
+    LONGS_EQUAL(freeBefore, freeClusters());
+}
+
+TEST(Prealloc, FragmentedVolume_ShouldReturnNotContiguousAndLeaveFileUsable)
+{
+    // Use every 64th cluster so that no free run is longer than 63 clusters.
+    for (uint32_t cluster = 2 ; cluster < m_fs.n_fatent ; cluster += 64)
+    {
+        setFatEntry(cluster, FAT_EOC);
+    }
+    invalidateFsInfo();
+    remount();
+    uint32_t freeBefore = freeClusters();
+    openFile("0:/LOG.BIN");
+
+        LONGS_EQUAL(FR_NOT_CONTIGUOUS, f_prealloc(&m_file, 64 * clusterSize()));
+    LONGS_EQUAL(0, m_file.sclust);
+    LONGS_EQUAL(0, m_file.pcl);
+    LONGS_EQUAL(freeBefore, freeClusters());
+    LONGS_EQUAL(FR_OK, f_prealloc(&m_file, 63 * clusterSize()));
+    appendPattern(&m_file, 63 * clusterSize(), 1);
+    LONGS_EQUAL(FR_OK, f_close(&m_file));
+
+    remount();
+    checkFile("0:/LOG.BIN", 63 * clusterSize(), 1);
+    checkFreeCount();
+    LONGS_EQUAL(freeBefore - 63, freeClusters());
+}
+
+TEST(Prealloc, FileHandleOnFragmentedVolume_ShouldReturnNegativeNotContiguous)
+{
+    for (uint32_t cluster = 2 ; cluster < m_fs.n_fatent ; cluster += 64)
+    {
+        setFatEntry(cluster, FAT_EOC);
+    }
+    invalidateFsInfo();
+    remount();
+    uint32_t       freeBefore = freeClusters();
+    FATFileHandle* pHead = NULL;
+    openFile("0:/LOG.BIN");
+    FATFileHandle* pHandle = new FATFileHandle(m_file, &pHead);
+
+        int result = pHandle->preallocate(64 * clusterSize());
+    CHECK_TRUE(result < 0);
+    LONGS_EQUAL(FATFileHandle::PREALLOCATE_NOT_CONTIGUOUS, result);
+    LONGS_EQUAL(0, pHandle->preallocate(63 * clusterSize()));
+    LONGS_EQUAL(0, pHandle->close());
+    POINTERS_EQUAL(NULL, pHead);
+    checkFreeCount();
+    LONGS_EQUAL(freeBefore, freeClusters());
+}
+
+TEST(Prealloc, DiskErrorWhileLinkingRun_ShouldFreeClustersAlreadyLinked)
+{
+    // The run spans 16 FAT sectors. Fail the second read of one in the middle, which comes from put_fat() after
+    // find_free_run() has scanned past it and it has been pushed out of the window and pool.
+    const uint32_t clusterCount = 2000;
+    uint32_t       freeBefore = freeClusters();
+    openFile("0:/LOG.BIN");
+    g_simDisk.failReadSector = m_fs.fatbase + 8;
+    g_simDisk.failReadSkip = 1;
+
+        LONGS_EQUAL(FR_DISK_ERR, f_prealloc(&m_file, clusterCount * clusterSize()));
+    LONGS_EQUAL(0xFFFFFFFF, g_simDisk.failReadSector);
+    LONGS_EQUAL(0, m_file.sclust);
+    LONGS_EQUAL(freeBefore, freeClusters());
+    f_close(&m_file);
+    // Writing another file syncs the FAT to the card.
+    writeFile("0:/OTHER.BIN", clusterSize(), 2);
+    uint32_t otherCluster = fileFirstCluster("0:/OTHER.BIN");
+    checkClustersFree(otherCluster + 1, clusterCount);
+
+    remount();
+    checkFile("0:/OTHER.BIN", clusterSize(), 2);
+    checkFreeCount();
+    LONGS_EQUAL(freeBefore - 1, freeClusters());
+}
@@ -0,0 +1,168 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <SDStreamWriter.h>
+#include "FatFsBase.h"
+
+
+static const uint32_t MAX_SIZE = 64 * 1024;
+
+
+TEST_GROUP_BASE(SDStreamWriter, FatFsBase)
+{
+    SDStreamWriter* m_pWriter;
+    // Word aligned so that whole sectors can be streamed straight from it.
+    uint32_t        m_buffer[(4 * 512 + 8) / sizeof(uint32_t)];
+
+    void setup()
+    {
+        FatFsBase::setup();
+        m_pWriter = new SDStreamWriter(m_pSd);
+    }
+
+    void teardown()
+    {
+        delete m_pWriter;
+        FatFsBase::teardown();
+    }
+
+    // Writes length bytes of the pattern for the current end of the file, starting misaligned by skew bytes.
+    int writePattern(size_t length, size_t skew = 0)
+    {
+        uint8_t* pData = (uint8_t*)m_buffer + skew;
+        CHECK_TRUE(skew + length <= sizeof(m_buffer));
+        fillPattern(pData, length, 1, m_pWriter->size());
+        return m_pWriter->write(pData, length);
+    }
+
+    void checkWritePattern(size_t length, size_t skew = 0)
+    {
+        LONGS_EQUAL(length, writePattern(length, skew));
+    }
+
+    uint32_t fileFirstCluster(const char* pFilename)
+    {
+        FIL file;
+        LONGS_EQUAL(FR_OK, f_open(&file, pFilename, FA_OPEN_EXISTING | FA_READ));
+        uint32_t cluster = file.sclust;
+        LONGS_EQUAL(FR_OK, f_close(&file));
+        return cluster;
+    }
+};
+
+
+TEST(SDStreamWriter, UnalignedAndPartialWritesAcrossFlushes_ShouldReadBackThroughFatFs)
+{
+    LONGS_EQUAL(0, m_pWriter->open("LOG.BIN", MAX_SIZE));
+    checkWritePattern(100);
+    checkWritePattern(1000, 1);
+    LONGS_EQUAL(0, m_pWriter->flush());
+    checkFile("0:/LOG.BIN", 1100, 1);
+
+    checkWritePattern(7, 3);
+    checkWritePattern(512 - 1107 % 512);
+    checkWritePattern(3 * 512);
+    checkWritePattern(2 * 512 + 5, 2);
+    LONGS_EQUAL(0, m_pWriter->flush());
+    LONGS_EQUAL(4101, m_pWriter->size());
+    checkFile("0:/LOG.BIN", 4101, 1);
+
+    checkWritePattern(1);
+    LONGS_EQUAL(0, m_pWriter->flush());
+    checkWritePattern(4 * 512);
+    LONGS_EQUAL(0, m_pWriter->close());
+    CHECK_FALSE(m_pWriter->isOpen());
+
+    remount();
+    checkFile("0:/LOG.BIN", m_pWriter->size(), 1);
+    checkFreeCount();
+}
+
+TEST(SDStreamWriter, WriteBeyondReservedSpace_ShouldReturnShortCount)
+{
+    LONGS_EQUAL(0, m_pWriter->open("LOG.BIN", 1000));
+    checkWritePattern(800);
+
+        LONGS_EQUAL(200, writePattern(800));
+        LONGS_EQUAL(0, writePattern(1));
+
+    LONGS_EQUAL(1000, m_pWriter->size());
+    LONGS_EQUAL(0, m_pWriter->close());
+    remount();
+    checkFile("0:/LOG.BIN", 1000, 1);
+}
+
+TEST(SDStreamWriter, WriteStreamFailure_ShouldCloseFileAsOfLastFlushAndAllowReopen)
+{
+    LONGS_EQUAL(0, m_pWriter->open("LOG.BIN", MAX_SIZE));
+    checkWritePattern(2000);
+    LONGS_EQUAL(0, m_pWriter->flush());
+    // The driver tries each block 3 times.
+    m_pCard->corruptNextWriteCrc(3);
+
+        LONGS_EQUAL(-1, writePattern(4 * 512));
+
+    CHECK_FALSE(m_pWriter->isOpen());
+    LONGS_EQUAL(-1, writePattern(1));
+    checkFile("0:/LOG.BIN", 2000, 1);
+    LONGS_EQUAL(4, readChain(fileFirstCluster("0:/LOG.BIN"), NULL, MAX_SIZE / 512));
+    checkFreeCount();
+
+    LONGS_EQUAL(0, m_pWriter->open("LOG2.BIN", MAX_SIZE));
+    checkWritePattern(1500, 1);
+    checkWritePattern(1500, 1);
+    LONGS_EQUAL(0, m_pWriter->close());
+    remount();
+    checkFile("0:/LOG.BIN", 2000, 1);
+    checkFile("0:/LOG2.BIN", 3000, 1);
+    checkFreeCount();
+}
+
+TEST(SDStreamWriter, Close_ShouldFreeUnusedPartOfReservation)
+{
+    uint32_t freeBefore = freeClusters();
+    LONGS_EQUAL(0, m_pWriter->open("LOG.BIN", MAX_SIZE));
+    LONGS_EQUAL(freeBefore - MAX_SIZE / clusterSize(), freeClusters());
+    checkWritePattern(4 * 512);
+    checkWritePattern(4 * 512);
+    checkWritePattern(100);
+
+        LONGS_EQUAL(0, m_pWriter->close());
+
+    uint32_t usedClusters = (8 * 512 + 100 + clusterSize() - 1) / clusterSize();
+    LONGS_EQUAL(usedClusters, readChain(fileFirstCluster("0:/LOG.BIN"), NULL, MAX_SIZE / 512));
+    LONGS_EQUAL(freeBefore - usedClusters, freeClusters());
+    remount();
+    checkFile("0:/LOG.BIN", 8 * 512 + 100, 1);
+    checkFreeCount();
+}
+
+TEST(SDStreamWriter, PathTooLong_ShouldFailOpenWithoutCreatingFile)
+{
+    char filename[80];
+    memset(filename, 'A', sizeof(filename) - 1);
+    filename[sizeof(filename) - 1] = '\0';
+
+        LONGS_EQUAL(-1, m_pWriter->open(filename, MAX_SIZE));
+
+    CHECK_FALSE(m_pWriter->isOpen());
+    FATFS_DIR dir;
+    FILINFO   info;
+    info.lfname = NULL;
+    info.lfsize = 0;
+    LONGS_EQUAL(FR_OK, f_opendir(&dir, "0:/"));
+    LONGS_EQUAL(FR_OK, f_readdir(&dir, &info));
+    LONGS_EQUAL(0, info.fname[0]);
+    LONGS_EQUAL(FR_OK, f_closedir(&dir));
+}
@@ -0,0 +1,106 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* FatFs disk I/O layer routed to the SDFileSystem driver of the current test. */
+#include "FatFsBase.h"
+
+
+SimDisk g_simDisk;
+
+
+static bool shouldFailRead(DWORD sector, UINT count)
+{
+    if (g_simDisk.failReadSector - sector >= count)
+    {
+        return false;
+    }
+    if (g_simDisk.failReadSkip > 0)
+    {
+        g_simDisk.failReadSkip--;
+        return false;
+    }
+    g_simDisk.failReadSector = 0xFFFFFFFF;
+    return true;
+}
+
+static void countRead(DWORD sector, UINT count)
+{
+    g_simDisk.sectorsRead += count;
+    for (UINT i = 0 ; i < count ; i++)
+    {
+        if (sector + i >= g_simDisk.fatStart && sector + i < g_simDisk.fatEnd)
+        {
+            g_simDisk.fatSectorsRead++;
+        }
+    }
+}
+
+
+DSTATUS disk_initialize(BYTE pdrv)
+{
+    return g_simDisk.pSd->disk_initialize();
+}
+
+DSTATUS disk_status(BYTE pdrv)
+{
+    return g_simDisk.pSd->disk_status();
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE* pBuffer, DWORD sector, UINT count)
+{
+    if (shouldFailRead(sector, count))
+    {
+        return RES_ERROR;
+    }
+    countRead(sector, count);
+    return g_simDisk.pSd->disk_read(pBuffer, sector, count) ? RES_ERROR : RES_OK;
+}
+
+DRESULT disk_read_copy(BYTE pdrv, BYTE* pBuffer, DWORD sector, BYTE* pCopy, UINT copySize)
+{
+    if (shouldFailRead(sector, 1))
+    {
+        return RES_ERROR;
+    }
+    countRead(sector, 1);
+    return g_simDisk.pSd->disk_read_copy(pBuffer, sector, pCopy, copySize) ? RES_ERROR : RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE* pBuffer, DWORD sector, UINT count)
+{
+    g_simDisk.sectorsWritten += count;
+    return g_simDisk.pSd->disk_write(pBuffer, sector, count) ? RES_ERROR : RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* pBuffer)
+{
+    switch (cmd)
+    {
+    case CTRL_SYNC:
+        return g_simDisk.pSd->disk_sync() ? RES_ERROR : RES_OK;
+    case GET_SECTOR_COUNT:
+        *(DWORD*)pBuffer = g_simDisk.pSd->disk_sectors();
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *(DWORD*)pBuffer = 1;
+        return RES_OK;
+    }
+    return RES_PARERR;
+}
+
+DWORD get_fattime(void)
+{
+    // 2016-01-01 00:00:00
+    return (DWORD)(2016 - 1980) << 25 | (DWORD)1 << 21 | (DWORD)1 << 16;
+}
@@ -0,0 +1,271 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <stdio.h>
+#include "FatFsBase.h"
+
+
+static const uint32_t DIRECTORY_COUNT = 4;
+static const uint32_t FILE_COUNT = 200;
+static const uint32_t CHURN_COUNT = 1000;
+
+// Directory entry layout from the FAT32 File System Specification.
+#define DIR_ENTRY_SIZE  32
+#define DIR_ENTRIES     (512 / DIR_ENTRY_SIZE)
+// Offset of BPB_FSInfo in the FAT32 boot sector.
+#define BPB_FS_INFO     48
+
+
+struct ExpectedFile
+{
+    bool     exists;
+    uint32_t size;
+    uint32_t seed;
+};
+
+
+TEST_GROUP_BASE(WindowPool, FatFsBase)
+{
+    ExpectedFile m_files[FILE_COUNT];
+    uint32_t     m_random;
+    char         m_filename[32];
+
+    void setup()
+    {
+        FatFsBase::setup();
+        memset(m_files, 0, sizeof(m_files));
+        m_random = 1;
+    }
+
+    uint32_t nextRandom()
+    {
+        m_random = m_random * 1103515245 + 12345;
+        return m_random >> 8;
+    }
+
+    const char* filename(uint32_t index)
+    {
+        snprintf(m_filename, sizeof(m_filename), "0:/D%u/F%03u.BIN", index % DIRECTORY_COUNT, index);
+        return m_filename;
+    }
+
+    // sync_fs() only writes the FSINFO sector through the window when the volume has one. Without it, each call
+    // leaves the window and pool holding the sectors it last used, which makes the pool contents predictable.
+    void remountWithoutFsInfo()
+    {
+        uint8_t* pBootSector = m_pCard->sector(m_fs.volbase);
+        pBootSector[BPB_FS_INFO] = 0;
+        pBootSector[BPB_FS_INFO + 1] = 0;
+        remount();
+        LONGS_EQUAL(0x80, m_fs.fsi_flag);
+    }
+
+    bool isSectorPooled(uint32_t sector)
+    {
+        for (uint32_t i = 0 ; i < _FS_WINPOOL ; i++)
+        {
+            if (m_fs.pool_sect[i] == sector)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t clusterSector(uint32_t cluster)
+    {
+        return m_fs.database + (cluster - 2) * m_fs.csize;
+    }
+
+    uint32_t directoryCluster(const char* pPath)
+    {
+        FATFS_DIR dir;
+        LONGS_EQUAL(FR_OK, f_opendir(&dir, pPath));
+        uint32_t cluster = dir.sclust;
+        LONGS_EQUAL(FR_OK, f_closedir(&dir));
+        return cluster;
+    }
+
+    uint32_t countDotEntries(const uint8_t* pSector)
+    {
+        uint32_t count = 0;
+        for (uint32_t i = 0 ; i < DIR_ENTRIES ; i++)
+        {
+            if (pSector[i * DIR_ENTRY_SIZE] == '.')
+            {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    bool isEntryClear(const uint8_t* pSector, uint32_t entry)
+    {
+        for (uint32_t i = 0 ; i < DIR_ENTRY_SIZE ; i++)
+        {
+            if (pSector[entry * DIR_ENTRY_SIZE + i] != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    FRESULT statFile(const char* pFilename)
+    {
+        FILINFO info;
+        info.lfname = NULL;
+        info.lfsize = 0;
+        return f_stat(pFilename, &info);
+    }
+
+    void createEmptyFile(const char* pFilename)
+    {
+        FIL file;
+        LONGS_EQUAL(FR_OK, f_open(&file, pFilename, FA_CREATE_NEW | FA_WRITE));
+        LONGS_EQUAL(FR_OK, f_close(&file));
+    }
+
+    // Fills a deleted directory's cluster with deleted entries so that a stale copy of it can't pass for a cleared one.
+    uint32_t createAndRemoveDirectory(const char* pPath)
+    {
+        char path[32];
+        LONGS_EQUAL(FR_OK, f_mkdir(pPath));
+        for (uint32_t i = 0 ; i < DIR_ENTRIES - 2 ; i++)
+        {
+            snprintf(path, sizeof(path), "%s/G%u", pPath, i);
+            createEmptyFile(path);
+        }
+        for (uint32_t i = 0 ; i < DIR_ENTRIES - 2 ; i++)
+        {
+            snprintf(path, sizeof(path), "%s/G%u", pPath, i);
+            LONGS_EQUAL(FR_OK, f_unlink(path));
+        }
+        uint32_t cluster = directoryCluster(pPath);
+        LONGS_EQUAL(FR_OK, f_unlink(pPath));
+        LONGS_EQUAL(0, fatEntry(cluster));
+        return cluster;
+    }
+};
+
+
+TEST(WindowPool, CreateDeleteChurnAcrossDirectories_ShouldMatchAfterRemount)
+{
+    char directory[8];
+    for (uint32_t i = 0 ; i < DIRECTORY_COUNT ; i++)
+    {
+        snprintf(directory, sizeof(directory), "0:/D%u", i);
+        LONGS_EQUAL(FR_OK, f_mkdir(directory));
+    }
+
+    for (uint32_t i = 0 ; i < CHURN_COUNT ; i++)
+    {
+        uint32_t      index = nextRandom() % FILE_COUNT;
+        ExpectedFile* pFile = &m_files[index];
+        if (pFile->exists && nextRandom() % 3 == 0)
+        {
+            LONGS_EQUAL(FR_OK, f_unlink(filename(index)));
+            pFile->exists = false;
+        }
+        else
+        {
+            pFile->exists = true;
+            pFile->size = nextRandom() % (6 * clusterSize());
+            pFile->seed = i;
+            writeFile(filename(index), pFile->size, pFile->seed);
+        }
+    }
+    CHECK_TRUE(m_fs.n_winhit > 0);
+    remount();
+
+    for (uint32_t i = 0 ; i < FILE_COUNT ; i++)
+    {
+        if (m_files[i].exists)
+        {
+            checkFile(filename(i), m_files[i].size, m_files[i].seed);
+        }
+        else
+        {
+            LONGS_EQUAL(FR_NO_FILE, statFile(filename(i)));
+        }
+    }
+    checkFreeCount();
+}
+
+TEST(WindowPool, MkdirReusesClusterOfDeletedDirectoryStillInPool_ShouldClearIt)
+{
+    remountWithoutFsInfo();
+    uint32_t deletedCluster = createAndRemoveDirectory("0:/OLD");
+    CHECK_TRUE(isSectorPooled(clusterSector(deletedCluster)));
+    m_fs.last_clust = deletedCluster - 1;
+
+        LONGS_EQUAL(FR_OK, f_mkdir("0:/NEW"));
+    LONGS_EQUAL(deletedCluster, directoryCluster("0:/NEW"));
+    createEmptyFile("0:/NEW/FILE");
+    remount();
+
+    LONGS_EQUAL(FR_OK, statFile("0:/NEW/FILE"));
+    const uint8_t* pSector = m_pCard->sector(clusterSector(deletedCluster));
+    LONGS_EQUAL('.', pSector[0 * DIR_ENTRY_SIZE]);
+    LONGS_EQUAL('.', pSector[1 * DIR_ENTRY_SIZE + 1]);
+    LONGS_EQUAL('F', pSector[2 * DIR_ENTRY_SIZE]);
+    for (uint32_t i = 3 ; i < DIR_ENTRIES ; i++)
+    {
+        CHECK_TRUE(isEntryClear(pSector, i));
+    }
+}
+
+TEST(WindowPool, DirectoryGrowsIntoClusterOfDeletedDirectoryStillInPool_ShouldClearIt)
+{
+    char path[16];
+    remountWithoutFsInfo();
+    // Fill the single sector root directory so that the first long name below has to grow it into another cluster.
+    for (uint32_t i = 0 ; i < DIR_ENTRIES - 1 ; i++)
+    {
+        snprintf(path, sizeof(path), "0:/R%u", i);
+        createEmptyFile(path);
+    }
+    uint32_t deletedCluster = createAndRemoveDirectory("0:/OLD");
+    CHECK_TRUE(isSectorPooled(clusterSector(deletedCluster)));
+    m_fs.last_clust = deletedCluster - 1;
+
+        createEmptyFile("0:/First long file name.txt");
+    createEmptyFile("0:/Second long file name.txt");
+    LONGS_EQUAL(2, readChain(m_fs.dirbase, NULL, 2));
+    LONGS_EQUAL(deletedCluster, fatEntry(m_fs.dirbase));
+    remount();
+
+    LONGS_EQUAL(FR_OK, statFile("0:/First long file name.txt"));
+    LONGS_EQUAL(FR_OK, statFile("0:/Second long file name.txt"));
+    const uint8_t* pSector = m_pCard->sector(clusterSector(deletedCluster));
+    LONGS_EQUAL(0, countDotEntries(pSector));
+    CHECK_TRUE(isEntryClear(pSector, DIR_ENTRIES - 1));
+}
+
+TEST(WindowPool, MountOverUninitializedObject_ShouldStartWithEmptyPool)
+{
+    LONGS_EQUAL(FR_OK, f_mount(NULL, "0:", 0));
+    memset(&m_fs, 0x5A, sizeof(m_fs));
+    resetCounts();
+
+        LONGS_EQUAL(FR_OK, f_mount(&m_fs, "0:", 1));
+    LONGS_EQUAL(0, g_simDisk.sectorsWritten);
+    for (uint32_t i = 0 ; i < _FS_WINPOOL ; i++)
+    {
+        LONGS_EQUAL(0, m_fs.pool_flag[i]);
+    }
+    writeFile("0:/FILE.BIN", 4 * clusterSize(), 1);
+    remount();
+    checkFile("0:/FILE.BIN", 4 * clusterSize(), 1);
+}
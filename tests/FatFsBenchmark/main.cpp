@@ -0,0 +1,390 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Host benchmark which runs FatFs on top of the SDFileSystem driver and the SDCardSim model to measure how long it
+   takes to get from f_mount() to the first write on a large, mostly full volume, the latency of streaming writes
+   with and without f_prealloc(), and the throughput of large sequential writes through f_write() (the fopen()/fwrite()
+   path) compared to SDStreamWriter. Small f_read() records are also read back with disk_read_copy() copying the head
+   of each newly loaded sector out during the CRC check, and again with the separate copy that FatFs used to make, to
+   show the difference in how many bytes of sector data get moved through memory.
+
+   The volume is formatted as a 32GB FAT32 card with 32k clusters. Everything but a 10% tail is then marked as in use
+   directly in the FAT and the FSINFO hints are invalidated (as some hosts leave them) so that FatFs has to find free
+   space by scanning the FAT. The times reported are in terms of the simulated SPI clock, ignoring CPU time.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ff.h>
+#include <diskio.h>
+#include <SDFileSystem.h>
+#include <SDStreamWriter.h>
+#include <SDCardSim.h>
+#include <SimSDFileSystem.h>
+
+
+// FSINFO field offsets from the FAT32 File System Specification.
+#define FSI_FREE_COUNT  488
+#define FSI_NXT_FREE    492
+
+static const uint32_t g_clusterSize = 32 * 1024;
+static const uint32_t g_appendSize = 1024 * 1024;
+static const uint32_t g_streamSize = 4 * 1024 * 1024;
+static const uint32_t g_streamWriteSize = 4 * 1024;
+static const uint32_t g_recordReadSize = 1024 * 1024;
+static const uint32_t g_recordSizes[] = { 128, 500 };
+
+static SDCardSim       g_card(32U * 1024 * 1024 * 2);
+static SimSDFileSystem g_sd(&g_card);
+static FATFS           g_fs;
+static uint8_t         g_buffer[16 * 1024];
+static uint64_t        g_startTime;
+static uint64_t        g_lastElapsedTime;
+static bool            g_isReadCopyFused = true;
+static uint64_t        g_sectorsLoaded;
+static uint64_t        g_readCopyBytes;
+static uint64_t        g_driverMemoryTraffic;
+
+
+static void fillVolume();
+static void setFatEntry(uint32_t cluster, uint32_t value);
+static void invalidateFsInfo();
+static void remount();
+static void streamFile(const char* pFilename, bool preallocate);
+static void writeWithFatFs(const char* pFilename);
+static void writeWithStreamWriter(const char* pFilename);
+static void readInRecords(const char* pFilename, uint32_t recordSize, bool isFused);
+static void startTest(const char* pDescription);
+static void endTest(uint32_t divisor = 1, const char* pUnits = NULL);
+static void checkResult(FRESULT result, const char* pOperation);
+
+
+int main(int argc, char** argv)
+{
+    FIL      file;
+    UINT     bytesWritten;
+    DWORD    freeClusters;
+    FATFS*   pFs;
+
+    printf("Formatting simulated 32GB volume...\n");
+    checkResult(f_mount(&g_fs, "0:", 0), "f_mount");
+    checkResult(f_mkfs("0:", 0, g_clusterSize), "f_mkfs");
+    checkResult(f_mount(&g_fs, "0:", 1), "f_mount");
+    // log.txt gets the first cluster after the root directory so that appending to it has to search past the full
+    // part of the volume.
+    checkResult(f_open(&file, "0:log.txt", FA_CREATE_ALWAYS | FA_WRITE), "f_open");
+    checkResult(f_write(&file, g_buffer, sizeof(g_buffer), &bytesWritten), "f_write");
+    checkResult(f_close(&file), "f_close");
+    fillVolume();
+    printf("    %lu clusters, %lu FAT sectors, FAT scan starts at cluster 2.\n\n",
+           (unsigned long)g_fs.n_fatent - 2, (unsigned long)g_fs.fsize);
+
+    startTest("f_mount() to first f_write() of a new file");
+    remount();
+    checkResult(f_open(&file, "0:new.txt", FA_CREATE_ALWAYS | FA_WRITE), "f_open");
+    checkResult(f_write(&file, g_buffer, 512, &bytesWritten), "f_write");
+    checkResult(f_close(&file), "f_close");
+    endTest();
+
+    startTest("Append 1MB to log.txt (stretches the chain of a file before the full region)");
+    checkResult(f_open(&file, "0:log.txt", FA_OPEN_EXISTING | FA_WRITE), "f_open");
+    checkResult(f_lseek(&file, file.fsize), "f_lseek");
+    for (uint32_t i = 0 ; i < g_appendSize ; i += sizeof(g_buffer))
+    {
+        checkResult(f_write(&file, g_buffer, sizeof(g_buffer), &bytesWritten), "f_write");
+    }
+    checkResult(f_close(&file), "f_close");
+    endTest(g_appendSize / g_clusterSize, "cluster");
+
+    startTest("f_mount() and first f_getfree()");
+    invalidateFsInfo();
+    remount();
+    checkResult(f_getfree("0:", &freeClusters, &pFs), "f_getfree");
+    endTest();
+
+    startTest("Second f_getfree()");
+    checkResult(f_getfree("0:", &freeClusters, &pFs), "f_getfree");
+    endTest();
+
+    startTest("First f_write() of a new file after f_getfree()");
+    checkResult(f_open(&file, "0:new2.txt", FA_CREATE_ALWAYS | FA_WRITE), "f_open");
+    checkResult(f_write(&file, g_buffer, 512, &bytesWritten), "f_write");
+    checkResult(f_close(&file), "f_close");
+    endTest();
+
+    streamFile("0:stream1.bin", false);
+    streamFile("0:stream2.bin", true);
+
+    writeWithFatFs("0:fwrite.bin");
+    writeWithStreamWriter("stream3.bin");
+
+    for (size_t i = 0 ; i < sizeof(g_recordSizes)/sizeof(g_recordSizes[0]) ; i++)
+    {
+        readInRecords("0:fwrite.bin", g_recordSizes[i], false);
+        readInRecords("0:fwrite.bin", g_recordSizes[i], true);
+    }
+
+    printf("%lu clusters free.\n", (unsigned long)freeClusters);
+
+    return 0;
+}
+
+static void streamFile(const char* pFilename, bool preallocate)
+{
+    FIL      file;
+    CLCACHE  clusterCache;
+    UINT     bytesWritten;
+    uint64_t maxWriteTime = 0;
+
+    startTest(preallocate ? "Log 4MB in 4k writes with f_prealloc()" : "Log 4MB in 4k writes");
+    checkResult(f_open(&file, pFilename, FA_CREATE_ALWAYS | FA_WRITE), "f_open");
+    // Attach a cluster cache as FATFileHandle does.
+    clusterCache.used = 0;
+    file.clcache = &clusterCache;
+    if (preallocate)
+    {
+        checkResult(f_prealloc(&file, g_streamSize), "f_prealloc");
+    }
+    for (uint32_t i = 0 ; i < g_streamSize ; i += g_streamWriteSize)
+    {
+        uint64_t start = g_card.elapsedNanoseconds();
+        checkResult(f_write(&file, g_buffer, g_streamWriteSize, &bytesWritten), "f_write");
+        uint64_t elapsed = g_card.elapsedNanoseconds() - start;
+        if (elapsed > maxWriteTime)
+        {
+            maxWriteTime = elapsed;
+        }
+    }
+    checkResult(f_close(&file), "f_close");
+    endTest();
+    printf("    %.3f ms worst case f_write().\n", maxWriteTime / 1000000.0);
+}
+
+static void writeWithFatFs(const char* pFilename)
+{
+    FIL      file;
+    CLCACHE  clusterCache;
+    UINT     bytesWritten;
+
+    startTest("Write 4MB in 16k writes with f_write()");
+    checkResult(f_open(&file, pFilename, FA_CREATE_ALWAYS | FA_WRITE), "f_open");
+    clusterCache.used = 0;
+    file.clcache = &clusterCache;
+    for (uint32_t i = 0 ; i < g_streamSize ; i += sizeof(g_buffer))
+    {
+        checkResult(f_write(&file, g_buffer, sizeof(g_buffer), &bytesWritten), "f_write");
+    }
+    checkResult(f_close(&file), "f_close");
+    endTest();
+    printf("    %.3f MB/s\n", g_streamSize / 1048576.0 / (g_lastElapsedTime / 1000000000.0));
+}
+
+static void writeWithStreamWriter(const char* pFilename)
+{
+    SDStreamWriter writer(&g_sd);
+    uint32_t       transactionsBefore = g_sd.writeStreamTransactionCount();
+
+    startTest("Write 4MB in 16k writes with SDStreamWriter");
+    if (writer.open(pFilename, g_streamSize) != 0)
+    {
+        fprintf(stderr, "error: SDStreamWriter::open failed\n");
+        exit(-1);
+    }
+    for (uint32_t i = 0 ; i < g_streamSize ; i += sizeof(g_buffer))
+    {
+        if (writer.write(g_buffer, sizeof(g_buffer)) != (int)sizeof(g_buffer))
+        {
+            fprintf(stderr, "error: SDStreamWriter::write failed\n");
+            g_sd.dumpErrorLog(stderr);
+            exit(-1);
+        }
+    }
+    if (writer.close() != 0)
+    {
+        fprintf(stderr, "error: SDStreamWriter::close failed\n");
+        exit(-1);
+    }
+    endTest();
+    printf("    %.3f MB/s, %u CMD25 transactions.\n",
+           g_streamSize / 1048576.0 / (g_lastElapsedTime / 1000000000.0),
+           g_sd.writeStreamTransactionCount() - transactionsBefore);
+}
+
+static void readInRecords(const char* pFilename, uint32_t recordSize, bool isFused)
+{
+    FIL  file;
+    UINT bytesRead;
+    char description[128];
+
+    snprintf(description, sizeof(description), "Read 1MB in %u byte f_read() records with %s",
+             (unsigned int)recordSize, isFused ? "disk_read_copy() fused with CRC check" : "separate copy");
+    startTest(description);
+    g_isReadCopyFused = isFused;
+    g_sectorsLoaded = 0;
+    g_readCopyBytes = 0;
+    g_driverMemoryTraffic = 0;
+    uint32_t fusedCountBefore = g_sd.fusedReadCopyCount();
+
+    checkResult(f_open(&file, pFilename, FA_OPEN_EXISTING | FA_READ), "f_open");
+    for (uint32_t i = 0 ; i + recordSize <= g_recordReadSize ; i += recordSize)
+    {
+        checkResult(f_read(&file, g_buffer, recordSize, &bytesRead), "f_read");
+    }
+    checkResult(f_close(&file), "f_close");
+    endTest();
+
+    // FatFs mem_cpy()s everything that disk_read_copy() didn't copy, out of the file's sector buffer.
+    uint64_t totalRead = g_recordReadSize / recordSize * recordSize;
+    uint64_t traffic = g_driverMemoryTraffic + 2 * (totalRead - g_readCopyBytes);
+    printf("    %.1f bytes of memory traffic per sector loaded, %u fused copies.\n",
+           (double)traffic / g_sectorsLoaded, g_sd.fusedReadCopyCount() - fusedCountBefore);
+}
+
+static void fillVolume()
+{
+    // Cluster 2 is the root directory and cluster 3 is log.txt. Mark everything else up to 90% of the volume as
+    // being in use.
+    uint32_t lastUsed = (uint32_t)(g_fs.n_fatent / 10 * 9);
+    for (uint32_t cluster = 4 ; cluster <= lastUsed ; cluster++)
+    {
+        setFatEntry(cluster, 0x0FFFFFFF);
+    }
+    invalidateFsInfo();
+}
+
+static void setFatEntry(uint32_t cluster, uint32_t value)
+{
+    for (uint32_t fat = 0 ; fat < g_fs.n_fats ; fat++)
+    {
+        uint32_t offset = cluster * 4;
+        uint8_t* pSector = g_card.sector(g_fs.fatbase + fat * g_fs.fsize + offset / 512);
+        uint8_t* pEntry = pSector + offset % 512;
+        pEntry[0] = value;
+        pEntry[1] = value >> 8;
+        pEntry[2] = value >> 16;
+        pEntry[3] = value >> 24;
+    }
+}
+
+static void invalidateFsInfo()
+{
+    uint8_t* pFsInfo = g_card.sector(g_fs.volbase + 1);
+    memset(pFsInfo + FSI_FREE_COUNT, 0xFF, 4);
+    memset(pFsInfo + FSI_NXT_FREE, 0xFF, 4);
+}
+
+static void remount()
+{
+    checkResult(f_mount(NULL, "0:", 0), "f_mount");
+    checkResult(f_mount(&g_fs, "0:", 1), "f_mount");
+}
+
+static void startTest(const char* pDescription)
+{
+    printf("%s\n", pDescription);
+    g_card.resetStatistics();
+    g_startTime = g_card.elapsedNanoseconds();
+}
+
+static void endTest(uint32_t divisor /* = 1 */, const char* pUnits /* = NULL */)
+{
+    SDCardSim::Statistics stats = g_card.getStatistics();
+    uint64_t              elapsedTime = g_card.elapsedNanoseconds() - g_startTime;
+
+    g_lastElapsedTime = elapsedTime;
+
+    printf("    %.3f ms, %u blocks read, %u blocks written.\n",
+           elapsedTime / 1000000.0, stats.blocksRead, stats.blocksWritten);
+    if (pUnits)
+    {
+        printf("    %.3f ms, %.1f blocks read per %s.\n",
+               elapsedTime / 1000000.0 / divisor, (double)stats.blocksRead / divisor, pUnits);
+    }
+}
+
+static void checkResult(FRESULT result, const char* pOperation)
+{
+    if (result != FR_OK)
+    {
+        fprintf(stderr, "error: %s failed - %d\n", pOperation, result);
+        g_sd.dumpErrorLog(stderr);
+        exit(-1);
+    }
+}
+
+
+// FatFs disk I/O layer routed to the simulated card.
+DSTATUS disk_initialize(BYTE pdrv)
+{
+    return g_sd.disk_initialize();
+}
+
+DSTATUS disk_status(BYTE pdrv)
+{
+    return g_sd.disk_status();
+}
+
+// Memory traffic is counted as the bytes written by the SPI DMA plus the bytes read by the CRC check, and then for
+// any copy, the bytes read (unless fused with the CRC check) and written.
+DRESULT disk_read(BYTE pdrv, BYTE* pBuffer, DWORD sector, UINT count)
+{
+    g_sectorsLoaded += count;
+    g_driverMemoryTraffic += 2 * 512 * count;
+    return g_sd.disk_read(pBuffer, sector, count) ? RES_ERROR : RES_OK;
+}
+
+DRESULT disk_read_copy(BYTE pdrv, BYTE* pBuffer, DWORD sector, BYTE* pCopy, UINT copySize)
+{
+    if (!g_isReadCopyFused)
+    {
+        // The disk_read() and mem_cpy() which FatFs made before disk_read_copy() existed.
+        DRESULT result = disk_read(pdrv, pBuffer, sector, 1);
+        memcpy(pCopy, pBuffer, copySize);
+        g_readCopyBytes += copySize;
+        g_driverMemoryTraffic += 2 * copySize;
+        return result;
+    }
+
+    g_sectorsLoaded++;
+    g_readCopyBytes += copySize;
+    g_driverMemoryTraffic += 2 * 512 + copySize;
+    return g_sd.disk_read_copy(pBuffer, sector, pCopy, copySize) ? RES_ERROR : RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE* pBuffer, DWORD sector, UINT count)
+{
+    return g_sd.disk_write(pBuffer, sector, count) ? RES_ERROR : RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void* pBuffer)
+{
+    switch (cmd)
+    {
+    case CTRL_SYNC:
+        return g_sd.disk_sync() ? RES_ERROR : RES_OK;
+    case GET_SECTOR_COUNT:
+        *(DWORD*)pBuffer = g_sd.disk_sectors();
+        return RES_OK;
+    case GET_BLOCK_SIZE:
+        *(DWORD*)pBuffer = 1;
+        return RES_OK;
+    }
+    return RES_PARERR;
+}
+
+DWORD get_fattime(void)
+{
+    // 2016-01-01 00:00:00
+    return (DWORD)(2016 - 1980) << 25 | (DWORD)1 << 21 | (DWORD)1 << 16;
+}
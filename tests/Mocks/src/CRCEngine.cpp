@@ -0,0 +1,90 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "CRCEngine.h"
+
+
+CRCEngine::CRCEngine()
+{
+    m_pData = NULL;
+    m_length = 0;
+    m_startCount = 0;
+    m_byteCount = 0;
+    m_sum = 0;
+    m_isAvailable = true;
+    m_isBusy = false;
+}
+
+CRCEngine::~CRCEngine()
+{
+}
+
+bool CRCEngine::isAvailable()
+{
+    return m_isAvailable;
+}
+
+bool CRCEngine::start(const void* pData, size_t length, uint16_t seed)
+{
+    if (!m_isAvailable || m_isBusy)
+    {
+        return false;
+    }
+
+    m_pData = (const uint8_t*)pData;
+    m_length = length;
+    m_sum = seed;
+    m_isBusy = true;
+    m_startCount++;
+
+    return true;
+}
+
+uint16_t CRCEngine::wait()
+{
+    // Shift each byte through the CRC-CCITT polynomial (x^16 + x^12 + x^5 + 1) MSB first like the WR_DATA register.
+    while (m_length > 0)
+    {
+        m_sum ^= *m_pData++ << 8;
+        for (int bit = 0 ; bit < 8 ; bit++)
+        {
+            m_sum = (m_sum & 0x8000) ? (m_sum << 1) ^ 0x1021 : m_sum << 1;
+        }
+        m_length--;
+        m_byteCount++;
+    }
+    m_isBusy = false;
+
+    return m_sum;
+}
+
+void CRCEngine::setAvailable(bool isAvailable)
+{
+    m_isAvailable = isAvailable;
+}
+
+uint32_t CRCEngine::startCount()
+{
+    return m_startCount;
+}
+
+uint32_t CRCEngine::byteCount()
+{
+    return m_byteCount;
+}
+
+bool CRCEngine::isBusy()
+{
+    return m_isBusy;
+}
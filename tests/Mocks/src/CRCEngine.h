@@ -0,0 +1,53 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+// Mock to emulate the CRC engine peripheral that CRCEngine drives on real hardware. The CRC is computed a bit at a
+// time, as the peripheral does, when wait() is called so that tests can check that the buffer is left alone until
+// then.
+#ifndef CRC_ENGINE_H_
+#define CRC_ENGINE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+class CRCEngine
+{
+public:
+    CRCEngine();
+    ~CRCEngine();
+
+    bool     isAvailable();
+    bool     start(const void* pData, size_t length, uint16_t seed);
+    uint16_t wait();
+
+    // Testing hooks.
+    // Emulate a part without a CRC engine (ie. the LPC1768).
+    void     setAvailable(bool isAvailable);
+    // Number of successful start() calls and bytes fed through the engine.
+    uint32_t startCount();
+    uint32_t byteCount();
+    bool     isBusy();
+
+protected:
+    const uint8_t* m_pData;
+    size_t         m_length;
+    uint32_t       m_startCount;
+    uint32_t       m_byteCount;
+    uint16_t       m_sum;
+    bool           m_isAvailable;
+    bool           m_isBusy;
+};
+
+#endif /* CRC_ENGINE_H_ */
@@ -17,6 +17,7 @@
 #define FAT_FILE_SYSTEM_H
 
 #include <stdint.h>
+#include <string.h>
 #include <Timer.h>
 
 class FATFileSystem
@@ -24,7 +25,14 @@ class FATFileSystem
 public:
     FATFileSystem(const char* name)
     {
+        _fsid[0] = '0';
+        _fsid[1] = '\0';
     }
+    virtual ~FATFileSystem()
+    {
+    }
+
+    char _fsid[2];
 
     virtual int disk_initialize() = 0;
     virtual int disk_status() = 0;
@@ -32,6 +40,15 @@ public:
     virtual int disk_write(const uint8_t* buffer, uint32_t block_number, uint32_t count) = 0;
     virtual int disk_sync() = 0;
     virtual uint32_t disk_sectors() = 0;
+    virtual int disk_read_copy(uint8_t* buffer, uint32_t block_number, uint8_t* copy, uint32_t copy_size)
+    {
+        int result = disk_read(buffer, block_number, 1);
+        if (result == 0)
+        {
+            memcpy(copy, buffer, copy_size);
+        }
+        return result;
+    }
 
 protected:
 };
@@ -0,0 +1,43 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+// Place holder for mbed's FileHandle interface so that FATFileHandle can be built for the PC host.
+#ifndef FILE_HANDLE_H_
+#define FILE_HANDLE_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+
+namespace mbed
+{
+
+class FileHandle
+{
+public:
+    virtual ~FileHandle()
+    {
+    }
+
+    virtual ssize_t write(const void* buffer, size_t length) = 0;
+    virtual int close() = 0;
+    virtual ssize_t read(void* buffer, size_t length) = 0;
+    virtual int isatty() = 0;
+    virtual off_t lseek(off_t offset, int whence) = 0;
+    virtual int fsync() = 0;
+    virtual off_t flen() = 0;
+};
+
+} // namespace mbed
+
+#endif /* FILE_HANDLE_H_ */
@@ -12,29 +12,31 @@
    See the License for the specific language governing permissions and
    limitations under the License.
 */
-// Mock implementation for Interlock.h routines that are just for unit testing.
+// Mock implementation for Interlock.h routines that are just for unit testing. They are built on the GCC __sync
+// builtins so that they are still atomic when the tests exercise them from multiple pthreads.
 #include "../../../SDFileSystem/Interlocked.h"
 
 uint32_t interlockedIncrement(volatile uint32_t* pValue)
 {
-    (*pValue)++;
-    return *pValue;
+    return __sync_add_and_fetch(pValue, 1);
 }
 
 uint32_t interlockedDecrement(volatile uint32_t* pValue)
 {
-    (*pValue)--;
-    return *pValue;
+    return __sync_sub_and_fetch(pValue, 1);
 }
 
 uint32_t interlockedAdd(volatile uint32_t* pVal1, uint32_t val2)
 {
-    (*pVal1) += val2;
-    return *pVal1;
+    return __sync_add_and_fetch(pVal1, val2);
 }
 
 uint32_t interlockedSubtract(volatile uint32_t* pVal1, uint32_t val2)
 {
-    (*pVal1) -= val2;
-    return *pVal1;
+    return __sync_sub_and_fetch(pVal1, val2);
+}
+
+uint32_t interlockedCompareExchange(volatile uint32_t* pValue, uint32_t exchange, uint32_t comparand)
+{
+    return __sync_val_compare_and_swap(pValue, comparand, exchange);
 }
@@ -0,0 +1,33 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+// Interface for a simulated device which can be attached to the SPIDma mock with SPIDma::setDevice(). Once attached,
+// every byte clocked out by the mock is passed to the device and the device's reply is returned as the inbound byte
+// instead of the data queued up with setInboundFromString().
+#ifndef SPI_DEVICE_H_
+#define SPI_DEVICE_H_
+
+#include <stdint.h>
+
+class SPIDevice
+{
+public:
+    virtual ~SPIDevice() {}
+
+    virtual void    setChipSelect(int state) = 0;
+    virtual void    setFrequency(int hz) = 0;
+    virtual uint8_t exchange(uint8_t mosi) = 0;
+};
+
+#endif /* SPI_DEVICE_H_ */
@@ -44,6 +44,20 @@ SPIDma::SPIDma(PinName mosi, PinName miso, PinName sclk, PinName ssel /* = 0 */,
     m_transferCall = 0;
     m_transferFailStart = 0;
     m_transferFailStop = 0;
+    m_pAsyncStaging = NULL;
+    m_asyncStagingAlloc = 0;
+    memset(m_asyncReadSegments, 0, sizeof(m_asyncReadSegments));
+    m_asyncReadSegmentCount = 0;
+    m_pAsyncCallback = NULL;
+    m_pAsyncContext = NULL;
+    m_asyncCompletionDelay = 0;
+    m_asyncPollsRemaining = 0;
+    m_asyncTransferCount = 0;
+    m_pAsyncHook = NULL;
+    m_pAsyncHookContext = NULL;
+    m_pDevice = NULL;
+    m_isAsyncPending = false;
+    m_asyncResult = true;
 
     if (ssel > 0)
     {
@@ -67,19 +81,28 @@ SPIDma::~SPIDma()
     m_pSettings = NULL;
     m_pSettingsCurr = NULL;
     m_settingsAlloc = 0;
+    free(m_pAsyncStaging);
+    m_pAsyncStaging = NULL;
+    m_asyncStagingAlloc = 0;
 }
 
 void SPIDma::setChipSelect(int state)
 {
+    waitForTransfer();
     m_settings.type = ChipSelect;
     m_settings.chipSelect = state;
     m_settings.bytesSentBefore = m_pOutCurr - m_pOutBuffer;
 
     recordLatestSetting();
+    if (m_pDevice)
+    {
+        m_pDevice->setChipSelect(state);
+    }
 }
 
 void SPIDma::format(int bits, int mode /* = 0 */)
 {
+    waitForTransfer();
     m_settings.type = Format;
     m_settings.bits = bits;
     m_settings.mode = mode;
@@ -108,15 +131,29 @@ void SPIDma::recordLatestSetting()
 
 void SPIDma::frequency(int hz /* = 1000000 */)
 {
+    waitForTransfer();
     m_settings.type = Frequency;
     m_settings.frequency = hz;
     m_settings.bytesSentBefore = m_pOutCurr - m_pOutBuffer;
 
     recordLatestSetting();
+    if (m_pDevice)
+    {
+        m_pDevice->setFrequency(hz);
+    }
 }
 
 void SPIDma::send(int data)
 {
+    waitForTransfer();
+    if (m_pDevice)
+    {
+        // Outbound bytes aren't recorded when a device is attached since benchmarks can send many megabytes.
+        m_pDevice->exchange(data);
+        m_byteCount++;
+        return;
+    }
+
     int bytesUsed = m_pOutCurr - m_pOutBuffer;
     if ((size_t)bytesUsed >= m_outAlloc)
     {
@@ -135,8 +172,23 @@ void SPIDma::send(int data)
     m_byteCount++;
 }
 
+void SPIDma::send(const void* pvData, size_t count)
+{
+    const uint8_t* p = (const uint8_t*)pvData;
+    while (count--)
+    {
+        send(*p++);
+    }
+}
+
 int  SPIDma::exchange(int data)
 {
+    if (m_pDevice)
+    {
+        waitForTransfer();
+        m_byteCount++;
+        return m_pDevice->exchange(data);
+    }
     send(data);
 
     int ret = 0xBD;
@@ -147,6 +199,12 @@ int  SPIDma::exchange(int data)
 }
 
 bool SPIDma::transfer(const void* pvWrite, size_t writeSize, void* pvRead, size_t readSize)
+{
+    waitForTransfer();
+    return transferInternal(pvWrite, writeSize, pvRead, readSize);
+}
+
+bool SPIDma::transferInternal(const void* pvWrite, size_t writeSize, void* pvRead, size_t readSize)
 {
     const uint8_t* pWrite = (const uint8_t*)pvWrite;
     uint8_t*       pRead = (uint8_t*)pvRead;
@@ -177,6 +235,145 @@ bool SPIDma::transfer(const void* pvWrite, size_t writeSize, void* pvRead, size_
     return true;
 }
 
+void SPIDma::transferAsync(const void* pvWrite, size_t writeSize, void* pvRead, size_t readSize,
+                           TransferCallback pCallback /* = NULL */, void* pContext /* = NULL */)
+{
+    Segment readSegment = { pvRead, readSize };
+    startAsyncTransfer(pvWrite, writeSize, &readSegment, pvRead ? 1 : 0, pCallback, pContext);
+}
+
+void SPIDma::readScatterAsync(const Segment* pSegments, size_t segmentCount,
+                              TransferCallback pCallback /* = NULL */, void* pContext /* = NULL */)
+{
+    static const uint8_t fillByte = 0xFF;
+    startAsyncTransfer(&fillByte, 1, pSegments, segmentCount, pCallback, pContext);
+}
+
+void SPIDma::writeGatherAsync(const Segment* pSegments, size_t segmentCount,
+                              TransferCallback pCallback /* = NULL */, void* pContext /* = NULL */)
+{
+    waitForTransfer();
+
+    // Gather the segments into the staging buffer so that they are recorded as a single outbound transfer. The
+    // staging buffer isn't needed for inbound data since the MISO bytes are discarded on writes.
+    assert ( segmentCount > 0 && segmentCount <= SPIDMA_MAX_SEGMENTS );
+    size_t totalSize = getSegmentsSize(pSegments, segmentCount);
+    growAsyncStaging(totalSize);
+    uint8_t* pDest = m_pAsyncStaging;
+    for (size_t i = 0 ; i < segmentCount ; i++)
+    {
+        memcpy(pDest, pSegments[i].pBuffer, pSegments[i].count);
+        pDest += pSegments[i].count;
+    }
+    startAsyncTransfer(m_pAsyncStaging, totalSize, NULL, 0, pCallback, pContext);
+}
+
+void SPIDma::startAsyncTransfer(const void* pvWrite, size_t writeSize,
+                                const Segment* pReadSegments, size_t readSegmentCount,
+                                TransferCallback pCallback, void* pContext)
+{
+    waitForTransfer();
+
+    // The outbound bytes are recorded and the inbound bytes consumed immediately but the inbound data isn't copied
+    // into the caller's buffers until the transfer completes so that tests will catch code which touches the read
+    // buffers too early.
+    assert ( readSegmentCount <= SPIDMA_MAX_SEGMENTS );
+    size_t readSize = getSegmentsSize(pReadSegments, readSegmentCount);
+    growAsyncStaging(readSize);
+    m_asyncTransferCount++;
+    m_asyncResult = transferInternal(pvWrite, writeSize, readSegmentCount ? m_pAsyncStaging : NULL, readSize);
+    memcpy(m_asyncReadSegments, pReadSegments, readSegmentCount * sizeof(*pReadSegments));
+    m_asyncReadSegmentCount = readSegmentCount;
+    m_pAsyncCallback = pCallback;
+    m_pAsyncContext = pContext;
+    m_asyncPollsRemaining = m_asyncCompletionDelay;
+    m_isAsyncPending = true;
+    if (m_pAsyncHook)
+    {
+        m_pAsyncHook(m_pAsyncHookContext, AsyncTransferStarted);
+    }
+}
+
+void SPIDma::growAsyncStaging(size_t size)
+{
+    if (size > m_asyncStagingAlloc)
+    {
+        // This is test only code and doesn't run in production so don't worry about alloc failure.
+        uint8_t* pRealloc = (uint8_t*)realloc(m_pAsyncStaging, size);
+        assert ( pRealloc );
+        m_pAsyncStaging = pRealloc;
+        m_asyncStagingAlloc = size;
+    }
+}
+
+size_t SPIDma::getSegmentsSize(const Segment* pSegments, size_t segmentCount)
+{
+    size_t totalSize = 0;
+    for (size_t i = 0 ; i < segmentCount ; i++)
+    {
+        totalSize += pSegments[i].count;
+    }
+    return totalSize;
+}
+
+bool SPIDma::isTransferPending()
+{
+    if (!m_isAsyncPending)
+    {
+        return false;
+    }
+    if (m_asyncPollsRemaining > 0)
+    {
+        m_asyncPollsRemaining--;
+        return true;
+    }
+    completeAsyncTransfer();
+    return false;
+}
+
+bool SPIDma::waitForTransfer()
+{
+    if (!m_isAsyncPending)
+    {
+        return m_asyncResult;
+    }
+    completeAsyncTransfer();
+    return m_asyncResult;
+}
+
+void SPIDma::completeAsyncTransfer()
+{
+    if (m_pAsyncHook)
+    {
+        m_pAsyncHook(m_pAsyncHookContext, AsyncTransferCompleted);
+    }
+    if (m_asyncResult)
+    {
+        const uint8_t* pSrc = m_pAsyncStaging;
+        for (size_t i = 0 ; i < m_asyncReadSegmentCount ; i++)
+        {
+            memcpy(m_asyncReadSegments[i].pBuffer, pSrc, m_asyncReadSegments[i].count);
+            pSrc += m_asyncReadSegments[i].count;
+        }
+    }
+    m_isAsyncPending = false;
+    if (m_pAsyncCallback)
+    {
+        m_pAsyncCallback(m_pAsyncContext, m_asyncResult);
+    }
+}
+
+void SPIDma::setDevice(SPIDevice* pDevice)
+{
+    waitForTransfer();
+    m_pDevice = pDevice;
+    if (m_pDevice)
+    {
+        m_pDevice->setFrequency(m_settings.frequency);
+        m_pDevice->setChipSelect(m_settings.chipSelect);
+    }
+}
+
 uint32_t SPIDma::getByteCount()
 {
     return m_byteCount;
@@ -294,3 +491,19 @@ void SPIDma::failTransferCall(uint32_t callToFail, uint32_t failRepeatCount /* =
     m_transferFailStart = callToFail;
     m_transferFailStop = callToFail + failRepeatCount - 1;
 }
+
+void SPIDma::setTransferCompletionDelay(uint32_t pollCount)
+{
+    m_asyncCompletionDelay = pollCount;
+}
+
+uint32_t SPIDma::getAsyncTransferCount()
+{
+    return m_asyncTransferCount;
+}
+
+void SPIDma::setAsyncTransferHook(AsyncTransferHook pHook, void* pContext)
+{
+    m_pAsyncHook = pHook;
+    m_pAsyncHookContext = pContext;
+}
@@ -17,12 +17,25 @@
 #ifndef SPI_DMA_H_
 #define SPI_DMA_H_
 
+#include "SPIDevice.h"
+
 // Define this here for PC based unit testing so that we don't need to use mbed provided ones.
 typedef uint32_t PinName;
 
+// Maximum number of buffers which can be passed into a single readScatterAsync() or writeGatherAsync() call.
+#define SPIDMA_MAX_SEGMENTS 8
+
 class SPIDma
 {
 public:
+    typedef void (*TransferCallback)(void* pContext, bool wasSuccessful);
+
+    struct Segment
+    {
+        void*  pBuffer;
+        size_t count;
+    };
+
     SPIDma(PinName mosi, PinName miso, PinName sclk, PinName ssel = 0, int sselInitVal = 1);
     ~SPIDma();
 
@@ -33,8 +46,17 @@ public:
     void setChipSelect(int state);
 
     void send(int data);
+    void send(const void* pvData, size_t count);
     int  exchange(int data);
     bool transfer(const void* pvWrite, size_t writeSize, void* pvRead, size_t readSize);
+    void transferAsync(const void* pvWrite, size_t writeSize, void* pvRead, size_t readSize,
+                       TransferCallback pCallback = NULL, void* pContext = NULL);
+    void readScatterAsync(const Segment* pSegments, size_t segmentCount,
+                          TransferCallback pCallback = NULL, void* pContext = NULL);
+    void writeGatherAsync(const Segment* pSegments, size_t segmentCount,
+                          TransferCallback pCallback = NULL, void* pContext = NULL);
+    bool isTransferPending();
+    bool waitForTransfer();
 
     uint32_t getByteCount();
     void     resetByteCount();
@@ -57,16 +79,40 @@ public:
         int         chipSelect;
     };
 
+    enum AsyncTransferEvent
+    {
+        AsyncTransferStarted = 1,
+        AsyncTransferCompleted
+    };
+    typedef void (*AsyncTransferHook)(void* pContext, AsyncTransferEvent event);
+
     const char* getOutboundAsString(int start = 0, int count = -1);
     void        setInboundFromString(const char* pData);
     bool        isInboundBufferEmpty();
     size_t      getSettingsCount();
     Settings    getSetting(size_t index);
     void        failTransferCall(uint32_t callToFail, uint32_t failRepeatCount = 1);
+    //  Number of isTransferPending() calls which return true before an async transfer completes. Defaults to 0 so
+    //  that the first poll completes the transfer.
+    void        setTransferCompletionDelay(uint32_t pollCount);
+    uint32_t    getAsyncTransferCount();
+    //  Hook called just after an async transfer is started and just before it is marked as complete. Allows tests to
+    //  verify what work the code under test performs while a transfer is in flight.
+    void        setAsyncTransferHook(AsyncTransferHook pHook, void* pContext);
+    //  Attach a simulated device (ie. SD card model) to the bus. While attached, outbound bytes are sent to the device
+    //  rather than recorded and inbound bytes come from the device rather than setInboundFromString().
+    void        setDevice(SPIDevice* pDevice);
 
 protected:
     static uint32_t hexToNibble(char digit);
     void            recordLatestSetting();
+    bool            transferInternal(const void* pvWrite, size_t writeSize, void* pvRead, size_t readSize);
+    void            startAsyncTransfer(const void* pvWrite, size_t writeSize,
+                                       const Segment* pReadSegments, size_t readSegmentCount,
+                                       TransferCallback pCallback, void* pContext);
+    void            growAsyncStaging(size_t size);
+    void            completeAsyncTransfer();
+    static size_t   getSegmentsSize(const Segment* pSegments, size_t segmentCount);
 
     uint8_t*  m_pOutBuffer;
     uint8_t*  m_pOutCurr;
@@ -84,6 +130,22 @@ protected:
     uint32_t  m_transferCall;
     uint32_t  m_transferFailStart;
     uint32_t  m_transferFailStop;
+
+    // State for simulating delayed completion of transferAsync() calls.
+    uint8_t*         m_pAsyncStaging;
+    size_t           m_asyncStagingAlloc;
+    Segment          m_asyncReadSegments[SPIDMA_MAX_SEGMENTS];
+    size_t           m_asyncReadSegmentCount;
+    TransferCallback m_pAsyncCallback;
+    void*            m_pAsyncContext;
+    uint32_t         m_asyncCompletionDelay;
+    uint32_t         m_asyncPollsRemaining;
+    uint32_t         m_asyncTransferCount;
+    AsyncTransferHook m_pAsyncHook;
+    void*            m_pAsyncHookContext;
+    SPIDevice*       m_pDevice;
+    bool             m_isAsyncPending;
+    bool             m_asyncResult;
 };
 
 #endif /* SPI_DMA_H_ */
@@ -13,7 +13,7 @@
    limitations under the License.
 */
 // Mock to simulate mbed's Timer class.  It will just return a fixed amount of elapsed time between each call to
-// read_ms().
+// read_ms() or read_us().  The elapsed time per call is in milliseconds for both.
 #include "Timer.h"
 
 Timer::Timer()
@@ -32,6 +32,11 @@ int Timer::read_ms()
     return m_currTime;
 }
 
+int Timer::read_us()
+{
+    return read_ms() * 1000;
+}
+
 void Timer::start()
 {
     m_isRunning = true;
@@ -13,7 +13,7 @@
    limitations under the License.
 */
 // Mock to simulate mbed's Timer class.  It will just return a fixed amount of elapsed time between each call to
-// read_ms().
+// read_ms() or read_us().  The elapsed time per call is in milliseconds for both.
 #ifndef TIMER_H_
 #define TIMER_H_
 
@@ -26,6 +26,7 @@ public:
     void stop();
     void reset();
     int  read_ms();
+    int  read_us();
 
     void setElapsedTimePerCall(int amount);
 protected:
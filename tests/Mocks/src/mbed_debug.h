@@ -0,0 +1,25 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+// Place holder for mbed's debug_if() which discards the output when running on the PC host.
+#ifndef MBED_DEBUG_H_
+#define MBED_DEBUG_H_
+
+static inline void debug_if(int condition, const char* pFormat, ...)
+{
+    (void)condition;
+    (void)pFormat;
+}
+
+#endif /* MBED_DEBUG_H_ */
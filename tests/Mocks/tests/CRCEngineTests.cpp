@@ -0,0 +1,75 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <string.h>
+#include <CRCEngine.h>
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+
+TEST_GROUP(CRCEngine)
+{
+    CRCEngine m_engine;
+    uint8_t   m_block[512];
+
+    void setup()
+    {
+        memset(m_block, 0xFF, sizeof(m_block));
+    }
+
+    void teardown()
+    {
+    }
+};
+
+
+TEST(CRCEngine, IsAvailable_ShouldDefaultToTrue)
+{
+    CHECK_TRUE(m_engine.isAvailable());
+}
+
+TEST(CRCEngine, BlockOfAllFFs_ShouldMatchSDSpecificationExample)
+{
+    CHECK_TRUE(m_engine.start(m_block, sizeof(m_block), 0));
+    LONGS_EQUAL(0x7FA1, m_engine.wait());
+    LONGS_EQUAL(1, m_engine.startCount());
+    LONGS_EQUAL(512, m_engine.byteCount());
+}
+
+TEST(CRCEngine, ContinueFromSeed_ShouldMatchSingleCalculation)
+{
+    CHECK_TRUE(m_engine.start(m_block, 100, 0));
+    uint16_t seed = m_engine.wait();
+    CHECK_TRUE(m_engine.start(m_block + 100, sizeof(m_block) - 100, seed));
+    LONGS_EQUAL(0x7FA1, m_engine.wait());
+}
+
+TEST(CRCEngine, StartWhileBusy_ShouldFail)
+{
+    CHECK_TRUE(m_engine.start(m_block, sizeof(m_block), 0));
+    CHECK_TRUE(m_engine.isBusy());
+    CHECK_FALSE(m_engine.start(m_block, sizeof(m_block), 0));
+    LONGS_EQUAL(0x7FA1, m_engine.wait());
+    CHECK_FALSE(m_engine.isBusy());
+    LONGS_EQUAL(1, m_engine.startCount());
+}
+
+TEST(CRCEngine, StartWhenNotAvailable_ShouldFail)
+{
+    m_engine.setAvailable(false);
+    CHECK_FALSE(m_engine.isAvailable());
+    CHECK_FALSE(m_engine.start(m_block, sizeof(m_block), 0));
+    LONGS_EQUAL(0, m_engine.startCount());
+}
@@ -66,3 +66,16 @@ TEST(Interlocked, InterlockedAddSubtract)
     LONGS_EQUAL(0, interlockedSubtract(&value, 8));
     LONGS_EQUAL(0, value);
 }
+
+TEST(Interlocked, InterlockedCompareExchange)
+{
+    uint32_t value = 7;
+
+    // Only stores the new value when the current value matches the comparand.
+    LONGS_EQUAL(7, interlockedCompareExchange(&value, 9, 6));
+    LONGS_EQUAL(7, value);
+    LONGS_EQUAL(7, interlockedCompareExchange(&value, 9, 7));
+    LONGS_EQUAL(9, value);
+    LONGS_EQUAL(9, interlockedCompareExchange(&value, 0, 9));
+    LONGS_EQUAL(0, value);
+}
@@ -22,10 +22,67 @@
 #define LOW  0
 
 
+static uint32_t g_callbackCount;
+static bool     g_callbackResult;
+static void*    g_pCallbackContext;
+
+static void transferCallback(void* pContext, bool wasSuccessful)
+{
+    g_callbackCount++;
+    g_callbackResult = wasSuccessful;
+    g_pCallbackContext = pContext;
+}
+
+static uint32_t g_hookEvents[4];
+static uint32_t g_hookEventCount;
+
+// Device which echoes back each byte plus one and records chip select/frequency changes.
+class EchoDevice : public SPIDevice
+{
+public:
+    EchoDevice()
+    {
+        chipSelect = -1;
+        frequency = -1;
+        byteCount = 0;
+    }
+
+    virtual void setChipSelect(int state)
+    {
+        chipSelect = state;
+    }
+    virtual void setFrequency(int hz)
+    {
+        frequency = hz;
+    }
+    virtual uint8_t exchange(uint8_t mosi)
+    {
+        byteCount++;
+        return mosi + 1;
+    }
+
+    int      chipSelect;
+    int      frequency;
+    uint32_t byteCount;
+};
+
+static void asyncTransferHook(void* pContext, SPIDma::AsyncTransferEvent event)
+{
+    if (g_hookEventCount < sizeof(g_hookEvents)/sizeof(g_hookEvents[0]))
+    {
+        g_hookEvents[g_hookEventCount++] = event;
+    }
+}
+
+
 TEST_GROUP(SPIDma)
 {
     void setup()
     {
+        g_callbackCount = 0;
+        g_callbackResult = false;
+        g_pCallbackContext = NULL;
+        g_hookEventCount = 0;
     }
 
     void teardown()
@@ -68,6 +125,16 @@ TEST(SPIDma, WriteTwoBytes_VerifyOneAtATime)
     STRCMP_EQUAL("78", spi.getOutboundAsString(1, 1));
 }
 
+TEST(SPIDma, WriteSixByteBuffer_VerifyAllRecordedInOrder)
+{
+    SPIDma               spi(1, 2, 3);
+    static const uint8_t packet[] = { 0x40, 0x00, 0x00, 0x00, 0x00, 0x95 };
+
+    spi.send(packet, sizeof(packet));
+    STRCMP_EQUAL("400000000095", spi.getOutboundAsString());
+    LONGS_EQUAL(6, spi.getByteCount());
+}
+
 TEST(SPIDma, GetOutboundAsStringWithIndexOutOfBounds_ShouldReturnEmptyString)
 {
     SPIDma spi(1, 2, 3);
@@ -207,6 +274,115 @@ TEST(SPIDma, CallTransferFourTimes_FailSecondAndThirdCall_FirstAndLastShouldSucc
     STRCMP_EQUAL("1278", spi.getOutboundAsString());
 }
 
+TEST(SPIDma, TransferAsync_VerifyReadBufferNotUpdatedUntilCompletion)
+{
+    SPIDma spi(1, 2, 3);
+    uint8_t writeBuffer[2] = { 0x12, 0x34 };
+    uint8_t readBuffer[2] = { 0xFF, 0xFF };
+
+    spi.setInboundFromString("5678");
+    spi.setTransferCompletionDelay(2);
+    spi.transferAsync(writeBuffer, sizeof(writeBuffer), readBuffer, sizeof(readBuffer));
+    STRCMP_EQUAL("1234", spi.getOutboundAsString());
+    LONGS_EQUAL(1, spi.getAsyncTransferCount());
+        CHECK_TRUE(spi.isTransferPending());
+        CHECK_TRUE(spi.isTransferPending());
+    LONGS_EQUAL(0xFF, readBuffer[0]);
+    LONGS_EQUAL(0xFF, readBuffer[1]);
+        CHECK_FALSE(spi.isTransferPending());
+    LONGS_EQUAL(0x56, readBuffer[0]);
+    LONGS_EQUAL(0x78, readBuffer[1]);
+    CHECK_TRUE(spi.waitForTransfer());
+}
+
+TEST(SPIDma, TransferAsync_WaitForTransfer_ShouldCompleteImmediately)
+{
+    SPIDma spi(1, 2, 3);
+    uint8_t writeBuffer = 0x12;
+    uint8_t readBuffer[2] = { 0xFF, 0xFF };
+
+    spi.setInboundFromString("5678");
+    spi.setTransferCompletionDelay(100);
+    spi.transferAsync(&writeBuffer, sizeof(writeBuffer), readBuffer, sizeof(readBuffer));
+        CHECK_TRUE(spi.waitForTransfer());
+    CHECK_FALSE(spi.isTransferPending());
+    LONGS_EQUAL(0x56, readBuffer[0]);
+    LONGS_EQUAL(0x78, readBuffer[1]);
+    STRCMP_EQUAL("1212", spi.getOutboundAsString());
+    LONGS_EQUAL(2, spi.getByteCount());
+}
+
+TEST(SPIDma, TransferAsync_VerifyCallbackIssuedOnCompletion)
+{
+    SPIDma spi(1, 2, 3);
+    uint8_t writeBuffer = 0xFF;
+    uint8_t readBuffer = 0x00;
+
+    spi.setInboundFromString("5A");
+    spi.setTransferCompletionDelay(1);
+    spi.transferAsync(&writeBuffer, sizeof(writeBuffer), &readBuffer, sizeof(readBuffer), transferCallback, &spi);
+        CHECK_TRUE(spi.isTransferPending());
+    LONGS_EQUAL(0, g_callbackCount);
+        CHECK_FALSE(spi.isTransferPending());
+    LONGS_EQUAL(1, g_callbackCount);
+    CHECK_TRUE(g_callbackResult);
+    POINTERS_EQUAL(&spi, g_pCallbackContext);
+    LONGS_EQUAL(0x5A, readBuffer);
+}
+
+TEST(SPIDma, TransferAsync_FailTransfer_CallbackAndWaitShouldReturnFalse)
+{
+    SPIDma spi(1, 2, 3);
+    uint8_t writeBuffer = 0x12;
+    uint8_t readBuffer = 0xFF;
+
+    spi.setInboundFromString("56");
+    spi.failTransferCall(1);
+    spi.transferAsync(&writeBuffer, sizeof(writeBuffer), &readBuffer, sizeof(readBuffer), transferCallback, NULL);
+        CHECK_FALSE(spi.waitForTransfer());
+    LONGS_EQUAL(1, g_callbackCount);
+    CHECK_FALSE(g_callbackResult);
+    LONGS_EQUAL(0xFF, readBuffer);
+    STRCMP_EQUAL("", spi.getOutboundAsString());
+    CHECK_FALSE(spi.isInboundBufferEmpty());
+}
+
+TEST(SPIDma, TransferAsync_ThenExchange_ShouldImplicitlyCompletePendingTransfer)
+{
+    SPIDma spi(1, 2, 3);
+    uint8_t writeBuffer = 0x12;
+    uint8_t readBuffer = 0xFF;
+
+    spi.setInboundFromString("5678");
+    spi.setTransferCompletionDelay(100);
+    spi.transferAsync(&writeBuffer, sizeof(writeBuffer), &readBuffer, sizeof(readBuffer), transferCallback, NULL);
+        LONGS_EQUAL(0x78, spi.exchange(0x34));
+    LONGS_EQUAL(1, g_callbackCount);
+    LONGS_EQUAL(0x56, readBuffer);
+    CHECK_FALSE(spi.isTransferPending());
+    STRCMP_EQUAL("1234", spi.getOutboundAsString());
+}
+
+TEST(SPIDma, TransferAsync_VerifyHookCalledOnStartAndCompletion)
+{
+    SPIDma spi(1, 2, 3);
+    uint8_t writeBuffer = 0x12;
+    uint8_t readBuffer = 0xFF;
+
+    spi.setInboundFromString("56");
+    spi.setTransferCompletionDelay(1);
+    spi.setAsyncTransferHook(asyncTransferHook, NULL);
+    spi.transferAsync(&writeBuffer, sizeof(writeBuffer), &readBuffer, sizeof(readBuffer));
+    LONGS_EQUAL(1, g_hookEventCount);
+    LONGS_EQUAL(SPIDma::AsyncTransferStarted, g_hookEvents[0]);
+        CHECK_TRUE(spi.isTransferPending());
+    LONGS_EQUAL(1, g_hookEventCount);
+        CHECK_FALSE(spi.isTransferPending());
+    LONGS_EQUAL(2, g_hookEventCount);
+    LONGS_EQUAL(SPIDma::AsyncTransferCompleted, g_hookEvents[1]);
+    LONGS_EQUAL(0x56, readBuffer);
+}
+
 TEST(SPIDma, SetSpecificFrequency_VerifyThatItIsRecorded)
 {
     SPIDma spi(1, 2, 3);
@@ -483,3 +659,75 @@ TEST(SPIDma, GetByteCount_VerifyResetBackToZero)
     spi.resetByteCount();
     LONGS_EQUAL(0, spi.getByteCount());
 }
+
+TEST(SPIDma, ReadScatterAsync_ShouldSendFFAndScatterIntoSegmentsOnCompletion)
+{
+    SPIDma spi(1, 2, 3);
+    uint8_t firstBuffer[1] = { 0x00 };
+    uint8_t secondBuffer[3] = { 0x00, 0x00, 0x00 };
+    SPIDma::Segment segments[2] = { { firstBuffer, sizeof(firstBuffer) }, { secondBuffer, sizeof(secondBuffer) } };
+
+    spi.setInboundFromString("12345678");
+    spi.setTransferCompletionDelay(1);
+    spi.readScatterAsync(segments, 2);
+    STRCMP_EQUAL("FFFFFFFF", spi.getOutboundAsString());
+    LONGS_EQUAL(1, spi.getAsyncTransferCount());
+        CHECK_TRUE(spi.isTransferPending());
+    LONGS_EQUAL(0x00, firstBuffer[0]);
+        CHECK_FALSE(spi.isTransferPending());
+    LONGS_EQUAL(0x12, firstBuffer[0]);
+    LONGS_EQUAL(0x34, secondBuffer[0]);
+    LONGS_EQUAL(0x56, secondBuffer[1]);
+    LONGS_EQUAL(0x78, secondBuffer[2]);
+    LONGS_EQUAL(4, spi.getByteCount());
+}
+
+TEST(SPIDma, WriteGatherAsync_ShouldSendSegmentsInOrderAsSingleTransfer)
+{
+    SPIDma spi(1, 2, 3);
+    uint8_t firstBuffer[2] = { 0x12, 0x34 };
+    uint8_t secondBuffer[1] = { 0x56 };
+    SPIDma::Segment segments[2] = { { secondBuffer, sizeof(secondBuffer) }, { firstBuffer, sizeof(firstBuffer) } };
+
+    spi.writeGatherAsync(segments, 2);
+    STRCMP_EQUAL("561234", spi.getOutboundAsString());
+    LONGS_EQUAL(1, spi.getAsyncTransferCount());
+        CHECK_TRUE(spi.waitForTransfer());
+}
+
+TEST(SPIDma, WriteGatherAsync_FailTransfer_ShouldReturnFalseFromWait)
+{
+    SPIDma spi(1, 2, 3);
+    uint8_t buffer[2] = { 0x12, 0x34 };
+    SPIDma::Segment segments[2] = { { buffer, 1 }, { buffer + 1, 1 } };
+
+    spi.failTransferCall(1);
+    spi.writeGatherAsync(segments, 2);
+    STRCMP_EQUAL("", spi.getOutboundAsString());
+        CHECK_FALSE(spi.waitForTransfer());
+}
+
+TEST(SPIDma, SetDevice_ShouldRouteTrafficToDeviceInsteadOfRecordingIt)
+{
+    SPIDma     spi(1, 2, 3, 4);
+    EchoDevice device;
+    uint8_t    writeBuffer[2] = { 0x12, 0x34 };
+    uint8_t    readBuffer[2] = { 0x00, 0x00 };
+
+    spi.frequency(25000000);
+    spi.setDevice(&device);
+    LONGS_EQUAL(HIGH, device.chipSelect);
+    LONGS_EQUAL(25000000, device.frequency);
+
+    spi.setChipSelect(LOW);
+    LONGS_EQUAL(LOW, device.chipSelect);
+    spi.send(0x55);
+    LONGS_EQUAL(0x43, spi.exchange(0x42));
+        CHECK_TRUE(spi.transfer(writeBuffer, sizeof(writeBuffer), readBuffer, sizeof(readBuffer)));
+    LONGS_EQUAL(0x13, readBuffer[0]);
+    LONGS_EQUAL(0x35, readBuffer[1]);
+
+    LONGS_EQUAL(4, device.byteCount);
+    LONGS_EQUAL(4, spi.getByteCount());
+    STRCMP_EQUAL("", spi.getOutboundAsString());
+}
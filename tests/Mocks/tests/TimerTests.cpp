@@ -71,3 +71,13 @@ TEST(Timer, CheckTimeAfterCallingStart_UseNonDefaultIncrementAmount)
     LONGS_EQUAL(20, timer.read_ms());
     LONGS_EQUAL(30, timer.read_ms());
 }
+
+TEST(Timer, ReadUs_ShouldAdvanceLikeReadMsButReturnMicroseconds)
+{
+    Timer timer;
+
+    timer.start();
+    LONGS_EQUAL(1000, timer.read_us());
+    LONGS_EQUAL(2, timer.read_ms());
+    LONGS_EQUAL(3000, timer.read_us());
+}
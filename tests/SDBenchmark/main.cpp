@@ -0,0 +1,221 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* Host benchmark which runs PerformanceTest style workloads through the SDFileSystem driver against the SDCardSim
+   model and reports throughput in terms of the simulated SPI clock.
+
+   The simulated clock only advances when bytes are clocked over the SPI bus so the results are an upper bound which
+   ignores CPU time spent between transfers. They are intended for comparing driver changes, not predicting absolute
+   hardware throughput.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDFileSystem.h>
+#include <SDStripedFileSystem.h>
+#include <SDCardSim.h>
+#include <SimSDFileSystem.h>
+#include <diskio.h>
+
+
+static const uint32_t g_testFileSize = 10 * 1024 * 1024;
+static const uint32_t g_recordSize = 128;
+static const uint32_t g_metadataSize = 1024 * 1024;
+
+static SDCardSim       g_card(32 * 1024 * 2);
+static SimSDFileSystem g_sd(&g_card);
+// Second card on another SPI bus which is only used for the striping tests.
+static SDCardSim       g_card2(32 * 1024 * 2);
+static SimSDFileSystem g_sd2(&g_card2);
+static uint8_t         g_buffer[16 * 1024];
+static uint32_t        g_cache[16 * 1024 / sizeof(uint32_t)];
+
+
+static void startTest(const char* pDescription);
+static void endTest(uint32_t bytesTransferred);
+static void checkResult(int result, const char* pOperation);
+
+
+int main(int argc, char** argv)
+{
+    uint32_t blockCount = sizeof(g_buffer) / 512;
+
+    g_card2.shareClock(&g_card);
+    checkResult(g_sd.disk_initialize(), "disk_initialize");
+
+    startTest("16k disk_write()");
+    memset(g_buffer, 0x55, sizeof(g_buffer));
+    for (uint32_t block = 0 ; block < g_testFileSize / 512 ; block += blockCount)
+    {
+        checkResult(g_sd.disk_write(g_buffer, block, blockCount), "disk_write");
+    }
+    endTest(g_testFileSize);
+
+    // Mimic FatFs metadata updates which result in many single sector disk_write() calls.
+    startTest("Single sector disk_write()");
+    for (uint32_t block = 0 ; block < g_metadataSize / 512 ; block++)
+    {
+        checkResult(g_sd.disk_write(g_buffer, block, 1), "disk_write");
+    }
+    endTest(g_metadataSize);
+
+    startTest("Single sector disk_write() with status checked every 16 writes");
+    checkResult(g_sd.setWriteStatusCheckInterval(16), "setWriteStatusCheckInterval");
+    for (uint32_t block = 0 ; block < g_metadataSize / 512 ; block++)
+    {
+        checkResult(g_sd.disk_write(g_buffer, block, 1), "disk_write");
+    }
+    checkResult(g_sd.disk_sync(), "disk_sync");
+    checkResult(g_sd.setWriteStatusCheckInterval(1), "setWriteStatusCheckInterval");
+    endTest(g_metadataSize);
+
+    startTest("16k disk_read()");
+    for (uint32_t block = 0 ; block < g_testFileSize / 512 ; block += blockCount)
+    {
+        checkResult(g_sd.disk_read(g_buffer, block, blockCount), "disk_read");
+    }
+    endTest(g_testFileSize);
+
+    // Mimic FatFs reading a file with 4k clusters where f_read() splits a large read at every cluster boundary.
+    startTest("4k disk_read()");
+    for (uint32_t block = 0 ; block < g_testFileSize / 512 ; block += 8)
+    {
+        checkResult(g_sd.disk_read(g_buffer, block, 8), "disk_read");
+    }
+    endTest(g_testFileSize);
+
+    startTest("4k disk_read() with read streaming");
+    checkResult(g_sd.setReadStreamIdleTimeout(100), "setReadStreamIdleTimeout");
+    for (uint32_t block = 0 ; block < g_testFileSize / 512 ; block += 8)
+    {
+        checkResult(g_sd.disk_read(g_buffer, block, 8), "disk_read");
+    }
+    checkResult(g_sd.setReadStreamIdleTimeout(0), "setReadStreamIdleTimeout");
+    endTest(g_testFileSize);
+
+    // Mimic FatFs reading a file in records smaller than a sector with no stdio buffering: each record results in a
+    // single sector disk_read() into the file's sector buffer and the records are then copied out of it.
+    startTest("128 byte records (single sector disk_read())");
+    for (uint32_t offset = 0 ; offset < g_testFileSize ; offset += g_recordSize)
+    {
+        if (offset % 512 == 0)
+        {
+            checkResult(g_sd.disk_read(g_buffer, offset / 512, 1), "disk_read");
+        }
+    }
+    endTest(g_testFileSize);
+
+    startTest("128 byte records with sector cache & read-ahead");
+    checkResult(g_sd.enableSectorCache(g_cache, sizeof(g_cache), 2), "enableSectorCache");
+    checkResult(g_sd.setReadAheadWindow(SDFILESYSTEM_READ_AHEAD_MAX_WINDOW), "setReadAheadWindow");
+    for (uint32_t offset = 0 ; offset < g_testFileSize ; offset += g_recordSize)
+    {
+        if (offset % 512 == 0)
+        {
+            checkResult(g_sd.disk_read(g_buffer, offset / 512, 1), "disk_read");
+        }
+    }
+    checkResult(g_sd.disableSectorCache(), "disableSectorCache");
+    endTest(g_testFileSize);
+
+    // Switch the card into High-Speed mode and repeat the large transfers at 50MHz.
+    checkResult(g_sd.setMaximumFrequency(50000000), "setMaximumFrequency");
+    checkResult(g_sd.disk_initialize(), "disk_initialize");
+
+    startTest("16k disk_write() in High-Speed mode");
+    for (uint32_t block = 0 ; block < g_testFileSize / 512 ; block += blockCount)
+    {
+        checkResult(g_sd.disk_write(g_buffer, block, blockCount), "disk_write");
+    }
+    endTest(g_testFileSize);
+
+    startTest("16k disk_read() in High-Speed mode");
+    for (uint32_t block = 0 ; block < g_testFileSize / 512 ; block += blockCount)
+    {
+        checkResult(g_sd.disk_read(g_buffer, block, blockCount), "disk_read");
+    }
+    endTest(g_testFileSize);
+
+    // Compare writing to one card against striping across two where each card programs a block while the other is
+    // being sent one.
+    SDFileSystem*       cards[2] = { &g_sd, &g_sd2 };
+    SDStripedFileSystem striped("stripe", cards, 2, 16);
+    checkResult(g_sd2.setMaximumFrequency(50000000), "setMaximumFrequency");
+    checkResult(striped.disk_initialize(), "disk_initialize");
+    checkResult(g_sd.setWriteStatusCheckInterval(16), "setWriteStatusCheckInterval");
+    checkResult(g_sd2.setWriteStatusCheckInterval(16), "setWriteStatusCheckInterval");
+
+    startTest("16k disk_write() in High-Speed mode with status checked every 16 writes");
+    for (uint32_t block = 0 ; block < g_testFileSize / 512 ; block += blockCount)
+    {
+        checkResult(g_sd.disk_write(g_buffer, block, blockCount), "disk_write");
+    }
+    checkResult(g_sd.disk_sync(), "disk_sync");
+    endTest(g_testFileSize);
+
+    startTest("16k disk_write() striped across 2 cards in 8k stripes");
+    for (uint32_t block = 0 ; block < g_testFileSize / 512 ; block += blockCount)
+    {
+        checkResult(striped.disk_write(g_buffer, block, blockCount), "disk_write");
+    }
+    checkResult(striped.disk_sync(), "disk_sync");
+    endTest(g_testFileSize);
+
+    return 0;
+}
+
+static uint64_t g_startTime;
+
+static void startTest(const char* pDescription)
+{
+    printf("%s\n", pDescription);
+    g_card.resetStatistics();
+    g_card2.resetStatistics();
+    g_startTime = g_card.elapsedNanoseconds();
+}
+
+static void endTest(uint32_t bytesTransferred)
+{
+    // Combine the statistics of both cards for the striping tests.
+    SDCardSim::Statistics stats = g_card.getStatistics();
+    SDCardSim::Statistics stats2 = g_card2.getStatistics();
+    stats.totalBytes += stats2.totalBytes;
+    stats.payloadBytes += stats2.payloadBytes;
+    stats.busyBytes += stats2.busyBytes;
+    stats.readAccessBytes += stats2.readAccessBytes;
+    stats.commandCount += stats2.commandCount;
+    stats.blocksRead += stats2.blocksRead;
+    stats.blocksWritten += stats2.blocksWritten;
+    uint64_t              elapsedTime = g_card.elapsedNanoseconds() - g_startTime;
+    double                seconds = elapsedTime / 1000000000.0;
+
+    printf("    %.2f MB/second.\n", (bytesTransferred / seconds) / (1000.0 * 1000.0));
+    printf("    Bus utilisation: %.1f%% payload, %.1f%% busy, %.1f%% read access, %.1f%% overhead.\n",
+           100.0 * stats.payloadBytes / stats.totalBytes,
+           100.0 * stats.busyBytes / stats.totalBytes,
+           100.0 * stats.readAccessBytes / stats.totalBytes,
+           100.0 * (stats.totalBytes - stats.payloadBytes - stats.busyBytes - stats.readAccessBytes) / stats.totalBytes);
+    printf("    %u commands, %u blocks read, %u blocks written.\n",
+           stats.commandCount, stats.blocksRead, stats.blocksWritten);
+}
+
+static void checkResult(int result, const char* pOperation)
+{
+    if (result != RES_OK)
+    {
+        fprintf(stderr, "error: %s failed - %d\n", pOperation, result);
+        g_sd.dumpErrorLog(stderr);
+        exit(-1);
+    }
+}
@@ -0,0 +1,802 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+// Byte level model of a SD card running in SPI mode.
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SDCardSim.h"
+
+
+#define HIGH 1
+#define LOW  0
+
+// 7.3.1.3 Detailed Command Description - Commands and arguments used by this model.
+#define CMD_TRANSMISSION_BIT    0x40
+#define CMD59_CRC_OPTION_BIT    1
+#define ACMD41_HCS_BIT          (1 << 30)
+#define CMD6_MODE_SWITCH        (1U << 31)
+
+// 7.3.2.1 Format R1
+#define R1_IDLE                 (1 << 0)
+#define R1_ILLEGAL_COMMAND      (1 << 2)
+#define R1_COM_CRC_ERROR        (1 << 3)
+#define R1_PARAMETER_ERROR      (1 << 6)
+
+// 5.1 OCR register
+#define OCR_3_2__3_3V           (0x1FF << 15)
+#define OCR_CCS                 (1 << 30)
+#define OCR_POWER_UP_DONE       (1U << 31)
+
+// 7.3.3.1 Data Response Token & 7.3.3.2 Start Block Tokens and Stop Tran Token
+#define DATA_RESPONSE_ACCEPTED  0x05
+#define DATA_RESPONSE_CRC_ERROR 0x0B
+#define BLOCK_START             0xFE
+#define MULTIPLE_BLOCK_START    0xFC
+#define MULTIPLE_BLOCK_STOP     0xFD
+#define DATA_ERROR_OUT_OF_RANGE 0x08
+
+
+static void setBits(uint8_t* p, size_t size, uint32_t lowBit, uint32_t highBit, uint32_t value);
+
+
+SDCardSim::SDCardSim(uint32_t sectorCount, bool isHighCapacity /* = true */)
+{
+    // The CSD register can only describe capacities which are a multiple of these sizes.
+    assert ( sectorCount > 0 && (sectorCount % (isHighCapacity ? 1024 : 512)) == 0 );
+
+    // Storage is allocated a chunk at a time as sectors are first accessed so that large cards can be simulated.
+    m_chunkCount = (sectorCount + SECTORS_PER_CHUNK - 1) / SECTORS_PER_CHUNK;
+    m_ppChunks = (uint8_t**)calloc(m_chunkCount, sizeof(*m_ppChunks));
+    assert ( m_ppChunks );
+    m_sectorCount = sectorCount;
+    m_isHighCapacity = isHighCapacity;
+    m_timings = defaultTimings();
+    resetStatistics();
+
+    m_isSelected = false;
+    m_time = 0;
+    m_pTime = &m_time;
+    m_frequency = 0;
+    setFrequency(400000);
+
+    m_isIdle = true;
+    m_isCrcEnabled = false;
+    m_isAppCmd = false;
+    m_isInitStarted = false;
+    m_initDoneTime = 0;
+    m_busyUntil = 0;
+    m_wellWrittenBlocks = 0;
+    m_corruptReadCount = 0;
+    m_corruptWriteCount = 0;
+    m_isHighSpeedSupported = true;
+    m_isHighSpeed = false;
+    m_maxReliableFrequency = 0;
+    memset(m_cid, 0, sizeof(m_cid));
+    memcpy(&m_cid[1], "SIMSDCRD", 8);
+    m_cid[15] = (crc7(m_cid, 15) << 1) | 1;
+    buildCsd();
+
+    m_receiveState = RECEIVE_COMMAND;
+    memset(m_command, 0, sizeof(m_command));
+    m_commandIndex = 0;
+    m_isMultipleWrite = false;
+    m_writeSector = 0;
+    m_writeIndex = 0;
+
+    m_readState = READ_NONE;
+    m_readSector = 0;
+    m_readReadyTime = 0;
+    m_registerSize = 0;
+    clearQueue();
+}
+
+SDCardSim::~SDCardSim()
+{
+    for (uint32_t i = 0 ; i < m_chunkCount ; i++)
+    {
+        free(m_ppChunks[i]);
+    }
+    free(m_ppChunks);
+    m_ppChunks = NULL;
+}
+
+SDCardSim::Timings SDCardSim::defaultTimings()
+{
+    Timings timings;
+
+    timings.ncrBytes = 1;
+    timings.readAccessTimeUs = 100;
+    timings.programTimeUs = 200;
+    timings.stopBusyTimeUs = 500;
+    timings.initTimeUs = 50000;
+    return timings;
+}
+
+void SDCardSim::setTimings(const Timings& timings)
+{
+    // 7.5.1 Command / Response - NCR is 1 to 8 bytes.
+    assert ( timings.ncrBytes >= 1 && timings.ncrBytes <= 8 );
+    m_timings = timings;
+}
+
+SDCardSim::Timings SDCardSim::getTimings()
+{
+    return m_timings;
+}
+
+uint8_t* SDCardSim::sector(uint32_t sectorNumber)
+{
+    assert ( sectorNumber < m_sectorCount );
+    uint8_t** ppChunk = &m_ppChunks[sectorNumber / SECTORS_PER_CHUNK];
+    if (!*ppChunk)
+    {
+        *ppChunk = (uint8_t*)calloc(SECTORS_PER_CHUNK, 512);
+        assert ( *ppChunk );
+    }
+    return *ppChunk + 512 * (sectorNumber % SECTORS_PER_CHUNK);
+}
+
+uint32_t SDCardSim::sectorCount()
+{
+    return m_sectorCount;
+}
+
+uint64_t SDCardSim::elapsedNanoseconds()
+{
+    return *m_pTime;
+}
+
+void SDCardSim::shareClock(SDCardSim* pCard)
+{
+    m_pTime = pCard->m_pTime;
+}
+
+int SDCardSim::frequency()
+{
+    return m_frequency;
+}
+
+SDCardSim::Statistics SDCardSim::getStatistics()
+{
+    return m_stats;
+}
+
+void SDCardSim::resetStatistics()
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void SDCardSim::corruptNextReadCrc(uint32_t count /* = 1 */)
+{
+    m_corruptReadCount = count;
+}
+
+void SDCardSim::corruptNextWriteCrc(uint32_t count /* = 1 */)
+{
+    m_corruptWriteCount = count;
+}
+
+void SDCardSim::setHighSpeedSupport(bool isSupported)
+{
+    m_isHighSpeedSupported = isSupported;
+    buildCsd();
+}
+
+bool SDCardSim::isHighSpeed()
+{
+    return m_isHighSpeed;
+}
+
+void SDCardSim::setMaximumReliableFrequency(int maxReliableHz)
+{
+    m_maxReliableFrequency = maxReliableHz;
+}
+
+void SDCardSim::setChipSelect(int state)
+{
+    m_isSelected = (state == LOW);
+    if (!m_isSelected)
+    {
+        // Abandon any partially received command. Busy signalling and read streams continue in the background.
+        m_commandIndex = 0;
+    }
+}
+
+void SDCardSim::setFrequency(int hz)
+{
+    // The mock reports a frequency of 0 if the driver hasn't set one yet so stick with the 400kHz power on default.
+    if (hz <= 0)
+    {
+        return;
+    }
+    m_frequency = hz;
+    m_nsPerByte = (8ULL * 1000000000ULL) / hz;
+}
+
+uint8_t SDCardSim::exchange(uint8_t mosi)
+{
+    // The virtual clock only advances as bytes are clocked over the bus so the timings above cost the driver the same
+    // number of exchanges they would on real hardware.
+    *m_pTime += m_nsPerByte;
+    m_stats.totalBytes++;
+
+    // 7.2 SPI Bus Protocol - MISO is tri-stated (pulled high) when the card isn't selected.
+    if (!m_isSelected)
+    {
+        return 0xFF;
+    }
+
+    // SPI is full duplex so the byte going out was determined before this byte coming in was seen.
+    uint8_t miso = nextOutputByte();
+    processInputByte(mosi);
+    return miso;
+}
+
+uint8_t SDCardSim::nextOutputByte()
+{
+    if (m_queueHead == m_queueTail && m_readState != READ_NONE)
+    {
+        if (*m_pTime < m_readReadyTime)
+        {
+            m_stats.readAccessBytes++;
+            return 0xFF;
+        }
+        if (m_readState == READ_REGISTER)
+        {
+            queueDataBlock(m_register, m_registerSize);
+            m_readState = READ_NONE;
+        }
+        else if (m_readSector >= m_sectorCount)
+        {
+            // 7.3.3.3 Data Error Token - Multiple block read ran off the end of the card.
+            queueByte(DATA_ERROR_OUT_OF_RANGE);
+            m_readState = READ_NONE;
+        }
+        else
+        {
+            queueDataBlock(sector(m_readSector), 512);
+            m_readSector++;
+            if (m_readState == READ_SINGLE_SECTOR)
+            {
+                m_readState = READ_NONE;
+            }
+            m_readReadyTime = *m_pTime + usToNanoseconds(m_timings.readAccessTimeUs);
+        }
+    }
+
+    if (m_queueHead != m_queueTail)
+    {
+        // Only count payload as it is actually clocked out since CMD12 can abandon a block part way through.
+        if (m_queueHead >= m_payloadStart && m_queueHead < m_payloadEnd)
+        {
+            m_stats.payloadBytes++;
+            if (m_queueHead == m_payloadEnd - 1 && m_payloadEnd - m_payloadStart == 512)
+            {
+                m_stats.blocksRead++;
+            }
+        }
+        return m_queue[m_queueHead++];
+    }
+    if (isBusy())
+    {
+        m_stats.busyBytes++;
+        return 0x00;
+    }
+    return 0xFF;
+}
+
+void SDCardSim::processInputByte(uint8_t mosi)
+{
+    switch (m_receiveState)
+    {
+    case RECEIVE_COMMAND:
+        receiveCommandByte(mosi);
+        break;
+    case RECEIVE_WRITE_TOKEN:
+        receiveWriteToken(mosi);
+        break;
+    case RECEIVE_WRITE_DATA:
+        receiveWriteData(mosi);
+        break;
+    }
+}
+
+void SDCardSim::receiveCommandByte(uint8_t byte)
+{
+    // 7.3.1.1 Command Format - Commands start with a 0 start bit followed by a 1 transmission bit.
+    if (m_commandIndex == 0 && (byte & 0xC0) != CMD_TRANSMISSION_BIT)
+    {
+        return;
+    }
+    // The card doesn't accept new commands while it is busy programming.
+    if (m_commandIndex == 0 && isBusy())
+    {
+        return;
+    }
+
+    m_command[m_commandIndex++] = byte;
+    if (m_commandIndex == sizeof(m_command))
+    {
+        m_commandIndex = 0;
+        executeCommand();
+    }
+}
+
+void SDCardSim::receiveWriteToken(uint8_t byte)
+{
+    if (isBusy())
+    {
+        return;
+    }
+
+    if ((!m_isMultipleWrite && byte == BLOCK_START) || (m_isMultipleWrite && byte == MULTIPLE_BLOCK_START))
+    {
+        m_writeIndex = 0;
+        m_receiveState = RECEIVE_WRITE_DATA;
+    }
+    else if (m_isMultipleWrite && byte == MULTIPLE_BLOCK_STOP)
+    {
+        // 7.2.4 Data Write - One byte after the stop tran token the card goes busy.
+        queueByte(0xFF);
+        setBusy(m_timings.stopBusyTimeUs);
+        m_receiveState = RECEIVE_COMMAND;
+    }
+    else if ((byte & 0xC0) == CMD_TRANSMISSION_BIT)
+    {
+        // A command (ie. CMD12 after a write error) ends the write.
+        m_receiveState = RECEIVE_COMMAND;
+        receiveCommandByte(byte);
+    }
+}
+
+void SDCardSim::receiveWriteData(uint8_t byte)
+{
+    m_writeBuffer[m_writeIndex++] = byte;
+    if (m_writeIndex < sizeof(m_writeBuffer))
+    {
+        return;
+    }
+
+    m_stats.payloadBytes += 512;
+    uint16_t crcReceived = (m_writeBuffer[512] << 8) | m_writeBuffer[513];
+    bool     isCorrupted = m_corruptWriteCount > 0;
+    if (isCorrupted)
+    {
+        m_corruptWriteCount--;
+    }
+    if (isCorrupted || (m_isCrcEnabled && (crcReceived != crc16(m_writeBuffer, 512) || isClockTooFast())))
+    {
+        m_stats.crcErrorCount++;
+        queueByte(DATA_RESPONSE_CRC_ERROR);
+    }
+    else
+    {
+        memcpy(sector(m_writeSector), m_writeBuffer, 512);
+        m_stats.blocksWritten++;
+        m_wellWrittenBlocks++;
+        m_writeSector++;
+        queueByte(DATA_RESPONSE_ACCEPTED);
+        setBusy(m_timings.programTimeUs);
+    }
+
+    if (m_isMultipleWrite && m_writeSector < m_sectorCount)
+    {
+        m_receiveState = RECEIVE_WRITE_TOKEN;
+    }
+    else
+    {
+        m_receiveState = RECEIVE_COMMAND;
+    }
+}
+
+void SDCardSim::executeCommand()
+{
+    uint8_t  cmd = m_command[0] & 0x3F;
+    uint32_t argument = ((uint32_t)m_command[1] << 24) | ((uint32_t)m_command[2] << 16) |
+                        ((uint32_t)m_command[3] << 8) | (uint32_t)m_command[4];
+    uint8_t  r1 = m_isIdle ? R1_IDLE : 0;
+    bool     isAppCmd = m_isAppCmd;
+    uint32_t sectorNumber = 0;
+
+    m_stats.commandCount++;
+    m_isAppCmd = false;
+
+    // 4.5 Cyclic Redundancy Code - CMD0 and CMD8 are always CRC checked. Others only when enabled with CMD59.
+    if ((m_isCrcEnabled || cmd == 0 || cmd == 8) && (m_command[5] >> 1) != crc7(m_command, 5))
+    {
+        m_stats.crcErrorCount++;
+        queueResponse(r1 | R1_COM_CRC_ERROR);
+        return;
+    }
+
+    // 4.3.12 Command System - Only a few commands are accepted in idle state.
+    if (m_isIdle && !isAppCmd && cmd != 0 && cmd != 8 && cmd != 55 && cmd != 58 && cmd != 59)
+    {
+        queueResponse(r1 | R1_ILLEGAL_COMMAND);
+        return;
+    }
+    if (isAppCmd)
+    {
+        executeAppCommand(cmd, argument, r1);
+        return;
+    }
+
+    switch (cmd)
+    {
+    case 0:
+        // GO_IDLE_STATE
+        m_isIdle = true;
+        m_isCrcEnabled = false;
+        m_isInitStarted = false;
+        m_isHighSpeed = false;
+        m_readState = READ_NONE;
+        queueResponse(R1_IDLE);
+        break;
+    case 6:
+        // SWITCH_FUNC - R1 followed by the 512-bit switch function status.
+        queueResponse(r1);
+        switchFunction(argument);
+        break;
+    case 8:
+        // SEND_IF_COND - Echo back voltage range and check pattern.
+        queueResponse(r1);
+        queueByte(0x00);
+        queueByte(0x00);
+        queueByte((argument >> 8) & 0xF);
+        queueByte(argument & 0xFF);
+        break;
+    case 9:
+        // SEND_CSD
+        queueResponse(r1);
+        startRegisterRead(m_csd, sizeof(m_csd));
+        break;
+    case 10:
+        // SEND_CID
+        queueResponse(r1);
+        startRegisterRead(m_cid, sizeof(m_cid));
+        break;
+    case 12:
+    {
+        // STOP_TRANSMISSION - Data still being sent is abandoned. There is a stuff byte before the R1 response and
+        // then the card is busy if it was ending a write.
+        bool wasReading = (m_readState != READ_NONE);
+        clearQueue();
+        m_readState = READ_NONE;
+        queueByte(0xFF);
+        queueResponse(r1);
+        if (!wasReading)
+        {
+            setBusy(m_timings.stopBusyTimeUs);
+        }
+        break;
+    }
+    case 13:
+        // SEND_STATUS - R2 response.
+        queueResponse(r1);
+        queueByte(0x00);
+        break;
+    case 16:
+        // SET_BLOCKLEN - Only 512-byte blocks are supported.
+        queueResponse(argument == 512 ? r1 : (r1 | R1_PARAMETER_ERROR));
+        break;
+    case 17:
+    case 18:
+        // READ_SINGLE_BLOCK / READ_MULTIPLE_BLOCK
+        if (!isAddressValid(argument, &sectorNumber))
+        {
+            queueResponse(r1 | R1_PARAMETER_ERROR);
+            break;
+        }
+        queueResponse(r1);
+        startRead(cmd == 17 ? READ_SINGLE_SECTOR : READ_MULTIPLE_SECTORS, sectorNumber);
+        break;
+    case 24:
+    case 25:
+        // WRITE_BLOCK / WRITE_MULTIPLE_BLOCK
+        if (!isAddressValid(argument, &sectorNumber))
+        {
+            queueResponse(r1 | R1_PARAMETER_ERROR);
+            break;
+        }
+        queueResponse(r1);
+        m_isMultipleWrite = (cmd == 25);
+        m_writeSector = sectorNumber;
+        m_wellWrittenBlocks = 0;
+        m_receiveState = RECEIVE_WRITE_TOKEN;
+        break;
+    case 55:
+        // APP_CMD
+        m_isAppCmd = true;
+        queueResponse(r1);
+        break;
+    case 58:
+    {
+        // READ_OCR - R3 response.
+        uint32_t ocr = OCR_3_2__3_3V;
+        if (!m_isIdle)
+        {
+            ocr |= OCR_POWER_UP_DONE | (m_isHighCapacity ? OCR_CCS : 0);
+        }
+        queueResponse(r1);
+        queueByte(ocr >> 24);
+        queueByte(ocr >> 16);
+        queueByte(ocr >> 8);
+        queueByte(ocr);
+        break;
+    }
+    case 59:
+        // CRC_ON_OFF
+        m_isCrcEnabled = (argument & CMD59_CRC_OPTION_BIT) != 0;
+        queueResponse(r1);
+        break;
+    default:
+        queueResponse(r1 | R1_ILLEGAL_COMMAND);
+        break;
+    }
+}
+
+void SDCardSim::executeAppCommand(uint8_t cmd, uint32_t argument, uint8_t r1)
+{
+    switch (cmd)
+    {
+    case 22:
+    {
+        // SEND_NUM_WR_BLOCKS - Number of blocks written without error by last write command.
+        uint8_t count[4];
+        count[0] = m_wellWrittenBlocks >> 24;
+        count[1] = m_wellWrittenBlocks >> 16;
+        count[2] = m_wellWrittenBlocks >> 8;
+        count[3] = m_wellWrittenBlocks;
+        queueResponse(r1);
+        startRegisterRead(count, sizeof(count));
+        break;
+    }
+    case 23:
+        // SET_WR_BLK_ERASE_COUNT - Pre-erase hint which this model doesn't need.
+        queueResponse(r1);
+        break;
+    case 41:
+        // SD_SEND_OP_COND - Stay idle for the initialization time. High capacity cards never leave idle if the host
+        // doesn't indicate that it supports them.
+        if (!m_isInitStarted)
+        {
+            m_isInitStarted = true;
+            m_initDoneTime = *m_pTime + usToNanoseconds(m_timings.initTimeUs);
+        }
+        if (*m_pTime >= m_initDoneTime && (!m_isHighCapacity || (argument & ACMD41_HCS_BIT)))
+        {
+            m_isIdle = false;
+        }
+        queueResponse(m_isIdle ? R1_IDLE : 0);
+        break;
+    default:
+        queueResponse(r1 | R1_ILLEGAL_COMMAND);
+        break;
+    }
+}
+
+bool SDCardSim::isAddressValid(uint32_t argument, uint32_t* pSector)
+{
+    // SDSC cards use byte addresses which must be block aligned.
+    if (!m_isHighCapacity)
+    {
+        if (argument & 511)
+        {
+            return false;
+        }
+        argument >>= 9;
+    }
+    *pSector = argument;
+    return argument < m_sectorCount;
+}
+
+void SDCardSim::startRead(ReadState readState, uint32_t sectorNumber)
+{
+    m_readState = readState;
+    m_readSector = sectorNumber;
+    m_readReadyTime = *m_pTime + usToNanoseconds(m_timings.readAccessTimeUs);
+}
+
+void SDCardSim::startRegisterRead(const uint8_t* pData, size_t size)
+{
+    assert ( size <= sizeof(m_register) );
+    memcpy(m_register, pData, size);
+    m_registerSize = size;
+    m_readState = READ_REGISTER;
+    m_readReadyTime = *m_pTime + usToNanoseconds(m_timings.readAccessTimeUs);
+}
+
+void SDCardSim::queueDataBlock(const uint8_t* pData, size_t size)
+{
+    uint16_t crc = crc16(pData, size);
+    if (m_corruptReadCount > 0)
+    {
+        crc ^= 0x0001;
+        m_corruptReadCount--;
+    }
+    else if (isClockTooFast())
+    {
+        crc ^= 0x0001;
+    }
+
+    queueByte(BLOCK_START);
+    assert ( m_queueTail + size + 2 <= sizeof(m_queue) );
+    memcpy(&m_queue[m_queueTail], pData, size);
+    m_payloadStart = m_queueTail;
+    m_payloadEnd = m_queueTail + size;
+    m_queueTail += size;
+    queueByte(crc >> 8);
+    queueByte(crc & 0xFF);
+}
+
+void SDCardSim::queueByte(uint8_t byte)
+{
+    if (m_queueHead == m_queueTail)
+    {
+        clearQueue();
+    }
+    assert ( m_queueTail < sizeof(m_queue) );
+    m_queue[m_queueTail++] = byte;
+}
+
+void SDCardSim::queueResponse(uint8_t r1)
+{
+    // 7.5.1 Command / Response - NCR bytes of 0xFF before the R1 response.
+    for (uint32_t i = 0 ; i < m_timings.ncrBytes ; i++)
+    {
+        queueByte(0xFF);
+    }
+    queueByte(r1);
+}
+
+void SDCardSim::clearQueue()
+{
+    m_queueHead = 0;
+    m_queueTail = 0;
+    m_payloadStart = 0;
+    m_payloadEnd = 0;
+}
+
+void SDCardSim::buildCsd()
+{
+    memset(m_csd, 0, sizeof(m_csd));
+    if (m_isHighCapacity)
+    {
+        // 5.3.3 CSD Register (CSD Version 2.0)
+        setBits(m_csd, sizeof(m_csd), 126, 127, 1);
+        setBits(m_csd, sizeof(m_csd), 80, 83, 9);
+        setBits(m_csd, sizeof(m_csd), 48, 69, m_sectorCount / 1024 - 1);
+    }
+    else
+    {
+        // 5.3.2 CSD Register (CSD Version 1.0) - 512-byte blocks with C_SIZE_MULT of 512.
+        assert ( m_sectorCount / 512 <= 4096 );
+        setBits(m_csd, sizeof(m_csd), 80, 83, 9);
+        setBits(m_csd, sizeof(m_csd), 62, 73, m_sectorCount / 512 - 1);
+        setBits(m_csd, sizeof(m_csd), 47, 49, 7);
+    }
+    // CCC 0x5B5 includes class 10 (switch) which is required for CMD6. TRAN_SPEED of 0x32 is 25MHz.
+    setBits(m_csd, sizeof(m_csd), 84, 95, m_isHighSpeedSupported ? 0x5B5 : 0x1B5);
+    setBits(m_csd, sizeof(m_csd), 96, 103, 0x32);
+    m_csd[15] = (crc7(m_csd, 15) << 1) | 1;
+}
+
+void SDCardSim::switchFunction(uint32_t argument)
+{
+    // 4.3.10 Switch Function Command - Only function group 1 (access mode) is modelled. Its function 0 is default
+    // speed and function 1 is High-Speed. A function of 0xF leaves the group unchanged.
+    uint32_t requested = argument & 0xF;
+    uint32_t selected = m_isHighSpeed ? 1 : 0;
+    if (requested == 0 || (requested == 1 && m_isHighSpeedSupported))
+    {
+        selected = requested;
+    }
+    else if (requested != 0xF)
+    {
+        selected = 0xF;
+    }
+    if ((argument & CMD6_MODE_SWITCH) && selected != 0xF)
+    {
+        m_isHighSpeed = (selected == 1);
+    }
+
+    // 4.3.10.4 Switch Function Status - Maximum current (bits 511:496), group 1 support (bits 415:400) and group 1
+    // selection (bits 379:376).
+    uint8_t status[64];
+    memset(status, 0, sizeof(status));
+    setBits(status, sizeof(status), 496, 511, 100);
+    setBits(status, sizeof(status), 400, 415, m_isHighSpeedSupported ? 0x0003 : 0x0001);
+    setBits(status, sizeof(status), 376, 379, selected);
+    startRegisterRead(status, sizeof(status));
+}
+
+bool SDCardSim::isClockTooFast()
+{
+    int maxFrequency = m_isHighSpeed ? 50000000 : 25000000;
+    if (m_maxReliableFrequency != 0 && m_maxReliableFrequency < maxFrequency)
+    {
+        maxFrequency = m_maxReliableFrequency;
+    }
+    return m_frequency > maxFrequency;
+}
+
+bool SDCardSim::isBusy()
+{
+    return *m_pTime < m_busyUntil;
+}
+
+void SDCardSim::setBusy(uint32_t timeUs)
+{
+    m_busyUntil = *m_pTime + usToNanoseconds(timeUs);
+}
+
+uint64_t SDCardSim::usToNanoseconds(uint32_t timeUs)
+{
+    return (uint64_t)timeUs * 1000;
+}
+
+uint8_t SDCardSim::crc7(const uint8_t* pData, size_t size)
+{
+    // 4.5 Cyclic Redundancy Code - Bitwise implementation of x^7 + x^3 + 1 so that the model doesn't share any code
+    // with the driver that it is checking.
+    uint8_t crc = 0;
+    for (size_t i = 0 ; i < size ; i++)
+    {
+        for (int bit = 7 ; bit >= 0 ; bit--)
+        {
+            uint8_t in = ((pData[i] >> bit) & 1) ^ ((crc >> 6) & 1);
+            crc = (crc << 1) & 0x7F;
+            if (in)
+            {
+                crc ^= 0x09;
+            }
+        }
+    }
+    return crc;
+}
+
+uint16_t SDCardSim::crc16(const uint8_t* pData, size_t size)
+{
+    // 4.5 Cyclic Redundancy Code - Bitwise implementation of x^16 + x^12 + x^5 + 1 (CRC-CCITT with 0 seed).
+    uint16_t crc = 0;
+    for (size_t i = 0 ; i < size ; i++)
+    {
+        crc ^= (uint16_t)pData[i] << 8;
+        for (int bit = 0 ; bit < 8 ; bit++)
+        {
+            crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+
+static void setBits(uint8_t* p, size_t size, uint32_t lowBit, uint32_t highBit, uint32_t value)
+{
+    // Registers are stored MSB first so bit 0 is the low bit of the last byte.
+    for (uint32_t bit = lowBit ; bit <= highBit ; bit++, value >>= 1)
+    {
+        uint8_t* pByte = &p[(size - 1) - (bit >> 3)];
+        uint8_t  mask = 1 << (bit & 7);
+        if (value & 1)
+        {
+            *pByte |= mask;
+        }
+        else
+        {
+            *pByte &= ~mask;
+        }
+    }
+}
@@ -0,0 +1,200 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/*
+    Byte level model of a SD card running in SPI mode. It is attached to the SPIDma mock with SPIDma::setDevice() so
+    that the real SDFileSystem driver can run against it on the host. Time is tracked with a virtual clock which is
+    advanced by 8 SPI clock periods for each byte exchanged so that the card's timing parameters (NCR, NAC, program
+    and busy times) cost the driver the same number of SPI exchanges that they would on real hardware.
+
+    Supported commands: CMD0, CMD6, CMD8, CMD9, CMD10, CMD12, CMD13, CMD16, CMD17, CMD18, CMD24, CMD25, CMD55, CMD58, CMD59,
+                        ACMD22, ACMD23, ACMD41
+*/
+#ifndef SD_CARD_SIM_H_
+#define SD_CARD_SIM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <SPIDevice.h>
+
+
+class SDCardSim : public SPIDevice
+{
+public:
+    struct Timings
+    {
+        // Number of 0xFF bytes between the end of a command and its R1 response (1 - 8 bytes).
+        uint32_t ncrBytes;
+        // Time from a read command (or end of previous block for CMD18) until the start block token (NAC).
+        uint32_t readAccessTimeUs;
+        // Time the card signals busy after accepting each written data block.
+        uint32_t programTimeUs;
+        // Time the card signals busy after a stop tran token or a CMD12 which ends a write.
+        uint32_t stopBusyTimeUs;
+        // Time ACMD41 keeps returning idle after the first one is issued.
+        uint32_t initTimeUs;
+    };
+
+    struct Statistics
+    {
+        // Total number of bytes clocked over the bus.
+        uint64_t totalBytes;
+        // Number of data block payload bytes (not including tokens or CRCs) transferred in either direction.
+        uint64_t payloadBytes;
+        // Number of bytes clocked while the card was signalling busy.
+        uint64_t busyBytes;
+        // Number of bytes clocked while waiting for read data to become available (NAC).
+        uint64_t readAccessBytes;
+        // Number of commands received.
+        uint32_t commandCount;
+        uint32_t blocksRead;
+        uint32_t blocksWritten;
+        uint32_t crcErrorCount;
+    };
+
+    // Creates a card with sectorCount 512-byte sectors. SDHC cards use block addressing and SDSC cards use byte
+    // addressing.
+    SDCardSim(uint32_t sectorCount, bool isHighCapacity = true);
+    virtual ~SDCardSim();
+
+    // SPIDevice interface.
+    virtual void    setChipSelect(int state);
+    virtual void    setFrequency(int hz);
+    virtual uint8_t exchange(uint8_t mosi);
+
+    void            setTimings(const Timings& timings);
+    Timings         getTimings();
+    // Default timings are based on typical values measured for a class 10 SDHC card.
+    static Timings  defaultTimings();
+
+    // Returns a pointer to the 512 bytes of sectorNumber. Sectors are only guaranteed to be contiguous within a chunk
+    // of SECTORS_PER_CHUNK sectors.
+    uint8_t*        sector(uint32_t sectorNumber);
+    uint32_t        sectorCount();
+    uint64_t        elapsedNanoseconds();
+    // Makes this card use the virtual clock of pCard. Must be called before the card is used. Cards on separate buses
+    // driven by the same CPU share a timeline so that one card can finish programming while the driver is clocking
+    // data to another.
+    void            shareClock(SDCardSim* pCard);
+    int             frequency();
+    Statistics      getStatistics();
+    void            resetStatistics();
+
+    // Corrupt the CRC of the next count data blocks sent by the card. Used to exercise driver retry paths.
+    void            corruptNextReadCrc(uint32_t count = 1);
+    // Reject the next count data blocks written to the card with a CRC error response, as if they were corrupted on
+    // the way. Each rejected block is left unwritten.
+    void            corruptNextWriteCrc(uint32_t count = 1);
+
+    // Cards support High-Speed mode (CMD6 function group 1, function 1) by default. Data blocks are corrupted when
+    // the card is clocked faster than its current bus speed mode allows (25MHz default speed, 50MHz High-Speed) or
+    // faster than a maxReliableHz limit which models poor wiring. A maxReliableHz of 0 removes that limit.
+    void            setHighSpeedSupport(bool isSupported);
+    bool            isHighSpeed();
+    void            setMaximumReliableFrequency(int maxReliableHz);
+
+protected:
+    enum ReceiveState
+    {
+        RECEIVE_COMMAND,
+        RECEIVE_WRITE_TOKEN,
+        RECEIVE_WRITE_DATA
+    };
+    enum ReadState
+    {
+        READ_NONE,
+        READ_SINGLE_SECTOR,
+        READ_MULTIPLE_SECTORS,
+        READ_REGISTER
+    };
+
+    uint8_t  nextOutputByte();
+    void     processInputByte(uint8_t mosi);
+    void     receiveCommandByte(uint8_t byte);
+    void     receiveWriteToken(uint8_t byte);
+    void     receiveWriteData(uint8_t byte);
+    void     executeCommand();
+    void     executeAppCommand(uint8_t cmd, uint32_t argument, uint8_t r1);
+    bool     isAddressValid(uint32_t argument, uint32_t* pSector);
+    void     startRead(ReadState readState, uint32_t sector);
+    void     startRegisterRead(const uint8_t* pData, size_t size);
+    void     queueDataBlock(const uint8_t* pData, size_t size);
+    void     queueByte(uint8_t byte);
+    void     queueResponse(uint8_t r1);
+    void     clearQueue();
+    void     buildCsd();
+    void     switchFunction(uint32_t argument);
+    bool     isClockTooFast();
+    bool     isBusy();
+    void     setBusy(uint32_t timeUs);
+    uint64_t usToNanoseconds(uint32_t timeUs);
+
+    static uint8_t  crc7(const uint8_t* pData, size_t size);
+    static uint16_t crc16(const uint8_t* pData, size_t size);
+
+    enum { SECTORS_PER_CHUNK = 128 };
+
+    uint8_t**    m_ppChunks;
+    uint32_t     m_chunkCount;
+    uint32_t     m_sectorCount;
+    bool         m_isHighCapacity;
+    Timings      m_timings;
+    Statistics   m_stats;
+
+    // Bus state.
+    bool         m_isSelected;
+    uint64_t     m_nsPerByte;
+    uint64_t     m_time;
+    uint64_t*    m_pTime;
+    int          m_frequency;
+
+    // Card state.
+    bool         m_isIdle;
+    bool         m_isCrcEnabled;
+    bool         m_isAppCmd;
+    bool         m_isInitStarted;
+    uint64_t     m_initDoneTime;
+    uint64_t     m_busyUntil;
+    uint32_t     m_wellWrittenBlocks;
+    uint32_t     m_corruptReadCount;
+    uint32_t     m_corruptWriteCount;
+    bool         m_isHighSpeedSupported;
+    bool         m_isHighSpeed;
+    int          m_maxReliableFrequency;
+    uint8_t      m_cid[16];
+    uint8_t      m_csd[16];
+
+    // Inbound command/data state.
+    ReceiveState m_receiveState;
+    uint8_t      m_command[6];
+    size_t       m_commandIndex;
+    bool         m_isMultipleWrite;
+    uint32_t     m_writeSector;
+    uint8_t      m_writeBuffer[512 + 2];
+    size_t       m_writeIndex;
+
+    // Outbound data state.
+    ReadState    m_readState;
+    uint32_t     m_readSector;
+    uint64_t     m_readReadyTime;
+    uint8_t      m_register[64];
+    size_t       m_registerSize;
+    uint8_t      m_queue[1 + 512 + 2 + 64];
+    size_t       m_queueHead;
+    size_t       m_queueTail;
+    size_t       m_payloadStart;
+    size_t       m_payloadEnd;
+};
+
+#endif /* SD_CARD_SIM_H_ */
@@ -0,0 +1,61 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+/* SDFileSystem driver attached to a SDCardSim model (or any other SPIDevice) for the host tests and benchmarks, along
+   with helpers shared by those tests. It isn't built into the SDCardSim library since that library doesn't depend on
+   the SDFileSystem sources.
+*/
+#ifndef SIM_SD_FILE_SYSTEM_H_
+#define SIM_SD_FILE_SYSTEM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <diskio.h>
+#include <SDFileSystem.h>
+#include <SPIDevice.h>
+
+
+// Derive a class from SDFileSystem to get at the SPIDma mock so that the simulator can be attached to it.
+class SimSDFileSystem : public SDFileSystem
+{
+public:
+    SimSDFileSystem(SPIDevice* pDevice)
+        : SDFileSystem(1, 2, 3, 4, "sd")
+    {
+        m_spi.setDevice(pDevice);
+    }
+
+    volatile uint32_t& threadCount()
+    {
+        return m_threadCount;
+    }
+
+    // Makes calls which need an initialized card, like startWriteStream(), fail.
+    void markUninitialized()
+    {
+        m_status |= STA_NOINIT;
+    }
+};
+
+
+// Fills a buffer with a pattern which differs for each seed and for each sector in the buffer.
+static inline void fillBuffer(uint8_t* pBuffer, size_t size, uint32_t seed)
+{
+    for (size_t i = 0 ; i < size ; i++)
+    {
+        pBuffer[i] = (uint8_t)(seed + i * 7 + i / 512);
+    }
+}
+
+#endif /* SIM_SD_FILE_SYSTEM_H_ */
@@ -0,0 +1,454 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <string.h>
+#include <SDFileSystem.h>
+#include <SDHardwareCRC.h>
+#include <SDCardSim.h>
+#include <SimSDFileSystem.h>
+#include <diskio.h>
+#include <printfSpy.h>
+#include <mri.h>
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+
+TEST_GROUP(SDCardSim)
+{
+    void setup()
+    {
+        printfSpy_Hook(1024);
+    }
+
+    void teardown()
+    {
+        printfSpy_Unhook();
+    }
+};
+
+
+TEST(SDCardSim, DiskInitialize_SDHC_ShouldSucceedAndSwitchTo25MHz)
+{
+    SDCardSim       card(2048);
+    SimSDFileSystem sd(&card);
+
+        LONGS_EQUAL(0, sd.disk_initialize());
+
+    LONGS_EQUAL(25000000, card.frequency());
+    LONGS_EQUAL(2048, sd.disk_sectors());
+    CHECK_TRUE(sd.isErrorLogEmpty());
+    // ACMD41 should have had to loop until the 50 msec init time elapsed.
+    CHECK_TRUE(sd.maximumACMD41LoopTime() >= 50);
+}
+
+TEST(SDCardSim, DiskInitialize_HighSpeedRequested_ShouldSwitchTo50MHz)
+{
+    SDCardSim       card(2048);
+    SimSDFileSystem sd(&card);
+    uint8_t         writeBuffer[4 * 512];
+    uint8_t         readBuffer[4 * 512];
+
+    LONGS_EQUAL(RES_OK, sd.setMaximumFrequency(50000000));
+        LONGS_EQUAL(0, sd.disk_initialize());
+    fillBuffer(writeBuffer, sizeof(writeBuffer), 42);
+        LONGS_EQUAL(RES_OK, sd.disk_write(writeBuffer, 10, 4));
+        LONGS_EQUAL(RES_OK, sd.disk_read(readBuffer, 10, 4));
+
+    CHECK_TRUE(card.isHighSpeed());
+    LONGS_EQUAL(50000000, card.frequency());
+    CHECK_TRUE(0 == memcmp(writeBuffer, readBuffer, sizeof(readBuffer)));
+    CHECK_TRUE(sd.isErrorLogEmpty());
+}
+
+TEST(SDCardSim, DiskInitialize_HighSpeedNotSupported_ShouldStayAt25MHz)
+{
+    SDCardSim       card(2048);
+    SimSDFileSystem sd(&card);
+
+    card.setHighSpeedSupport(false);
+    LONGS_EQUAL(RES_OK, sd.setMaximumFrequency(50000000));
+        LONGS_EQUAL(0, sd.disk_initialize());
+
+    CHECK_FALSE(card.isHighSpeed());
+    LONGS_EQUAL(25000000, card.frequency());
+    CHECK_TRUE(sd.isErrorLogEmpty());
+}
+
+TEST(SDCardSim, HighSpeedOverUnreliableWiring_ShouldFallBackTo25MHz)
+{
+    SDCardSim       card(2048);
+    SimSDFileSystem sd(&card);
+    uint8_t         writeBuffer[512];
+    uint8_t         readBuffer[512];
+
+    card.setMaximumReliableFrequency(25000000);
+    LONGS_EQUAL(RES_OK, sd.setMaximumFrequency(50000000));
+    LONGS_EQUAL(0, sd.disk_initialize());
+    fillBuffer(writeBuffer, sizeof(writeBuffer), 42);
+
+        // Every attempt at 50MHz fails CRC so this write runs out of retries before the burst is large enough to
+        // trigger a fallback.
+        LONGS_EQUAL(RES_ERROR, sd.disk_write(writeBuffer, 10, 1));
+        // The first CRC error of this write completes the burst and the retry succeeds at 25MHz.
+        LONGS_EQUAL(RES_OK, sd.disk_write(writeBuffer, 10, 1));
+        LONGS_EQUAL(RES_OK, sd.disk_read(readBuffer, 10, 1));
+
+    LONGS_EQUAL(25000000, card.frequency());
+    LONGS_EQUAL(1, sd.frequencyFallbackCount());
+    CHECK_TRUE(0 == memcmp(writeBuffer, readBuffer, sizeof(readBuffer)));
+}
+
+TEST(SDCardSim, DiskInitialize_SDSC_ShouldUseByteAddressing)
+{
+    SDCardSim       card(1024, false);
+    SimSDFileSystem sd(&card);
+    uint8_t         buffer[512];
+
+        LONGS_EQUAL(0, sd.disk_initialize());
+    fillBuffer(buffer, sizeof(buffer), 1);
+        LONGS_EQUAL(RES_OK, sd.disk_write(buffer, 1023, 1));
+
+    LONGS_EQUAL(1024, sd.disk_sectors());
+    CHECK_TRUE(0 == memcmp(buffer, card.sector(1023), sizeof(buffer)));
+    CHECK_TRUE(sd.isErrorLogEmpty());
+}
+
+TEST(SDCardSim, SingleAndMultiBlockWriteThenRead_ShouldRoundTrip)
+{
+    SDCardSim       card(2048);
+    SimSDFileSystem sd(&card);
+    uint8_t         writeBuffer[4 * 512];
+    uint8_t         readBuffer[4 * 512];
+
+    LONGS_EQUAL(0, sd.disk_initialize());
+    fillBuffer(writeBuffer, sizeof(writeBuffer), 42);
+
+        LONGS_EQUAL(RES_OK, sd.disk_write(writeBuffer, 10, 1));
+        LONGS_EQUAL(RES_OK, sd.disk_write(writeBuffer + 512, 11, 3));
+        LONGS_EQUAL(RES_OK, sd.disk_read(readBuffer, 10, 4));
+
+    CHECK_TRUE(0 == memcmp(writeBuffer, readBuffer, sizeof(readBuffer)));
+        LONGS_EQUAL(RES_OK, sd.disk_read(readBuffer, 12, 1));
+    CHECK_TRUE(0 == memcmp(writeBuffer + 2 * 512, readBuffer, 512));
+
+    SDCardSim::Statistics stats = card.getStatistics();
+    LONGS_EQUAL(4, stats.blocksWritten);
+    LONGS_EQUAL(5, stats.blocksRead);
+    CHECK_TRUE(sd.isErrorLogEmpty());
+}
+
+TEST(SDCardSim, WriteStreamAcrossCallsAndInterleavedRead_ShouldRoundTrip)
+{
+    SDCardSim       card(2048);
+    SimSDFileSystem sd(&card);
+    uint8_t         writeBuffer[4 * 512];
+    uint8_t         readBuffer[512];
+
+    LONGS_EQUAL(0, sd.disk_initialize());
+    fillBuffer(writeBuffer, sizeof(writeBuffer), 42);
+
+        LONGS_EQUAL(RES_OK, sd.startWriteStream(100, 16));
+        LONGS_EQUAL(RES_OK, sd.writeStream(writeBuffer, 1));
+        LONGS_EQUAL(RES_OK, sd.writeStream(writeBuffer + 512, 2));
+        // Reading stops the open CMD25 and the next stream write starts a new one.
+        LONGS_EQUAL(RES_OK, sd.disk_read(readBuffer, 101, 1));
+        LONGS_EQUAL(RES_OK, sd.writeStream(writeBuffer + 3 * 512, 1));
+        LONGS_EQUAL(RES_OK, sd.endWriteStream());
+
+    CHECK_TRUE(0 == memcmp(writeBuffer + 512, readBuffer, sizeof(readBuffer)));
+    for (uint32_t i = 0 ; i < 4 ; i++)
+    {
+        CHECK_TRUE(0 == memcmp(writeBuffer + i * 512, card.sector(100 + i), 512));
+    }
+    LONGS_EQUAL(2, sd.writeStreamTransactionCount());
+    LONGS_EQUAL(4, card.getStatistics().blocksWritten);
+    CHECK_TRUE(sd.isErrorLogEmpty());
+}
+
+TEST(SDCardSim, TwoCardsOnSeparateBuses_ShouldTransferIndependently)
+{
+    SDCardSim       card1(2048);
+    SDCardSim       card2(4096);
+    SimSDFileSystem sd1(&card1);
+    SimSDFileSystem sd2(&card2);
+    uint8_t         writeBuffer1[4 * 512];
+    uint8_t         writeBuffer2[4 * 512];
+    uint8_t         readBuffer[4 * 512];
+
+    LONGS_EQUAL(0, sd1.disk_initialize());
+    LONGS_EQUAL(0, sd2.disk_initialize());
+    LONGS_EQUAL(2048, sd1.disk_sectors());
+    LONGS_EQUAL(4096, sd2.disk_sectors());
+    fillBuffer(writeBuffer1, sizeof(writeBuffer1), 1);
+    fillBuffer(writeBuffer2, sizeof(writeBuffer2), 2);
+
+        // Interleave a write stream on each card as a recorder striping data across both would.
+        LONGS_EQUAL(RES_OK, sd1.startWriteStream(100, 4));
+        LONGS_EQUAL(RES_OK, sd2.startWriteStream(100, 4));
+        for (uint32_t i = 0 ; i < 4 ; i++)
+        {
+            LONGS_EQUAL(RES_OK, sd1.writeStream(writeBuffer1 + i * 512, 1));
+            LONGS_EQUAL(RES_OK, sd2.writeStream(writeBuffer2 + i * 512, 1));
+        }
+        LONGS_EQUAL(RES_OK, sd1.endWriteStream());
+        LONGS_EQUAL(RES_OK, sd2.endWriteStream());
+
+    // Each card should have only seen its own data and a single CMD25.
+    LONGS_EQUAL(RES_OK, sd1.disk_read(readBuffer, 100, 4));
+    CHECK_TRUE(0 == memcmp(writeBuffer1, readBuffer, sizeof(readBuffer)));
+    LONGS_EQUAL(RES_OK, sd2.disk_read(readBuffer, 100, 4));
+    CHECK_TRUE(0 == memcmp(writeBuffer2, readBuffer, sizeof(readBuffer)));
+    LONGS_EQUAL(1, sd1.writeStreamTransactionCount());
+    LONGS_EQUAL(1, sd2.writeStreamTransactionCount());
+    LONGS_EQUAL(4, card1.getStatistics().blocksWritten);
+    LONGS_EQUAL(4, card2.getStatistics().blocksWritten);
+    CHECK_TRUE(sd1.isErrorLogEmpty());
+    CHECK_TRUE(sd2.isErrorLogEmpty());
+}
+
+TEST(SDCardSim, TwoCards_UsingOneWhileAnotherThreadUsesTheOther_ShouldNotTripSingleThreadedCheck)
+{
+    SDCardSim       card1(2048);
+    SDCardSim       card2(2048);
+    SimSDFileSystem sd1(&card1);
+    SimSDFileSystem sd2(&card2);
+    uint8_t         buffer[512];
+
+    LONGS_EQUAL(0, sd1.disk_initialize());
+    LONGS_EQUAL(0, sd2.disk_initialize());
+    g_debugBreakCount = 0;
+
+    // Simulate that another thread is in the middle of a call on the first card.
+    sd1.threadCount() = 1;
+        LONGS_EQUAL(RES_OK, sd2.disk_read(buffer, 10, 1));
+    LONGS_EQUAL(0, g_debugBreakCount);
+        LONGS_EQUAL(RES_OK, sd1.disk_read(buffer, 10, 1));
+    LONGS_EQUAL(1, g_debugBreakCount);
+
+    sd1.threadCount() = 0;
+    g_debugBreakCount = 0;
+}
+
+TEST(SDCardSim, ReadCrcError_DriverShouldRetryAndSucceed)
+{
+    SDCardSim       card(2048);
+    SimSDFileSystem sd(&card);
+    uint8_t         buffer[512];
+
+    LONGS_EQUAL(0, sd.disk_initialize());
+    fillBuffer(card.sector(5), 512, 5);
+    card.corruptNextReadCrc();
+
+        LONGS_EQUAL(RES_OK, sd.disk_read(buffer, 5, 1));
+
+    CHECK_TRUE(0 == memcmp(card.sector(5), buffer, sizeof(buffer)));
+    LONGS_EQUAL(1, sd.receiveCrcErrorCount());
+}
+
+TEST(SDCardSim, WriteCrcError_DriverShouldRetryAndSucceed)
+{
+    SDCardSim       card(2048);
+    SimSDFileSystem sd(&card);
+    uint8_t         buffer[512];
+
+    LONGS_EQUAL(0, sd.disk_initialize());
+    fillBuffer(buffer, sizeof(buffer), 5);
+    card.corruptNextWriteCrc();
+
+        LONGS_EQUAL(RES_OK, sd.disk_write(buffer, 5, 1));
+
+    CHECK_TRUE(0 == memcmp(card.sector(5), buffer, sizeof(buffer)));
+    LONGS_EQUAL(1, card.getStatistics().crcErrorCount);
+}
+
+TEST(SDCardSim, WriteCrcErrorOnEveryRetry_ShouldFailWrite)
+{
+    SDCardSim       card(2048);
+    SimSDFileSystem sd(&card);
+    uint8_t         buffer[512];
+
+    LONGS_EQUAL(0, sd.disk_initialize());
+    fillBuffer(buffer, sizeof(buffer), 5);
+    card.corruptNextWriteCrc(3);
+
+        LONGS_EQUAL(RES_ERROR, sd.disk_write(buffer, 5, 1));
+
+    CHECK_FALSE(0 == memcmp(card.sector(5), buffer, sizeof(buffer)));
+    LONGS_EQUAL(3, card.getStatistics().crcErrorCount);
+}
+
+TEST(SDCardSim, ProgramTime_ShouldBeReflectedInBusyWaitAndElapsedTime)
+{
+    SDCardSim       card(2048);
+    SimSDFileSystem sd(&card);
+    uint8_t         buffer[512];
+
+    SDCardSim::Timings timings = card.getTimings();
+    timings.programTimeUs = 10000;
+    card.setTimings(timings);
+    LONGS_EQUAL(0, sd.disk_initialize());
+    card.resetStatistics();
+    uint64_t startTime = card.elapsedNanoseconds();
+
+        LONGS_EQUAL(RES_OK, sd.disk_write(buffer, 0, 1));
+
+    // Busy for 10 msec at 25MHz is 31250 byte times, starting from when the data response token is queued.
+    SDCardSim::Statistics stats = card.getStatistics();
+    CHECK_TRUE(stats.busyBytes > 31240 && stats.busyBytes <= 31250);
+    CHECK_TRUE(card.elapsedNanoseconds() - startTime >= 10000000ULL);
+    LONGS_EQUAL(512, stats.payloadBytes);
+}
+
+TEST(SDCardSim, ReadPastEndOfCard_ShouldFail)
+{
+    SDCardSim       card(1024);
+    SimSDFileSystem sd(&card);
+    uint8_t         buffer[512];
+
+    LONGS_EQUAL(0, sd.disk_initialize());
+
+        LONGS_EQUAL(RES_ERROR, sd.disk_read(buffer, 1024, 1));
+}
+
+TEST(SDCardSim, CommandWithBadCrc_ShouldReturnCrcError)
+{
+    SDCardSim card(1024);
+    // CMD0 with the CRC of the last byte broken.
+    static const uint8_t cmd0[] = { 0x40, 0x00, 0x00, 0x00, 0x00, 0x97 };
+
+    card.setChipSelect(0);
+    for (size_t i = 0 ; i < sizeof(cmd0) ; i++)
+    {
+        LONGS_EQUAL(0xFF, card.exchange(cmd0[i]));
+    }
+
+    LONGS_EQUAL(0xFF, card.exchange(0xFF));
+    LONGS_EQUAL(0x09, card.exchange(0xFF));
+    LONGS_EQUAL(1, card.getStatistics().crcErrorCount);
+}
+
+TEST(SDCardSim, HardwareCrcBackend_ShouldProduceCrcsAcceptedByCardAndCheckReads)
+{
+    SDCardSim       card(1024);
+    SimSDFileSystem sd(&card);
+    SDHardwareCRC   hardwareCrc;
+    uint8_t         writeBuffer[4 * 512];
+    uint8_t         readBuffer[4 * 512];
+
+    fillBuffer(writeBuffer, sizeof(writeBuffer), 0x3C);
+    SDCRC::setCrc16Backend(&hardwareCrc);
+        LONGS_EQUAL(0, sd.disk_initialize());
+        LONGS_EQUAL(RES_OK, sd.disk_write(writeBuffer, 10, 4));
+        LONGS_EQUAL(RES_OK, sd.disk_read(readBuffer, 10, 4));
+    SDCRC::setCrc16Backend(NULL);
+
+    CHECK_TRUE(0 == memcmp(writeBuffer, readBuffer, sizeof(readBuffer)));
+    LONGS_EQUAL(0, card.getStatistics().crcErrorCount);
+    LONGS_EQUAL(8, hardwareCrc.offloadCount());
+    CHECK_TRUE(sd.isErrorLogEmpty());
+}
+
+TEST(SDCardSim, DiskReadCopy_ShouldFillBufferAndCopyHeadDuringCrcCheck)
+{
+    SDCardSim       card(1024);
+    SimSDFileSystem sd(&card);
+    uint8_t         buffer[512];
+    uint8_t         copy[100 + 1];
+
+    LONGS_EQUAL(0, sd.disk_initialize());
+    fillBuffer(card.sector(7), 512, 7);
+    memset(copy, 0xEE, sizeof(copy));
+
+        LONGS_EQUAL(RES_OK, sd.disk_read_copy(buffer, 7, copy, 99));
+
+    CHECK_TRUE(0 == memcmp(card.sector(7), buffer, sizeof(buffer)));
+    CHECK_TRUE(0 == memcmp(card.sector(7), copy, 99));
+    LONGS_EQUAL(0xEE, copy[99]);
+    LONGS_EQUAL(1, sd.fusedReadCopyCount());
+    CHECK_TRUE(sd.isErrorLogEmpty());
+}
+
+TEST(SDCardSim, DiskReadCopy_CrcError_ShouldRetryAndRecopy)
+{
+    SDCardSim       card(1024);
+    SimSDFileSystem sd(&card);
+    uint8_t         buffer[512];
+    uint8_t         copy[512];
+
+    LONGS_EQUAL(0, sd.disk_initialize());
+    fillBuffer(card.sector(5), 512, 5);
+    card.corruptNextReadCrc();
+
+        LONGS_EQUAL(RES_OK, sd.disk_read_copy(buffer, 5, copy, sizeof(copy)));
+
+    CHECK_TRUE(0 == memcmp(card.sector(5), buffer, sizeof(buffer)));
+    CHECK_TRUE(0 == memcmp(card.sector(5), copy, sizeof(copy)));
+    LONGS_EQUAL(1, sd.receiveCrcErrorCount());
+    LONGS_EQUAL(1, sd.fusedReadCopyCount());
+}
+
+TEST(SDCardSim, DiskReadCopy_ContinuingReadStream_ShouldCopyHead)
+{
+    SDCardSim       card(1024);
+    SimSDFileSystem sd(&card);
+    uint8_t         buffer[4 * 512];
+    uint8_t         copy[64];
+
+    LONGS_EQUAL(0, sd.disk_initialize());
+    LONGS_EQUAL(RES_OK, sd.setReadStreamIdleTimeout(10));
+    fillBuffer(card.sector(24), 512, 24);
+
+        LONGS_EQUAL(RES_OK, sd.disk_read(buffer, 20, 4));
+        LONGS_EQUAL(RES_OK, sd.disk_read_copy(buffer, 24, copy, sizeof(copy)));
+
+    CHECK_TRUE(0 == memcmp(card.sector(24), buffer, 512));
+    CHECK_TRUE(0 == memcmp(card.sector(24), copy, sizeof(copy)));
+    LONGS_EQUAL(1, sd.readStreamContinueCount());
+    LONGS_EQUAL(1, sd.fusedReadCopyCount());
+}
+
+TEST(SDCardSim, DiskReadCopy_SectorCacheEnabled_ShouldCopySeparately)
+{
+    SDCardSim       card(1024);
+    SimSDFileSystem sd(&card);
+    uint8_t         cache[4 * 512];
+    uint8_t         buffer[512];
+    uint8_t         copy[32];
+
+    LONGS_EQUAL(0, sd.disk_initialize());
+    LONGS_EQUAL(RES_OK, sd.enableSectorCache(cache, sizeof(cache), 2));
+    fillBuffer(card.sector(9), 512, 9);
+
+        LONGS_EQUAL(RES_OK, sd.disk_read_copy(buffer, 9, copy, sizeof(copy)));
+
+    CHECK_TRUE(0 == memcmp(card.sector(9), buffer, sizeof(buffer)));
+    CHECK_TRUE(0 == memcmp(card.sector(9), copy, sizeof(copy)));
+    LONGS_EQUAL(1, sd.sectorCacheMissCount());
+    LONGS_EQUAL(0, sd.fusedReadCopyCount());
+}
+
+TEST(SDCardSim, DiskReadCopy_CopyLargerThanBlock_ShouldFail)
+{
+    SDCardSim       card(1024);
+    SimSDFileSystem sd(&card);
+    uint8_t         buffer[512];
+    uint8_t         copy[513];
+
+    LONGS_EQUAL(0, sd.disk_initialize());
+
+        LONGS_EQUAL(RES_PARERR, sd.disk_read_copy(buffer, 9, copy, sizeof(copy)));
+
+    LONGS_EQUAL(0, sd.fusedReadCopyCount());
+}
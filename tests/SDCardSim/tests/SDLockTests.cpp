@@ -0,0 +1,429 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <SDFileSystem.h>
+#include <SDCardSim.h>
+#include <SimSDFileSystem.h>
+#include <diskio.h>
+#include <printfSpy.h>
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+
+// SDLock implemented with pthreads, as an application would with its RTOS mutex and condition variable.
+class PthreadLock : public SDLock
+{
+public:
+    PthreadLock()
+    {
+        pthread_mutex_init(&m_mutex, NULL);
+        pthread_cond_init(&m_cond, NULL);
+    }
+    virtual ~PthreadLock()
+    {
+        pthread_cond_destroy(&m_cond);
+        pthread_mutex_destroy(&m_mutex);
+    }
+
+    virtual void lock()
+    {
+        pthread_mutex_lock(&m_mutex);
+    }
+    virtual void unlock()
+    {
+        pthread_mutex_unlock(&m_mutex);
+    }
+    virtual void wait()
+    {
+        pthread_cond_wait(&m_cond, &m_mutex);
+    }
+    virtual void notifyAll()
+    {
+        pthread_cond_broadcast(&m_cond);
+    }
+
+protected:
+    pthread_mutex_t m_mutex;
+    pthread_cond_t  m_cond;
+};
+
+
+// Sits between the driver and the simulated card so that a test can stall the thread servicing requests in the
+// middle of a transfer while other threads queue up behind it.
+class GatedDevice : public SPIDevice
+{
+public:
+    GatedDevice(SDCardSim* pCard)
+    {
+        m_pCard = pCard;
+        m_isClosed = false;
+        m_isBlocked = false;
+        pthread_mutex_init(&m_mutex, NULL);
+        pthread_cond_init(&m_cond, NULL);
+    }
+    virtual ~GatedDevice()
+    {
+        pthread_cond_destroy(&m_cond);
+        pthread_mutex_destroy(&m_mutex);
+    }
+
+    virtual void setChipSelect(int state)
+    {
+        m_pCard->setChipSelect(state);
+    }
+    virtual void setFrequency(int hz)
+    {
+        m_pCard->setFrequency(hz);
+    }
+    virtual uint8_t exchange(uint8_t mosi)
+    {
+        pthread_mutex_lock(&m_mutex);
+        while (m_isClosed)
+        {
+            m_isBlocked = true;
+            pthread_cond_wait(&m_cond, &m_mutex);
+        }
+        m_isBlocked = false;
+        pthread_mutex_unlock(&m_mutex);
+        return m_pCard->exchange(mosi);
+    }
+
+    void close()
+    {
+        pthread_mutex_lock(&m_mutex);
+        m_isClosed = true;
+        pthread_mutex_unlock(&m_mutex);
+    }
+    void open()
+    {
+        pthread_mutex_lock(&m_mutex);
+        m_isClosed = false;
+        pthread_cond_broadcast(&m_cond);
+        pthread_mutex_unlock(&m_mutex);
+    }
+    bool isBlocked()
+    {
+        pthread_mutex_lock(&m_mutex);
+        bool isBlocked = m_isBlocked;
+        pthread_mutex_unlock(&m_mutex);
+        return isBlocked;
+    }
+
+protected:
+    SDCardSim*      m_pCard;
+    pthread_mutex_t m_mutex;
+    pthread_cond_t  m_cond;
+    bool            m_isClosed;
+    bool            m_isBlocked;
+};
+
+
+// Extend SimSDFileSystem to get at the request queue.
+class LockedSDFileSystem : public SimSDFileSystem
+{
+public:
+    LockedSDFileSystem(SPIDevice* pDevice)
+        : SimSDFileSystem(pDevice)
+    {
+    }
+
+    // Must be called with the lock held.
+    uint32_t queuedRequestCount()
+    {
+        uint32_t count = 0;
+        for (Request* pCurr = m_pRequests ; pCurr ; pCurr = pCurr->pNext)
+        {
+            count++;
+        }
+        return count;
+    }
+};
+
+
+// A disk_read() or disk_write() issued from its own thread.
+struct ThreadRequest
+{
+    LockedSDFileSystem* pSd;
+    uint8_t*            pBuffer;
+    uint32_t            blockNumber;
+    uint32_t            count;
+    bool                isWrite;
+    int                 result;
+    pthread_t           thread;
+};
+
+static void* requestThread(void* pv)
+{
+    ThreadRequest* pRequest = (ThreadRequest*)pv;
+    if (pRequest->isWrite)
+    {
+        pRequest->result = pRequest->pSd->disk_write(pRequest->pBuffer, pRequest->blockNumber, pRequest->count);
+    }
+    else
+    {
+        pRequest->result = pRequest->pSd->disk_read(pRequest->pBuffer, pRequest->blockNumber, pRequest->count);
+    }
+    return NULL;
+}
+
+
+// Each thread repeatedly writes and reads back its own region of the card, mixing in single block requests which go
+// through the sector cache and calls which don't go through the request queue.
+struct StressThread
+{
+    LockedSDFileSystem* pSd;
+    uint32_t            firstBlock;
+    uint32_t            failures;
+    pthread_t           thread;
+    uint8_t             writeBuffer[4 * 512];
+    uint8_t             readBuffer[4 * 512];
+};
+
+static void* stressThread(void* pv)
+{
+    StressThread* pThread = (StressThread*)pv;
+    for (uint32_t i = 0 ; i < 50 ; i++)
+    {
+        uint32_t count = 1 + i % 4;
+        uint32_t blockNumber = pThread->firstBlock + (i * 3) % 16;
+        for (size_t j = 0 ; j < count * 512 ; j++)
+        {
+            pThread->writeBuffer[j] = (uint8_t)(pThread->firstBlock + i * 13 + j * 7);
+        }
+
+        if (pThread->pSd->disk_write(pThread->writeBuffer, blockNumber, count) != RES_OK)
+        {
+            pThread->failures++;
+        }
+        if ((i & 7) == 0 && pThread->pSd->disk_sync() != RES_OK)
+        {
+            pThread->failures++;
+        }
+        memset(pThread->readBuffer, 0, sizeof(pThread->readBuffer));
+        if (pThread->pSd->disk_read(pThread->readBuffer, blockNumber, count) != RES_OK ||
+            memcmp(pThread->writeBuffer, pThread->readBuffer, count * 512) != 0)
+        {
+            pThread->failures++;
+        }
+        sched_yield();
+    }
+    return NULL;
+}
+
+
+TEST_GROUP(SDLock)
+{
+    SDCardSim*          m_pCard;
+    GatedDevice*        m_pGate;
+    LockedSDFileSystem* m_pSd;
+    PthreadLock         m_lock;
+    ThreadRequest       m_requests[4];
+    uint8_t             m_buffers[4][8 * 512];
+
+    void setup()
+    {
+        printfSpy_Hook(1024);
+        m_pCard = new SDCardSim(2048);
+        m_pGate = new GatedDevice(m_pCard);
+        m_pSd = new LockedSDFileSystem(m_pGate);
+        LONGS_EQUAL(RES_OK, m_pSd->setLock(&m_lock));
+        LONGS_EQUAL(0, m_pSd->disk_initialize());
+        m_pCard->resetStatistics();
+        memset(m_requests, 0, sizeof(m_requests));
+        memset(m_buffers, 0, sizeof(m_buffers));
+    }
+
+    void teardown()
+    {
+        delete m_pSd;
+        delete m_pGate;
+        delete m_pCard;
+        printfSpy_Unhook();
+    }
+
+    void startRequest(uint32_t index, bool isWrite, uint32_t blockNumber, uint32_t count)
+    {
+        ThreadRequest* pRequest = &m_requests[index];
+        pRequest->pSd = m_pSd;
+        pRequest->pBuffer = m_buffers[index];
+        pRequest->blockNumber = blockNumber;
+        pRequest->count = count;
+        pRequest->isWrite = isWrite;
+        pRequest->result = -1;
+        LONGS_EQUAL(0, pthread_create(&pRequest->thread, NULL, requestThread, pRequest));
+    }
+
+    void joinRequest(uint32_t index)
+    {
+        LONGS_EQUAL(0, pthread_join(m_requests[index].thread, NULL));
+        LONGS_EQUAL(RES_OK, m_requests[index].result);
+    }
+
+    // Stalls the first request in the middle of its transfer and then starts the rest so that they all queue up
+    // behind it before any of them are serviced. The first request is for multiple blocks so that it bypasses the
+    // sector cache and has to talk to the card.
+    void startQueuedRequests(bool isWrite, const uint32_t* pBlockNumbers, uint32_t count, uint32_t requestCount)
+    {
+        m_pGate->close();
+        startRequest(0, isWrite, 1000, 2);
+        while (!m_pGate->isBlocked())
+        {
+            sched_yield();
+        }
+        for (uint32_t i = 1 ; i < requestCount ; i++)
+        {
+            startRequest(i, isWrite, pBlockNumbers[i - 1], count);
+        }
+        while (queuedRequestCount() < requestCount - 1)
+        {
+            sched_yield();
+        }
+        m_pGate->open();
+        for (uint32_t i = 0 ; i < requestCount ; i++)
+        {
+            joinRequest(i);
+        }
+    }
+
+    uint32_t queuedRequestCount()
+    {
+        m_lock.lock();
+        uint32_t count = m_pSd->queuedRequestCount();
+        m_lock.unlock();
+        return count;
+    }
+};
+
+
+TEST(SDLock, SetLock_WithNoRequestsQueued_ShouldSucceed)
+{
+    LONGS_EQUAL(RES_OK, m_pSd->setLock(NULL));
+    LONGS_EQUAL(RES_OK, m_pSd->setLock(&m_lock));
+}
+
+TEST(SDLock, DiskWriteAndRead_FromSingleThread_ShouldBeServicedByCaller)
+{
+    fillBuffer(m_buffers[0], 2 * 512, 0x12);
+    LONGS_EQUAL(RES_OK, m_pSd->disk_write(m_buffers[0], 10, 2));
+    LONGS_EQUAL(RES_OK, m_pSd->disk_read(m_buffers[1], 10, 2));
+    CHECK_TRUE(0 == memcmp(m_buffers[0], m_buffers[1], 2 * 512));
+    LONGS_EQUAL(0, m_pSd->mergedRequestCount());
+    CHECK_TRUE(m_pSd->isErrorLogEmpty());
+}
+
+TEST(SDLock, DiskWrite_QueuedOutOfOrderForContiguousBlocks_ShouldMergeIntoSingleCMD25)
+{
+    static const uint32_t blockNumbers[3] = { 24, 10, 17 };
+    for (uint32_t i = 1 ; i < 4 ; i++)
+    {
+        fillBuffer(m_buffers[i], 7 * 512, i);
+    }
+
+    startQueuedRequests(true, blockNumbers, 7, 4);
+
+    LONGS_EQUAL(2, m_pSd->mergedRequestCount());
+    // CMD55 + ACMD23 + CMD25 + CMD13 for the stalled request and the same again for the 3 merged ones.
+    LONGS_EQUAL(8, m_pCard->getStatistics().commandCount);
+    LONGS_EQUAL(2 + 3 * 7, m_pCard->getStatistics().blocksWritten);
+    for (uint32_t i = 1 ; i < 4 ; i++)
+    {
+        for (uint32_t j = 0 ; j < 7 ; j++)
+        {
+            CHECK_TRUE(0 == memcmp(m_buffers[i] + j * 512, m_pCard->sector(blockNumbers[i - 1] + j), 512));
+        }
+    }
+    CHECK_TRUE(m_pSd->isErrorLogEmpty());
+}
+
+TEST(SDLock, DiskRead_QueuedForContiguousBlocks_ShouldMergeIntoSingleCMD18)
+{
+    static const uint32_t blockNumbers[3] = { 30, 20, 25 };
+    for (uint32_t i = 20 ; i < 35 ; i++)
+    {
+        fillBuffer(m_pCard->sector(i), 512, i);
+    }
+
+    startQueuedRequests(false, blockNumbers, 5, 4);
+
+    LONGS_EQUAL(2, m_pSd->mergedRequestCount());
+    // CMD18 + CMD12 for the stalled request and the same again for the 3 merged ones.
+    LONGS_EQUAL(4, m_pCard->getStatistics().commandCount);
+    for (uint32_t i = 1 ; i < 4 ; i++)
+    {
+        for (uint32_t j = 0 ; j < 5 ; j++)
+        {
+            CHECK_TRUE(0 == memcmp(m_buffers[i] + j * 512, m_pCard->sector(blockNumbers[i - 1] + j), 512));
+        }
+    }
+    CHECK_TRUE(m_pSd->isErrorLogEmpty());
+}
+
+TEST(SDLock, DiskWrite_QueuedWithGapBetweenBlocks_ShouldNotMerge)
+{
+    static const uint32_t blockNumbers[2] = { 10, 13 };
+    fillBuffer(m_buffers[1], 2 * 512, 1);
+    fillBuffer(m_buffers[2], 2 * 512, 2);
+
+    startQueuedRequests(true, blockNumbers, 2, 3);
+
+    LONGS_EQUAL(0, m_pSd->mergedRequestCount());
+    CHECK_TRUE(0 == memcmp(m_buffers[1], m_pCard->sector(10), 512));
+    CHECK_TRUE(0 == memcmp(m_buffers[2] + 512, m_pCard->sector(14), 512));
+    CHECK_TRUE(m_pSd->isErrorLogEmpty());
+}
+
+TEST(SDLock, DiskWrite_QueuedSingleBlocksWithSectorCacheEnabled_ShouldGoThroughCacheWithoutMerging)
+{
+    static const uint32_t blockNumbers[2] = { 11, 10 };
+    static uint8_t        cache[4 * 512];
+    LONGS_EQUAL(RES_OK, m_pSd->enableSectorCache(cache, sizeof(cache), 2));
+    m_pCard->resetStatistics();
+    fillBuffer(m_buffers[1], 512, 1);
+    fillBuffer(m_buffers[2], 512, 2);
+
+    startQueuedRequests(true, blockNumbers, 1, 3);
+
+    LONGS_EQUAL(0, m_pSd->mergedRequestCount());
+    LONGS_EQUAL(2, m_pCard->getStatistics().blocksWritten);
+    LONGS_EQUAL(RES_OK, m_pSd->disk_sync());
+    CHECK_TRUE(0 == memcmp(m_buffers[2], m_pCard->sector(10), 512));
+    CHECK_TRUE(0 == memcmp(m_buffers[1], m_pCard->sector(11), 512));
+    CHECK_TRUE(m_pSd->isErrorLogEmpty());
+}
+
+TEST(SDLock, StressTest_FourThreadsWritingAndReadingOwnRegions_ShouldAllReadBackWhatTheyWrote)
+{
+    static uint8_t      cache[8 * 512];
+    static StressThread threads[4];
+    LONGS_EQUAL(RES_OK, m_pSd->enableSectorCache(cache, sizeof(cache), 2));
+
+    for (uint32_t i = 0 ; i < 4 ; i++)
+    {
+        threads[i].pSd = m_pSd;
+        threads[i].firstBlock = 100 + i * 32;
+        threads[i].failures = 0;
+        LONGS_EQUAL(0, pthread_create(&threads[i].thread, NULL, stressThread, &threads[i]));
+    }
+    for (uint32_t i = 0 ; i < 4 ; i++)
+    {
+        LONGS_EQUAL(0, pthread_join(threads[i].thread, NULL));
+        LONGS_EQUAL(0, threads[i].failures);
+    }
+    LONGS_EQUAL(0, m_pSd->threadCount());
+    CHECK_TRUE(m_pSd->isErrorLogEmpty());
+}
@@ -0,0 +1,275 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <string.h>
+#include <SDStripedFileSystem.h>
+#include <SDCardSim.h>
+#include <SimSDFileSystem.h>
+#include <diskio.h>
+#include <printfSpy.h>
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+
+TEST_GROUP(SDStripedFileSystem)
+{
+    SDCardSim*       m_pCards[3];
+    SimSDFileSystem* m_pSDs[3];
+
+    void setup()
+    {
+        printfSpy_Hook(1024);
+        memset(m_pCards, 0, sizeof(m_pCards));
+        memset(m_pSDs, 0, sizeof(m_pSDs));
+    }
+
+    void teardown()
+    {
+        for (size_t i = 0 ; i < sizeof(m_pCards)/sizeof(m_pCards[0]) ; i++)
+        {
+            delete m_pSDs[i];
+            delete m_pCards[i];
+        }
+        printfSpy_Unhook();
+    }
+
+    // Creates count cards which share the first card's virtual clock. The second card is twice the size of the others.
+    void createCards(uint32_t count)
+    {
+        for (uint32_t i = 0 ; i < count ; i++)
+        {
+            m_pCards[i] = new SDCardSim(i == 1 ? 4096 : 2048);
+            if (i > 0)
+            {
+                m_pCards[i]->shareClock(m_pCards[0]);
+            }
+            m_pSDs[i] = new SimSDFileSystem(m_pCards[i]);
+        }
+    }
+
+    SDFileSystem** cards()
+    {
+        return (SDFileSystem**)m_pSDs;
+    }
+
+    // Checks that each logical sector written landed on the expected card and sector.
+    void validateStripes(const uint8_t* pBuffer, uint32_t blockNumber, uint32_t count, uint32_t cardCount,
+                         uint32_t stripeSectors)
+    {
+        for (uint32_t i = 0 ; i < count ; i++)
+        {
+            uint32_t logical = blockNumber + i;
+            uint32_t row = logical / (stripeSectors * cardCount);
+            uint32_t card = (logical / stripeSectors) % cardCount;
+            uint32_t sector = row * stripeSectors + logical % stripeSectors;
+            CHECK_TRUE(0 == memcmp(pBuffer + i * 512, m_pCards[card]->sector(sector), 512));
+        }
+    }
+
+    void validateErrorLogsEmpty(uint32_t cardCount)
+    {
+        for (uint32_t i = 0 ; i < cardCount ; i++)
+        {
+            CHECK_TRUE(m_pSDs[i]->isErrorLogEmpty());
+        }
+    }
+};
+
+
+TEST(SDStripedFileSystem, DiskInitialize_ShouldInitializeAllCardsAndUseWholeStripesOfSmallestCard)
+{
+    createCards(2);
+    SDStripedFileSystem striped("stripe", cards(), 2, 3);
+
+    LONGS_EQUAL(STA_NOINIT, striped.disk_status());
+        LONGS_EQUAL(0, striped.disk_initialize());
+
+    LONGS_EQUAL(0, striped.disk_status());
+    LONGS_EQUAL(0, m_pSDs[0]->disk_status());
+    LONGS_EQUAL(0, m_pSDs[1]->disk_status());
+    // The first card is the smallest with 2048 sectors which is 682 whole 3 sector stripes.
+    LONGS_EQUAL(682 * 3 * 2, striped.disk_sectors());
+}
+
+TEST(SDStripedFileSystem, InvalidConfigurations_ShouldFailToInitialize)
+{
+    createCards(1);
+    SDStripedFileSystem oneCard("stripe", cards(), 1, 8);
+    SDStripedFileSystem noStripe("stripe", cards(), 2, 0);
+    SDStripedFileSystem tooManyCards("stripe", cards(), SDSTRIPEDFILESYSTEM_MAX_CARDS + 1, 8);
+
+    LONGS_EQUAL(STA_NOINIT, oneCard.disk_initialize());
+    LONGS_EQUAL(STA_NOINIT, noStripe.disk_initialize());
+    LONGS_EQUAL(STA_NOINIT, tooManyCards.disk_initialize());
+    LONGS_EQUAL(0, oneCard.disk_sectors());
+}
+
+TEST(SDStripedFileSystem, ReadWriteBeforeInit_ShouldFail)
+{
+    uint8_t buffer[512];
+
+    createCards(2);
+    SDStripedFileSystem striped("stripe", cards(), 2, 8);
+
+    LONGS_EQUAL(RES_NOTRDY, striped.disk_read(buffer, 0, 1));
+    LONGS_EQUAL(RES_NOTRDY, striped.disk_write(buffer, 0, 1));
+    LONGS_EQUAL(RES_NOTRDY, striped.disk_sync());
+}
+
+TEST(SDStripedFileSystem, ReadWriteOutOfRange_ShouldFail)
+{
+    uint8_t buffer[2 * 512];
+
+    createCards(2);
+    SDStripedFileSystem striped("stripe", cards(), 2, 8);
+    LONGS_EQUAL(0, striped.disk_initialize());
+
+    LONGS_EQUAL(RES_PARERR, striped.disk_read(buffer, 0, 0));
+    LONGS_EQUAL(RES_PARERR, striped.disk_write(buffer, striped.disk_sectors(), 1));
+    LONGS_EQUAL(RES_PARERR, striped.disk_read(buffer, striped.disk_sectors() - 1, 2));
+}
+
+TEST(SDStripedFileSystem, UnalignedMultiStripeWrite_ShouldSplitAcrossCardsAndReadBack)
+{
+    uint8_t writeBuffer[40 * 512];
+    uint8_t readBuffer[40 * 512];
+
+    createCards(2);
+    SDStripedFileSystem striped("stripe", cards(), 2, 8);
+    LONGS_EQUAL(0, striped.disk_initialize());
+    fillBuffer(writeBuffer, sizeof(writeBuffer), 42);
+    m_pCards[0]->resetStatistics();
+    m_pCards[1]->resetStatistics();
+
+        // Starts part way through the first card's stripe and ends part way through the second card's.
+        LONGS_EQUAL(RES_OK, striped.disk_write(writeBuffer, 5, 40));
+
+    validateStripes(writeBuffer, 5, 40, 2, 8);
+    // Sectors 5-7, 16-23 & 32-39 on the first card and 8-15, 24-31 & 40-44 on the second.
+    LONGS_EQUAL(19, m_pCards[0]->getStatistics().blocksWritten);
+    LONGS_EQUAL(21, m_pCards[1]->getStatistics().blocksWritten);
+
+        LONGS_EQUAL(RES_OK, striped.disk_read(readBuffer, 5, 40));
+
+    CHECK_TRUE(0 == memcmp(writeBuffer, readBuffer, sizeof(readBuffer)));
+    LONGS_EQUAL(19, m_pCards[0]->getStatistics().blocksRead);
+    LONGS_EQUAL(21, m_pCards[1]->getStatistics().blocksRead);
+    validateErrorLogsEmpty(2);
+}
+
+TEST(SDStripedFileSystem, WriteWithinOneStripe_ShouldOnlyUseOneCard)
+{
+    uint8_t writeBuffer[3 * 512];
+    uint8_t readBuffer[3 * 512];
+
+    createCards(3);
+    SDStripedFileSystem striped("stripe", cards(), 3, 4);
+    LONGS_EQUAL(0, striped.disk_initialize());
+    fillBuffer(writeBuffer, sizeof(writeBuffer), 7);
+    for (int i = 0 ; i < 3 ; i++)
+    {
+        m_pCards[i]->resetStatistics();
+    }
+
+        LONGS_EQUAL(RES_OK, striped.disk_write(writeBuffer, 4 * 3 * 10 + 4 + 1, 3));
+        LONGS_EQUAL(RES_OK, striped.disk_read(readBuffer, 4 * 3 * 10 + 4 + 1, 3));
+
+    CHECK_TRUE(0 == memcmp(writeBuffer, readBuffer, sizeof(readBuffer)));
+    validateStripes(writeBuffer, 4 * 3 * 10 + 4 + 1, 3, 3, 4);
+    LONGS_EQUAL(0, m_pCards[0]->getStatistics().commandCount);
+    LONGS_EQUAL(3, m_pCards[1]->getStatistics().blocksWritten);
+    LONGS_EQUAL(0, m_pCards[2]->getStatistics().commandCount);
+    validateErrorLogsEmpty(3);
+}
+
+TEST(SDStripedFileSystem, WriteSpanningMoreRowsThanVectors_ShouldSplitIntoMultiplePasses)
+{
+    const uint32_t sectorCount = (SDSTRIPEDFILESYSTEM_MAX_VECTORS * 2 + 3) * 2;
+    uint8_t        writeBuffer[sectorCount * 512];
+    uint8_t        readBuffer[sectorCount * 512];
+
+    createCards(2);
+    SDStripedFileSystem striped("stripe", cards(), 2, 1);
+    LONGS_EQUAL(0, striped.disk_initialize());
+    fillBuffer(writeBuffer, sizeof(writeBuffer), 3);
+
+        LONGS_EQUAL(RES_OK, striped.disk_write(writeBuffer, 1, sectorCount));
+        LONGS_EQUAL(RES_OK, striped.disk_read(readBuffer, 1, sectorCount));
+
+    CHECK_TRUE(0 == memcmp(writeBuffer, readBuffer, sizeof(readBuffer)));
+    validateStripes(writeBuffer, 1, sectorCount, 2, 1);
+    LONGS_EQUAL(RES_OK, striped.disk_sync());
+    validateErrorLogsEmpty(2);
+}
+
+TEST(SDStripedFileSystem, StartWriteStreamFailure_ShouldOnlyEndStreamsWhichWereStarted)
+{
+    uint8_t writeBuffer[3 * 512];
+    uint8_t streamBuffer[2 * 512];
+
+    createCards(3);
+    SDStripedFileSystem striped("stripe", cards(), 3, 1);
+    LONGS_EQUAL(0, striped.disk_initialize());
+    fillBuffer(writeBuffer, sizeof(writeBuffer), 5);
+    fillBuffer(streamBuffer, sizeof(streamBuffer), 6);
+    // The third card has a stream of its own part way through.
+    LONGS_EQUAL(RES_OK, m_pSDs[2]->startWriteStream(100, 2));
+    LONGS_EQUAL(RES_OK, m_pSDs[2]->writeStream(streamBuffer, 1));
+    m_pSDs[1]->markUninitialized();
+
+        LONGS_EQUAL(RES_NOTRDY, striped.disk_write(writeBuffer, 0, 3));
+
+    // The stream started on the first card was ended.
+    LONGS_EQUAL(RES_PARERR, m_pSDs[0]->writeStream(writeBuffer, 1));
+    // The third card's own stream was never reached so it is still open.
+    LONGS_EQUAL(RES_OK, m_pSDs[2]->writeStream(streamBuffer + 512, 1));
+    LONGS_EQUAL(RES_OK, m_pSDs[2]->endWriteStream());
+    CHECK_TRUE(0 == memcmp(streamBuffer, m_pCards[2]->sector(100), sizeof(streamBuffer)));
+}
+
+TEST(SDStripedFileSystem, StripedWrites_ShouldOverlapProgrammingAndTakeLessTimeThanOneCard)
+{
+    static uint8_t buffer[64 * 512];
+    const uint32_t totalSectors = 1024;
+
+    createCards(3);
+    fillBuffer(buffer, sizeof(buffer), 1);
+    SDStripedFileSystem striped("stripe", cards(), 2, 32);
+    LONGS_EQUAL(0, striped.disk_initialize());
+    LONGS_EQUAL(0, m_pSDs[2]->disk_initialize());
+    for (int i = 0 ; i < 3 ; i++)
+    {
+        LONGS_EQUAL(RES_OK, m_pSDs[i]->setWriteStatusCheckInterval(16));
+    }
+
+    uint64_t startTime = m_pCards[0]->elapsedNanoseconds();
+    for (uint32_t block = 0 ; block < totalSectors ; block += 64)
+    {
+        LONGS_EQUAL(RES_OK, m_pSDs[2]->disk_write(buffer, block, 64));
+    }
+    LONGS_EQUAL(RES_OK, m_pSDs[2]->disk_sync());
+    uint64_t singleCardTime = m_pCards[0]->elapsedNanoseconds() - startTime;
+
+    startTime = m_pCards[0]->elapsedNanoseconds();
+    for (uint32_t block = 0 ; block < totalSectors ; block += 64)
+    {
+        LONGS_EQUAL(RES_OK, striped.disk_write(buffer, block, 64));
+    }
+    LONGS_EQUAL(RES_OK, striped.disk_sync());
+    uint64_t stripedTime = m_pCards[0]->elapsedNanoseconds() - startTime;
+
+    CHECK_TRUE(stripedTime < singleCardTime);
+    validateErrorLogsEmpty(3);
+}
@@ -37,7 +37,7 @@ TEST(DiskRead, DiskRead_AttemptBeforeInit_ShouldFail_GetLogged)
 
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
-    snprintf(expectedOutput, sizeof(expectedOutput), "disk_read(%08X,42,1) - Attempt to read uninitialized drive\n",
+    snprintf(expectedOutput, sizeof(expectedOutput), "disk_read(%X,42,1) - Attempt to read uninitialized drive\n",
              (uint32_t)(size_t)buffer);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
 }
@@ -51,7 +51,7 @@ TEST(DiskRead, DiskRead_AttemptToRead0Blocks_ShouldFail_GetLogged)
 
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
-    snprintf(expectedOutput, sizeof(expectedOutput), "disk_read(%08X,42,0) - Attempt to read 0 blocks\n",
+    snprintf(expectedOutput, sizeof(expectedOutput), "disk_read(%X,42,0) - Attempt to read 0 blocks\n",
              (uint32_t)(size_t)buffer);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
 }
@@ -312,7 +312,7 @@ TEST(DiskRead, DiskRead_SingleBlock_ForceReceiveDataBlockToTimeout_ShouldRetry_L
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "receiveDataBlock(%08X,512) - Time out after 500ms\n"
+             "startReceiveDataBlock(%X,512) - Time out after 500ms\n"
              "sendCommandAndReceiveDataBlock(CMD17,%X,%X,512) - receiveDataBlock failed\n",
              (uint32_t)(size_t)buffer,
              42, (uint32_t)(size_t)buffer);
@@ -427,9 +427,9 @@ TEST(DiskRead, DiskRead_SingleBlock_ForceReceiveDataBlockToTimeoutOn2DifferentBl
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[512];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "receiveDataBlock(%08X,512) - Time out after 500ms\n"
+             "startReceiveDataBlock(%X,512) - Time out after 500ms\n"
              "sendCommandAndReceiveDataBlock(CMD17,%X,%X,512) - receiveDataBlock failed\n"
-             "receiveDataBlock(%08X,512) - Time out after 500ms\n"
+             "startReceiveDataBlock(%X,512) - Time out after 500ms\n"
              "sendCommandAndReceiveDataBlock(CMD17,%X,%X,512) - receiveDataBlock failed\n",
              (uint32_t)(size_t)buffer,
              42, (uint32_t)(size_t)buffer,
@@ -509,11 +509,11 @@ TEST(DiskRead, DiskRead_SingleBlock_ForceReceiveDataBlockToTimeout3Times_ShouldF
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[512];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "receiveDataBlock(%08X,512) - Time out after 500ms\n"
+             "startReceiveDataBlock(%X,512) - Time out after 500ms\n"
              "sendCommandAndReceiveDataBlock(CMD17,%X,%X,512) - receiveDataBlock failed\n"
-             "receiveDataBlock(%08X,512) - Time out after 500ms\n"
+             "startReceiveDataBlock(%X,512) - Time out after 500ms\n"
              "sendCommandAndReceiveDataBlock(CMD17,%X,%X,512) - receiveDataBlock failed\n"
-             "receiveDataBlock(%08X,512) - Time out after 500ms\n"
+             "startReceiveDataBlock(%X,512) - Time out after 500ms\n"
              "sendCommandAndReceiveDataBlock(CMD17,%X,%X,512) - receiveDataBlock failed\n"
              "disk_read(%X,42,1) - Read failed\n",
              (uint32_t)(size_t)buffer,
@@ -583,7 +583,7 @@ TEST(DiskRead, DiskRead_SingleBlock_FailReceiveDataBlockWithInvalidStartToken_Sh
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "receiveDataBlock(%08X,512) - Expected 0xFE start block token. Response=0xFD\n"
+             "startReceiveDataBlock(%X,512) - Expected 0xFE start block token. Response=0xFD\n"
              "sendCommandAndReceiveDataBlock(CMD17,%X,%X,512) - receiveDataBlock failed\n",
              (uint32_t)(size_t)buffer,
              42,(uint32_t)(size_t)buffer);
@@ -690,9 +690,9 @@ TEST(DiskRead, DiskRead_SingleBlock_FailReceiveDataBlockWithInvalidStartTokenOnT
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[512];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "receiveDataBlock(%08X,512) - Expected 0xFE start block token. Response=0xFD\n"
+             "startReceiveDataBlock(%X,512) - Expected 0xFE start block token. Response=0xFD\n"
              "sendCommandAndReceiveDataBlock(CMD17,%X,%X,512) - receiveDataBlock failed\n"
-             "receiveDataBlock(%08X,512) - Expected 0xFE start block token. Response=0xFD\n"
+             "startReceiveDataBlock(%X,512) - Expected 0xFE start block token. Response=0xFD\n"
              "sendCommandAndReceiveDataBlock(CMD17,%X,%X,512) - receiveDataBlock failed\n",
              (uint32_t)(size_t)buffer,
              42,(uint32_t)(size_t)buffer,
@@ -762,7 +762,7 @@ TEST(DiskRead, DiskRead_SingleBlock_FailReceiveDataBlockWithInvalidCRC_ShouldRet
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "receiveDataBlock(%08X,512) - Invalid CRC. Expected=0xBAAD Actual=0x2F29\n"
+             "verifyDataBlockCrc(%X,512) - Invalid CRC. Expected=0xBAAD Actual=0x2F29\n"
              "sendCommandAndReceiveDataBlock(CMD17,%X,%X,512) - receiveDataBlock failed\n",
              (uint32_t)(size_t)buffer,
              42, (uint32_t)(size_t)buffer);
@@ -829,7 +829,7 @@ TEST(DiskRead, DiskRead_SingleBlock_FailReceiveDataBlockWithFailTransferCall_Sho
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "receiveDataBlock(%08X,512) - SPI transfer failed\n"
+             "finishReceiveDataBlock(%X,512) - SPI transfer failed\n"
              "sendCommandAndReceiveDataBlock(CMD17,%X,%X,512) - receiveDataBlock failed\n",
              (uint32_t)(size_t)buffer,
              42, (uint32_t)(size_t)buffer);
@@ -943,9 +943,9 @@ TEST(DiskRead, DiskRead_SingleBlock_FailReceiveDataBlockFailTransferFor2Blocks_S
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[512];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "receiveDataBlock(%08X,512) - SPI transfer failed\n"
+             "finishReceiveDataBlock(%X,512) - SPI transfer failed\n"
              "sendCommandAndReceiveDataBlock(CMD17,%X,%X,512) - receiveDataBlock failed\n"
-             "receiveDataBlock(%08X,512) - SPI transfer failed\n"
+             "finishReceiveDataBlock(%X,512) - SPI transfer failed\n"
              "sendCommandAndReceiveDataBlock(CMD17,%X,%X,512) - receiveDataBlock failed\n",
              (uint32_t)(size_t)buffer,
              42, (uint32_t)(size_t)buffer,
@@ -1119,7 +1119,7 @@ TEST(DiskRead, DiskRead_MultiBlock_CMD18Error_ShouldFail_GetLogged)
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "disk_read(%08X,42,2) - CMD18 returned 0x04\n",
+             "disk_read(%X,42,2) - CMD18 returned 0x04\n",
              (uint32_t)(size_t)buffer);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
 }
@@ -1167,7 +1167,7 @@ TEST(DiskRead, DiskRead_MultiBlock_CMD12Error_ShouldFail_GetLogged)
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "disk_read(%08X,42,2) - CMD12 returned 0x04\n",
+             "disk_read(%X,42,2) - CMD12 returned 0x04\n",
              (uint32_t)(size_t)buffer);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
 }
@@ -1178,12 +1178,17 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForEachBlockOnce_ShouldSuccee
 
     initSDHC();
     // Fail CRC for first block.
+    // The CRC of each block is only checked once the next block has started to be received.
     // CMD18 input data.
     setupDataForCmd("00");
     // 0xFE starts read data block.
     m_sd.spi().setInboundFromString("FE");
     // Data block will contain 512 bytes of 0x11 + invalid CRC.
     setupDataBlock(0x11, 512, "BAAD");
+    // 0xFE starts read data block.
+    m_sd.spi().setInboundFromString("FE");
+    // Data block will contain 512 bytes of 0x22 + valid CRC (received while first block CRC is checked).
+    setupDataBlock(0x22, 512);
     // CMD12 input data.
     setupDataForCmd12("00");
 
@@ -1199,6 +1204,10 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForEachBlockOnce_ShouldSuccee
     m_sd.spi().setInboundFromString("FE");
     // Data block will contain 512 bytes of 0x22 + invalid CRC.
     setupDataBlock(0x22, 512, "BAAD");
+    // 0xFE starts read data block.
+    m_sd.spi().setInboundFromString("FE");
+    // Data block will contain 512 bytes of 0x33 + valid CRC (received while second block CRC is checked).
+    setupDataBlock(0x33, 512);
     // CMD12 input data.
     setupDataForCmd12("00");
 
@@ -1214,6 +1223,10 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForEachBlockOnce_ShouldSuccee
     m_sd.spi().setInboundFromString("FE");
     // Data block will contain 512 bytes of 0x33 + invalid CRC.
     setupDataBlock(0x33, 512, "BAAD");
+    // 0xFE starts read data block.
+    m_sd.spi().setInboundFromString("FE");
+    // Data block will contain 512 bytes of 0x44 + valid CRC (received while third block CRC is checked).
+    setupDataBlock(0x44, 512);
     // CMD12 input data.
     setupDataForCmd12("00");
 
@@ -1237,7 +1250,7 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForEachBlockOnce_ShouldSuccee
     setupDataForCmd("00");
     // 0xFE starts read data block.
     m_sd.spi().setInboundFromString("FE");
-    // Data block will contain 512 bytes of 0x33 + valid CRC.
+    // Data block will contain 512 bytes of 0x44 + valid CRC.
     setupDataBlock(0x44, 512);
     // CMD12 input data.
     setupDataForCmd12("00");
@@ -1247,7 +1260,7 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForEachBlockOnce_ShouldSuccee
 
         LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 4));
 
-    // Failed read of first block.
+    // Failed read of first block, detected while second block was being received.
     validateSelect();
     // Should send CMD18 to start read process.  Argument is block number.
     validateCmdPacket(18, 42);
@@ -1255,13 +1268,13 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForEachBlockOnce_ShouldSuccee
     //  1 to read in header.
     //  512 to read data.
     //  2 to read CRC.
-    validateFFBytes(1*(1+512+2));
+    validateFFBytes(2*(1+512+2));
     // Should send CMD12 to stop read process.
     validateCmdPacket(12);
     validateDeselect();
 
     // Retry from failure of first block.
-    // Failed read of second block.
+    // Failed read of second block, detected while third block was being received.
     validateSelect();
     // Should send CMD18 to start read process.  Argument is block number.
     validateCmdPacket(18, 42);
@@ -1269,13 +1282,13 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForEachBlockOnce_ShouldSuccee
     //  1 to read in header.
     //  512 to read data.
     //  2 to read CRC.
-    validateFFBytes(2*(1+512+2));
+    validateFFBytes(3*(1+512+2));
     // Should send CMD12 to stop read process.
     validateCmdPacket(12);
     validateDeselect();
 
     // Retry from failure of second block.
-    // Failed read of third block.
+    // Failed read of third block, detected while fourth block was being received.
     validateSelect();
     // Should send CMD18 to start read process.  Argument is block number.
     validateCmdPacket(18, 42+1);
@@ -1283,13 +1296,13 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForEachBlockOnce_ShouldSuccee
     //  1 to read in header.
     //  512 to read data.
     //  2 to read CRC.
-    validateFFBytes(2*(1+512+2));
+    validateFFBytes(3*(1+512+2));
     // Should send CMD12 to stop read process.
     validateCmdPacket(12);
     validateDeselect();
 
     // Retry from failure of third block.
-    // Failed read of fourth block.
+    // Failed read of fourth block, detected after it was received since it is the last block.
     validateSelect();
     // Should send CMD18 to start read process.  Argument is block number.
     validateCmdPacket(18, 42+2);
@@ -1298,6 +1311,8 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForEachBlockOnce_ShouldSuccee
     //  512 to read data.
     //  2 to read CRC.
     validateFFBytes(2*(1+512+2));
+    // The fourth CRC error in quick succession should halve the SPI clock rate before the retry.
+    validateFrequency(12500000);
     // Should send CMD12 to stop read process.
     validateCmdPacket(12);
     validateDeselect();
@@ -1325,19 +1340,22 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForEachBlockOnce_ShouldSuccee
     LONGS_EQUAL(1, m_sd.maximumReadRetryCount());
     // Failed on CRC check a total of 4 times.
     LONGS_EQUAL(4, m_sd.receiveCrcErrorCount());
+    LONGS_EQUAL(1, m_sd.frequencyFallbackCount());
+    LONGS_EQUAL(12500000, m_sd.currentFrequency());
 
     // Verify error log output.
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[1024];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "receiveDataBlock(%08X,512) - Invalid CRC. Expected=0xBAAD Actual=0x3880\n"
-             "disk_read(%08X,42,4) - receiveDataBlock failed. block=42\n"
-             "receiveDataBlock(%08X,512) - Invalid CRC. Expected=0xBAAD Actual=0x7100\n"
-             "disk_read(%08X,42,4) - receiveDataBlock failed. block=43\n"
-             "receiveDataBlock(%08X,512) - Invalid CRC. Expected=0xBAAD Actual=0x4980\n"
-             "disk_read(%08X,42,4) - receiveDataBlock failed. block=44\n"
-             "receiveDataBlock(%08X,512) - Invalid CRC. Expected=0xBAAD Actual=0xE200\n"
-             "disk_read(%08X,42,4) - receiveDataBlock failed. block=45\n",
+             "verifyDataBlockCrc(%X,512) - Invalid CRC. Expected=0xBAAD Actual=0x3880\n"
+             "disk_read(%X,42,4) - verifyDataBlockCrc failed. block=42\n"
+             "verifyDataBlockCrc(%X,512) - Invalid CRC. Expected=0xBAAD Actual=0x7100\n"
+             "disk_read(%X,42,4) - verifyDataBlockCrc failed. block=43\n"
+             "verifyDataBlockCrc(%X,512) - Invalid CRC. Expected=0xBAAD Actual=0x4980\n"
+             "disk_read(%X,42,4) - verifyDataBlockCrc failed. block=44\n"
+             "verifyDataBlockCrc(%X,512) - Invalid CRC. Expected=0xBAAD Actual=0xE200\n"
+             "recordCrcError() - Falling back from 25000000Hz to 12500000Hz\n"
+             "disk_read(%X,42,4) - verifyDataBlockCrc failed. block=45\n",
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer + 1*512, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer + 2*512, (uint32_t)(size_t)buffer,
@@ -1358,6 +1376,10 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForFirstBlockThreeTimes_Shoul
     m_sd.spi().setInboundFromString("FE");
     // Data block will contain 512 bytes of 0xAD + invalid CRC.
     setupDataBlock(0xAD, 512, "BAAD");
+    // 0xFE starts read data block.
+    m_sd.spi().setInboundFromString("FE");
+    // Second data block is received while the CRC of the first is checked.
+    setupDataBlock(0xDA, 512);
     // CMD12 input data.
     setupDataForCmd12("00");
     // CMD18 input data.
@@ -1366,6 +1388,10 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForFirstBlockThreeTimes_Shoul
     m_sd.spi().setInboundFromString("FE");
     // Data block will contain 512 bytes of 0xAD + invalid CRC.
     setupDataBlock(0xAD, 512, "BAAD");
+    // 0xFE starts read data block.
+    m_sd.spi().setInboundFromString("FE");
+    // Second data block is received while the CRC of the first is checked.
+    setupDataBlock(0xDA, 512);
     // CMD12 input data.
     setupDataForCmd12("00");
     // CMD18 input data.
@@ -1374,6 +1400,10 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForFirstBlockThreeTimes_Shoul
     m_sd.spi().setInboundFromString("FE");
     // Data block will contain 512 bytes of 0xAD + invalid CRC.
     setupDataBlock(0xAD, 512, "BAAD");
+    // 0xFE starts read data block.
+    m_sd.spi().setInboundFromString("FE");
+    // Second data block is received while the CRC of the first is checked.
+    setupDataBlock(0xDA, 512);
     // CMD12 input data.
     setupDataForCmd12("00");
 
@@ -1390,7 +1420,7 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForFirstBlockThreeTimes_Shoul
     //  1 to read in header.
     //  512 to read data.
     //  2 to read CRC.
-    validateFFBytes(1*(1+512+2));
+    validateFFBytes(2*(1+512+2));
     // Should send CMD12 to stop read process.
     validateCmdPacket(12);
     validateDeselect();
@@ -1402,7 +1432,7 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForFirstBlockThreeTimes_Shoul
     //  1 to read in header.
     //  512 to read data.
     //  2 to read CRC.
-    validateFFBytes(1*(1+512+2));
+    validateFFBytes(2*(1+512+2));
     // Should send CMD12 to stop read process.
     validateCmdPacket(12);
     validateDeselect();
@@ -1414,15 +1444,15 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForFirstBlockThreeTimes_Shoul
     //  1 to read in header.
     //  512 to read data.
     //  2 to read CRC.
-    validateFFBytes(1*(1+512+2));
+    validateFFBytes(2*(1+512+2));
     // Should send CMD12 to stop read process.
     validateCmdPacket(12);
     validateDeselect();
 
     // Will have read in data to first block before encountering CRC error.
     validateBuffer(buffer, 512, 0xAD);
-    // Second block read should not have happened though and still contain zero fill.
-    validateBuffer(buffer + 512, 512, 0x00);
+    // Second block will have been received while the first block's CRC was being checked.
+    validateBuffer(buffer + 512, 512, 0xDA);
 
     // Failed CRC check 3 times on single block.
     LONGS_EQUAL(3, m_sd.maximumReadRetryCount());
@@ -1432,12 +1462,12 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockCrcForFirstBlockThreeTimes_Shoul
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[1024];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "receiveDataBlock(%08X,512) - Invalid CRC. Expected=0xBAAD Actual=0x2F29\n"
-             "disk_read(%08X,42,2) - receiveDataBlock failed. block=42\n"
-             "receiveDataBlock(%08X,512) - Invalid CRC. Expected=0xBAAD Actual=0x2F29\n"
-             "disk_read(%08X,42,2) - receiveDataBlock failed. block=42\n"
-             "receiveDataBlock(%08X,512) - Invalid CRC. Expected=0xBAAD Actual=0x2F29\n"
-             "disk_read(%08X,42,2) - receiveDataBlock failed. block=42\n",
+             "verifyDataBlockCrc(%X,512) - Invalid CRC. Expected=0xBAAD Actual=0x2F29\n"
+             "disk_read(%X,42,2) - verifyDataBlockCrc failed. block=42\n"
+             "verifyDataBlockCrc(%X,512) - Invalid CRC. Expected=0xBAAD Actual=0x2F29\n"
+             "disk_read(%X,42,2) - verifyDataBlockCrc failed. block=42\n"
+             "verifyDataBlockCrc(%X,512) - Invalid CRC. Expected=0xBAAD Actual=0x2F29\n"
+             "disk_read(%X,42,2) - verifyDataBlockCrc failed. block=42\n",
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer);
@@ -1515,8 +1545,8 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockTransferForFirstBlockOnce_Should
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[1024];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "receiveDataBlock(%08X,512) - SPI transfer failed\n"
-             "disk_read(%08X,42,2) - receiveDataBlock failed. block=42\n",
+             "finishReceiveDataBlock(%X,512) - SPI transfer failed\n"
+             "disk_read(%X,42,2) - finishReceiveDataBlock failed. block=42\n",
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
 }
@@ -1594,14 +1624,163 @@ TEST(DiskRead, DiskRead_MultiBlock_FailDataBlockTransferForFirstBlockThreeTimes_
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[1024];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "receiveDataBlock(%08X,512) - SPI transfer failed\n"
-             "disk_read(%08X,42,2) - receiveDataBlock failed. block=42\n"
-             "receiveDataBlock(%08X,512) - SPI transfer failed\n"
-             "disk_read(%08X,42,2) - receiveDataBlock failed. block=42\n"
-             "receiveDataBlock(%08X,512) - SPI transfer failed\n"
-             "disk_read(%08X,42,2) - receiveDataBlock failed. block=42\n",
+             "finishReceiveDataBlock(%X,512) - SPI transfer failed\n"
+             "disk_read(%X,42,2) - finishReceiveDataBlock failed. block=42\n"
+             "finishReceiveDataBlock(%X,512) - SPI transfer failed\n"
+             "disk_read(%X,42,2) - finishReceiveDataBlock failed. block=42\n"
+             "finishReceiveDataBlock(%X,512) - SPI transfer failed\n"
+             "disk_read(%X,42,2) - finishReceiveDataBlock failed. block=42\n",
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
 }
+
+TEST(DiskRead, DiskRead_MultiBlock_CorruptFirstBlockAfterSecondTransferStarts_ShouldFailCrcAndRetryFromFirstBlock)
+{
+    uint8_t       buffer[2*512];
+    BlockModifier modifier = { buffer, 2, SPIDma::AsyncTransferStarted, 0xFF, 0 };
+
+    initSDHC();
+    // CMD18 input data.
+    setupDataForCmd("00");
+    // 0xFE starts read data block.
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0x11, 512);
+    // 0xFE starts read data block.
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0x22, 512);
+    // CMD12 input data.
+    setupDataForCmd12("00");
+    // Retry from first block.
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0x11, 512);
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0x22, 512);
+    setupDataForCmd12("00");
+
+    // Corrupt the first block as soon as the second block's transfer starts. The first block's CRC should only be
+    // checked after this point, while the second block is in flight.
+    m_sd.spi().setTransferCompletionDelay(10);
+    m_sd.spi().setAsyncTransferHook(modifyBlockHook, &modifier);
+
+    // Clear buffer to 0x00 before reading into it.
+    memset(buffer, 0, sizeof(buffer));
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 2));
+
+    // First attempt.
+    validateSelect();
+    validateCmdPacket(18, 42);
+    validateFFBytes(2*(1+512+2));
+    validateCmdPacket(12);
+    validateDeselect();
+    // Retry from first block.
+    validateSelect();
+    validateCmdPacket(18, 42);
+    validateFFBytes(2*(1+512+2));
+    validateCmdPacket(12);
+    validateDeselect();
+
+    // Should have read in data via SPI.
+    validateBuffer(buffer, 512, 0x11);
+    validateBuffer(buffer + 512, 512, 0x22);
+
+    LONGS_EQUAL(4, m_sd.spi().getAsyncTransferCount());
+    LONGS_EQUAL(1, m_sd.maximumReadRetryCount());
+    LONGS_EQUAL(1, m_sd.receiveCrcErrorCount());
+}
+
+TEST(DiskRead, DiskRead_MultiBlock_CorruptFirstBlockAfterSecondTransferCompletes_ShouldHaveAlreadyVerifiedFirstBlock)
+{
+    uint8_t       buffer[2*512];
+    BlockModifier modifier = { buffer, 2, SPIDma::AsyncTransferCompleted, 0xFF, 0 };
+
+    initSDHC();
+    // CMD18 input data.
+    setupDataForCmd("00");
+    // 0xFE starts read data block.
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0x11, 512);
+    // 0xFE starts read data block.
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0x22, 512);
+    // CMD12 input data.
+    setupDataForCmd12("00");
+
+    // Modifying the first block once the second block's transfer completes won't be detected since its CRC was
+    // already verified while the second block was in flight.
+    m_sd.spi().setTransferCompletionDelay(10);
+    m_sd.spi().setAsyncTransferHook(modifyBlockHook, &modifier);
+
+    // Clear buffer to 0x00 before reading into it.
+    memset(buffer, 0, sizeof(buffer));
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 2));
+
+    validateSelect();
+    validateCmdPacket(18, 42);
+    validateFFBytes(2*(1+512+2));
+    validateCmdPacket(12);
+    validateDeselect();
+
+    validateBuffer(buffer, 512, 0xFF);
+    validateBuffer(buffer + 512, 512, 0x22);
+    LONGS_EQUAL(0, m_sd.maximumReadRetryCount());
+    LONGS_EQUAL(0, m_sd.receiveCrcErrorCount());
+}
+
+TEST(DiskRead, DiskRead_MultiBlock_FailSecondBlockStartTokenWhileFirstBlockCrcPending_ShouldKeepFirstBlockAndRetryFromSecond)
+{
+    uint8_t buffer[2*512];
+
+    initSDHC();
+    // CMD18 input data.
+    setupDataForCmd("00");
+    // 0xFE starts read data block.
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0x11, 512);
+    // Return invalid start token for second block.
+    m_sd.spi().setInboundFromString("FD");
+    // CMD12 input data.
+    setupDataForCmd12("00");
+    // Retry from second block.
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0x22, 512);
+    setupDataForCmd12("00");
+
+    // Clear buffer to 0x00 before reading into it.
+    memset(buffer, 0, sizeof(buffer));
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 2));
+
+    // First attempt which reads the first block and fails on the start token of the second.
+    validateSelect();
+    validateCmdPacket(18, 42);
+    validateFFBytes(1*(1+512+2) + 1);
+    validateCmdPacket(12);
+    validateDeselect();
+    // Retry from second block since the first block's CRC was still verified.
+    validateSelect();
+    validateCmdPacket(18, 43);
+    validateFFBytes(1*(1+512+2));
+    validateCmdPacket(12);
+    validateDeselect();
+
+    validateBuffer(buffer, 512, 0x11);
+    validateBuffer(buffer + 512, 512, 0x22);
+    LONGS_EQUAL(1, m_sd.maximumReadRetryCount());
+    LONGS_EQUAL(1, m_sd.receiveBadTokenCount());
+    LONGS_EQUAL(0, m_sd.receiveCrcErrorCount());
+
+    // Verify error log output.
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[1024];
+    snprintf(expectedOutput, sizeof(expectedOutput),
+             "startReceiveDataBlock(%X,512) - Expected 0xFE start block token. Response=0xFD\n"
+             "disk_read(%X,42,2) - startReceiveDataBlock failed. block=43\n",
+             (uint32_t)(size_t)buffer + 512, (uint32_t)(size_t)buffer);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
@@ -0,0 +1,406 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "SDFileSystemBaseTests.h"
+
+TEST_GROUP_BASE(DiskVector,SDFileSystemBase)
+{
+    void setupDataForCmd12(const char* pR1Response = "01" /* No errors & in idle state */)
+    {
+        // Return extra padding byte.
+        m_sd.spi().setInboundFromString("FF");
+        // Return indicated R1 response.
+        m_sd.spi().setInboundFromString(pR1Response);
+    }
+
+    void setupVectors(uint8_t* pBuffer, size_t firstSize, size_t secondSize, size_t thirdSize)
+    {
+        // Split the caller's buffer into 3 vectors which are listed in reverse memory order so that the vectors
+        // can't accidentally be treated as one contiguous buffer.
+        m_vectors[0].pBuffer = pBuffer + secondSize + thirdSize;
+        m_vectors[0].count = firstSize;
+        m_vectors[1].pBuffer = pBuffer + thirdSize;
+        m_vectors[1].count = secondSize;
+        m_vectors[2].pBuffer = pBuffer;
+        m_vectors[2].count = thirdSize;
+    }
+
+    SDFileSystem::IoVector m_vectors[SPIDMA_MAX_SEGMENTS + 1];
+};
+
+
+TEST(DiskVector, DiskReadv_AttemptBeforeInit_ShouldFail_GetLogged)
+{
+    uint8_t buffer[512];
+
+    setupVectors(buffer, 256, 128, 128);
+        LONGS_EQUAL(RES_NOTRDY, m_sd.disk_readv(m_vectors, 3, 42));
+
+    // Only the constructor should have generated any SPI traffic.
+    validateConstructor();
+
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[256];
+    snprintf(expectedOutput, sizeof(expectedOutput), "disk_readv(%X,3,42) - Attempt to read uninitialized drive\n",
+             (uint32_t)(size_t)m_vectors);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
+
+TEST(DiskVector, DiskReadv_TotalSizeNotMultipleOfBlockSize_ShouldFail_GetLogged)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    setupVectors(buffer, 256, 128, 124);
+        LONGS_EQUAL(RES_PARERR, m_sd.disk_readv(m_vectors, 3, 42));
+
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[256];
+    snprintf(expectedOutput, sizeof(expectedOutput), "disk_readv(%X,3,42) - Invalid vectors\n",
+             (uint32_t)(size_t)m_vectors);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
+
+TEST(DiskVector, DiskReadv_VectorSizeNotMultipleOf4_ShouldFail)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    setupVectors(buffer, 254, 130, 128);
+        LONGS_EQUAL(RES_PARERR, m_sd.disk_readv(m_vectors, 3, 42));
+}
+
+TEST(DiskVector, DiskReadv_BlockSplitAcrossTooManyVectors_ShouldFail)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    for (size_t i = 0 ; i < SPIDMA_MAX_SEGMENTS + 1 ; i++)
+    {
+        m_vectors[i].pBuffer = buffer + i * 4;
+        m_vectors[i].count = 4;
+    }
+    m_vectors[SPIDMA_MAX_SEGMENTS].count = 512 - SPIDMA_MAX_SEGMENTS * 4;
+        LONGS_EQUAL(RES_PARERR, m_sd.disk_readv(m_vectors, SPIDMA_MAX_SEGMENTS + 1, 42));
+}
+
+TEST(DiskVector, DiskReadv_SingleBlockSplitAcrossTwoVectors_ShouldUseCMD17_ShouldSucceed)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    // CMD17 input data.
+    setupDataForCmd("00");
+    // 0xFE starts read data block.
+    m_sd.spi().setInboundFromString("FE");
+    // Data block will contain 512 bytes of 0xAD + valid CRC.
+    setupDataBlock(0xAD, 512);
+
+    memset(buffer, 0, sizeof(buffer));
+    setupVectors(buffer, 256, 256, 0);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_readv(m_vectors, 2, 42));
+
+    validateSelect();
+    validateCmdPacket(17, 42);
+    validateFFBytes(1+512+2);
+    validateDeselect();
+
+    // Should have read 0xAD fill into both vectors with a single DMA transfer.
+    validateBuffer(buffer, sizeof(buffer), 0xAD);
+    LONGS_EQUAL(1, m_sd.spi().getAsyncTransferCount());
+    LONGS_EQUAL(0, m_sd.maximumReadRetryCount());
+}
+
+TEST(DiskVector, DiskReadv_TwoBlocksSplitAcrossThreeVectors_ShouldUseSingleCMD18_ShouldSucceed)
+{
+    uint8_t buffer[1024];
+
+    initSDSC();
+    // CMD18 input data.
+    setupDataForCmd("00");
+    // Two data blocks of 0xAD and 0xDA.
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0xAD, 512);
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0xDA, 512);
+    // CMD12 input data.
+    setupDataForCmd12("00");
+
+    // The second vector straddles the two blocks.
+    memset(buffer, 0, sizeof(buffer));
+    setupVectors(buffer, 256, 512, 256);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_readv(m_vectors, 3, 42));
+
+    validateSelect();
+    // Note that argument for SDSC should be block number * 512.
+    validateCmdPacket(18, 42 * 512);
+    validateFFBytes(2*(1+512+2));
+    validateCmdPacket(12);
+    validateDeselect();
+
+    // Vectors were listed in reverse memory order.
+    validateBuffer((uint8_t*)m_vectors[0].pBuffer, 256, 0xAD);
+    validateBuffer((uint8_t*)m_vectors[1].pBuffer, 256, 0xAD);
+    validateBuffer((uint8_t*)m_vectors[1].pBuffer + 256, 256, 0xDA);
+    validateBuffer((uint8_t*)m_vectors[2].pBuffer, 256, 0xDA);
+    LONGS_EQUAL(2, m_sd.spi().getAsyncTransferCount());
+    LONGS_EQUAL(0, m_sd.maximumReadRetryCount());
+}
+
+TEST(DiskVector, DiskReadv_FailCrcOnSecondBlock_ShouldRetryJustSecondBlock_GetLogged_GetCounted)
+{
+    uint8_t buffer[1024];
+
+    initSDHC();
+    // CMD18 input data.
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0xAD, 512);
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0xDA, 512, "0000");
+    // CMD12 input data.
+    setupDataForCmd12("00");
+    // Retry of second block uses CMD17.
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0xDA, 512);
+
+    memset(buffer, 0, sizeof(buffer));
+    setupVectors(buffer, 256, 512, 256);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_readv(m_vectors, 3, 42));
+
+    validateSelect();
+    validateCmdPacket(18, 42);
+    validateFFBytes(2*(1+512+2));
+    validateCmdPacket(12);
+    validateDeselect();
+    validateSelect();
+    validateCmdPacket(17, 43);
+    validateFFBytes(1+512+2);
+    validateDeselect();
+
+    validateBuffer((uint8_t*)m_vectors[0].pBuffer, 256, 0xAD);
+    validateBuffer((uint8_t*)m_vectors[1].pBuffer, 256, 0xAD);
+    validateBuffer((uint8_t*)m_vectors[1].pBuffer + 256, 256, 0xDA);
+    validateBuffer((uint8_t*)m_vectors[2].pBuffer, 256, 0xDA);
+    LONGS_EQUAL(1, m_sd.maximumReadRetryCount());
+    LONGS_EQUAL(1, m_sd.receiveCrcErrorCount());
+
+    uint8_t block[512];
+    memset(block, 0xDA, sizeof(block));
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[512];
+    snprintf(expectedOutput, sizeof(expectedOutput),
+             "verifyDataBlockCrc(%X,512) - Invalid CRC. Expected=0x0000 Actual=0x%04X\n"
+             "disk_readv(%X,3,42) - receiveDataBlock failed. block=43\n",
+             (uint32_t)(size_t)m_vectors[1].pBuffer + 256, SDCRC::crc16(block, sizeof(block)),
+             (uint32_t)(size_t)m_vectors);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
+
+TEST(DiskVector, DiskWritev_AttemptBeforeInit_ShouldFail_GetLogged)
+{
+    uint8_t buffer[512];
+
+    setupVectors(buffer, 256, 128, 128);
+        LONGS_EQUAL(RES_NOTRDY, m_sd.disk_writev(m_vectors, 3, 42));
+
+    // Only the constructor should have generated any SPI traffic.
+    validateConstructor();
+
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[256];
+    snprintf(expectedOutput, sizeof(expectedOutput), "disk_writev(%X,3,42) - Attempt to write uninitialized drive\n",
+             (uint32_t)(size_t)m_vectors);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
+
+TEST(DiskVector, DiskWritev_TotalSizeNotMultipleOfBlockSize_ShouldFail_GetLogged)
+{
+    uint8_t buffer[1024];
+
+    initSDHC();
+    setupVectors(buffer, 256, 512, 128);
+        LONGS_EQUAL(RES_PARERR, m_sd.disk_writev(m_vectors, 3, 42));
+
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[256];
+    snprintf(expectedOutput, sizeof(expectedOutput), "disk_writev(%X,3,42) - Invalid vectors\n",
+             (uint32_t)(size_t)m_vectors);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
+
+TEST(DiskVector, DiskWritev_TwoBlocksSplitAcrossThreeVectors_ShouldUseSingleCMD25_ShouldSucceed)
+{
+    uint8_t buffer[1024];
+
+    initSDHC();
+    // ACMD23 input data.
+    setupDataForACmd("00");
+    // CMD25 input data.
+    setupDataForCmd("00");
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        // Return not-busy on first loop in waitWhileBusy() and then successful write response token.
+        m_sd.spi().setInboundFromString("FF");
+        m_sd.spi().setInboundFromString("05");
+    }
+    // Sending of stop transmission token.
+    m_sd.spi().setInboundFromString("FF");
+    // CMD13 input data with successful R2 response.
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("00");
+
+    // The second vector straddles the two blocks.
+    setupVectors(buffer, 256, 512, 256);
+    memset(m_vectors[0].pBuffer, 0x11, 256);
+    memset(m_vectors[1].pBuffer, 0x11, 256);
+    memset((uint8_t*)m_vectors[1].pBuffer + 256, 0x22, 256);
+    memset(m_vectors[2].pBuffer, 0x22, 256);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_writev(m_vectors, 3, 42));
+
+    validateACmd(23, 2);
+    validateSelect();
+    validateCmdPacket(25, 42);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x11);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x22);
+    validateFFBytes(1);
+    STRCMP_EQUAL("FD", m_sd.spi().getOutboundAsString(m_byteIndex++, 1));
+    validateDeselect();
+    validateCmd(13, 0, 1);
+
+    // Each block should have been sent with a single DMA transfer.
+    LONGS_EQUAL(2, m_sd.spi().getAsyncTransferCount());
+    LONGS_EQUAL(0, m_sd.maximumWriteRetryCount());
+}
+
+TEST(DiskVector, DiskWritev_SingleBlock_ShouldStillUseCMD25_ShouldSucceed)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    // ACMD23 input data.
+    setupDataForACmd("00");
+    // CMD25 input data.
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("FF");
+    m_sd.spi().setInboundFromString("05");
+    // Sending of stop transmission token.
+    m_sd.spi().setInboundFromString("FF");
+    // CMD13 input data with successful R2 response.
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("00");
+
+    memset(buffer, 0xAD, sizeof(buffer));
+    setupVectors(buffer, 4, 500, 8);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_writev(m_vectors, 3, 42));
+
+    validateACmd(23, 1);
+    validateSelect();
+    validateCmdPacket(25, 42);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0xAD);
+    validateFFBytes(1);
+    STRCMP_EQUAL("FD", m_sd.spi().getOutboundAsString(m_byteIndex++, 1));
+    validateDeselect();
+    validateCmd(13, 0, 1);
+}
+
+TEST(DiskVector, DiskWritev_WriteErrorOnSecondBlock_ShouldUseACMD22ToRewind_GetLogged_GetCounted)
+{
+    uint8_t buffer[1024];
+
+    initSDHC();
+    // ACMD23 input data.
+    setupDataForACmd("00");
+    // CMD25 input data.
+    setupDataForCmd("00");
+    // First block accepted.
+    m_sd.spi().setInboundFromString("FF");
+    m_sd.spi().setInboundFromString("05");
+    // Second block returns write error.
+    m_sd.spi().setInboundFromString("FF");
+    m_sd.spi().setInboundFromString("0D");
+    // CMD12 input data with extra padding byte.
+    m_sd.spi().setInboundFromString("00");
+    m_sd.spi().setInboundFromString("FF");
+    m_sd.spi().setInboundFromString("FF");
+    m_sd.spi().setInboundFromString("00");
+    // ACMD22 returns that 1 block was successfully written.
+    setupDataForACmd("00");
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock((uint32_t)1);
+    // Retry from second block.
+    setupDataForACmd("00");
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("FF");
+    m_sd.spi().setInboundFromString("05");
+    m_sd.spi().setInboundFromString("FF");
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("00");
+
+    setupVectors(buffer, 256, 512, 256);
+    memset(m_vectors[0].pBuffer, 0x11, 256);
+    memset(m_vectors[1].pBuffer, 0x11, 256);
+    memset((uint8_t*)m_vectors[1].pBuffer + 256, 0x22, 256);
+    memset(m_vectors[2].pBuffer, 0x22, 256);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_writev(m_vectors, 3, 42));
+
+    // First attempt which gets write error on second block.
+    validateACmd(23, 2);
+    validateSelect();
+    validateCmdPacket(25, 42);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x11);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x22);
+    validateDeselect();
+    validateCmd(12, 0);
+    // Should send ACMD22 (CMD55 + CMD22) to determine blocks written.
+    validateCmd(55);
+    validateSelect();
+    validateCmdPacket(22);
+    validateFFBytes(1+4+2);
+    validateDeselect();
+
+    // Retry from second block.
+    validateACmd(23, 1);
+    validateSelect();
+    validateCmdPacket(25, 43);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x22);
+    validateFFBytes(1);
+    STRCMP_EQUAL("FD", m_sd.spi().getOutboundAsString(m_byteIndex++, 1));
+    validateDeselect();
+    validateCmd(13, 0, 1);
+
+    LONGS_EQUAL(1, m_sd.maximumWriteRetryCount());
+    LONGS_EQUAL(1, m_sd.transmitResponseErrorCount());
+
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[512];
+    snprintf(expectedOutput, sizeof(expectedOutput),
+             "transmitDataBlock(FC,%X,512) - Data Response=0x0D\n"
+             "disk_writev(%X,3,42) - transmitDataBlock failed. block=43\n",
+             (uint32_t)(size_t)m_vectors[1].pBuffer + 256, (uint32_t)(size_t)m_vectors);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
@@ -27,6 +27,51 @@ TEST_GROUP_BASE(DiskWrite,SDFileSystemBase)
         // Return indicated R1 response.
         m_sd.spi().setInboundFromString(pR1Response);
     }
+
+    void setupDataForMultiBlockWrite(uint32_t blockCount)
+    {
+        // ACMD23 input data.
+        setupDataForACmd("00");
+        // CMD25 input data.
+        setupDataForCmd("00");
+        for (uint32_t i = 0 ; i < blockCount ; i++)
+        {
+            // Return not-busy on first loop in waitWhileBusy().
+            m_sd.spi().setInboundFromString("FF");
+            // Return successful write response token.
+            m_sd.spi().setInboundFromString("05");
+        }
+        // Sending of stop transmission token.
+        // Return not-busy on first loop in waitWhileBusy().
+        m_sd.spi().setInboundFromString("FF");
+        // CMD13 input data with successful R2 response.
+        setupDataForCmd("00");
+        m_sd.spi().setInboundFromString("00");
+    }
+
+    void validateDataBlockWithCrcOf(uint8_t tokenByte, uint8_t fillByte, uint8_t crcFillByte)
+    {
+        uint8_t block[512];
+        memset(block, crcFillByte, sizeof(block));
+        uint16_t crc = SDCRC::crc16(block, sizeof(block));
+
+        char expected[2*(1 + 512 + 2) + 1];
+        char* pCurr = expected;
+        *pCurr++ = m_hexDigits[tokenByte >> 4];
+        *pCurr++ = m_hexDigits[tokenByte & 0xF];
+        for (int i = 0 ; i < 512 ; i++)
+        {
+            *pCurr++ = m_hexDigits[fillByte >> 4];
+            *pCurr++ = m_hexDigits[fillByte & 0xF];
+        }
+        snprintf(pCurr, 5, "%04X", crc);
+
+        STRCMP_EQUAL(expected, m_sd.spi().getOutboundAsString(m_byteIndex, 1 + 512 + 2));
+        m_byteIndex += 1 + 512 + 2;
+
+        // Should have sent one 0xFF byte to retrieve write response token.
+        validateFFBytes(1);
+    }
 };
 
 
@@ -41,7 +86,7 @@ TEST(DiskWrite, DiskWrite_AttemptBeforeInit_ShouldFail_GetLogged)
 
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
-    snprintf(expectedOutput, sizeof(expectedOutput), "disk_write(%08X,42,1) - Attempt to write uninitialized drive\n",
+    snprintf(expectedOutput, sizeof(expectedOutput), "disk_write(%X,42,1) - Attempt to write uninitialized drive\n",
              (uint32_t)(size_t)buffer);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
 }
@@ -55,7 +100,7 @@ TEST(DiskWrite, DiskWrite_AttemptToWrite0Blocks_ShouldFail_GetLogged)
 
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
-    snprintf(expectedOutput, sizeof(expectedOutput), "disk_write(%08X,42,0) - Attempt to write 0 blocks\n",
+    snprintf(expectedOutput, sizeof(expectedOutput), "disk_write(%X,42,0) - Attempt to write 0 blocks\n",
              (uint32_t)(size_t)buffer);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
 }
@@ -270,7 +315,7 @@ TEST(DiskWrite, DiskWrite_SingleBlock_ForceWaitWhileBusyToTimeout_ShouldRetry_Lo
     char expectedOutput[256];
     snprintf(expectedOutput, sizeof(expectedOutput),
              "waitWhileBusy(2) - Time out. Response=0x00\n"
-             "transmitDataBlock(FE,%08X,512) - Time out after 500ms\n"
+             "transmitDataBlock(FE,%X,512) - Time out after 500ms\n"
              "disk_write(%X,42,1) - transmitDataBlock failed\n",
              (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer);
@@ -390,10 +435,10 @@ TEST(DiskWrite, DiskWrite_SingleBlock_ForceWaitWhileBusyToTimeoutOn2Blocks_Shoul
     char expectedOutput[512];
     snprintf(expectedOutput, sizeof(expectedOutput),
              "waitWhileBusy(2) - Time out. Response=0x00\n"
-             "transmitDataBlock(FE,%08X,512) - Time out after 500ms\n"
+             "transmitDataBlock(FE,%X,512) - Time out after 500ms\n"
              "disk_write(%X,42,1) - transmitDataBlock failed\n"
              "waitWhileBusy(2) - Time out. Response=0x00\n"
-             "transmitDataBlock(FE,%08X,512) - Time out after 500ms\n"
+             "transmitDataBlock(FE,%X,512) - Time out after 500ms\n"
              "disk_write(%X,43,1) - transmitDataBlock failed\n",
              (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer,
@@ -465,7 +510,7 @@ TEST(DiskWrite, DiskWrite_SingleBlock_FailTransmitDataBlockWithInvalidCRC_Should
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "transmitDataBlock(FE,%08X,512) - Data Response=0x0B\n"
+             "transmitDataBlock(FE,%X,512) - Data Response=0x0B\n"
              "disk_write(%X,42,1) - transmitDataBlock failed\n",
              (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer);
@@ -549,11 +594,11 @@ TEST(DiskWrite, DiskWrite_SingleBlock_ForceTransmitDataBlockToFailCRC3Times_Shou
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[512];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "transmitDataBlock(FE,%08X,512) - Data Response=0x0B\n"
+             "transmitDataBlock(FE,%X,512) - Data Response=0x0B\n"
              "disk_write(%X,42,1) - transmitDataBlock failed\n"
-             "transmitDataBlock(FE,%08X,512) - Data Response=0x0B\n"
+             "transmitDataBlock(FE,%X,512) - Data Response=0x0B\n"
              "disk_write(%X,42,1) - transmitDataBlock failed\n"
-             "transmitDataBlock(FE,%08X,512) - Data Response=0x0B\n"
+             "transmitDataBlock(FE,%X,512) - Data Response=0x0B\n"
              "disk_write(%X,42,1) - transmitDataBlock failed\n",
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
@@ -625,7 +670,7 @@ TEST(DiskWrite, DiskWrite_SingleBlock_FailTransmitDataBlockWithTransferError_Sho
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "transmitDataBlock(FE,%08X,512) - SPI transfer failed\n"
+             "transmitDataBlock(FE,%X,512) - SPI transfer failed\n"
              "disk_write(%X,42,1) - transmitDataBlock failed\n",
              (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer);
@@ -747,9 +792,9 @@ TEST(DiskWrite, DiskWrite_SingleBlock_FailTransmitDataBlockWithTransferErrorOnTw
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[512];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "transmitDataBlock(FE,%08X,512) - SPI transfer failed\n"
+             "transmitDataBlock(FE,%X,512) - SPI transfer failed\n"
              "disk_write(%X,42,1) - transmitDataBlock failed\n"
-             "transmitDataBlock(FE,%08X,512) - SPI transfer failed\n"
+             "transmitDataBlock(FE,%X,512) - SPI transfer failed\n"
              "disk_write(%X,43,1) - transmitDataBlock failed\n",
              (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer,
@@ -832,11 +877,11 @@ TEST(DiskWrite, DiskWrite_SingleBlock_ForceTransmitDataBlockToFailTransfer3Times
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[512];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "transmitDataBlock(FE,%08X,512) - SPI transfer failed\n"
+             "transmitDataBlock(FE,%X,512) - SPI transfer failed\n"
              "disk_write(%X,42,1) - transmitDataBlock failed\n"
-             "transmitDataBlock(FE,%08X,512) - SPI transfer failed\n"
+             "transmitDataBlock(FE,%X,512) - SPI transfer failed\n"
              "disk_write(%X,42,1) - transmitDataBlock failed\n"
-             "transmitDataBlock(FE,%08X,512) - SPI transfer failed\n"
+             "transmitDataBlock(FE,%X,512) - SPI transfer failed\n"
              "disk_write(%X,42,1) - transmitDataBlock failed\n",
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
@@ -1382,6 +1427,8 @@ TEST(DiskWrite, DiskWrite_MultiBlock_FailDataBlockCrcOnceOnEachBlock_ShouldRetry
     validateFFBytes(1);
     // Should send start block token, buffer data, and CRC.
     validateDataBlock(0xFC, 0x44);
+    // The fourth CRC error in quick succession should halve the SPI clock rate before the retry.
+    validateFrequency(12500000);
     // Should send CMD12 to stop write because of the error.
     validateDeselect();
     validateCmd(12, 0);
@@ -1409,19 +1456,22 @@ TEST(DiskWrite, DiskWrite_MultiBlock_FailDataBlockCrcOnceOnEachBlock_ShouldRetry
     LONGS_EQUAL(1, m_sd.maximumWriteRetryCount());
     // A total of 4 CRC error responses.
     LONGS_EQUAL(4, m_sd.transmitResponseErrorCount());
+    LONGS_EQUAL(1, m_sd.frequencyFallbackCount());
+    LONGS_EQUAL(12500000, m_sd.currentFrequency());
 
     // Verify error log output.
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[1024];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "transmitDataBlock(FC,%08X,512) - Data Response=0x0B\n"
-             "disk_write(%08X,42,4) - transmitDataBlock failed. block=42\n"
-             "transmitDataBlock(FC,%08X,512) - Data Response=0x0B\n"
-             "disk_write(%08X,42,4) - transmitDataBlock failed. block=43\n"
-             "transmitDataBlock(FC,%08X,512) - Data Response=0x0B\n"
-             "disk_write(%08X,42,4) - transmitDataBlock failed. block=44\n"
-             "transmitDataBlock(FC,%08X,512) - Data Response=0x0B\n"
-             "disk_write(%08X,42,4) - transmitDataBlock failed. block=45\n",
+             "transmitDataBlock(FC,%X,512) - Data Response=0x0B\n"
+             "disk_write(%X,42,4) - transmitDataBlock failed. block=42\n"
+             "transmitDataBlock(FC,%X,512) - Data Response=0x0B\n"
+             "disk_write(%X,42,4) - transmitDataBlock failed. block=43\n"
+             "transmitDataBlock(FC,%X,512) - Data Response=0x0B\n"
+             "disk_write(%X,42,4) - transmitDataBlock failed. block=44\n"
+             "transmitDataBlock(FC,%X,512) - Data Response=0x0B\n"
+             "recordCrcError() - Falling back from 25000000Hz to 12500000Hz\n"
+             "disk_write(%X,42,4) - transmitDataBlock failed. block=45\n",
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer + 1*512, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer + 2*512, (uint32_t)(size_t)buffer,
@@ -1528,12 +1578,12 @@ TEST(DiskWrite, DiskWrite_MultiBlock_FailDataBlockCrcForFirstBlockThreeTimes_Sho
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[1024];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "transmitDataBlock(FC,%08X,512) - Data Response=0x0B\n"
-             "disk_write(%08X,42,2) - transmitDataBlock failed. block=42\n"
-             "transmitDataBlock(FC,%08X,512) - Data Response=0x0B\n"
-             "disk_write(%08X,42,2) - transmitDataBlock failed. block=42\n"
-             "transmitDataBlock(FC,%08X,512) - Data Response=0x0B\n"
-             "disk_write(%08X,42,2) - transmitDataBlock failed. block=42\n",
+             "transmitDataBlock(FC,%X,512) - Data Response=0x0B\n"
+             "disk_write(%X,42,2) - transmitDataBlock failed. block=42\n"
+             "transmitDataBlock(FC,%X,512) - Data Response=0x0B\n"
+             "disk_write(%X,42,2) - transmitDataBlock failed. block=42\n"
+             "transmitDataBlock(FC,%X,512) - Data Response=0x0B\n"
+             "disk_write(%X,42,2) - transmitDataBlock failed. block=42\n",
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer);
@@ -1632,8 +1682,8 @@ TEST(DiskWrite, DiskWrite_MultiBlock_FailDataBlockTransferOnFirstBlock_ShouldRet
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[1024];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "transmitDataBlock(FC,%08X,512) - SPI transfer failed\n"
-             "disk_write(%08X,42,2) - transmitDataBlock failed. block=42\n",
+             "transmitDataBlock(FC,%X,512) - SPI transfer failed\n"
+             "disk_write(%X,42,2) - transmitDataBlock failed. block=42\n",
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
 }
@@ -1734,12 +1784,12 @@ TEST(DiskWrite, DiskWrite_MultiBlock_FailDataBlockTransferForFirstBlockThreeTime
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[1024];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "transmitDataBlock(FC,%08X,512) - SPI transfer failed\n"
-             "disk_write(%08X,42,2) - transmitDataBlock failed. block=42\n"
-             "transmitDataBlock(FC,%08X,512) - SPI transfer failed\n"
-             "disk_write(%08X,42,2) - transmitDataBlock failed. block=42\n"
-             "transmitDataBlock(FC,%08X,512) - SPI transfer failed\n"
-             "disk_write(%08X,42,2) - transmitDataBlock failed. block=42\n",
+             "transmitDataBlock(FC,%X,512) - SPI transfer failed\n"
+             "disk_write(%X,42,2) - transmitDataBlock failed. block=42\n"
+             "transmitDataBlock(FC,%X,512) - SPI transfer failed\n"
+             "disk_write(%X,42,2) - transmitDataBlock failed. block=42\n"
+             "transmitDataBlock(FC,%X,512) - SPI transfer failed\n"
+             "disk_write(%X,42,2) - transmitDataBlock failed. block=42\n",
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer);
@@ -1883,8 +1933,8 @@ TEST(DiskWrite, DiskWrite_MultiBlock_FailDataBlockWithWriteError_RewindBlockPoin
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[1024];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "transmitDataBlock(FC,%08X,512) - Data Response=0x0D\n"
-             "disk_write(%08X,42,4) - transmitDataBlock failed. block=44\n",
+             "transmitDataBlock(FC,%X,512) - Data Response=0x0D\n"
+             "disk_write(%X,42,4) - transmitDataBlock failed. block=44\n",
              (uint32_t)(size_t)buffer + 2*512, (uint32_t)(size_t)buffer);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
 }
@@ -1952,10 +2002,10 @@ TEST(DiskWrite, DiskWrite_MultiBlock_FailACMD22DuringWriteFailureRecovery_Should
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[1024];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "transmitDataBlock(FC,%08X,512) - Data Response=0x0D\n"
-             "disk_write(%08X,42,2) - transmitDataBlock failed. block=43\n"
+             "transmitDataBlock(FC,%X,512) - Data Response=0x0D\n"
+             "disk_write(%X,42,2) - transmitDataBlock failed. block=43\n"
              "sendCommandAndReceiveDataBlock(ACMD22,0,X,4) - ACMD22 returned 0x04\n"
-             "disk_write(%08X,42,2) - Failed to retrieve written block count.\n",
+             "disk_write(%X,42,2) - Failed to retrieve written block count.\n",
              (uint32_t)(size_t)buffer + 1*512,
              (uint32_t)(size_t)buffer,
              (uint32_t)(size_t)buffer);
@@ -2085,8 +2135,178 @@ TEST(DiskWrite, DiskWrite_MultiBlock_ReturnTooLargeBlockCountInACMD22Call_Should
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[1024];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "transmitDataBlock(FC,%08X,512) - Data Response=0x0D\n"
-             "disk_write(%08X,42,2) - transmitDataBlock failed. block=43\n",
+             "transmitDataBlock(FC,%X,512) - Data Response=0x0D\n"
+             "disk_write(%X,42,2) - transmitDataBlock failed. block=43\n",
              (uint32_t)(size_t)buffer + 1*512, (uint32_t)(size_t)buffer);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
 }
+
+TEST(DiskWrite, DiskWrite_MultiBlock_DelayedTransferCompletion_ShouldSendEachBlockWithAsyncTransfer)
+{
+    uint8_t buffer[3*512];
+
+    initSDHC();
+    setupDataForMultiBlockWrite(3);
+    // Make the mock report that each block transfer is still in flight for a while.
+    m_sd.spi().setTransferCompletionDelay(10);
+
+    // Fill the write buffer with data to write.
+    memset(buffer, 0x11, 512);
+    memset(buffer + 1*512, 0x22, 512);
+    memset(buffer + 2*512, 0x33, 512);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 3));
+
+    // Should send ACDM23 to start write process.  Argument is block count.
+    validateACmd(23, 3);
+    validateSelect();
+    // Should send CMD25 to start write process.  Argument is block number.
+    validateCmdPacket(25, 42);
+    // Each block should be sent with no extra SPI traffic between the waitWhileBusy(), token, data, CRC, and response.
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x11);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x22);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x33);
+    // Should have sent one 0xFF byte in waitWhileBusy().
+    validateFFBytes(1);
+    // Should send stop transmission token.
+    STRCMP_EQUAL("FD", m_sd.spi().getOutboundAsString(m_byteIndex++, 1));
+    // Deselect as the write is now complete.
+    validateDeselect();
+    // Should send CMD13 to get R2 write status.
+    validateCmd(13, 0, 1);
+
+    // Each of the 3 data blocks should have been sent via its own asynchronous DMA transfer.
+    LONGS_EQUAL(3, m_sd.spi().getAsyncTransferCount());
+    LONGS_EQUAL(0, m_sd.maximumWriteRetryCount());
+}
+
+TEST(DiskWrite, DiskWrite_MultiBlock_ModifySecondBlockAfterFirstTransferStarts_ShouldCalculateSecondCrcDuringFirstTransfer)
+{
+    uint8_t       buffer[2*512];
+    BlockModifier modifier = { buffer + 512, 1, SPIDma::AsyncTransferStarted, 0x44, 0 };
+
+    initSDHC();
+    setupDataForMultiBlockWrite(2);
+    m_sd.spi().setTransferCompletionDelay(10);
+    m_sd.spi().setAsyncTransferHook(modifyBlockHook, &modifier);
+
+    // Fill the write buffer with data to write.
+    memset(buffer, 0x11, 512);
+    memset(buffer + 1*512, 0x22, 512);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 2));
+
+    validateACmd(23, 2);
+    validateSelect();
+    validateCmdPacket(25, 42);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x11);
+    // The CRC for the second block isn't calculated until the first block's DMA transfer has started so it matches
+    // the data that was modified at that time.
+    validateFFBytes(1);
+    validateDataBlockWithCrcOf(0xFC, 0x44, 0x44);
+    validateFFBytes(1);
+    STRCMP_EQUAL("FD", m_sd.spi().getOutboundAsString(m_byteIndex++, 1));
+    validateDeselect();
+    validateCmd(13, 0, 1);
+}
+
+TEST(DiskWrite, DiskWrite_MultiBlock_ModifySecondBlockAfterFirstTransferCompletes_ShouldHaveAlreadyCalculatedSecondCrc)
+{
+    uint8_t       buffer[2*512];
+    BlockModifier modifier = { buffer + 512, 1, SPIDma::AsyncTransferCompleted, 0x44, 0 };
+
+    initSDHC();
+    setupDataForMultiBlockWrite(2);
+    m_sd.spi().setTransferCompletionDelay(10);
+    m_sd.spi().setAsyncTransferHook(modifyBlockHook, &modifier);
+
+    // Fill the write buffer with data to write.
+    memset(buffer, 0x11, 512);
+    memset(buffer + 1*512, 0x22, 512);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 2));
+
+    validateACmd(23, 2);
+    validateSelect();
+    validateCmdPacket(25, 42);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x11);
+    // The CRC for the second block was calculated while the first block was still in flight so it reflects the
+    // original contents even though the data itself was modified before it was sent.
+    validateFFBytes(1);
+    validateDataBlockWithCrcOf(0xFC, 0x44, 0x22);
+    validateFFBytes(1);
+    STRCMP_EQUAL("FD", m_sd.spi().getOutboundAsString(m_byteIndex++, 1));
+    validateDeselect();
+    validateCmd(13, 0, 1);
+}
+
+TEST(DiskWrite, DiskWrite_MultiBlock_FailSecondBlockTransfer_ShouldRecalculateCrcOnRetry_GetLogged_GetCounted)
+{
+    uint8_t buffer[2*512];
+
+    initSDHC();
+
+    // Fail the second block with transfer error.
+    // ACMD23 input data.
+    setupDataForACmd("00");
+    // CMD25 input data.
+    setupDataForCmd("00");
+    // First block.
+    m_sd.spi().setInboundFromString("FF");
+    m_sd.spi().setInboundFromString("05");
+    // Second block.
+    m_sd.spi().setInboundFromString("FF");
+    // CMD12 input data.
+    setupDataForCmd12("00");
+    // Retry from second block as a multi-block write of 1 block.
+    setupDataForMultiBlockWrite(1);
+
+    // Fail the second call to transfer.
+    m_sd.spi().failTransferCall(2, 1);
+    m_sd.spi().setTransferCompletionDelay(10);
+
+    // Fill the write buffer with data to write.
+    memset(buffer, 0x11, 512);
+    memset(buffer + 1*512, 0x22, 512);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 2));
+
+    // First attempt which will fail transfer on second block.
+    validateACmd(23, 2);
+    validateSelect();
+    validateCmdPacket(25, 42);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x11);
+    validateFFBytes(1);
+    STRCMP_EQUAL("FC", m_sd.spi().getOutboundAsString(m_byteIndex++, 1));
+    validateDeselect();
+    validateCmd(12, 0);
+
+    // Retry from second block with freshly calculated CRC.
+    validateACmd(23, 1);
+    validateSelect();
+    validateCmdPacket(25, 43);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x22);
+    validateFFBytes(1);
+    STRCMP_EQUAL("FD", m_sd.spi().getOutboundAsString(m_byteIndex++, 1));
+    validateDeselect();
+    validateCmd(13, 0, 1);
+
+    LONGS_EQUAL(1, m_sd.maximumWriteRetryCount());
+    LONGS_EQUAL(1, m_sd.transmitTransferFailCount());
+
+    // Verify error log output.
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[1024];
+    snprintf(expectedOutput, sizeof(expectedOutput),
+             "transmitDataBlock(FC,%X,512) - SPI transfer failed\n"
+             "disk_write(%X,42,2) - transmitDataBlock failed. block=43\n",
+             (uint32_t)(size_t)(buffer + 512), (uint32_t)(size_t)buffer);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
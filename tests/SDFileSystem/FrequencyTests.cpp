@@ -0,0 +1,345 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "SDFileSystemBaseTests.h"
+
+
+TEST_GROUP_BASE(Frequency,SDFileSystemBase)
+{
+    void setupDataBlockFromBuffer(const uint8_t* pData, size_t size)
+    {
+        char* pAlloc = (char*)malloc(2 + size * 2 + 4 + 1);
+        char* pCurr = pAlloc;
+
+        // 0xFE starts read data block.
+        *pCurr++ = 'F';
+        *pCurr++ = 'E';
+        for (size_t i = 0 ; i < size ; i++)
+        {
+            *pCurr++ = m_hexDigits[pData[i] >> 4];
+            *pCurr++ = m_hexDigits[pData[i] & 0xF];
+        }
+        snprintf(pCurr, 5, "%04X", SDCRC::crc16(pData, size));
+        m_sd.spi().setInboundFromString(pAlloc);
+        free(pAlloc);
+    }
+
+    void setupDataForCmd9(bool supportsSwitch = true)
+    {
+        // 5.3.3 CSD Register - CCC of 0x5B5 includes class 10 (switch) and 0x1B5 doesn't.
+        uint8_t csd[16];
+        memset(csd, 0, sizeof(csd));
+        csd[0] = 0x40;
+        csd[4] = supportsSwitch ? 0x5B : 0x1B;
+        csd[5] = 0x50;
+        setupDataForCmd("00");
+        setupDataBlockFromBuffer(csd, sizeof(csd));
+    }
+
+    void setupDataForCmd6(bool supportsHighSpeed, uint8_t selectedFunction)
+    {
+        // 4.3.10.4 Switch Function Status - Byte 13 holds bits 407:400 (group 1 support) and byte 16 holds bits
+        // 383:376 (group 2 and group 1 function selection).
+        uint8_t status[64];
+        memset(status, 0, sizeof(status));
+        status[13] = supportsHighSpeed ? 0x03 : 0x01;
+        status[16] = selectedFunction;
+        setupDataForCmd("00");
+        setupDataBlockFromBuffer(status, sizeof(status));
+    }
+
+    void validateRegisterRead(uint8_t command, uint32_t argument, size_t size)
+    {
+        validateSelect();
+        validateCmdPacket(command, argument);
+        validateFFBytes(1 + size + 2);
+        validateDeselect();
+    }
+
+    void setupDataForReadWithCrcError()
+    {
+        // CMD10 input data with bad CRC on first attempt.
+        setupDataForCmd("00");
+        m_sd.spi().setInboundFromString("FE");
+        setupDataBlock(0xAD, 16, "BAAD");
+        // Retry is successful.
+        setupDataForCmd("00");
+        m_sd.spi().setInboundFromString("FE");
+        setupDataBlock(0xAD, 16);
+    }
+
+    void validateReadWithCrcError(uint32_t fallbackFrequency = 0)
+    {
+        validateSelect();
+        validateCmdPacket(10);
+        validateFFBytes(1 + 16 + 2);
+        if (fallbackFrequency)
+        {
+            validateFrequency(fallbackFrequency);
+        }
+        validateDeselect();
+        validateRegisterRead(10, 0, 16);
+    }
+};
+
+
+TEST(Frequency, SetMaximumFrequency_BelowMinimum_ShouldFail_GetLogged)
+{
+    validateConstructor();
+
+        LONGS_EQUAL(RES_PARERR, m_sd.setMaximumFrequency(399999));
+
+    m_sd.dumpErrorLog(stderr);
+    STRCMP_EQUAL("setMaximumFrequency(399999) - Frequency must be at least 400000Hz\n", printfSpy_GetLastOutput());
+}
+
+TEST(Frequency, DefaultMaximum_ShouldNotIssueCMD6)
+{
+    initSDHC();
+    LONGS_EQUAL(25000000, m_sd.currentFrequency());
+}
+
+TEST(Frequency, MaximumBelowDefaultSpeed_ShouldUseMaximumWithoutCMD6)
+{
+    validateConstructor();
+    LONGS_EQUAL(RES_OK, m_sd.setMaximumFrequency(12000000));
+    setupDataForInitSDHC();
+
+        LONGS_EQUAL(0, m_sd.disk_initialize());
+
+    validateInitSDHCCommands();
+    validateFrequency(12000000);
+    LONGS_EQUAL(0, settingsRemaining());
+}
+
+TEST(Frequency, HighSpeedCard_ShouldSwitchWithCMD6AndRunAt50MHz)
+{
+    validateConstructor();
+    LONGS_EQUAL(RES_OK, m_sd.setMaximumFrequency(100000000));
+    setupDataForInitSDHC();
+    setupDataForCmd9();
+    setupDataForCmd6(true, 0x01);
+    setupDataForCmd6(true, 0x01);
+
+        LONGS_EQUAL(0, m_sd.disk_initialize());
+
+    validateInitSDHCCommands();
+    validateRegisterRead(9, 0, 16);
+    validateRegisterRead(6, 0x00FFFFF1, 64);
+    validateRegisterRead(6, 0x80FFFFF1, 64);
+    validateFrequency(50000000);
+    LONGS_EQUAL(0, settingsRemaining());
+    LONGS_EQUAL(50000000, m_sd.currentFrequency());
+    LONGS_EQUAL(50000000 / 8, m_sd.spiBytesPerSecond());
+}
+
+TEST(Frequency, HighSpeedCard_ShouldBeLimitedToMaximumFrequency)
+{
+    validateConstructor();
+    LONGS_EQUAL(RES_OK, m_sd.setMaximumFrequency(40000000));
+    setupDataForInitSDHC();
+    setupDataForCmd9();
+    setupDataForCmd6(true, 0x01);
+    setupDataForCmd6(true, 0x01);
+
+        LONGS_EQUAL(0, m_sd.disk_initialize());
+
+    validateInitSDHCCommands();
+    validateRegisterRead(9, 0, 16);
+    validateRegisterRead(6, 0x00FFFFF1, 64);
+    validateRegisterRead(6, 0x80FFFFF1, 64);
+    validateFrequency(40000000);
+}
+
+TEST(Frequency, CardWithoutSwitchCommandClass_ShouldStayAt25MHzWithoutCMD6)
+{
+    validateConstructor();
+    LONGS_EQUAL(RES_OK, m_sd.setMaximumFrequency(50000000));
+    setupDataForInitSDHC();
+    setupDataForCmd9(false);
+
+        LONGS_EQUAL(0, m_sd.disk_initialize());
+
+    validateInitSDHCCommands();
+    validateRegisterRead(9, 0, 16);
+    validateFrequency(25000000);
+    LONGS_EQUAL(0, settingsRemaining());
+}
+
+TEST(Frequency, CardWithoutHighSpeedFunction_ShouldStayAt25MHzWithoutSwitching)
+{
+    validateConstructor();
+    LONGS_EQUAL(RES_OK, m_sd.setMaximumFrequency(50000000));
+    setupDataForInitSDHC();
+    setupDataForCmd9();
+    // Function 0xF in the selection field indicates that High-Speed can't be selected.
+    setupDataForCmd6(false, 0x0F);
+
+        LONGS_EQUAL(0, m_sd.disk_initialize());
+
+    validateInitSDHCCommands();
+    validateRegisterRead(9, 0, 16);
+    validateRegisterRead(6, 0x00FFFFF1, 64);
+    validateFrequency(25000000);
+    LONGS_EQUAL(0, settingsRemaining());
+}
+
+TEST(Frequency, FailedHighSpeedSwitch_ShouldStayAt25MHz_GetLogged)
+{
+    validateConstructor();
+    LONGS_EQUAL(RES_OK, m_sd.setMaximumFrequency(50000000));
+    setupDataForInitSDHC();
+    setupDataForCmd9();
+    setupDataForCmd6(true, 0x01);
+    setupDataForCmd6(true, 0x0F);
+
+        LONGS_EQUAL(0, m_sd.disk_initialize());
+
+    validateInitSDHCCommands();
+    validateRegisterRead(9, 0, 16);
+    validateRegisterRead(6, 0x00FFFFF1, 64);
+    validateRegisterRead(6, 0x80FFFFF1, 64);
+    validateFrequency(25000000);
+    m_sd.dumpErrorLog(stderr);
+    STRCMP_EQUAL("switchToHighSpeed() - CMD6 switch selected function 0xF\n", printfSpy_GetLastOutput());
+}
+
+TEST(Frequency, FailedCMD6_ShouldStayAt25MHz_GetLogged)
+{
+    validateConstructor();
+    LONGS_EQUAL(RES_OK, m_sd.setMaximumFrequency(50000000));
+    setupDataForInitSDHC();
+    setupDataForCmd9();
+    // CMD6 input data.  Return illegal command.
+    setupDataForCmd("04");
+
+        LONGS_EQUAL(0, m_sd.disk_initialize());
+
+    validateInitSDHCCommands();
+    validateRegisterRead(9, 0, 16);
+    validateSelect();
+    validateCmdPacket(6, 0x00FFFFF1);
+    validateDeselect();
+    validateFrequency(25000000);
+    m_sd.dumpErrorLog(stderr);
+    // The address of the status buffer on the stack is part of the first log entry so only check the tail.
+    CHECK_TRUE(NULL != strstr(printfSpy_GetLastOutput(), "- CMD6 returned 0x04\nswitchToHighSpeed() - CMD6 check failed\n"));
+}
+
+TEST(Frequency, CrcErrorBurst_ShouldHalveFrequency_GetLogged_GetCounted)
+{
+    uint8_t cid[16];
+
+    initSDHC();
+    for (int i = 0 ; i < 4 ; i++)
+    {
+        setupDataForReadWithCrcError();
+    }
+
+    for (int i = 0 ; i < 4 ; i++)
+    {
+        LONGS_EQUAL(RES_OK, m_sd.getCID(cid, sizeof(cid)));
+    }
+
+    validateReadWithCrcError();
+    validateReadWithCrcError();
+    validateReadWithCrcError();
+    validateReadWithCrcError(12500000);
+    LONGS_EQUAL(12500000, m_sd.currentFrequency());
+    LONGS_EQUAL(12500000 / 8, m_sd.spiBytesPerSecond());
+    LONGS_EQUAL(1, m_sd.frequencyFallbackCount());
+    LONGS_EQUAL(4, m_sd.receiveCrcErrorCount());
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[1024];
+    size_t offset = 0;
+    for (int i = 0 ; i < 4 ; i++)
+    {
+        offset += snprintf(expectedOutput + offset, sizeof(expectedOutput) - offset,
+                           "verifyDataBlockCrc(%X,16) - Invalid CRC. Expected=0xBAAD Actual=0x6ADB\n"
+                           "%s"
+                           "sendCommandAndReceiveDataBlock(CMD10,0,%X,16) - receiveDataBlock failed\n",
+                           (uint32_t)(size_t)cid,
+                           i == 3 ? "recordCrcError() - Falling back from 25000000Hz to 12500000Hz\n" : "",
+                           (uint32_t)(size_t)cid);
+    }
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
+
+TEST(Frequency, CrcErrorsSpreadOverTime_ShouldNotChangeFrequency)
+{
+    uint8_t cid[16];
+
+    initSDHC();
+    m_sd.crcErrorTimer().setElapsedTimePerCall(1001);
+    for (int i = 0 ; i < 4 ; i++)
+    {
+        setupDataForReadWithCrcError();
+    }
+
+    for (int i = 0 ; i < 4 ; i++)
+    {
+        LONGS_EQUAL(RES_OK, m_sd.getCID(cid, sizeof(cid)));
+        validateReadWithCrcError();
+    }
+
+    LONGS_EQUAL(25000000, m_sd.currentFrequency());
+    LONGS_EQUAL(0, m_sd.frequencyFallbackCount());
+    LONGS_EQUAL(4, m_sd.receiveCrcErrorCount());
+}
+
+TEST(Frequency, CrcErrorBurstAtMinimumFrequency_ShouldNotGoLower)
+{
+    uint8_t cid[16];
+
+    validateConstructor();
+    LONGS_EQUAL(RES_OK, m_sd.setMaximumFrequency(400000));
+    setupDataForInitSDHC();
+    LONGS_EQUAL(0, m_sd.disk_initialize());
+    validateInitSDHCCommands();
+    validateFrequency(400000);
+    for (int i = 0 ; i < 4 ; i++)
+    {
+        setupDataForReadWithCrcError();
+    }
+
+    for (int i = 0 ; i < 4 ; i++)
+    {
+        LONGS_EQUAL(RES_OK, m_sd.getCID(cid, sizeof(cid)));
+        validateReadWithCrcError();
+    }
+
+    LONGS_EQUAL(400000, m_sd.currentFrequency());
+    LONGS_EQUAL(0, m_sd.frequencyFallbackCount());
+}
+
+TEST(Frequency, DiskInitialize_ShouldRestoreNegotiatedFrequencyAfterFallback)
+{
+    uint8_t cid[16];
+
+    initSDHC();
+    for (int i = 0 ; i < 4 ; i++)
+    {
+        setupDataForReadWithCrcError();
+        LONGS_EQUAL(RES_OK, m_sd.getCID(cid, sizeof(cid)));
+        validateReadWithCrcError(i == 3 ? 12500000 : 0);
+    }
+    LONGS_EQUAL(12500000, m_sd.currentFrequency());
+    setupDataForInitSDHC();
+
+        LONGS_EQUAL(0, m_sd.disk_initialize());
+
+    validateInitSDHCCommands();
+    validateFrequency(25000000);
+    LONGS_EQUAL(25000000, m_sd.currentFrequency());
+}
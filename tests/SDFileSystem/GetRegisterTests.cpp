@@ -80,8 +80,8 @@ TEST(GetRegisters, GetCID_FailCommand_ShouldFail)
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "sendCommandAndReceiveDataBlock(CMD10,0,%08X,16) - CMD10 returned 0x04\n"
-             "getCID(%08X,16) - Register read failed\n",
+             "sendCommandAndReceiveDataBlock(CMD10,0,%X,16) - CMD10 returned 0x04\n"
+             "getCID(%X,16) - Register read failed\n",
              (uint32_t)(size_t)cid,
              (uint32_t)(size_t)cid);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
@@ -150,8 +150,8 @@ TEST(GetRegisters, GetCSD_FailCommand_ShouldFail)
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "sendCommandAndReceiveDataBlock(CMD9,0,%08X,16) - CMD9 returned 0x04\n"
-             "getCSD(%08X,16) - Register read failed\n",
+             "sendCommandAndReceiveDataBlock(CMD9,0,%X,16) - CMD9 returned 0x04\n"
+             "getCSD(%X,16) - Register read failed\n",
              (uint32_t)(size_t)csd,
              (uint32_t)(size_t)csd);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
@@ -203,7 +203,7 @@ TEST(GetRegisters, GetOCR_FailCommand_ShouldFail)
     m_sd.dumpErrorLog(stderr);
     char expectedOutput[256];
     snprintf(expectedOutput, sizeof(expectedOutput),
-             "getOCR(%08X) - Register read failed. Response=0x04\n",
+             "getOCR(%X) - Register read failed. Response=0x04\n",
              (uint32_t)(size_t)&ocr);
     STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
 }
@@ -0,0 +1,99 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <LatencyHistogram.h>
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+
+TEST_GROUP(LatencyHistogram)
+{
+    LatencyHistogram m_histogram;
+};
+
+
+TEST(LatencyHistogram, BucketForLatency_ShouldBeNumberOfSignificantBits)
+{
+    LONGS_EQUAL(0, LatencyHistogram::bucketForLatency(0));
+    LONGS_EQUAL(1, LatencyHistogram::bucketForLatency(1));
+    LONGS_EQUAL(2, LatencyHistogram::bucketForLatency(2));
+    LONGS_EQUAL(2, LatencyHistogram::bucketForLatency(3));
+    LONGS_EQUAL(3, LatencyHistogram::bucketForLatency(4));
+    LONGS_EQUAL(10, LatencyHistogram::bucketForLatency(1023));
+    LONGS_EQUAL(11, LatencyHistogram::bucketForLatency(1024));
+}
+
+TEST(LatencyHistogram, BucketForLatency_LongLatenciesShouldGoInLastBucket)
+{
+    LONGS_EQUAL(LATENCY_HISTOGRAM_BUCKETS - 1, LatencyHistogram::bucketForLatency(1 << 19));
+    LONGS_EQUAL(LATENCY_HISTOGRAM_BUCKETS - 1, LatencyHistogram::bucketForLatency(1 << 20));
+    LONGS_EQUAL(LATENCY_HISTOGRAM_BUCKETS - 1, LatencyHistogram::bucketForLatency(0xFFFFFFFF));
+}
+
+TEST(LatencyHistogram, BucketLowerBound_ShouldBeSmallestLatencyInBucket)
+{
+    LONGS_EQUAL(0, LatencyHistogram::bucketLowerBound(0));
+    LONGS_EQUAL(1, LatencyHistogram::bucketLowerBound(1));
+    LONGS_EQUAL(2, LatencyHistogram::bucketLowerBound(2));
+    LONGS_EQUAL(1024, LatencyHistogram::bucketLowerBound(11));
+}
+
+TEST(LatencyHistogram, Record_ShouldCountInBucketAndTrackTotalAndMaximum)
+{
+    m_histogram.record(0);
+    m_histogram.record(5);
+    m_histogram.record(6);
+    m_histogram.record(100);
+
+    LONGS_EQUAL(1, m_histogram.count(0));
+    LONGS_EQUAL(2, m_histogram.count(3));
+    LONGS_EQUAL(1, m_histogram.count(7));
+    LONGS_EQUAL(4, m_histogram.totalCount());
+    LONGS_EQUAL(100, m_histogram.maximum());
+}
+
+TEST(LatencyHistogram, Reset_ShouldClearEverything)
+{
+    m_histogram.record(5);
+    m_histogram.reset();
+
+    LONGS_EQUAL(0, m_histogram.count(3));
+    LONGS_EQUAL(0, m_histogram.totalCount());
+    LONGS_EQUAL(0, m_histogram.maximum());
+}
+
+TEST(LatencyHistogram, Percentile_EmptyHistogram_ShouldBeZero)
+{
+    LONGS_EQUAL(0, m_histogram.percentile(50));
+    LONGS_EQUAL(0, m_histogram.percentile(99));
+}
+
+TEST(LatencyHistogram, Percentile_ShouldBeUpperBoundOfBucketHoldingPercentile)
+{
+    for (int i = 0 ; i < 98 ; i++)
+    {
+        m_histogram.record(5);
+    }
+    m_histogram.record(100);
+    m_histogram.record(3000);
+
+    // 5us is in the 4-7us bucket.
+    LONGS_EQUAL(7, m_histogram.percentile(50));
+    LONGS_EQUAL(7, m_histogram.percentile(98));
+    // 100us is in the 64-127us bucket.
+    LONGS_EQUAL(127, m_histogram.percentile(99));
+    // Upper bound of the 2048-4095us bucket is capped to the maximum seen.
+    LONGS_EQUAL(3000, m_histogram.percentile(100));
+}
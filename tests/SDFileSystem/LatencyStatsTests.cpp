@@ -0,0 +1,153 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "SDFileSystemBaseTests.h"
+
+
+TEST_GROUP_BASE(LatencyStats,SDFileSystemBase)
+{
+    SDFileSystem::LatencyStats m_stats;
+
+    void setupDataForSingleBlockRead()
+    {
+        // CMD17 input data.
+        setupDataForCmd("00");
+        // 0xFE starts read data block.
+        m_sd.spi().setInboundFromString("FE");
+        setupDataBlock(0xAD, 512);
+    }
+
+    void validateSingleBlockRead()
+    {
+        validateSelect();
+        validateCmdPacket(17, 42);
+        validateFFBytes(1+512+2);
+        validateDeselect();
+    }
+};
+
+
+TEST(LatencyStats, Constructor_ShouldStartWithEmptyHistograms)
+{
+    validateConstructor();
+    m_sd.getLatencyStats(&m_stats);
+
+    LONGS_EQUAL(0, m_stats.diskRead.totalCount());
+    LONGS_EQUAL(0, m_stats.diskWrite.totalCount());
+    LONGS_EQUAL(0, m_stats.selectWait.totalCount());
+    LONGS_EQUAL(0, m_stats.programWait.totalCount());
+    LONGS_EQUAL(0, m_stats.receiveWait.totalCount());
+    LONGS_EQUAL(0, m_stats.statusCheck.totalCount());
+}
+
+TEST(LatencyStats, DiskRead_ShouldRecordReadSelectAndReceiveLatencies)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    m_sd.resetLatencyStats();
+    m_sd.latencyTimer().setElapsedTimePerCall(3);
+    setupDataForSingleBlockRead();
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+
+    validateSingleBlockRead();
+    m_sd.getLatencyStats(&m_stats);
+    // Mock timer advances 3ms between the start and end of disk_read().
+    LONGS_EQUAL(1, m_stats.diskRead.totalCount());
+    LONGS_EQUAL(3000, m_stats.diskRead.maximum());
+    LONGS_EQUAL(0, m_stats.diskWrite.totalCount());
+    // The wait for the block token and for the card to be ready for CMD17 are measured in SPI exchanges.
+    LONGS_EQUAL(1, m_stats.selectWait.totalCount());
+    LONGS_EQUAL(1, m_stats.receiveWait.totalCount());
+    LONGS_EQUAL(0, m_stats.receiveWait.maximum());
+    LONGS_EQUAL(0, m_stats.programWait.totalCount());
+    LONGS_EQUAL(0, m_stats.statusCheck.totalCount());
+}
+
+TEST(LatencyStats, DiskWrite_ShouldRecordWriteProgramAndStatusCheckLatencies)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    m_sd.resetLatencyStats();
+    // CMD24 input data.
+    setupDataForCmd("00");
+    // Return not-busy on first loop in waitWhileBusy().
+    m_sd.spi().setInboundFromString("FF");
+    // Return successful write response token.
+    m_sd.spi().setInboundFromString("05");
+    // CMD13 input data with successful R2 response.
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("00");
+    memset(buffer, 0xAD, sizeof(buffer));
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 1));
+
+    validateSelect();
+    validateCmdPacket(24, 42);
+    validateFFBytes(1);
+    validateDataBlock(0xFE, 0xAD);
+    validateDeselect();
+    validateCmd(13, 0, 1);
+    m_sd.getLatencyStats(&m_stats);
+    // The mock timer advances 1ms per read so the CMD13 nested within disk_write() adds another 2ms to it.
+    LONGS_EQUAL(1, m_stats.diskWrite.totalCount());
+    LONGS_EQUAL(3000, m_stats.diskWrite.maximum());
+    LONGS_EQUAL(1, m_stats.statusCheck.totalCount());
+    LONGS_EQUAL(1000, m_stats.statusCheck.maximum());
+    LONGS_EQUAL(2, m_stats.selectWait.totalCount());
+    LONGS_EQUAL(1, m_stats.programWait.totalCount());
+    LONGS_EQUAL(0, m_stats.diskRead.totalCount());
+    LONGS_EQUAL(0, m_stats.receiveWait.totalCount());
+}
+
+TEST(LatencyStats, GetLatencyStats_ShouldBeSnapshotWhichIsntUpdatedByLaterOperations)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    m_sd.resetLatencyStats();
+    setupDataForSingleBlockRead();
+    LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+    validateSingleBlockRead();
+    m_sd.getLatencyStats(&m_stats);
+
+    setupDataForSingleBlockRead();
+    LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+    validateSingleBlockRead();
+
+    LONGS_EQUAL(1, m_stats.diskRead.totalCount());
+    m_sd.getLatencyStats(&m_stats);
+    LONGS_EQUAL(2, m_stats.diskRead.totalCount());
+    LONGS_EQUAL(2, m_stats.diskRead.count(LatencyHistogram::bucketForLatency(1000)));
+}
+
+TEST(LatencyStats, ResetLatencyStats_ShouldClearAllHistograms)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    setupDataForSingleBlockRead();
+    LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+    validateSingleBlockRead();
+
+        m_sd.resetLatencyStats();
+
+    m_sd.getLatencyStats(&m_stats);
+    LONGS_EQUAL(0, m_stats.diskRead.totalCount());
+    LONGS_EQUAL(0, m_stats.diskRead.maximum());
+    LONGS_EQUAL(0, m_stats.selectWait.totalCount());
+    LONGS_EQUAL(0, m_stats.receiveWait.totalCount());
+}
@@ -0,0 +1,231 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "SDFileSystemBaseTests.h"
+
+// Size of buffer required to hold the specified number of cache lines.
+#define CACHE_BUFFER_SIZE(LINES) ((LINES) * (512 + sizeof(SectorCache::Line)) + 4)
+
+
+TEST_GROUP_BASE(ReadAhead,SDFileSystemBase)
+{
+    void setupDataForSingleBlockRead(uint8_t fillByte)
+    {
+        // CMD17 input data.
+        setupDataForCmd("00");
+        m_sd.spi().setInboundFromString("FE");
+        setupDataBlock(fillByte, 512);
+    }
+
+    void validateSingleBlockRead(uint32_t blockNumber)
+    {
+        validateSelect();
+        validateCmdPacket(17, blockNumber);
+        validateFFBytes(1+512+2);
+        validateDeselect();
+    }
+
+    void setupDataForMultiBlockRead(uint8_t firstFillByte, uint32_t blockCount)
+    {
+        // CMD18 input data.
+        setupDataForCmd("00");
+        for (uint32_t i = 0 ; i < blockCount ; i++)
+        {
+            m_sd.spi().setInboundFromString("FE");
+            setupDataBlock(firstFillByte + i, 512);
+        }
+        // CMD12 input data: extra padding byte and then R1 response.
+        m_sd.spi().setInboundFromString("FF");
+        m_sd.spi().setInboundFromString("00");
+    }
+
+    void validateMultiBlockRead(uint32_t blockNumber, uint32_t blockCount)
+    {
+        validateSelect();
+        validateCmdPacket(18, blockNumber);
+        validateFFBytes(blockCount*(1+512+2));
+        validateCmdPacket(12);
+        validateDeselect();
+    }
+
+    void enableCacheAndReadAhead(uint32_t windowSectors)
+    {
+        LONGS_EQUAL(RES_OK, m_sd.enableSectorCache(m_cacheBuffer, sizeof(m_cacheBuffer), 1));
+        LONGS_EQUAL(RES_OK, m_sd.setReadAheadWindow(windowSectors));
+    }
+
+    uint32_t m_cacheBuffer[CACHE_BUFFER_SIZE(8) / sizeof(uint32_t) + 1];
+};
+
+
+TEST(ReadAhead, SetReadAheadWindow_WithoutSectorCache_ShouldFail_GetLogged)
+{
+    initSDHC();
+
+        LONGS_EQUAL(RES_PARERR, m_sd.setReadAheadWindow(4));
+
+    m_sd.dumpErrorLog(stderr);
+    STRCMP_EQUAL("setReadAheadWindow(4) - Sector cache not enabled\n", printfSpy_GetLastOutput());
+}
+
+TEST(ReadAhead, SetReadAheadWindow_TooLarge_ShouldFail_GetLogged)
+{
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.enableSectorCache(m_cacheBuffer, sizeof(m_cacheBuffer), 1));
+
+        LONGS_EQUAL(RES_PARERR, m_sd.setReadAheadWindow(SDFILESYSTEM_READ_AHEAD_MAX_WINDOW + 1));
+
+    m_sd.dumpErrorLog(stderr);
+    STRCMP_EQUAL("setReadAheadWindow(17) - Window too large\n", printfSpy_GetLastOutput());
+}
+
+TEST(ReadAhead, SequentialSingleBlockReads_ShouldPrefetchWindowWithCMD18)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    enableCacheAndReadAhead(4);
+    setupDataForSingleBlockRead(0x10);
+    setupDataForMultiBlockRead(0x11, 4);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+    validateBuffer(buffer, sizeof(buffer), 0x10);
+        // First sequential miss should prefetch 43 - 46 with a single CMD18.
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 43, 1));
+    validateBuffer(buffer, sizeof(buffer), 0x11);
+    for (uint32_t i = 1 ; i < 4 ; i++)
+    {
+            LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 43 + i, 1));
+        validateBuffer(buffer, sizeof(buffer), 0x11 + i);
+    }
+
+    validateSingleBlockRead(42);
+    validateMultiBlockRead(43, 4);
+    STRCMP_EQUAL("", m_sd.spi().getOutboundAsString(m_byteIndex));
+    LONGS_EQUAL(1, m_sd.readAheadCount());
+    LONGS_EQUAL(4, m_sd.readAheadSectorCount());
+    LONGS_EQUAL(3, m_sd.sectorCacheHitCount());
+    LONGS_EQUAL(2, m_sd.sectorCacheMissCount());
+}
+
+TEST(ReadAhead, NonSequentialSingleBlockReads_ShouldNotPrefetch)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    enableCacheAndReadAhead(4);
+    setupDataForSingleBlockRead(0x10);
+    setupDataForSingleBlockRead(0x20);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 44, 1));
+
+    validateSingleBlockRead(42);
+    validateSingleBlockRead(44);
+    validateBuffer(buffer, sizeof(buffer), 0x20);
+    LONGS_EQUAL(0, m_sd.readAheadCount());
+}
+
+TEST(ReadAhead, WindowOf0_ShouldDisablePrefetch)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    enableCacheAndReadAhead(0);
+    setupDataForSingleBlockRead(0x10);
+    setupDataForSingleBlockRead(0x11);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 43, 1));
+
+    validateSingleBlockRead(42);
+    validateSingleBlockRead(43);
+    LONGS_EQUAL(0, m_sd.readAheadCount());
+}
+
+TEST(ReadAhead, Prefetch_ShouldStopAtAlreadyCachedDirtySector)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    enableCacheAndReadAhead(4);
+    memset(buffer, 0x55, sizeof(buffer));
+    LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 45, 1));
+    setupDataForSingleBlockRead(0x10);
+    setupDataForMultiBlockRead(0x11, 2);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 43, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 44, 1));
+    validateBuffer(buffer, sizeof(buffer), 0x12);
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 45, 1));
+    validateBuffer(buffer, sizeof(buffer), 0x55);
+
+    validateSingleBlockRead(42);
+    validateMultiBlockRead(43, 2);
+    STRCMP_EQUAL("", m_sd.spi().getOutboundAsString(m_byteIndex));
+    LONGS_EQUAL(2, m_sd.readAheadSectorCount());
+}
+
+TEST(ReadAhead, Prefetch_ShouldNotRecycleLinesAllocatedInSameWindow)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    // 2 sets of 1 way so that a window of 4 would wrap around onto lines already used for this prefetch.
+    LONGS_EQUAL(RES_OK, m_sd.enableSectorCache(m_cacheBuffer, CACHE_BUFFER_SIZE(2), 1));
+    LONGS_EQUAL(RES_OK, m_sd.setReadAheadWindow(4));
+    setupDataForSingleBlockRead(0x10);
+    setupDataForMultiBlockRead(0x11, 2);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 43, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 44, 1));
+    validateBuffer(buffer, sizeof(buffer), 0x12);
+
+    validateSingleBlockRead(42);
+    validateMultiBlockRead(43, 2);
+    LONGS_EQUAL(2, m_sd.readAheadSectorCount());
+}
+
+TEST(ReadAhead, PrefetchFails_ShouldFallBackToSingleBlockRead_GetLogged)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    enableCacheAndReadAhead(4);
+    setupDataForSingleBlockRead(0x10);
+    // CMD18 input data with error as response code.
+    setupDataForCmd("04");
+    setupDataForSingleBlockRead(0x11);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 43, 1));
+
+    validateSingleBlockRead(42);
+    validateSelect();
+    validateCmdPacket(18, 43);
+    validateDeselect();
+    validateSingleBlockRead(43);
+    validateBuffer(buffer, sizeof(buffer), 0x11);
+    LONGS_EQUAL(0, m_sd.readAheadCount());
+    // Prefetched lines should have been discarded so 44 isn't a false hit and the next read-ahead can be issued.
+    setupDataForMultiBlockRead(0x12, 4);
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 44, 1));
+    validateMultiBlockRead(44, 4);
+    validateBuffer(buffer, sizeof(buffer), 0x12);
+
+    m_sd.dumpErrorLog(stderr);
+    CHECK_TRUE(strstr(printfSpy_GetLastOutput(), "Failed to prefetch 4 sectors\n") != NULL);
+}
@@ -0,0 +1,257 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "SDFileSystemBaseTests.h"
+
+
+TEST_GROUP_BASE(ReadStream,SDFileSystemBase)
+{
+    void setupDataForCmd18()
+    {
+        setupDataForCmd("00");
+    }
+
+    void setupDataForBlocks(uint8_t firstFillByte, uint32_t blockCount)
+    {
+        for (uint32_t i = 0 ; i < blockCount ; i++)
+        {
+            m_sd.spi().setInboundFromString("FE");
+            setupDataBlock(firstFillByte + i, 512);
+        }
+    }
+
+    void setupDataForCmd12()
+    {
+        // Extra padding byte and then R1 response.
+        m_sd.spi().setInboundFromString("FF");
+        m_sd.spi().setInboundFromString("00");
+    }
+
+    void validateCmd18(uint32_t blockNumber)
+    {
+        validateSelect();
+        validateCmdPacket(18, blockNumber);
+    }
+
+    void validateBlocks(uint32_t blockCount)
+    {
+        validateFFBytes(blockCount*(1+512+2));
+    }
+
+    void validateCmd12()
+    {
+        validateCmdPacket(12);
+        validateDeselect();
+    }
+
+    void validateBuffers(uint8_t* pBuffer, uint8_t firstFillByte, uint32_t blockCount)
+    {
+        for (uint32_t i = 0 ; i < blockCount ; i++)
+        {
+            validateBuffer(pBuffer + i * 512, 512, firstFillByte + i);
+        }
+    }
+};
+
+
+TEST(ReadStream, SequentialMultiBlockReads_ShouldContinueSingleCMD18)
+{
+    uint8_t buffer[2*512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setReadStreamIdleTimeout(10));
+    setupDataForCmd18();
+    setupDataForBlocks(0x10, 2);
+    setupDataForBlocks(0x12, 2);
+    setupDataForBlocks(0x14, 1);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 2));
+    validateBuffers(buffer, 0x10, 2);
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 44, 2));
+    validateBuffers(buffer, 0x12, 2);
+        // Single block reads can continue the stream too.
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 46, 1));
+    validateBuffers(buffer, 0x14, 1);
+
+    // The card should still be selected with no CMD12 sent.
+    validateCmd18(42);
+    validateBlocks(5);
+    STRCMP_EQUAL("", m_sd.spi().getOutboundAsString(m_byteIndex));
+    LONGS_EQUAL(0, settingsRemaining());
+    LONGS_EQUAL(2, m_sd.readStreamContinueCount());
+
+    // disk_sync() should stop the stream before waiting for the card to be idle.
+    setupDataForCmd12();
+    m_sd.spi().setInboundFromString("00");
+    m_sd.spi().setInboundFromString("FF");
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_sync());
+
+    validateCmd12();
+    validateSelect();
+    validateDeselect();
+}
+
+TEST(ReadStream, NonSequentialRead_ShouldStopStreamAndStartNewCMD18)
+{
+    uint8_t buffer[2*512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setReadStreamIdleTimeout(10));
+    setupDataForCmd18();
+    setupDataForBlocks(0x10, 2);
+    setupDataForCmd12();
+    setupDataForCmd18();
+    setupDataForBlocks(0x20, 2);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 2));
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 100, 2));
+
+    validateBuffers(buffer, 0x20, 2);
+    validateCmd18(42);
+    validateBlocks(2);
+    validateCmd12();
+    validateCmd18(100);
+    validateBlocks(2);
+    LONGS_EQUAL(0, m_sd.readStreamContinueCount());
+}
+
+TEST(ReadStream, NonSequentialSingleBlockRead_ShouldStopStreamAndUseCMD17)
+{
+    uint8_t buffer[2*512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setReadStreamIdleTimeout(10));
+    setupDataForCmd18();
+    setupDataForBlocks(0x10, 2);
+    setupDataForCmd12();
+    // CMD17 input data.
+    setupDataForCmd("00");
+    setupDataForBlocks(0x20, 1);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 2));
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 10, 1));
+
+    validateBuffers(buffer, 0x20, 1);
+    validateCmd18(42);
+    validateBlocks(2);
+    validateCmd12();
+    validateSelect();
+    validateCmdPacket(17, 10);
+    validateBlocks(1);
+    validateDeselect();
+}
+
+TEST(ReadStream, SequentialReadAfterIdleTimeout_ShouldStopStreamAndStartNewCMD18)
+{
+    uint8_t buffer[2*512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setReadStreamIdleTimeout(10));
+    m_sd.readStreamTimer().setElapsedTimePerCall(11);
+    setupDataForCmd18();
+    setupDataForBlocks(0x10, 2);
+    setupDataForCmd12();
+    setupDataForCmd18();
+    setupDataForBlocks(0x12, 2);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 2));
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 44, 2));
+
+    validateBuffers(buffer, 0x12, 2);
+    validateCmd18(42);
+    validateBlocks(2);
+    validateCmd12();
+    validateCmd18(44);
+    validateBlocks(2);
+    LONGS_EQUAL(0, m_sd.readStreamContinueCount());
+}
+
+TEST(ReadStream, WriteWhileStreamOpen_ShouldStopStreamFirst)
+{
+    uint8_t buffer[2*512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setReadStreamIdleTimeout(10));
+    setupDataForCmd18();
+    setupDataForBlocks(0x10, 2);
+    setupDataForCmd12();
+    // CMD24 input data.
+    setupDataForCmd("00");
+    // Return not-busy on first loop in waitWhileBusy().
+    m_sd.spi().setInboundFromString("FF");
+    // Return successful write response token.
+    m_sd.spi().setInboundFromString("05");
+    // CMD13 input data with successful R2 response.
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("00");
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 2));
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 44, 1));
+
+    validateCmd18(42);
+    validateBlocks(2);
+    validateCmd12();
+    validateSelect();
+    validateCmdPacket(24, 44);
+    validateFFBytes(1);
+    validateDataBlock(0xFE, 0x10);
+    validateDeselect();
+    validateCmd(13, 0, 1);
+}
+
+TEST(ReadStream, DisableWhileStreamOpen_ShouldStopStream)
+{
+    uint8_t buffer[2*512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setReadStreamIdleTimeout(10));
+    setupDataForCmd18();
+    setupDataForBlocks(0x10, 2);
+    setupDataForCmd12();
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 2));
+        LONGS_EQUAL(RES_OK, m_sd.setReadStreamIdleTimeout(0));
+
+    validateCmd18(42);
+    validateBlocks(2);
+    validateCmd12();
+}
+
+TEST(ReadStream, CMD12FailsWhenStoppingStream_ShouldLogAndStillStartNewCMD18)
+{
+    uint8_t buffer[2*512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setReadStreamIdleTimeout(10));
+    setupDataForCmd18();
+    setupDataForBlocks(0x10, 2);
+    // CMD12 padding byte and then R1 response with error.
+    m_sd.spi().setInboundFromString("FF");
+    m_sd.spi().setInboundFromString("04");
+    setupDataForCmd18();
+    setupDataForBlocks(0x20, 2);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 2));
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 100, 2));
+
+    validateBuffers(buffer, 0x20, 2);
+    validateCmd18(42);
+    validateBlocks(2);
+    validateCmd12();
+    validateCmd18(100);
+    validateBlocks(2);
+    m_sd.dumpErrorLog(stderr);
+    STRCMP_EQUAL("closeReadStream() - CMD12 returned 0x04. block=44\n", printfSpy_GetLastOutput());
+}
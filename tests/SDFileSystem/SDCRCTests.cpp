@@ -0,0 +1,243 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <string.h>
+#include <SDCRC.h>
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+
+typedef uint16_t (*Crc16Function)(const uint8_t* pData, size_t length, uint16_t crc);
+
+// Bit at a time CRC16-CCITT (x^16 + x^12 + x^5 + 1) straight from the SD specification to compare the kernels against.
+static uint16_t referenceCrc16(const uint8_t* pData, size_t length, uint16_t crc)
+{
+    while (length--)
+    {
+        crc ^= *pData++ << 8;
+        for (int bit = 0 ; bit < 8 ; bit++)
+        {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+
+TEST_GROUP(SDCRC)
+{
+    SDCRC::Crc16Kernel m_origKernel;
+    uint32_t           m_buffer[512 / sizeof(uint32_t)];
+
+    void setup()
+    {
+        m_origKernel = SDCRC::crc16Kernel();
+        fillBuffer(0x5A);
+    }
+
+    void teardown()
+    {
+        SDCRC::setCrc16Kernel(m_origKernel);
+    }
+
+    uint8_t* buffer()
+    {
+        return (uint8_t*)m_buffer;
+    }
+
+    void fillBuffer(uint32_t seed)
+    {
+        for (size_t i = 0 ; i < sizeof(m_buffer) ; i++)
+        {
+            buffer()[i] = (uint8_t)(seed + i * 31 + (i >> 3));
+        }
+    }
+
+    // Every possible 16-bit CRC carried in from a previous buffer.
+    void validateAllInitialCrcs(Crc16Function pCrc16)
+    {
+        for (uint32_t crc = 0 ; crc <= 0xFFFF ; crc++)
+        {
+            uint16_t expected = SDCRC::crc16Table(buffer(), 8, crc);
+            if (expected != pCrc16(buffer(), 8, crc))
+            {
+                LONGS_EQUAL(expected, pCrc16(buffer(), 8, crc));
+            }
+        }
+    }
+
+    // Every possible value of each pair of bytes in the 8 bytes which make up one slice-by-8 iteration.
+    void validateAllBytePairs(Crc16Function pCrc16)
+    {
+        for (size_t offset = 0 ; offset < 8 ; offset += 2)
+        {
+            fillBuffer(offset);
+            for (uint32_t value = 0 ; value <= 0xFFFF ; value++)
+            {
+                buffer()[offset] = value >> 8;
+                buffer()[offset + 1] = value & 0xFF;
+                uint16_t expected = SDCRC::crc16Table(buffer(), 8, 0);
+                if (expected != pCrc16(buffer(), 8, 0))
+                {
+                    LONGS_EQUAL(expected, pCrc16(buffer(), 8, 0));
+                }
+            }
+        }
+    }
+
+    // Every length from 4 to 512 bytes, continued in two pieces split at every word boundary.
+    void validateAllLengthsAndSplits(Crc16Function pCrc16)
+    {
+        for (size_t length = 4 ; length <= sizeof(m_buffer) ; length += 4)
+        {
+            uint16_t expected = SDCRC::crc16Table(buffer(), length, 0);
+            LONGS_EQUAL(expected, pCrc16(buffer(), length, 0));
+            for (size_t split = 4 ; split < length ; split += 4)
+            {
+                uint16_t crc = pCrc16(buffer(), split, 0);
+                LONGS_EQUAL(expected, pCrc16(buffer() + split, length - split, crc));
+            }
+        }
+    }
+
+    void validateKernel(Crc16Function pCrc16)
+    {
+        validateAllInitialCrcs(pCrc16);
+        validateAllBytePairs(pCrc16);
+        validateAllLengthsAndSplits(pCrc16);
+    }
+};
+
+
+TEST(SDCRC, Crc16Table_ShouldMatchBitwiseReference)
+{
+    for (size_t length = 4 ; length <= sizeof(m_buffer) ; length += 4)
+    {
+        LONGS_EQUAL(referenceCrc16(buffer(), length, 0), SDCRC::crc16Table(buffer(), length, 0));
+    }
+    for (uint32_t crc = 0 ; crc <= 0xFFFF ; crc += 0x0101)
+    {
+        LONGS_EQUAL(referenceCrc16(buffer(), 8, crc), SDCRC::crc16Table(buffer(), 8, crc));
+    }
+}
+
+TEST(SDCRC, Crc16Table_BlockOfAllFFs_ShouldMatchSpecificationExample)
+{
+    // Value from the SD specification's CRC16 example: 512 bytes of 0xFF have a CRC16 of 0x7FA1.
+    memset(m_buffer, 0xFF, sizeof(m_buffer));
+    LONGS_EQUAL(0x7FA1, SDCRC::crc16Table(buffer(), sizeof(m_buffer), 0));
+}
+
+TEST(SDCRC, Crc16SliceBy4_ShouldMatchTableKernel)
+{
+    validateKernel(SDCRC::crc16SliceBy4);
+}
+
+TEST(SDCRC, Crc16SliceBy8_ShouldMatchTableKernel)
+{
+    validateKernel(SDCRC::crc16SliceBy8);
+}
+
+TEST(SDCRC, SetCrc16Kernel_ShouldSwitchKernelUsedByCrc16)
+{
+    static const SDCRC::Crc16Kernel kernels[] = { SDCRC::CRC16_KERNEL_TABLE,
+                                                  SDCRC::CRC16_KERNEL_SLICE_BY_4,
+                                                  SDCRC::CRC16_KERNEL_SLICE_BY_8 };
+    uint16_t expected = SDCRC::crc16Table(buffer(), sizeof(m_buffer), 0);
+
+    for (size_t i = 0 ; i < sizeof(kernels)/sizeof(kernels[0]) ; i++)
+    {
+        CHECK_TRUE(SDCRC::setCrc16Kernel(kernels[i]));
+        LONGS_EQUAL(kernels[i], SDCRC::crc16Kernel());
+        LONGS_EQUAL(expected, SDCRC::crc16(buffer(), sizeof(m_buffer)));
+    }
+}
+
+TEST(SDCRC, SetCrc16Kernel_InvalidKernel_ShouldFailAndKeepCurrentKernel)
+{
+    CHECK_TRUE(SDCRC::setCrc16Kernel(SDCRC::CRC16_KERNEL_TABLE));
+    CHECK_FALSE(SDCRC::setCrc16Kernel((SDCRC::Crc16Kernel)3));
+    LONGS_EQUAL(SDCRC::CRC16_KERNEL_TABLE, SDCRC::crc16Kernel());
+}
+
+TEST(SDCRC, Crc16Copy_EveryCopyLengthToUnalignedDest_ShouldMatchCrc16AndOnlyCopyRequestedBytes)
+{
+    uint8_t dest[1 + 512 + 1];
+    uint16_t expected = SDCRC::crc16Table(buffer(), sizeof(m_buffer), 0x1234);
+
+    for (size_t copyLength = 0 ; copyLength <= sizeof(m_buffer) ; copyLength++)
+    {
+        memset(dest, 0xEE, sizeof(dest));
+        LONGS_EQUAL(expected, SDCRC::crc16Copy(dest + 1, buffer(), sizeof(m_buffer), copyLength, 0x1234));
+        CHECK_TRUE(0 == memcmp(buffer(), dest + 1, copyLength));
+        LONGS_EQUAL(0xEE, dest[0]);
+        LONGS_EQUAL(0xEE, dest[1 + copyLength]);
+    }
+}
+
+TEST(SDCRC, Crc16Copy_EachKernel_ShouldMatchCrc16AndCopy)
+{
+    static const SDCRC::Crc16Kernel kernels[] = { SDCRC::CRC16_KERNEL_TABLE,
+                                                  SDCRC::CRC16_KERNEL_SLICE_BY_4,
+                                                  SDCRC::CRC16_KERNEL_SLICE_BY_8 };
+    uint8_t  dest[512];
+    uint16_t expected = SDCRC::crc16Table(buffer(), sizeof(m_buffer), 0);
+
+    for (size_t i = 0 ; i < sizeof(kernels)/sizeof(kernels[0]) ; i++)
+    {
+        CHECK_TRUE(SDCRC::setCrc16Kernel(kernels[i]));
+        memset(dest, 0xEE, sizeof(dest));
+        LONGS_EQUAL(expected, SDCRC::crc16Copy(dest, buffer(), sizeof(m_buffer), 37));
+        CHECK_TRUE(0 == memcmp(buffer(), dest, 37));
+        LONGS_EQUAL(0xEE, dest[37]);
+    }
+}
+
+TEST(SDCRC, Crc16Copy_ContinuedAcrossBuffers_ShouldMatchCrc16)
+{
+    uint8_t dest[512];
+    uint16_t expected = SDCRC::crc16Table(buffer(), sizeof(m_buffer), 0);
+
+    uint16_t crc = SDCRC::crc16Copy(dest, buffer(), 256, 256, 0);
+    crc = SDCRC::crc16Copy(dest + 256, buffer() + 256, 256, 13, crc);
+
+    LONGS_EQUAL(expected, crc);
+    CHECK_TRUE(0 == memcmp(buffer(), dest, 256 + 13));
+}
+
+TEST(SDCRC, Crc7Command_ShouldMatchCrc7OfPackedCommandToken)
+{
+    static const uint32_t arguments[] = { 0x00000000, 0x000001AA, 0x40000000, 0x12345678, 0xFFFFFFFF, 0x00FFFFF1 };
+
+    for (uint32_t cmd = 0 ; cmd < 64 ; cmd++)
+    {
+        for (size_t i = 0 ; i < sizeof(arguments)/sizeof(arguments[0]) ; i++)
+        {
+            uint8_t token[5] = { (uint8_t)(0x40 | cmd),
+                                 (uint8_t)(arguments[i] >> 24),
+                                 (uint8_t)(arguments[i] >> 16),
+                                 (uint8_t)(arguments[i] >> 8),
+                                 (uint8_t)arguments[i] };
+            LONGS_EQUAL(SDCRC::crc7(token, sizeof(token)), SDCRC::crc7Command(token[0], arguments[i]));
+        }
+    }
+}
+
+TEST(SDCRC, Crc7Command_ShouldMatchWellKnownCmd0AndCmd8Crcs)
+{
+    // CMD0 and CMD8 are sent before CRC checking is enabled so their CRCs are commonly quoted: 0x95 and 0x87.
+    LONGS_EQUAL(0x95 >> 1, SDCRC::crc7Command(0x40, 0));
+    LONGS_EQUAL(0x87 >> 1, SDCRC::crc7Command(0x48, 0x1AA));
+}
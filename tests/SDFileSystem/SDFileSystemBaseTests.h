@@ -52,6 +52,26 @@ public:
         return m_spiBytesPerSecond;
     }
 
+    Timer& readStreamTimer()
+    {
+        return m_readStreamTimer;
+    }
+
+    Timer& crcErrorTimer()
+    {
+        return m_crcErrorTimer;
+    }
+
+    Timer& waitTimer()
+    {
+        return m_waitTimer;
+    }
+
+    Timer& latencyTimer()
+    {
+        return m_latencyTimer;
+    }
+
     void setSpiBytesPerSecond(uint32_t spiExchanges)
     {
         m_spiBytesPerSecond = spiExchanges;
@@ -78,6 +98,30 @@ protected:
 #define LOW  0
 
 
+// Used by the pipelined read/write tests to modify the contents of a block while a DMA transfer is in flight.
+struct BlockModifier
+{
+    uint8_t*                   pBlock;
+    uint32_t                   transferToModify;
+    SPIDma::AsyncTransferEvent eventToModify;
+    uint8_t                    fillByte;
+    uint32_t                   transferCount;
+};
+
+inline void modifyBlockHook(void* pContext, SPIDma::AsyncTransferEvent event)
+{
+    BlockModifier* pModifier = (BlockModifier*)pContext;
+    if (event == SPIDma::AsyncTransferStarted)
+    {
+        pModifier->transferCount++;
+    }
+    if (pModifier->transferCount == pModifier->transferToModify && event == pModifier->eventToModify)
+    {
+        memset(pModifier->pBlock, pModifier->fillByte, 512);
+    }
+}
+
+
 class SDFileSystemBase : public Utest
 {
 protected:
@@ -92,7 +136,6 @@ protected:
         m_byteIndex = 0;
         printfSpy_Hook(1024);
         g_debugBreakCount = 0;
-        SingleThreadedCheck::m_threadCount = 0;
     }
 
     void teardown()
@@ -173,6 +216,16 @@ protected:
         m_byteIndex += 8;
     }
 
+    void validateFrequency(uint32_t expectedFrequency)
+    {
+        CHECK_TRUE(settingsRemaining() >= 1);
+
+        SPIDma::Settings settings = m_sd.spi().getSetting(m_settingsIndex++);
+        LONGS_EQUAL(SPIDma::Frequency, settings.type);
+        LONGS_EQUAL(expectedFrequency, settings.frequency);
+        LONGS_EQUAL(m_byteIndex, settings.bytesSentBefore);
+    }
+
     void validateCmd(uint8_t expectedCommand, uint32_t expectedArgument = 0, size_t extraResponseBytes=0)
     {
         // Should have set chip select low and then back to high again.
@@ -427,7 +480,28 @@ protected:
     void initSDHC()
     {
         validateConstructor();
+        setupDataForInitSDHC();
+
+        LONGS_EQUAL(0, m_sd.disk_initialize());
+
+        validateInitSDHCCommands();
 
+        // Should set frequency at end of init process.
+        CHECK_TRUE(settingsRemaining() >= 1);
+
+        // Verify 25MHz clock rate for SPI.
+        SPIDma::Settings settings = m_sd.spi().getSetting(m_settingsIndex++);
+        LONGS_EQUAL(SPIDma::Frequency, settings.type);
+        LONGS_EQUAL(25000000, settings.frequency);
+
+        // Verify no longer in NOINIT state.
+        LONGS_EQUAL(0, m_sd.disk_status());
+        // Verify that card was detected as high capacity where block addresses are SD read/write address.
+        LONGS_EQUAL(0, m_sd.blockToAddressShift());
+    }
+
+    void setupDataForInitSDHC()
+    {
         // CMD0 input data.
         setupDataForCmd();
         // CMD59 input data.
@@ -447,9 +521,10 @@ protected:
         // Return with high capacity (CCS) bit set to indicate SDHC/SDXC disk.
         setupDataForCmd();
         m_sd.spi().setInboundFromString("40000000");
+    }
 
-        LONGS_EQUAL(0, m_sd.disk_initialize());
-
+    void validateInitSDHCCommands()
+    {
         // Verify 400kHz clock rate for SPI.
         // Verify chip select is set high while 80 > 74 clocks are sent to chip during powerup.
         validate400kHzClockAnd80PrimingClockEdges();
@@ -469,19 +544,6 @@ protected:
         validateCmd(41, 0x40000000);
         // Should send CMD58 again to read OCR register to determine if the card is high capacity or not.
         validateCmd(58, 0, 4);
-
-        // Should set frequency at end of init process.
-        CHECK_TRUE(settingsRemaining() >= 1);
-
-        // Verify 25MHz clock rate for SPI.
-        SPIDma::Settings settings = m_sd.spi().getSetting(m_settingsIndex++);
-        LONGS_EQUAL(SPIDma::Frequency, settings.type);
-        LONGS_EQUAL(25000000, settings.frequency);
-
-        // Verify no longer in NOINIT state.
-        LONGS_EQUAL(0, m_sd.disk_status());
-        // Verify that card was detected as high capacity where block addresses are SD read/write address.
-        LONGS_EQUAL(0, m_sd.blockToAddressShift());
     }
 
     void initSDSC()
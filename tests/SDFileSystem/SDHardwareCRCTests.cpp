@@ -0,0 +1,136 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include <string.h>
+#include <SDHardwareCRC.h>
+
+// Include C++ headers for test harness.
+#include "CppUTest/TestHarness.h"
+
+
+// Derive a class from SDHardwareCRC to get at the emulated CRC engine.
+class TestHardwareCRC : public SDHardwareCRC
+{
+public:
+    CRCEngine& engine()
+    {
+        return m_engine;
+    }
+};
+
+
+TEST_GROUP(SDHardwareCRC)
+{
+    TestHardwareCRC m_hardwareCrc;
+    uint32_t        m_block[512 / sizeof(uint32_t)];
+
+    void setup()
+    {
+        for (size_t i = 0 ; i < sizeof(m_block) ; i++)
+        {
+            block()[i] = (uint8_t)(i * 13 + 7);
+        }
+        SDCRC::setCrc16Backend(&m_hardwareCrc);
+    }
+
+    void teardown()
+    {
+        SDCRC::setCrc16Backend(NULL);
+    }
+
+    uint8_t* block()
+    {
+        return (uint8_t*)m_block;
+    }
+};
+
+
+TEST(SDHardwareCRC, Crc16Backend_ShouldBeSet)
+{
+    POINTERS_EQUAL(&m_hardwareCrc, SDCRC::crc16Backend());
+}
+
+TEST(SDHardwareCRC, Crc16OfBlock_ShouldBeOffloadedAndMatchSoftware)
+{
+    uint16_t crc = SDCRC::crc16(block(), sizeof(m_block));
+
+    LONGS_EQUAL(SDCRC::crc16Table(block(), sizeof(m_block)), crc);
+    LONGS_EQUAL(1, m_hardwareCrc.offloadCount());
+    LONGS_EQUAL(1, m_hardwareCrc.engine().startCount());
+    LONGS_EQUAL(512, m_hardwareCrc.engine().byteCount());
+    CHECK_FALSE(m_hardwareCrc.engine().isBusy());
+}
+
+TEST(SDHardwareCRC, Crc16ContinuedAcrossBuffers_ShouldPassSeedToEngine)
+{
+    uint16_t crc = SDCRC::crc16(block(), 256);
+    crc = SDCRC::crc16(block() + 256, 256, crc);
+
+    LONGS_EQUAL(SDCRC::crc16Table(block(), sizeof(m_block)), crc);
+    LONGS_EQUAL(2, m_hardwareCrc.offloadCount());
+}
+
+TEST(SDHardwareCRC, Crc16OfSmallBuffer_ShouldUseSoftware)
+{
+    uint16_t crc = SDCRC::crc16(block(), SDHARDWARECRC_MIN_LENGTH - 4);
+
+    LONGS_EQUAL(SDCRC::crc16Table(block(), SDHARDWARECRC_MIN_LENGTH - 4), crc);
+    LONGS_EQUAL(0, m_hardwareCrc.offloadCount());
+    LONGS_EQUAL(0, m_hardwareCrc.engine().startCount());
+}
+
+TEST(SDHardwareCRC, Crc16WithNoEngine_ShouldFallBackToSoftware)
+{
+    m_hardwareCrc.engine().setAvailable(false);
+
+    uint16_t crc = SDCRC::crc16(block(), sizeof(m_block));
+
+    LONGS_EQUAL(SDCRC::crc16Table(block(), sizeof(m_block)), crc);
+    LONGS_EQUAL(0, m_hardwareCrc.offloadCount());
+}
+
+TEST(SDHardwareCRC, Crc16WhileEngineBusy_ShouldFallBackToSoftware)
+{
+    CHECK_TRUE(m_hardwareCrc.engine().start(block(), 64, 0));
+
+    uint16_t crc = SDCRC::crc16(block(), sizeof(m_block));
+
+    LONGS_EQUAL(SDCRC::crc16Table(block(), sizeof(m_block)), crc);
+    LONGS_EQUAL(0, m_hardwareCrc.offloadCount());
+    m_hardwareCrc.engine().wait();
+}
+
+TEST(SDHardwareCRC, Crc16Copy_ShouldCopyAndOffloadWholeBlock)
+{
+    uint8_t dest[512];
+    memset(dest, 0xEE, sizeof(dest));
+
+    uint16_t crc = SDCRC::crc16Copy(dest, block(), sizeof(m_block), 13, 0x1234);
+
+    LONGS_EQUAL(SDCRC::crc16Table(block(), sizeof(m_block), 0x1234), crc);
+    CHECK_TRUE(0 == memcmp(block(), dest, 13));
+    LONGS_EQUAL(0xEE, dest[13]);
+    LONGS_EQUAL(1, m_hardwareCrc.offloadCount());
+    LONGS_EQUAL(512, m_hardwareCrc.engine().byteCount());
+}
+
+TEST(SDHardwareCRC, NoBackend_ShouldUseSoftware)
+{
+    SDCRC::setCrc16Backend(NULL);
+
+    uint16_t crc = SDCRC::crc16(block(), sizeof(m_block));
+
+    LONGS_EQUAL(SDCRC::crc16Table(block(), sizeof(m_block)), crc);
+    LONGS_EQUAL(0, m_hardwareCrc.offloadCount());
+}
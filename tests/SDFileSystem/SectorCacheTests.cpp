@@ -0,0 +1,360 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "SDFileSystemBaseTests.h"
+
+// Size of buffer required to hold the specified number of cache lines.
+#define CACHE_BUFFER_SIZE(LINES) ((LINES) * (512 + sizeof(SectorCache::Line)) + 4)
+
+
+TEST_GROUP(SectorCache)
+{
+    SectorCache m_cache;
+    uint32_t    m_buffer[CACHE_BUFFER_SIZE(4) / sizeof(uint32_t) + 1];
+};
+
+
+TEST(SectorCache, Init_BufferTooSmallForOneSet_ShouldFail)
+{
+    CHECK_FALSE(m_cache.init(m_buffer, CACHE_BUFFER_SIZE(1) - 5, 1));
+    CHECK_FALSE(m_cache.isEnabled());
+    CHECK_FALSE(m_cache.init(m_buffer, CACHE_BUFFER_SIZE(3), 4));
+    CHECK_FALSE(m_cache.init(NULL, sizeof(m_buffer), 1));
+    CHECK_FALSE(m_cache.init(m_buffer, sizeof(m_buffer), 0));
+}
+
+TEST(SectorCache, Init_UnalignedBuffer_ShouldWordAlignLineData)
+{
+    uint8_t* pUnaligned = (uint8_t*)m_buffer + 1;
+    CHECK_TRUE(m_cache.init(pUnaligned, CACHE_BUFFER_SIZE(2), 2));
+    LONGS_EQUAL(2, m_cache.lineCount());
+
+    SectorCache::Line* pLine = m_cache.findVictim(0);
+    LONGS_EQUAL(0, (uintptr_t)pLine->pData & 3);
+    CHECK_TRUE(pLine->pData >= pUnaligned);
+}
+
+TEST(SectorCache, Lookup_ShouldCountHitsAndMisses)
+{
+    CHECK_TRUE(m_cache.init(m_buffer, sizeof(m_buffer), 2));
+
+    POINTERS_EQUAL(NULL, m_cache.lookup(42));
+    SectorCache::Line* pLine = m_cache.findVictim(42);
+    m_cache.fill(pLine, 42, false);
+    POINTERS_EQUAL(pLine, m_cache.lookup(42));
+    POINTERS_EQUAL(pLine, m_cache.peek(42));
+
+    LONGS_EQUAL(1, m_cache.hitCount());
+    LONGS_EQUAL(1, m_cache.missCount());
+    LONGS_EQUAL(0, m_cache.evictCount());
+}
+
+TEST(SectorCache, FindVictim_ShouldPickLeastRecentlyUsedLineInSet)
+{
+    // 2 sets of 2 ways so that even sectors map to the first set.
+    CHECK_TRUE(m_cache.init(m_buffer, sizeof(m_buffer), 2));
+    LONGS_EQUAL(4, m_cache.lineCount());
+
+    SectorCache::Line* pLine0 = m_cache.findVictim(0);
+    m_cache.fill(pLine0, 0, false);
+    SectorCache::Line* pLine2 = m_cache.findVictim(2);
+    CHECK_TRUE(pLine0 != pLine2);
+    m_cache.fill(pLine2, 2, false);
+    // Odd sector goes to the other set which still has free lines.
+    SectorCache::Line* pLine1 = m_cache.findVictim(1);
+    CHECK_TRUE(pLine1 != pLine0 && pLine1 != pLine2);
+
+    // Touching sector 0 makes sector 2 the least recently used.
+    m_cache.lookup(0);
+    POINTERS_EQUAL(pLine2, m_cache.findVictim(4));
+    m_cache.evict(pLine2);
+    LONGS_EQUAL(1, m_cache.evictCount());
+    POINTERS_EQUAL(NULL, m_cache.peek(2));
+}
+
+TEST(SectorCache, FindLowestDirtyLine_ShouldReturnInSectorOrder)
+{
+    CHECK_TRUE(m_cache.init(m_buffer, sizeof(m_buffer), 1));
+
+    POINTERS_EQUAL(NULL, m_cache.findLowestDirtyLine());
+    m_cache.fill(m_cache.findVictim(7), 7, true);
+    m_cache.fill(m_cache.findVictim(5), 5, false);
+    m_cache.fill(m_cache.findVictim(6), 6, true);
+
+    SectorCache::Line* pLine = m_cache.findLowestDirtyLine();
+    LONGS_EQUAL(6, pLine->sector);
+    pLine->isDirty = false;
+    LONGS_EQUAL(7, m_cache.findLowestDirtyLine()->sector);
+}
+
+
+
+TEST_GROUP_BASE(DiskCache,SDFileSystemBase)
+{
+    void setupDataForSingleBlockWrite()
+    {
+        // CMD24 input data.
+        setupDataForCmd("00");
+        // Return not-busy on first loop in waitWhileBusy() and then successful write response token.
+        m_sd.spi().setInboundFromString("FF");
+        m_sd.spi().setInboundFromString("05");
+        // CMD13 input data with successful R2 response.
+        setupDataForCmd("00");
+        m_sd.spi().setInboundFromString("00");
+    }
+
+    void validateSingleBlockWrite(uint32_t blockNumber, uint8_t fillByte)
+    {
+        validateSelect();
+        validateCmdPacket(24, blockNumber);
+        validateFFBytes(1);
+        validateDataBlock(0xFE, fillByte);
+        validateDeselect();
+        validateCmd(13, 0, 1);
+    }
+
+    void setupDataForSync()
+    {
+        // select() expects to receive a response which is not 0xFF for the first byte read.
+        m_sd.spi().setInboundFromString("00");
+        // Return not-busy on first loop in waitForNotBusy().
+        m_sd.spi().setInboundFromString("FF");
+    }
+
+    uint32_t m_cacheBuffer[CACHE_BUFFER_SIZE(4) / sizeof(uint32_t) + 1];
+};
+
+
+TEST(DiskCache, EnableSectorCache_BufferTooSmall_ShouldFail_GetLogged)
+{
+    initSDHC();
+
+        LONGS_EQUAL(RES_PARERR, m_sd.enableSectorCache(m_cacheBuffer, 100, 1));
+
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[256];
+    snprintf(expectedOutput, sizeof(expectedOutput), "enableSectorCache(%X,100,1) - Buffer too small\n",
+             (uint32_t)(size_t)m_cacheBuffer);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
+
+TEST(DiskCache, SingleBlockWriteThenRead_ShouldBeHeldInCacheWithNoSpiTraffic)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.enableSectorCache(m_cacheBuffer, sizeof(m_cacheBuffer), 2));
+    size_t byteIndex = m_byteIndex;
+
+    memset(buffer, 0xAD, sizeof(buffer));
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 1));
+    memset(buffer, 0x00, sizeof(buffer));
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+
+    validateBuffer(buffer, sizeof(buffer), 0xAD);
+    STRCMP_EQUAL("", m_sd.spi().getOutboundAsString(byteIndex));
+    LONGS_EQUAL(2, m_sd.sectorCacheHitCount());
+    LONGS_EQUAL(1, m_sd.sectorCacheMissCount());
+    LONGS_EQUAL(0, m_sd.sectorCacheEvictCount());
+}
+
+TEST(DiskCache, SingleBlockReadMiss_ShouldFillFromCardThenHit)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.enableSectorCache(m_cacheBuffer, sizeof(m_cacheBuffer), 2));
+    // CMD17 input data.
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0xDA, 512);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+    memset(buffer, 0x00, sizeof(buffer));
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+
+    // Only the first read should go to the card.
+    validateSelect();
+    validateCmdPacket(17, 42);
+    validateFFBytes(1+512+2);
+    validateDeselect();
+    validateBuffer(buffer, sizeof(buffer), 0xDA);
+    LONGS_EQUAL(1, m_sd.sectorCacheHitCount());
+    LONGS_EQUAL(1, m_sd.sectorCacheMissCount());
+}
+
+TEST(DiskCache, DirtySectorEvicted_ShouldBeWrittenBackWithCMD24_GetCounted)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    // Just room for a single line.
+    LONGS_EQUAL(RES_OK, m_sd.enableSectorCache(m_cacheBuffer, CACHE_BUFFER_SIZE(1), 1));
+    setupDataForSingleBlockWrite();
+
+    memset(buffer, 0x11, sizeof(buffer));
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 1));
+    memset(buffer, 0x22, sizeof(buffer));
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 43, 1));
+
+    // Sector 42 should have been written back to make room for 43.
+    validateSingleBlockWrite(42, 0x11);
+    LONGS_EQUAL(1, m_sd.sectorCacheEvictCount());
+    LONGS_EQUAL(2, m_sd.sectorCacheMissCount());
+}
+
+TEST(DiskCache, DiskSync_ShouldCoalesceConsecutiveDirtySectorsIntoCMD25)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.enableSectorCache(m_cacheBuffer, sizeof(m_cacheBuffer), 1));
+
+    // Write out of order to make sure that flush sorts them.
+    memset(buffer, 0x33, sizeof(buffer));
+    LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 45, 1));
+    memset(buffer, 0x22, sizeof(buffer));
+    LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 43, 1));
+    memset(buffer, 0x11, sizeof(buffer));
+    LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 1));
+
+    // Sectors 42 & 43 should go out as a single CMD25.
+    setupDataForACmd("00");
+    setupDataForCmd("00");
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        m_sd.spi().setInboundFromString("FF");
+        m_sd.spi().setInboundFromString("05");
+    }
+    m_sd.spi().setInboundFromString("FF");
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("00");
+    // Sector 45 on its own uses CMD24.
+    setupDataForSingleBlockWrite();
+    setupDataForSync();
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_sync());
+
+    validateACmd(23, 2);
+    validateSelect();
+    validateCmdPacket(25, 42);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x11);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x22);
+    validateFFBytes(1);
+    STRCMP_EQUAL("FD", m_sd.spi().getOutboundAsString(m_byteIndex++, 1));
+    validateDeselect();
+    validateCmd(13, 0, 1);
+    validateSingleBlockWrite(45, 0x33);
+    validateSelect();
+    validateDeselect();
+
+    // Everything is now clean so another sync shouldn't write anything.
+    setupDataForSync();
+        LONGS_EQUAL(RES_OK, m_sd.disk_sync());
+    validateSelect();
+    validateDeselect();
+}
+
+TEST(DiskCache, MultiBlockRead_ShouldBypassCacheButReturnDirtyCachedData)
+{
+    uint8_t buffer[1024];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.enableSectorCache(m_cacheBuffer, sizeof(m_cacheBuffer), 2));
+    memset(buffer, 0x55, 512);
+    LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 43, 1));
+
+    // CMD18 returns stale data for sector 43.
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0xAD, 512);
+    m_sd.spi().setInboundFromString("FE");
+    setupDataBlock(0xDA, 512);
+    m_sd.spi().setInboundFromString("FF");
+    m_sd.spi().setInboundFromString("00");
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 2));
+
+    validateSelect();
+    validateCmdPacket(18, 42);
+    validateFFBytes(2*(1+512+2));
+    validateCmdPacket(12);
+    validateDeselect();
+    validateBuffer(buffer, 512, 0xAD);
+    validateBuffer(buffer + 512, 512, 0x55);
+}
+
+TEST(DiskCache, MultiBlockWrite_ShouldWriteThroughAndCleanCachedCopy)
+{
+    uint8_t buffer[1024];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.enableSectorCache(m_cacheBuffer, sizeof(m_cacheBuffer), 2));
+    memset(buffer, 0x55, 512);
+    LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 43, 1));
+
+    setupDataForACmd("00");
+    setupDataForCmd("00");
+    for (int i = 0 ; i < 2 ; i++)
+    {
+        m_sd.spi().setInboundFromString("FF");
+        m_sd.spi().setInboundFromString("05");
+    }
+    m_sd.spi().setInboundFromString("FF");
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("00");
+    memset(buffer, 0x11, 512);
+    memset(buffer + 512, 0x22, 512);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 2));
+
+    validateACmd(23, 2);
+    validateSelect();
+    validateCmdPacket(25, 42);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x11);
+    validateFFBytes(1);
+    validateDataBlock(0xFC, 0x22);
+    validateFFBytes(1);
+    STRCMP_EQUAL("FD", m_sd.spi().getOutboundAsString(m_byteIndex++, 1));
+    validateDeselect();
+    validateCmd(13, 0, 1);
+
+    // Cached copy should now match and be clean so a read hits and sync doesn't write it again.
+    memset(buffer, 0x00, 512);
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 43, 1));
+    validateBuffer(buffer, 512, 0x22);
+    setupDataForSync();
+        LONGS_EQUAL(RES_OK, m_sd.disk_sync());
+    validateSelect();
+    validateDeselect();
+}
+
+TEST(DiskCache, DisableSectorCache_ShouldFlushDirtySectors)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.enableSectorCache(m_cacheBuffer, sizeof(m_cacheBuffer), 2));
+    memset(buffer, 0x77, sizeof(buffer));
+    LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 1));
+    setupDataForSingleBlockWrite();
+
+        LONGS_EQUAL(RES_OK, m_sd.disableSectorCache());
+
+    validateSingleBlockWrite(42, 0x77);
+}
@@ -21,30 +21,31 @@
 
 TEST_GROUP(SingleThreadedCheck)
 {
+    volatile uint32_t m_threadCount;
+
     void setup()
     {
         g_debugBreakCount = 0;
-        SingleThreadedCheck::m_threadCount = 0;
+        m_threadCount = 0;
     }
 
     void teardown()
     {
         g_debugBreakCount = 0;
-        SingleThreadedCheck::m_threadCount = 0;
     }
 };
 
 TEST(SingleThreadedCheck, SuccessfulConstructDestruct)
 {
     LONGS_EQUAL(0, g_debugBreakCount);
-    LONGS_EQUAL(0, SingleThreadedCheck::m_threadCount);
+    LONGS_EQUAL(0, m_threadCount);
     {
-        SingleThreadedCheck test;
+        SingleThreadedCheck test(m_threadCount);
 
         LONGS_EQUAL(0, g_debugBreakCount);
-        LONGS_EQUAL(1, SingleThreadedCheck::m_threadCount);
+        LONGS_EQUAL(1, m_threadCount);
     }
-    LONGS_EQUAL(0, SingleThreadedCheck::m_threadCount);
+    LONGS_EQUAL(0, m_threadCount);
     LONGS_EQUAL(0, g_debugBreakCount);
 }
 
@@ -52,13 +53,31 @@ TEST(SingleThreadedCheck, SimulateAnotherThreadUsingObject_FailConstructor)
 {
     LONGS_EQUAL(0, g_debugBreakCount);
     // Simulate that another thread is already using object by bumping count up to be non-zero.
-    SingleThreadedCheck::m_threadCount = 1;
+    m_threadCount = 1;
     {
-        SingleThreadedCheck test;
+        SingleThreadedCheck test(m_threadCount);
 
         LONGS_EQUAL(1, g_debugBreakCount);
-        LONGS_EQUAL(2, SingleThreadedCheck::m_threadCount);
+        LONGS_EQUAL(2, m_threadCount);
     }
-    LONGS_EQUAL(1, SingleThreadedCheck::m_threadCount);
+    LONGS_EQUAL(1, m_threadCount);
     LONGS_EQUAL(1, g_debugBreakCount);
 }
+
+TEST(SingleThreadedCheck, SimulateAnotherThreadUsingDifferentObject_ShouldSucceed)
+{
+    volatile uint32_t otherThreadCount = 0;
+
+    LONGS_EQUAL(0, g_debugBreakCount);
+    {
+        SingleThreadedCheck test(m_threadCount);
+        SingleThreadedCheck other(otherThreadCount);
+
+        LONGS_EQUAL(0, g_debugBreakCount);
+        LONGS_EQUAL(1, m_threadCount);
+        LONGS_EQUAL(1, otherThreadCount);
+    }
+    LONGS_EQUAL(0, m_threadCount);
+    LONGS_EQUAL(0, otherThreadCount);
+    LONGS_EQUAL(0, g_debugBreakCount);
+}
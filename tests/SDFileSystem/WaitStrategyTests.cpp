@@ -0,0 +1,255 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "SDFileSystemBaseTests.h"
+
+
+// Wait strategy which just records the waitCount passed into each backOff() call.
+class SpyWaitStrategy : public SDWaitStrategy
+{
+public:
+    SpyWaitStrategy()
+    {
+        callCount = 0;
+    }
+
+    virtual void backOff(uint32_t waitCount)
+    {
+        if (callCount < sizeof(waitCounts)/sizeof(waitCounts[0]))
+        {
+            waitCounts[callCount] = waitCount;
+        }
+        callCount++;
+    }
+
+    uint32_t waitCounts[16];
+    uint32_t callCount;
+};
+
+static int g_sleepCalls[8];
+static int g_sleepCallCount;
+
+static void sleepSpy(int us)
+{
+    g_sleepCalls[g_sleepCallCount++] = us;
+}
+
+
+TEST_GROUP_BASE(WaitStrategy,SDFileSystemBase)
+{
+    void setupDataForBusySelect(uint32_t busyBytes)
+    {
+        // select() expects to receive a response which is not 0xFF for the first byte read.
+        m_sd.spi().setInboundFromString("00");
+        for (uint32_t i = 0 ; i < busyBytes ; i++)
+        {
+            m_sd.spi().setInboundFromString("00");
+        }
+        m_sd.spi().setInboundFromString("FF");
+    }
+
+    void validateBusySelect(uint32_t busyBytes)
+    {
+        SPIDma::Settings settings = m_sd.spi().getSetting(m_settingsIndex++);
+        LONGS_EQUAL(SPIDma::ChipSelect, settings.type);
+        LONGS_EQUAL(LOW, settings.chipSelect);
+        // Priming byte, busy bytes, and then the not-busy byte.
+        validateFFBytes(1 + busyBytes + 1);
+    }
+};
+
+
+TEST(WaitStrategy, NoStrategy_ShouldSpinForWholeWait_RecordHistogram)
+{
+    SDFileSystem::LatencyStats stats;
+
+    initSDHC();
+    m_sd.resetLatencyStats();
+    setupDataForBusySelect(10);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_sync());
+
+    validateBusySelect(10);
+    validateDeselect();
+    LONGS_EQUAL(0, m_sd.waitBackOffCount());
+    // 11 exchanges at 25MHz is 3us.
+    m_sd.getLatencyStats(&stats);
+    LONGS_EQUAL(1, stats.selectWait.totalCount());
+    LONGS_EQUAL(1, stats.selectWait.count(LatencyHistogram::bucketForLatency(3)));
+}
+
+TEST(WaitStrategy, ShortBusy_ShouldOnlySpin)
+{
+    SpyWaitStrategy strategy;
+
+    initSDHC();
+    // 10us is ~31 exchanges at 25MHz.
+    LONGS_EQUAL(RES_OK, m_sd.setWaitStrategy(&strategy, 10));
+    setupDataForBusySelect(10);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_sync());
+
+    validateBusySelect(10);
+    validateDeselect();
+    LONGS_EQUAL(0, strategy.callCount);
+    LONGS_EQUAL(0, m_sd.waitBackOffCount());
+}
+
+TEST(WaitStrategy, LongBusy_ShouldBackOffBetweenPollsAfterSpinning)
+{
+    SpyWaitStrategy            strategy;
+    SDFileSystem::LatencyStats stats;
+
+    initSDHC();
+    // 2us is 6 exchanges at 25MHz.
+    LONGS_EQUAL(RES_OK, m_sd.setWaitStrategy(&strategy, 2));
+    setupDataForBusySelect(10);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_sync());
+
+    validateBusySelect(10);
+    validateDeselect();
+    // 6 busy polls while spinning and 4 more after backing off before the 5th poll after backing off sees not-busy.
+    LONGS_EQUAL(5, strategy.callCount);
+    for (uint32_t i = 0 ; i < 5 ; i++)
+    {
+        LONGS_EQUAL(i, strategy.waitCounts[i]);
+    }
+    LONGS_EQUAL(5, m_sd.waitBackOffCount());
+    // Mock timer advances 1ms for each read after backing off.
+    LONGS_EQUAL(5, m_sd.maximumWaitWhileBusyTime());
+    m_sd.getLatencyStats(&stats);
+    LONGS_EQUAL(1, stats.selectWait.count(LatencyHistogram::bucketForLatency(5001)));
+}
+
+TEST(WaitStrategy, LongBusy_ShouldTimeOutAfter500msOfTimer_GetLogged)
+{
+    SpyWaitStrategy strategy;
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setWaitStrategy(&strategy, 2));
+    m_sd.waitTimer().setElapsedTimePerCall(100);
+    // 6 spins and then polls after 100, 200, 300, 400 and 500ms of backing off.
+    setupDataForBusySelect(11);
+
+        LONGS_EQUAL(RES_ERROR, m_sd.disk_sync());
+
+    SPIDma::Settings settings = m_sd.spi().getSetting(m_settingsIndex++);
+    LONGS_EQUAL(SPIDma::ChipSelect, settings.type);
+    LONGS_EQUAL(LOW, settings.chipSelect);
+    validateFFBytes(1 + 11);
+    validateDeselect();
+    // Consume the unused not-busy byte.
+    m_sd.spi().exchange(0xFF);
+    m_byteIndex++;
+    LONGS_EQUAL(5, strategy.callCount);
+    LONGS_EQUAL(500, m_sd.maximumWaitWhileBusyTime());
+    m_sd.dumpErrorLog(stderr);
+    STRCMP_EQUAL("waitWhileBusy(1562500) - Time out. Response=0x00\n"
+                 "select() - 500 msec time out\n"
+                 "disk_sync() - Failed waiting for not busy\n",
+                 printfSpy_GetLastOutput());
+}
+
+TEST(WaitStrategy, LongReadAccessTime_ShouldBackOffWhileWaitingForBlockStart)
+{
+    SpyWaitStrategy            strategy;
+    SDFileSystem::LatencyStats stats;
+    uint8_t                    buffer[512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setWaitStrategy(&strategy, 2));
+    // CMD17 input data.
+    setupDataForCmd("00");
+    // NAC of 8 bytes before 0xFE starts read data block.
+    m_sd.spi().setInboundFromString("FFFFFFFFFFFFFFFFFE");
+    setupDataBlock(0xAD, 512);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_read(buffer, 42, 1));
+
+    validateSelect();
+    validateCmdPacket(17, 42);
+    validateFFBytes(9 + 512 + 2);
+    validateDeselect();
+    validateBuffer(buffer, sizeof(buffer), 0xAD);
+    // 6 waiting polls while spinning, 2 after backing off, and then the start token on the poll after the 3rd.
+    LONGS_EQUAL(3, strategy.callCount);
+    LONGS_EQUAL(3, m_sd.waitBackOffCount());
+    m_sd.getLatencyStats(&stats);
+    LONGS_EQUAL(1, stats.receiveWait.totalCount());
+    LONGS_EQUAL(1, stats.receiveWait.count(LatencyHistogram::bucketForLatency(3002)));
+}
+
+TEST(WaitStrategy, SetWaitStrategyToNull_ShouldRestoreSpinning)
+{
+    SpyWaitStrategy strategy;
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setWaitStrategy(&strategy, 2));
+    LONGS_EQUAL(RES_OK, m_sd.setWaitStrategy(NULL, 0));
+    setupDataForBusySelect(10);
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_sync());
+
+    validateBusySelect(10);
+    validateDeselect();
+    LONGS_EQUAL(0, strategy.callCount);
+}
+
+
+
+TEST_GROUP(SDSleepWaitStrategy)
+{
+    void setup()
+    {
+        g_sleepCallCount = 0;
+    }
+};
+
+
+TEST(SDSleepWaitStrategy, FromZero_ShouldYieldAndThenDoubleUpToMaximum)
+{
+    SDSleepWaitStrategy strategy(sleepSpy, 0, 4);
+
+    for (uint32_t i = 0 ; i < 6 ; i++)
+    {
+        strategy.backOff(i);
+    }
+
+    LONGS_EQUAL(6, g_sleepCallCount);
+    LONGS_EQUAL(0, g_sleepCalls[0]);
+    LONGS_EQUAL(1, g_sleepCalls[1]);
+    LONGS_EQUAL(2, g_sleepCalls[2]);
+    LONGS_EQUAL(4, g_sleepCalls[3]);
+    LONGS_EQUAL(4, g_sleepCalls[4]);
+    LONGS_EQUAL(4, g_sleepCalls[5]);
+}
+
+TEST(SDSleepWaitStrategy, FromMinimum_ShouldDoubleUpToMaximum)
+{
+    SDSleepWaitStrategy strategy(sleepSpy, 100, 1000);
+
+    strategy.backOff(0);
+    strategy.backOff(1);
+    strategy.backOff(3);
+    strategy.backOff(4);
+    strategy.backOff(100);
+
+    LONGS_EQUAL(5, g_sleepCallCount);
+    LONGS_EQUAL(100, g_sleepCalls[0]);
+    LONGS_EQUAL(200, g_sleepCalls[1]);
+    LONGS_EQUAL(800, g_sleepCalls[2]);
+    LONGS_EQUAL(1000, g_sleepCalls[3]);
+    LONGS_EQUAL(1000, g_sleepCalls[4]);
+}
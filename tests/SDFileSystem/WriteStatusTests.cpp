@@ -0,0 +1,225 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "SDFileSystemBaseTests.h"
+
+
+TEST_GROUP_BASE(WriteStatus,SDFileSystemBase)
+{
+    void setupDataForSingleBlockWrite()
+    {
+        // CMD24 input data.
+        setupDataForCmd("00");
+        // Return not-busy on first loop in waitWhileBusy().
+        m_sd.spi().setInboundFromString("FF");
+        // Return successful write response token.
+        m_sd.spi().setInboundFromString("05");
+    }
+
+    void setupDataForCmd13(const char* pStatus = "00")
+    {
+        // CMD13 input data with indicated R2 response.
+        setupDataForCmd("00");
+        m_sd.spi().setInboundFromString(pStatus);
+    }
+
+    void setupDataForDiskSync()
+    {
+        // select() expects to receive a response which is not 0xFF for the first byte read.
+        m_sd.spi().setInboundFromString("00");
+        // Return not-busy on first loop in waitForNotBusy().
+        m_sd.spi().setInboundFromString("FF");
+    }
+
+    void validateSingleBlockWrite(uint32_t blockNumber, uint8_t fillByte)
+    {
+        validateSelect();
+        validateCmdPacket(24, blockNumber);
+        validateFFBytes(1);
+        validateDataBlock(0xFE, fillByte);
+        validateDeselect();
+    }
+
+    void validateCmd13()
+    {
+        validateCmd(13, 0, 1);
+    }
+
+    void validateDiskSync()
+    {
+        validateSelect();
+        validateDeselect();
+    }
+};
+
+
+TEST(WriteStatus, SetWriteStatusCheckInterval_Zero_ShouldFail_GetLogged)
+{
+    initSDHC();
+
+        LONGS_EQUAL(RES_PARERR, m_sd.setWriteStatusCheckInterval(0));
+
+    LONGS_EQUAL(0, settingsRemaining());
+    m_sd.dumpErrorLog(stderr);
+    STRCMP_EQUAL("setWriteStatusCheckInterval(0) - Interval must be at least 1\n", printfSpy_GetLastOutput());
+}
+
+TEST(WriteStatus, IntervalOf3_ShouldOnlyIssueCMD13OnEveryThirdWrite)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setWriteStatusCheckInterval(3));
+    setupDataForSingleBlockWrite();
+    setupDataForSingleBlockWrite();
+    setupDataForSingleBlockWrite();
+    setupDataForCmd13();
+    setupDataForSingleBlockWrite();
+    memset(buffer, 0xAD, sizeof(buffer));
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 43, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 44, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 45, 1));
+
+    validateSingleBlockWrite(42, 0xAD);
+    validateSingleBlockWrite(43, 0xAD);
+    validateSingleBlockWrite(44, 0xAD);
+    validateCmd13();
+    validateSingleBlockWrite(45, 0xAD);
+    LONGS_EQUAL(0, settingsRemaining());
+}
+
+TEST(WriteStatus, DiskSync_ShouldIssueCMD13ForUncheckedWrites)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setWriteStatusCheckInterval(4));
+    setupDataForSingleBlockWrite();
+    setupDataForSingleBlockWrite();
+    setupDataForDiskSync();
+    setupDataForCmd13();
+    setupDataForDiskSync();
+    memset(buffer, 0xAD, sizeof(buffer));
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 43, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_sync());
+        // Nothing left unchecked so the next disk_sync() shouldn't need CMD13.
+        LONGS_EQUAL(RES_OK, m_sd.disk_sync());
+
+    validateSingleBlockWrite(42, 0xAD);
+    validateSingleBlockWrite(43, 0xAD);
+    validateDiskSync();
+    validateCmd13();
+    validateDiskSync();
+    LONGS_EQUAL(0, settingsRemaining());
+}
+
+TEST(WriteStatus, FailedCheckOnDiskSync_ShouldFailDiskSync_GetLogged)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setWriteStatusCheckInterval(4));
+    setupDataForSingleBlockWrite();
+    setupDataForDiskSync();
+    // Return WP_VIOLATION in the R2 status byte.
+    setupDataForCmd13("01");
+    memset(buffer, 0xAD, sizeof(buffer));
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 1));
+        LONGS_EQUAL(RES_ERROR, m_sd.disk_sync());
+
+    validateSingleBlockWrite(42, 0xAD);
+    validateDiskSync();
+    validateCmd13();
+    m_sd.dumpErrorLog(stderr);
+    STRCMP_EQUAL("checkDeferredWriteStatus() - CMD13 failed. Status=0x01\n"
+                 "disk_sync() - Deferred write status check failed\n",
+                 printfSpy_GetLastOutput());
+}
+
+TEST(WriteStatus, FailedCheckOnWrite_ShouldFailWriteAndNextDiskSyncOnly)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setWriteStatusCheckInterval(2));
+    setupDataForSingleBlockWrite();
+    setupDataForSingleBlockWrite();
+    setupDataForCmd13("01");
+    setupDataForDiskSync();
+    setupDataForDiskSync();
+    memset(buffer, 0xAD, sizeof(buffer));
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 1));
+        // The failure may belong to block 42 but can only be reported on the write which checks the status.
+        LONGS_EQUAL(RES_ERROR, m_sd.disk_write(buffer, 43, 1));
+        // disk_sync() should also report the error since the caller may have trusted the first write.
+        LONGS_EQUAL(RES_ERROR, m_sd.disk_sync());
+        // The error is only reported once.
+        LONGS_EQUAL(RES_OK, m_sd.disk_sync());
+
+    validateSingleBlockWrite(42, 0xAD);
+    validateSingleBlockWrite(43, 0xAD);
+    validateCmd13();
+    validateDiskSync();
+    validateDiskSync();
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[256];
+    snprintf(expectedOutput, sizeof(expectedOutput),
+             "disk_write(%X,43,1) - CMD13 failed. Status=0x01\n"
+             "disk_sync() - Deferred write status check failed\n",
+             (uint32_t)(size_t)buffer);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
+
+TEST(WriteStatus, DefaultInterval_ShouldIssueCMD13OnEveryWrite)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    setupDataForSingleBlockWrite();
+    setupDataForCmd13("01");
+    setupDataForDiskSync();
+    memset(buffer, 0xAD, sizeof(buffer));
+
+        LONGS_EQUAL(RES_ERROR, m_sd.disk_write(buffer, 42, 1));
+        // Strict mode reports the failure on the write itself so disk_sync() shouldn't report it again.
+        LONGS_EQUAL(RES_OK, m_sd.disk_sync());
+
+    validateSingleBlockWrite(42, 0xAD);
+    validateCmd13();
+    validateDiskSync();
+}
+
+TEST(WriteStatus, SetWriteStatusCheckInterval_ShouldCheckWritesLeftUnchecked)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.setWriteStatusCheckInterval(8));
+    setupDataForSingleBlockWrite();
+    setupDataForCmd13();
+    memset(buffer, 0xAD, sizeof(buffer));
+
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 42, 1));
+        LONGS_EQUAL(RES_OK, m_sd.setWriteStatusCheckInterval(1));
+
+    validateSingleBlockWrite(42, 0xAD);
+    validateCmd13();
+    LONGS_EQUAL(0, settingsRemaining());
+}
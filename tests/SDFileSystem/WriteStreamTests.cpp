@@ -0,0 +1,333 @@
+/* Copyright 2016 Adam Green (http://mbed.org/users/AdamGreen/)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+#include "SDFileSystemBaseTests.h"
+
+
+TEST_GROUP_BASE(WriteStream,SDFileSystemBase)
+{
+    void setupDataForStreamOpen()
+    {
+        // ACMD23 input data.
+        setupDataForACmd("00");
+        // CMD25 input data.
+        setupDataForCmd("00");
+    }
+
+    void setupDataForStreamBlock(const char* pDataResponse = "05")
+    {
+        // Return not-busy on first loop in waitWhileBusy().
+        m_sd.spi().setInboundFromString("FF");
+        // Return the write response token.
+        m_sd.spi().setInboundFromString(pDataResponse);
+    }
+
+    void setupDataForStreamStop()
+    {
+        // Sending of stop transmission token.
+        // Return not-busy on first loop in waitWhileBusy().
+        m_sd.spi().setInboundFromString("FF");
+        // CMD13 input data with successful R2 response.
+        setupDataForCmd("00");
+        m_sd.spi().setInboundFromString("00");
+    }
+
+    void setupDataForCmd12()
+    {
+        // select() expects to receive a response which is not 0xFF for the first byte read.
+        m_sd.spi().setInboundFromString("00");
+        // Return not-busy on first loop in waitForNotBusy().
+        m_sd.spi().setInboundFromString("FF");
+        // Return extra padding byte.
+        m_sd.spi().setInboundFromString("FF");
+        // Return R1 response.
+        m_sd.spi().setInboundFromString("00");
+    }
+
+    void validateStreamOpen(uint32_t blockNumber, uint32_t blocksLeft)
+    {
+        // Should send ACDM23 to pre-erase the rest of the stream.
+        validateACmd(23, blocksLeft);
+        validateSelect();
+        // Should send CMD25 to start write process.  Argument is block number.
+        validateCmdPacket(25, blockNumber);
+    }
+
+    void validateStreamBlock(uint8_t fillByte)
+    {
+        // Should have sent one 0xFF byte in waitWhileBusy().
+        validateFFBytes(1);
+        // Should send start block token, buffer data, and CRC.
+        validateDataBlock(0xFC, fillByte);
+    }
+
+    void validateStreamStop()
+    {
+        // Should have sent one 0xFF byte in waitWhileBusy().
+        validateFFBytes(1);
+        // Should send stop transmission token.
+        STRCMP_EQUAL("FD", m_sd.spi().getOutboundAsString(m_byteIndex++, 1));
+        // Deselect as the write is now complete.
+        validateDeselect();
+        // Should send CMD13 to get R2 write status.
+        validateCmd(13, 0, 1);
+    }
+};
+
+
+TEST(WriteStream, StartWriteStream_BeforeInit_ShouldFail_GetLogged)
+{
+    validateConstructor();
+
+        LONGS_EQUAL(RES_NOTRDY, m_sd.startWriteStream(42, 8));
+
+    m_sd.dumpErrorLog(stderr);
+    STRCMP_EQUAL("startWriteStream(42,8) - Attempt to write uninitialized drive\n", printfSpy_GetLastOutput());
+}
+
+TEST(WriteStream, StartWriteStream_ZeroBlocks_ShouldFail_GetLogged)
+{
+    initSDHC();
+
+        LONGS_EQUAL(RES_PARERR, m_sd.startWriteStream(42, 0));
+
+    m_sd.dumpErrorLog(stderr);
+    STRCMP_EQUAL("startWriteStream(42,0) - Attempt to stream 0 blocks\n", printfSpy_GetLastOutput());
+}
+
+TEST(WriteStream, WriteStream_WithoutStart_ShouldFail_GetLogged)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+
+        LONGS_EQUAL(RES_PARERR, m_sd.writeStream(buffer, 1));
+
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[256];
+    snprintf(expectedOutput, sizeof(expectedOutput),
+             "writeStream(%X,1) - Stream not started\n", (uint32_t)(size_t)buffer);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
+
+TEST(WriteStream, WriteStream_PastEndOfStream_ShouldFail_GetLogged)
+{
+    uint8_t buffer[2*512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.startWriteStream(42, 1));
+
+        LONGS_EQUAL(RES_PARERR, m_sd.writeStream(buffer, 2));
+
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[256];
+    snprintf(expectedOutput, sizeof(expectedOutput),
+             "writeStream(%X,2) - Attempt to write 1 blocks left in stream\n", (uint32_t)(size_t)buffer);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
+
+TEST(WriteStream, WriteStream_TwoCallsThenFlush_ShouldUseSingleCMD25)
+{
+    uint8_t buffer[2*512];
+
+    initSDHC();
+    setupDataForStreamOpen();
+    setupDataForStreamBlock();
+    setupDataForStreamBlock();
+    setupDataForStreamBlock();
+    setupDataForStreamStop();
+    memset(buffer, 0xAD, 512);
+    memset(buffer+512, 0xDA, 512);
+
+        LONGS_EQUAL(RES_OK, m_sd.startWriteStream(42, 8));
+        LONGS_EQUAL(RES_OK, m_sd.writeStream(buffer, 2));
+        LONGS_EQUAL(RES_OK, m_sd.writeStream(buffer, 1));
+    // The CMD25 should still be open so the card is left selected with no stop token.
+    validateStreamOpen(42, 8);
+    validateStreamBlock(0xAD);
+    validateStreamBlock(0xDA);
+    validateStreamBlock(0xAD);
+    STRCMP_EQUAL("", m_sd.spi().getOutboundAsString(m_byteIndex));
+    LONGS_EQUAL(0, settingsRemaining());
+
+        LONGS_EQUAL(RES_OK, m_sd.flushWriteStream());
+
+    validateStreamStop();
+    LONGS_EQUAL(1, m_sd.writeStreamTransactionCount());
+}
+
+TEST(WriteStream, WriteStream_AfterFlush_ShouldReopenAtNextBlockAndPreEraseRemainingBlocks)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    setupDataForStreamOpen();
+    setupDataForStreamBlock();
+    setupDataForStreamStop();
+    setupDataForStreamOpen();
+    setupDataForStreamBlock();
+    setupDataForStreamStop();
+    memset(buffer, 0xAD, sizeof(buffer));
+
+        LONGS_EQUAL(RES_OK, m_sd.startWriteStream(42, 8));
+        LONGS_EQUAL(RES_OK, m_sd.writeStream(buffer, 1));
+        LONGS_EQUAL(RES_OK, m_sd.flushWriteStream());
+        LONGS_EQUAL(RES_OK, m_sd.writeStream(buffer, 1));
+        LONGS_EQUAL(RES_OK, m_sd.endWriteStream());
+
+    validateStreamOpen(42, 8);
+    validateStreamBlock(0xAD);
+    validateStreamStop();
+    validateStreamOpen(43, 7);
+    validateStreamBlock(0xAD);
+    validateStreamStop();
+    LONGS_EQUAL(2, m_sd.writeStreamTransactionCount());
+}
+
+TEST(WriteStream, EndWriteStream_ShouldRequireNewStart)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    LONGS_EQUAL(RES_OK, m_sd.startWriteStream(42, 8));
+
+        LONGS_EQUAL(RES_OK, m_sd.endWriteStream());
+        LONGS_EQUAL(RES_PARERR, m_sd.writeStream(buffer, 1));
+
+    // Nothing was written so the card should never have been selected.
+    LONGS_EQUAL(0, m_sd.writeStreamTransactionCount());
+}
+
+TEST(WriteStream, DiskWrite_WhileStreamOpen_ShouldStopStreamFirst)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    setupDataForStreamOpen();
+    setupDataForStreamBlock();
+    setupDataForStreamStop();
+    // CMD24 input data.
+    setupDataForCmd("00");
+    // Return not-busy on first loop in waitWhileBusy().
+    m_sd.spi().setInboundFromString("FF");
+    // Return successful write response token.
+    m_sd.spi().setInboundFromString("05");
+    // CMD13 input data with successful R2 response.
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("00");
+    memset(buffer, 0xAD, sizeof(buffer));
+
+        LONGS_EQUAL(RES_OK, m_sd.startWriteStream(42, 8));
+        LONGS_EQUAL(RES_OK, m_sd.writeStream(buffer, 1));
+        LONGS_EQUAL(RES_OK, m_sd.disk_write(buffer, 1, 1));
+
+    validateStreamOpen(42, 8);
+    validateStreamBlock(0xAD);
+    // The open CMD25 must be stopped before the CMD24 can be sent.
+    validateStreamStop();
+    validateSelect();
+    validateCmdPacket(24, 1);
+    validateFFBytes(1);
+    validateDataBlock(0xFE, 0xAD);
+    validateDeselect();
+    validateCmd(13, 0, 1);
+}
+
+TEST(WriteStream, WriteStream_ImplicitStopFails_ShouldReturnErrorOnNextStreamCall_GetLogged)
+{
+    uint8_t buffer[512];
+
+    initSDHC();
+    setupDataForStreamOpen();
+    setupDataForStreamBlock();
+    // Sending of stop transmission token.
+    // Return not-busy on first loop in waitWhileBusy().
+    m_sd.spi().setInboundFromString("FF");
+    // CMD13 input data with R2 response which indicates an error.
+    setupDataForCmd("00");
+    m_sd.spi().setInboundFromString("01");
+    // select() in disk_sync() then expects a non 0xFF byte followed by not-busy.
+    m_sd.spi().setInboundFromString("00");
+    m_sd.spi().setInboundFromString("FF");
+    memset(buffer, 0xAD, sizeof(buffer));
+
+        LONGS_EQUAL(RES_OK, m_sd.startWriteStream(42, 8));
+        LONGS_EQUAL(RES_OK, m_sd.writeStream(buffer, 1));
+        // The stream is stopped by disk_sync() which succeeds itself.
+        LONGS_EQUAL(RES_OK, m_sd.disk_sync());
+        // The error is reported by every stream call until the stream is ended.
+        LONGS_EQUAL(RES_ERROR, m_sd.writeStream(buffer, 1));
+        LONGS_EQUAL(RES_ERROR, m_sd.flushWriteStream());
+        LONGS_EQUAL(RES_ERROR, m_sd.endWriteStream());
+        LONGS_EQUAL(RES_OK, m_sd.flushWriteStream());
+
+    validateStreamOpen(42, 8);
+    validateStreamBlock(0xAD);
+    validateStreamStop();
+    validateSelect();
+    validateDeselect();
+
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[256];
+    snprintf(expectedOutput, sizeof(expectedOutput),
+             "flushWriteStream() - CMD13 failed. Status=0x01\n"
+             "writeStream(%X,1) - Stream failed earlier\n",
+             (uint32_t)(size_t)buffer);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}
+
+TEST(WriteStream, WriteStream_CrcErrorOnSecondCall_ShouldRetryFromFailedBlock_GetLogged)
+{
+    uint8_t buffer[2*512];
+
+    initSDHC();
+    setupDataForStreamOpen();
+    setupDataForStreamBlock();
+    // Second call fails with a CRC error on its first block.
+    setupDataForStreamBlock("0B");
+    setupDataForCmd12();
+    // Retry re-opens the stream at the failed block.
+    setupDataForStreamOpen();
+    setupDataForStreamBlock();
+    setupDataForStreamBlock();
+    setupDataForStreamStop();
+    memset(buffer, 0xAD, 512);
+    memset(buffer+512, 0xDA, 512);
+
+        LONGS_EQUAL(RES_OK, m_sd.startWriteStream(42, 8));
+        LONGS_EQUAL(RES_OK, m_sd.writeStream(buffer, 1));
+        LONGS_EQUAL(RES_OK, m_sd.writeStream(buffer, 2));
+        LONGS_EQUAL(RES_OK, m_sd.endWriteStream());
+
+    validateStreamOpen(42, 8);
+    validateStreamBlock(0xAD);
+    validateStreamBlock(0xAD);
+    // Should send CMD12 to stop write because of the error.
+    validateDeselect();
+    validateCmd(12, 0);
+    validateStreamOpen(43, 7);
+    validateStreamBlock(0xAD);
+    validateStreamBlock(0xDA);
+    validateStreamStop();
+
+    LONGS_EQUAL(1, m_sd.maximumWriteRetryCount());
+    LONGS_EQUAL(2, m_sd.writeStreamTransactionCount());
+    m_sd.dumpErrorLog(stderr);
+    char expectedOutput[256];
+    snprintf(expectedOutput, sizeof(expectedOutput),
+             "transmitDataBlock(FC,%X,512) - Data Response=0x0B\n"
+             "writeStream(%X,2) - transmitDataBlock failed. block=43\n",
+             (uint32_t)(size_t)buffer, (uint32_t)(size_t)buffer);
+    STRCMP_EQUAL(expectedOutput, printfSpy_GetLastOutput());
+}